@@ -0,0 +1,225 @@
+#include "CellFieldRendererSystem.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cassert>
+#include <stdexcept>
+
+namespace hex {
+
+	// Layout of shaders/cell_field.vert and cell_field.frag
+	struct CellFieldPushConstantData {
+		glm::mat4 transform{1.f};
+		float rangeMin;
+		// 1 / (max - min), 0 for a constant field
+		float rangeScale;
+	};
+
+	CellFieldRendererSystem::CellFieldRendererSystem(HexDevice &device, const RenderTargetInfo &renderTarget, HexGeometryArena &geometryArena, HexPipelineManager &pipelineManager)
+		: hexDevice{device}, geometryArena{geometryArena}, pipelineManager{pipelineManager}, dynamicState{device, "Cell field renderer"} {
+		if (!hexDevice.enabledFeatures().geometryShader) {
+			throw std::runtime_error("fragment shader primitive ids are not supported (geometryShader feature)");
+		}
+
+		createDescriptorSetLayout();
+		try {
+			createPipelineLayout();
+			createPipelines(renderTarget);
+		} catch (...) {
+			pipelineManager.release(floatPipeline);
+			pipelineManager.release(quantizedPipeline);
+			pipelineManager.release(floatDoubleSidedPipeline);
+			if (pipelineLayout != VK_NULL_HANDLE) vkDestroyPipelineLayout(hexDevice.device(), pipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(hexDevice.device(), descriptorSetLayout, nullptr);
+			throw;
+		}
+	}
+
+	CellFieldRendererSystem::~CellFieldRendererSystem() {
+		for (auto &entry : fieldResources) {
+			vkDestroyDescriptorPool(hexDevice.device(), entry.second.descriptorPool, nullptr);
+		}
+		// Pipelines before their layout
+		pipelineManager.release(floatPipeline);
+		pipelineManager.release(quantizedPipeline);
+		pipelineManager.release(floatDoubleSidedPipeline);
+		pipelineManager.release(quantizedDoubleSidedPipeline);
+		vkDestroyPipelineLayout(hexDevice.device(), pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(hexDevice.device(), descriptorSetLayout, nullptr);
+	}
+
+	void CellFieldRendererSystem::createDescriptorSetLayout() {
+		// Triangle cells, cell values, colormap
+		std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+		for (uint32_t i = 0; i < bindings.size(); i++) {
+			bindings[i].binding = i;
+			bindings[i].descriptorType = i < 2 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		if (vkCreateDescriptorSetLayout(hexDevice.device(), &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create descriptor set layout");
+		}
+	}
+
+	void CellFieldRendererSystem::createPipelineLayout() {
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(CellFieldPushConstantData);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(hexDevice.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+			pipelineLayout = VK_NULL_HANDLE;
+			throw std::runtime_error("Failed to create pipeline layout");
+		}
+	}
+
+	void CellFieldRendererSystem::createPipelines(const RenderTargetInfo &renderTarget) {
+		// With dynamic cull mode the double sided requests get the culled pipelines
+		floatPipeline = requestPipeline<FloatStreams>(renderTarget, VK_CULL_MODE_BACK_BIT);
+		quantizedPipeline = requestPipeline<QuantizedStreams>(renderTarget, VK_CULL_MODE_BACK_BIT);
+		floatDoubleSidedPipeline = requestPipeline<FloatStreams>(renderTarget, VK_CULL_MODE_NONE);
+		quantizedDoubleSidedPipeline = requestPipeline<QuantizedStreams>(renderTarget, VK_CULL_MODE_NONE);
+	}
+
+	template <typename VertexT>
+	HexPipelineManager::Handle CellFieldRendererSystem::requestPipeline(const RenderTargetInfo &renderTarget, VkCullModeFlags cullMode) {
+		assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
+
+		PipelineConfigInfo pipelineConfig{};
+		HexPipeline::defaultPipelineConfigInfo(pipelineConfig);
+		HexPipeline::setVertexLayout<VertexT>(pipelineConfig);
+		pipelineConfig.rasterizationInfo.cullMode = cullMode;
+		HexPipeline::enableDynamicRenderState(pipelineConfig, hexDevice);
+		HexPipeline::setRenderTarget(pipelineConfig, renderTarget);
+		pipelineConfig.pipelineLayout = pipelineLayout;
+		renderState = RenderState::fromConfig(pipelineConfig);
+
+		return pipelineManager.request({
+			{VK_SHADER_STAGE_VERTEX_BIT, "shaders/cell_field.vert.spv"},
+			{VK_SHADER_STAGE_FRAGMENT_BIT, "shaders/cell_field.frag.spv"}
+		}, pipelineConfig);
+	}
+
+	HexPipeline *CellFieldRendererSystem::pipelineFor(HexVertexFormat format, bool doubleSided) {
+		switch (format) {
+			case HexVertexFormat::Quantized: return pipelineManager.get(doubleSided ? quantizedDoubleSidedPipeline : quantizedPipeline);
+			case HexVertexFormat::Float:
+			default: return pipelineManager.get(doubleSided ? floatDoubleSidedPipeline : floatPipeline);
+		}
+	}
+
+	// Fields wait for the device before replacing a buffer or the colormap, so the set is
+	// never rewritten while a submitted frame uses it
+	VkDescriptorSet CellFieldRendererSystem::descriptorSetFor(const HexCellField &field) {
+		FieldResources &resources = fieldResources[&field];
+
+		if (resources.descriptorPool == VK_NULL_HANDLE) {
+			std::array<VkDescriptorPoolSize, 2> poolSizes{{
+				{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2},
+				{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1}
+			}};
+
+			VkDescriptorPoolCreateInfo poolInfo{};
+			poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+			poolInfo.maxSets = 1;
+			poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+			poolInfo.pPoolSizes = poolSizes.data();
+
+			if (vkCreateDescriptorPool(hexDevice.device(), &poolInfo, nullptr, &resources.descriptorPool) != VK_SUCCESS) {
+				fieldResources.erase(&field);
+				throw std::runtime_error("Failed to create descriptor pool");
+			}
+
+			VkDescriptorSetAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			allocInfo.descriptorPool = resources.descriptorPool;
+			allocInfo.descriptorSetCount = 1;
+			allocInfo.pSetLayouts = &descriptorSetLayout;
+
+			if (vkAllocateDescriptorSets(hexDevice.device(), &allocInfo, &resources.descriptorSet) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to allocate descriptor set");
+			}
+		}
+
+		if (resources.fieldGeneration != field.getGeneration()) {
+			VkDescriptorBufferInfo cellInfo{field.getTriangleCellBuffer(), 0, field.getTriangleCellBufferSize()};
+			VkDescriptorBufferInfo valueInfo{field.getValueBuffer(), 0, field.getValueBufferSize()};
+			VkDescriptorImageInfo colormapInfo = field.getColormap().descriptorInfo();
+
+			std::array<VkWriteDescriptorSet, 3> writes{};
+			for (uint32_t i = 0; i < writes.size(); i++) {
+				writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[i].dstSet = resources.descriptorSet;
+				writes[i].dstBinding = i;
+				writes[i].descriptorCount = 1;
+			}
+			writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[0].pBufferInfo = &cellInfo;
+			writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[1].pBufferInfo = &valueInfo;
+			writes[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			writes[2].pImageInfo = &colormapInfo;
+			vkUpdateDescriptorSets(hexDevice.device(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+			resources.fieldGeneration = field.getGeneration();
+		}
+
+		return resources.descriptorSet;
+	}
+
+	void CellFieldRendererSystem::renderGameObjects(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera) {
+		dynamicState.begin(commandBuffer);
+		auto projectionView = camera.getProjection() * camera.getViewMatrix();
+
+		for (auto &gameObject : gameObjects) {
+			if (!drawsGameObject(gameObject)) continue;
+
+			const HexModel &model = *gameObject.model;
+			const HexCellField &field = *gameObject.cellField;
+
+			// Still compiling
+			HexPipeline *pipeline = pipelineFor(model.getVertexFormat(), model.isDoubleSided());
+			if (pipeline == nullptr) continue;
+			renderState.cullMode = model.getCullMode();
+			if (dynamicState.bindPipeline(*pipeline, renderState)) {
+				geometryArena.bind(commandBuffer, model.getVertexFormat());
+			}
+
+			CellFieldPushConstantData push{};
+			push.transform = projectionView * gameObject.transform.mat4() * model.getVertexTransform();
+			push.rangeMin = field.getRangeMin();
+			float extent = field.getRangeMax() - field.getRangeMin();
+			push.rangeScale = extent > 0.f ? 1.f / extent : 0.f;
+
+			VkDescriptorSet descriptorSet = descriptorSetFor(field);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+			vkCmdPushConstants(
+				commandBuffer,
+				pipelineLayout,
+				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+				0,
+				sizeof(CellFieldPushConstantData), &push
+			);
+
+			// Triangle cells follow the full resolution index order, gl_PrimitiveID starts at 0
+			gameObject.model->draw(commandBuffer, 0);
+		}
+	}
+}
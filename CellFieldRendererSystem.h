@@ -0,0 +1,68 @@
+#pragma once
+
+#include "HexCamera.h"
+#include "HexCellField.h"
+#include "HexDynamicState.h"
+#include "HexGeometryArena.h"
+#include "HexPipeline.h"
+#include "HexPipelineManager.h"
+#include "hex_device.h"
+#include "HexGameObject.h"
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace hex {
+
+	// Draws objects with a cell field: the fragment shader finds the cell of its triangle
+	// with gl_PrimitiveID and colors it through the field colormap. Needs the geometryShader
+	// feature (PrimitiveId input of fragment shaders). Fields must outlive the system.
+	class CellFieldRendererSystem {
+		public:
+
+		CellFieldRendererSystem(HexDevice &device, const RenderTargetInfo &renderTarget, HexGeometryArena &geometryArena, HexPipelineManager &pipelineManager);
+		~CellFieldRendererSystem();
+
+		CellFieldRendererSystem(const CellFieldRendererSystem&) = delete;
+		CellFieldRendererSystem &operator=(const CellFieldRendererSystem &) = delete;
+
+		// Objects drawn by this system, other renderers skip them. Volumes go through CellFilterSystem.
+		static bool drawsGameObject(const HexGameObject &gameObject) { return gameObject.cellField != nullptr && gameObject.volume == nullptr; }
+
+		void renderGameObjects(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera);
+
+		private:
+		struct FieldResources {
+			VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+			// Field generation the descriptor set was written for
+			uint64_t fieldGeneration = ~0ull;
+		};
+
+		void createDescriptorSetLayout();
+		void createPipelineLayout();
+		void createPipelines(const RenderTargetInfo &renderTarget);
+		template <typename VertexT>
+		HexPipelineManager::Handle requestPipeline(const RenderTargetInfo &renderTarget, VkCullModeFlags cullMode);
+
+		VkDescriptorSet descriptorSetFor(const HexCellField &field);
+		HexPipeline *pipelineFor(HexVertexFormat format, bool doubleSided);
+
+		HexDevice &hexDevice;
+		HexGeometryArena &geometryArena;
+		HexPipelineManager &pipelineManager;
+
+		VkDescriptorSetLayout descriptorSetLayout;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		HexPipelineManager::Handle floatPipeline = HexPipelineManager::NO_PIPELINE;
+		HexPipelineManager::Handle quantizedPipeline = HexPipelineManager::NO_PIPELINE;
+		// For open models (HexModel::isDoubleSided)
+		HexPipelineManager::Handle floatDoubleSidedPipeline = HexPipelineManager::NO_PIPELINE;
+		HexPipelineManager::Handle quantizedDoubleSidedPipeline = HexPipelineManager::NO_PIPELINE;
+		RenderState renderState;
+		HexDynamicState dynamicState;
+
+		std::unordered_map<const HexCellField*, FieldResources> fieldResources;
+	};
+}
@@ -0,0 +1,512 @@
+#include "CellFilterSystem.h"
+#include "HexSwapChain.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+namespace hex {
+
+	// Layout of shaders/cell_filter_common.glsl
+	struct CellFilterPushConstantData {
+		glm::vec4 planes[HexCellFilter::MAX_PLANES];
+		uint32_t planeCount;
+		uint32_t filterValues;
+		float valueMin;
+		float valueMax;
+		uint32_t filterLabels;
+		int32_t labelMin;
+		int32_t labelMax;
+		uint32_t cellCount;
+		uint32_t groupCount;
+		uint32_t groupsX;
+		uint32_t faceCapacity;
+		uint32_t readbackSlot;
+		uint32_t allFaces;
+	};
+
+	static_assert(sizeof(CellFilterPushConstantData) <= 128, "Push constants must fit the guaranteed 128 bytes");
+
+	// Layout of shaders/cell_faces.vert and cell_faces.frag
+	struct CellFacesPushConstantData {
+		glm::mat4 transform{1.f};
+		float rangeMin;
+		// 1 / (max - min), 0 for a constant field
+		float rangeScale;
+		float shrink;
+		// 0 without wireframe
+		float wireWidth;
+	};
+
+	namespace {
+		// CELL_GROUP_SIZE in shaders/cell_filter_common.glsl
+		const uint32_t cellWorkgroupSize = 256;
+		const uint32_t maxWorkgroupsX = 65535;
+		const uint32_t minFaceCapacity = 4096;
+		// Points, cells, face neighbors, labels, values, visible, groups, draw, faces, readback
+		const uint32_t computeBindingCount = 10;
+		// Points, cells, faces for the vertex shader, values, colormap for the fragment shader
+		const uint32_t drawBindingCount = 5;
+
+		uint32_t cellGroupCount(const HexVolumeModel &volume) {
+			return (volume.getCellCount() + cellWorkgroupSize - 1) / cellWorkgroupSize;
+		}
+
+		void computeBarrier(VkCommandBuffer commandBuffer) {
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+	}
+
+	CellFilterSystem::CellFilterSystem(HexDevice &device, const RenderTargetInfo &renderTarget, HexPipelineManager &pipelineManager)
+		: hexDevice{device}, pipelineManager{pipelineManager} {
+		try {
+			createDescriptorSetLayouts();
+			createPipelineLayouts();
+			createPipelines(renderTarget);
+		} catch (...) {
+			if (computePipelineLayout != VK_NULL_HANDLE) vkDestroyPipelineLayout(hexDevice.device(), computePipelineLayout, nullptr);
+			if (drawPipelineLayout != VK_NULL_HANDLE) vkDestroyPipelineLayout(hexDevice.device(), drawPipelineLayout, nullptr);
+			if (computeDescriptorSetLayout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(hexDevice.device(), computeDescriptorSetLayout, nullptr);
+			if (drawDescriptorSetLayout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(hexDevice.device(), drawDescriptorSetLayout, nullptr);
+			throw;
+		}
+	}
+
+	CellFilterSystem::~CellFilterSystem() {
+		for (auto &entry : volumeResources) {
+			destroyResources(entry.second);
+		}
+		// Pipelines before their layouts
+		cellFilterPipeline.reset();
+		faceCountPipeline.reset();
+		groupScanPipeline.reset();
+		faceCompactPipeline.reset();
+		drawPipeline.reset();
+		vkDestroyPipelineLayout(hexDevice.device(), computePipelineLayout, nullptr);
+		vkDestroyPipelineLayout(hexDevice.device(), drawPipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(hexDevice.device(), computeDescriptorSetLayout, nullptr);
+		vkDestroyDescriptorSetLayout(hexDevice.device(), drawDescriptorSetLayout, nullptr);
+	}
+
+	void CellFilterSystem::createDescriptorSetLayouts() {
+		std::array<VkDescriptorSetLayoutBinding, computeBindingCount> computeBindings{};
+		for (uint32_t i = 0; i < computeBindings.size(); i++) {
+			computeBindings[i].binding = i;
+			computeBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			computeBindings[i].descriptorCount = 1;
+			computeBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(computeBindings.size());
+		layoutInfo.pBindings = computeBindings.data();
+
+		if (vkCreateDescriptorSetLayout(hexDevice.device(), &layoutInfo, nullptr, &computeDescriptorSetLayout) != VK_SUCCESS) {
+			computeDescriptorSetLayout = VK_NULL_HANDLE;
+			throw std::runtime_error("Failed to create descriptor set layout");
+		}
+
+		std::array<VkDescriptorSetLayoutBinding, drawBindingCount> drawBindings{};
+		for (uint32_t i = 0; i < drawBindings.size(); i++) {
+			drawBindings[i].binding = i;
+			drawBindings[i].descriptorType = i < drawBindingCount - 1 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			drawBindings[i].descriptorCount = 1;
+			drawBindings[i].stageFlags = i < 3 ? VK_SHADER_STAGE_VERTEX_BIT : VK_SHADER_STAGE_FRAGMENT_BIT;
+		}
+
+		layoutInfo.bindingCount = static_cast<uint32_t>(drawBindings.size());
+		layoutInfo.pBindings = drawBindings.data();
+
+		if (vkCreateDescriptorSetLayout(hexDevice.device(), &layoutInfo, nullptr, &drawDescriptorSetLayout) != VK_SUCCESS) {
+			drawDescriptorSetLayout = VK_NULL_HANDLE;
+			throw std::runtime_error("Failed to create descriptor set layout");
+		}
+	}
+
+	void CellFilterSystem::createPipelineLayouts() {
+		VkPushConstantRange computeRange{};
+		computeRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		computeRange.offset = 0;
+		computeRange.size = sizeof(CellFilterPushConstantData);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &computeDescriptorSetLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &computeRange;
+
+		if (vkCreatePipelineLayout(hexDevice.device(), &pipelineLayoutInfo, nullptr, &computePipelineLayout) != VK_SUCCESS) {
+			computePipelineLayout = VK_NULL_HANDLE;
+			throw std::runtime_error("Failed to create pipeline layout");
+		}
+
+		VkPushConstantRange drawRange{};
+		drawRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		drawRange.offset = 0;
+		drawRange.size = sizeof(CellFacesPushConstantData);
+
+		pipelineLayoutInfo.pSetLayouts = &drawDescriptorSetLayout;
+		pipelineLayoutInfo.pPushConstantRanges = &drawRange;
+
+		if (vkCreatePipelineLayout(hexDevice.device(), &pipelineLayoutInfo, nullptr, &drawPipelineLayout) != VK_SUCCESS) {
+			drawPipelineLayout = VK_NULL_HANDLE;
+			throw std::runtime_error("Failed to create pipeline layout");
+		}
+	}
+
+	void CellFilterSystem::createPipelines(const RenderTargetInfo &renderTarget) {
+		cellFilterPipeline = std::make_unique<HexPipeline>(hexDevice, "shaders/cell_filter.comp.spv", computePipelineLayout, pipelineManager.getPipelineCache(), &pipelineManager.getShaderLibrary());
+		faceCountPipeline = std::make_unique<HexPipeline>(hexDevice, "shaders/face_count.comp.spv", computePipelineLayout, pipelineManager.getPipelineCache(), &pipelineManager.getShaderLibrary());
+		groupScanPipeline = std::make_unique<HexPipeline>(hexDevice, "shaders/group_scan.comp.spv", computePipelineLayout, pipelineManager.getPipelineCache(), &pipelineManager.getShaderLibrary());
+		faceCompactPipeline = std::make_unique<HexPipeline>(hexDevice, "shaders/face_compact.comp.spv", computePipelineLayout, pipelineManager.getPipelineCache(), &pipelineManager.getShaderLibrary());
+
+		// Vertices are pulled from storage buffers, no vertex input
+		PipelineConfigInfo pipelineConfig{};
+		HexPipeline::defaultPipelineConfigInfo(pipelineConfig);
+		pipelineConfig.bindingDescriptionCount = 0;
+		pipelineConfig.attributeDescriptionCount = 0;
+		// Faces take the winding of their cell, inverted cells show theirs inward
+		pipelineConfig.rasterizationInfo.cullMode = VK_CULL_MODE_NONE;
+		HexPipeline::setRenderTarget(pipelineConfig, renderTarget);
+		pipelineConfig.pipelineLayout = drawPipelineLayout;
+
+		hardwareBarycentrics = hexDevice.fragmentShaderBarycentricSupported();
+		drawPipeline = std::make_unique<HexPipeline>(
+			hexDevice,
+			std::vector<ShaderStageInfo>{
+				{VK_SHADER_STAGE_VERTEX_BIT, "shaders/cell_faces.vert.spv"},
+				{VK_SHADER_STAGE_FRAGMENT_BIT, hardwareBarycentrics ? "shaders/cell_faces_barycentric.frag.spv" : "shaders/cell_faces.frag.spv"}
+			},
+			pipelineConfig,
+			std::vector<SpecializationConstant>{},
+			pipelineManager.getPipelineCache(),
+			&pipelineManager.getShaderLibrary()
+		);
+	}
+
+	CellFilterSystem::VolumeResources &CellFilterSystem::resourcesFor(const HexVolumeModel &volume, const HexCellField &field) {
+		auto it = volumeResources.find(&volume);
+		if (it != volumeResources.end()) {
+			VolumeResources &resources = it->second;
+			if (resources.field != &field || resources.fieldGeneration != field.getGeneration()) {
+				// Fields wait for the device before replacing buffers, a different field does not
+				if (resources.field != &field) vkQueueWaitIdle(hexDevice.graphicsQueue());
+				updateDescriptorSets(volume, field, resources);
+				resources.computed = false;
+			}
+			return resources;
+		}
+
+		VolumeResources &resources = volumeResources[&volume];
+
+		hexDevice.createBuffer(
+			volume.getCellCount() * sizeof(uint32_t),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			resources.visibleBuffer,
+			resources.visibleMemory
+		);
+		hexDevice.createBuffer(
+			cellGroupCount(volume) * sizeof(uint32_t),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			resources.groupBuffer,
+			resources.groupMemory
+		);
+		hexDevice.createBuffer(
+			sizeof(VkDrawIndirectCommand),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			resources.drawBuffer,
+			resources.drawMemory
+		);
+		hexDevice.createBuffer(
+			HexSwapChain::MAX_FRAMES_IN_FLIGHT * sizeof(uint32_t),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			resources.readbackBuffer,
+			resources.readbackMemory
+		);
+		void *mapped;
+		vkMapMemory(hexDevice.device(), resources.readbackMemory, 0, VK_WHOLE_SIZE, 0, &mapped);
+		resources.readback = static_cast<uint32_t*>(mapped);
+		std::fill(resources.readback, resources.readback + HexSwapChain::MAX_FRAMES_IN_FLIGHT, 0u);
+
+		// Room for the boundary with a slice through the middle, grown when a filter exposes more
+		uint32_t maxFaces = volume.getCellCount() * HexVolumeMesh::CELL_FACES;
+		uint32_t faceCapacity = std::max(volume.getBoundaryFaceCount() * 2, minFaceCapacity);
+		createFaceBuffer(resources, std::min(faceCapacity, maxFaces));
+
+		std::array<VkDescriptorPoolSize, 2> poolSizes{{
+			{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, computeBindingCount + drawBindingCount - 1},
+			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1}
+		}};
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = 2;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+
+		if (vkCreateDescriptorPool(hexDevice.device(), &poolInfo, nullptr, &resources.descriptorPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create descriptor pool");
+		}
+
+		std::array<VkDescriptorSetLayout, 2> setLayouts{computeDescriptorSetLayout, drawDescriptorSetLayout};
+		std::array<VkDescriptorSet, 2> sets{};
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = resources.descriptorPool;
+		allocInfo.descriptorSetCount = static_cast<uint32_t>(setLayouts.size());
+		allocInfo.pSetLayouts = setLayouts.data();
+
+		if (vkAllocateDescriptorSets(hexDevice.device(), &allocInfo, sets.data()) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate descriptor sets");
+		}
+		resources.computeDescriptorSet = sets[0];
+		resources.drawDescriptorSet = sets[1];
+
+		updateDescriptorSets(volume, field, resources);
+		return resources;
+	}
+
+	void CellFilterSystem::createFaceBuffer(VolumeResources &resources, uint32_t faceCapacity) {
+		hexDevice.createBuffer(
+			static_cast<VkDeviceSize>(faceCapacity) * sizeof(uint32_t),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			resources.faceBuffer,
+			resources.faceMemory
+		);
+		resources.faceCapacity = faceCapacity;
+	}
+
+	void CellFilterSystem::destroyFaceBuffer(VolumeResources &resources) {
+		vkDestroyBuffer(hexDevice.device(), resources.faceBuffer, nullptr);
+		vkFreeMemory(hexDevice.device(), resources.faceMemory, nullptr);
+		resources.faceBuffer = VK_NULL_HANDLE;
+		resources.faceCapacity = 0;
+	}
+
+	// Only called when no submitted frame uses the sets: on creation, after growing the
+	// face buffers, or once the field waited for the device to replace its buffers
+	void CellFilterSystem::updateDescriptorSets(const HexVolumeModel &volume, const HexCellField &field, VolumeResources &resources) {
+		std::array<VkDescriptorBufferInfo, computeBindingCount> bufferInfos{{
+			{volume.getPointBuffer(), 0, VK_WHOLE_SIZE},
+			{volume.getCellBuffer(), 0, VK_WHOLE_SIZE},
+			{volume.getFaceNeighborBuffer(), 0, VK_WHOLE_SIZE},
+			{volume.getLabelBuffer(), 0, VK_WHOLE_SIZE},
+			{field.getValueBuffer(), 0, field.getValueBufferSize()},
+			{resources.visibleBuffer, 0, VK_WHOLE_SIZE},
+			{resources.groupBuffer, 0, VK_WHOLE_SIZE},
+			{resources.drawBuffer, 0, VK_WHOLE_SIZE},
+			{resources.faceBuffer, 0, VK_WHOLE_SIZE},
+			{resources.readbackBuffer, 0, VK_WHOLE_SIZE}
+		}};
+		VkDescriptorImageInfo colormapInfo = field.getColormap().descriptorInfo();
+
+		std::array<VkWriteDescriptorSet, computeBindingCount + drawBindingCount> writes{};
+		for (uint32_t i = 0; i < computeBindingCount; i++) {
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = resources.computeDescriptorSet;
+			writes[i].dstBinding = i;
+			writes[i].descriptorCount = 1;
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+
+		// Points, cells, compacted faces, cell values, colormap
+		const VkDescriptorBufferInfo *drawBufferInfos[] = {&bufferInfos[0], &bufferInfos[1], &bufferInfos[8], &bufferInfos[4]};
+		for (uint32_t i = 0; i < drawBindingCount; i++) {
+			VkWriteDescriptorSet &write = writes[computeBindingCount + i];
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = resources.drawDescriptorSet;
+			write.dstBinding = i;
+			write.descriptorCount = 1;
+			if (i < drawBindingCount - 1) {
+				write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				write.pBufferInfo = drawBufferInfos[i];
+			} else {
+				write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+				write.pImageInfo = &colormapInfo;
+			}
+		}
+		vkUpdateDescriptorSets(hexDevice.device(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+		resources.field = &field;
+		resources.fieldGeneration = field.getGeneration();
+	}
+
+	void CellFilterSystem::destroyResources(VolumeResources &resources) {
+		if (resources.readback != nullptr) vkUnmapMemory(hexDevice.device(), resources.readbackMemory);
+
+		VkBuffer buffers[] = {resources.visibleBuffer, resources.groupBuffer, resources.drawBuffer, resources.readbackBuffer};
+		VkDeviceMemory memories[] = {resources.visibleMemory, resources.groupMemory, resources.drawMemory, resources.readbackMemory};
+		for (int i = 0; i < 4; i++) {
+			if (buffers[i] == VK_NULL_HANDLE) continue;
+			vkDestroyBuffer(hexDevice.device(), buffers[i], nullptr);
+			vkFreeMemory(hexDevice.device(), memories[i], nullptr);
+		}
+		if (resources.faceBuffer != VK_NULL_HANDLE) destroyFaceBuffer(resources);
+		if (resources.descriptorPool != VK_NULL_HANDLE) {
+			vkDestroyDescriptorPool(hexDevice.device(), resources.descriptorPool, nullptr);
+		}
+	}
+
+	void CellFilterSystem::recordPasses(VkCommandBuffer commandBuffer, int frameIndex, const HexVolumeModel &volume, const HexCellFilter &filter, VolumeResources &resources) {
+		uint32_t groupCount = cellGroupCount(volume);
+		uint32_t groupsX = std::min(groupCount, maxWorkgroupsX);
+		uint32_t groupsY = (groupCount + groupsX - 1) / groupsX;
+
+		CellFilterPushConstantData push{};
+		push.planeCount = std::min(filter.planeCount, HexCellFilter::MAX_PLANES);
+		for (uint32_t i = 0; i < push.planeCount; i++) push.planes[i] = filter.planes[i];
+		push.filterValues = filter.filterValues ? 1 : 0;
+		push.valueMin = filter.valueMin;
+		push.valueMax = filter.valueMax;
+		push.filterLabels = filter.filterLabels && volume.hasLabels() ? 1 : 0;
+		push.labelMin = filter.labelMin;
+		push.labelMax = filter.labelMax;
+		push.cellCount = volume.getCellCount();
+		push.groupCount = groupCount;
+		push.groupsX = groupsX;
+		push.faceCapacity = resources.faceCapacity;
+		push.readbackSlot = static_cast<uint32_t>(frameIndex);
+		push.allFaces = filter.shrink < 1.f ? 1 : 0;
+
+		// Every pass shares the layout, the set and push constants stay bound across pipelines
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 0, 1, &resources.computeDescriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CellFilterPushConstantData), &push);
+
+		cellFilterPipeline->bind(commandBuffer);
+		vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+		computeBarrier(commandBuffer);
+
+		faceCountPipeline->bind(commandBuffer);
+		vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+		computeBarrier(commandBuffer);
+
+		groupScanPipeline->bind(commandBuffer);
+		vkCmdDispatch(commandBuffer, 1, 1, 1);
+		computeBarrier(commandBuffer);
+
+		faceCompactPipeline->bind(commandBuffer);
+		vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+	}
+
+	void CellFilterSystem::updateGameObjects(VkCommandBuffer commandBuffer, int frameIndex, std::vector<HexGameObject> &gameObjects) {
+		bool recorded = false;
+
+		for (auto &gameObject : gameObjects) {
+			if (!drawsGameObject(gameObject)) continue;
+
+			const HexVolumeModel &volume = *gameObject.volume;
+			const HexCellField &field = *gameObject.cellField;
+			if (field.getValueCount() < volume.getCellCount()) {
+				throw std::runtime_error("cell field has fewer values than the volume has cells");
+			}
+
+			VolumeResources &resources = resourcesFor(volume, field);
+
+			// The fence of this frame slot was waited on, its last count is final. Faces past
+			// the capacity were dropped: grow and compact again.
+			uint32_t exposedFaces = resources.readback[frameIndex];
+			if (exposedFaces > resources.faceCapacity) {
+				vkQueueWaitIdle(hexDevice.graphicsQueue());
+				uint32_t maxFaces = volume.getCellCount() * HexVolumeMesh::CELL_FACES;
+				uint32_t faceCapacity = std::min(std::max(exposedFaces + exposedFaces / 2, resources.faceCapacity * 2), maxFaces);
+				destroyFaceBuffer(resources);
+				createFaceBuffer(resources, faceCapacity);
+				updateDescriptorSets(volume, field, resources);
+				std::fill(resources.readback, resources.readback + HexSwapChain::MAX_FRAMES_IN_FLIGHT, 0u);
+				resources.computed = false;
+			}
+
+			if (resources.computed && resources.filter == gameObject.cellFilter && resources.valueVersion == field.getValueVersion()) continue;
+
+			if (!recorded) {
+				// Draws of the previous frame may still read the faces and the draw command
+				vkCmdPipelineBarrier(
+					commandBuffer,
+					VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					0, 0, nullptr, 0, nullptr, 0, nullptr
+				);
+				recorded = true;
+			}
+
+			recordPasses(commandBuffer, frameIndex, volume, gameObject.cellFilter, resources);
+			resources.computed = true;
+			resources.filter = gameObject.cellFilter;
+			resources.valueVersion = field.getValueVersion();
+		}
+
+		if (!recorded)
+			return;
+
+		// The host reads the exposed face count once the fence of this frame signals
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+			0, 1, &barrier, 0, nullptr, 0, nullptr
+		);
+	}
+
+	void CellFilterSystem::renderGameObjects(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera) {
+		bool bound = false;
+		auto projectionView = camera.getProjection() * camera.getViewMatrix();
+
+		for (auto &gameObject : gameObjects) {
+			if (!drawsGameObject(gameObject)) continue;
+
+			auto it = volumeResources.find(gameObject.volume.get());
+			if (it == volumeResources.end() || !it->second.computed) continue;
+			const VolumeResources &resources = it->second;
+			const HexCellField &field = *gameObject.cellField;
+
+			if (!bound) {
+				drawPipeline->bind(commandBuffer);
+				bound = true;
+			}
+
+			// Points are stored in model space, no vertex transform
+			CellFacesPushConstantData push{};
+			push.transform = projectionView * gameObject.transform.mat4();
+			push.rangeMin = field.getRangeMin();
+			float extent = field.getRangeMax() - field.getRangeMin();
+			push.rangeScale = extent > 0.f ? 1.f / extent : 0.f;
+			push.shrink = glm::clamp(gameObject.cellFilter.shrink, 0.f, 1.f);
+			push.wireWidth = wireframe ? WIREFRAME_WIDTH : 0.f;
+
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawPipelineLayout, 0, 1, &resources.drawDescriptorSet, 0, nullptr);
+			vkCmdPushConstants(
+				commandBuffer,
+				drawPipelineLayout,
+				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+				0,
+				sizeof(CellFacesPushConstantData), &push
+			);
+
+			// 6 vertices per compacted face
+			vkCmdDrawIndirect(commandBuffer, resources.drawBuffer, 0, 1, sizeof(VkDrawIndirectCommand));
+		}
+	}
+}
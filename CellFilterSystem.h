@@ -0,0 +1,111 @@
+#pragma once
+
+#include "HexCamera.h"
+#include "HexCellField.h"
+#include "HexPipeline.h"
+#include "HexPipelineManager.h"
+#include "HexVolumeModel.h"
+#include "hex_device.h"
+#include "HexGameObject.h"
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace hex {
+
+	// Draws volumes through their cell filter. Compute passes flag the shown cells, count the
+	// faces between shown and hidden cells per workgroup, scan the counts and compact the
+	// exposed faces in a list of face ids. One indirect draw pulls the face corners from the
+	// volume buffers in the vertex shader, 4 bytes per face instead of 6 indices and 2 triangle
+	// cells. Passes only run when the filter or the field values change. Volumes and fields
+	// must outlive the system.
+	class CellFilterSystem {
+		public:
+		// Edge lines of the wireframe overlay, in pixels
+		static constexpr float WIREFRAME_WIDTH = 1.f;
+
+		CellFilterSystem(HexDevice &device, const RenderTargetInfo &renderTarget, HexPipelineManager &pipelineManager);
+		~CellFilterSystem();
+
+		CellFilterSystem(const CellFilterSystem&) = delete;
+		CellFilterSystem &operator=(const CellFilterSystem &) = delete;
+
+		// Objects drawn by this system, other renderers skip them.
+		// Their field must have a value for every volume cell.
+		static bool drawsGameObject(const HexGameObject &gameObject) { return gameObject.volume != nullptr && gameObject.cellField != nullptr; }
+
+		// Record outside of the render pass, before renderGameObjects
+		void updateGameObjects(VkCommandBuffer commandBuffer, int frameIndex, std::vector<HexGameObject> &gameObjects);
+		void renderGameObjects(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera);
+
+		// Cell face edges drawn over the faces in the same pass, quad diagonals are hidden
+		void setWireframe(bool enabled) { wireframe = enabled; }
+		bool getWireframe() const { return wireframe; }
+		// Edge distances from VK_KHR_fragment_shader_barycentric, otherwise from barycentrics
+		// the vertex shader outputs
+		bool usesHardwareBarycentrics() const { return hardwareBarycentrics; }
+
+		private:
+		struct VolumeResources {
+			// One flag per cell
+			VkBuffer visibleBuffer = VK_NULL_HANDLE;
+			VkDeviceMemory visibleMemory = VK_NULL_HANDLE;
+			// One face count then first face slot per cell workgroup
+			VkBuffer groupBuffer = VK_NULL_HANDLE;
+			VkDeviceMemory groupMemory = VK_NULL_HANDLE;
+			// VkDrawIndirectCommand
+			VkBuffer drawBuffer = VK_NULL_HANDLE;
+			VkDeviceMemory drawMemory = VK_NULL_HANDLE;
+			// Compacted faces, cell * CELL_FACES + face
+			VkBuffer faceBuffer = VK_NULL_HANDLE;
+			VkDeviceMemory faceMemory = VK_NULL_HANDLE;
+			uint32_t faceCapacity = 0;
+			// Exposed face count of the last update of each frame in flight, host visible
+			VkBuffer readbackBuffer = VK_NULL_HANDLE;
+			VkDeviceMemory readbackMemory = VK_NULL_HANDLE;
+			uint32_t *readback = nullptr;
+
+			VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+			VkDescriptorSet computeDescriptorSet = VK_NULL_HANDLE;
+			VkDescriptorSet drawDescriptorSet = VK_NULL_HANDLE;
+			// Field and field generation the descriptor sets were written for
+			const HexCellField *field = nullptr;
+			uint64_t fieldGeneration = ~0ull;
+
+			// State the compacted faces were computed from
+			bool computed = false;
+			HexCellFilter filter{};
+			uint64_t valueVersion = ~0ull;
+		};
+
+		void createDescriptorSetLayouts();
+		void createPipelineLayouts();
+		void createPipelines(const RenderTargetInfo &renderTarget);
+
+		VolumeResources &resourcesFor(const HexVolumeModel &volume, const HexCellField &field);
+		void createFaceBuffer(VolumeResources &resources, uint32_t faceCapacity);
+		void destroyFaceBuffer(VolumeResources &resources);
+		void updateDescriptorSets(const HexVolumeModel &volume, const HexCellField &field, VolumeResources &resources);
+		void destroyResources(VolumeResources &resources);
+		void recordPasses(VkCommandBuffer commandBuffer, int frameIndex, const HexVolumeModel &volume, const HexCellFilter &filter, VolumeResources &resources);
+
+		HexDevice &hexDevice;
+		HexPipelineManager &pipelineManager;
+
+		VkDescriptorSetLayout computeDescriptorSetLayout = VK_NULL_HANDLE;
+		VkDescriptorSetLayout drawDescriptorSetLayout = VK_NULL_HANDLE;
+		VkPipelineLayout computePipelineLayout = VK_NULL_HANDLE;
+		VkPipelineLayout drawPipelineLayout = VK_NULL_HANDLE;
+		std::unique_ptr<HexPipeline> cellFilterPipeline;
+		std::unique_ptr<HexPipeline> faceCountPipeline;
+		std::unique_ptr<HexPipeline> groupScanPipeline;
+		std::unique_ptr<HexPipeline> faceCompactPipeline;
+		std::unique_ptr<HexPipeline> drawPipeline;
+
+		std::unordered_map<const HexVolumeModel*, VolumeResources> volumeResources;
+
+		bool hardwareBarycentrics = false;
+		bool wireframe = false;
+	};
+}
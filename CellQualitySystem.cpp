@@ -0,0 +1,229 @@
+#include "CellQualitySystem.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+namespace hex {
+
+	// Layout of shaders/cell_quality_common.glsl
+	struct CellQualityPushConstantData {
+		uint32_t metric;
+		uint32_t cellCount;
+		uint32_t groupsX;
+		uint32_t binCount;
+	};
+
+	namespace {
+		// QUALITY_GROUP_SIZE in shaders/cell_quality_common.glsl
+		const uint32_t qualityWorkgroupSize = 256;
+		const uint32_t maxWorkgroupsX = 65535;
+		// Points, cells, values, stats
+		const uint32_t bindingCount = 4;
+		// Min key, max key, degenerate count, bins
+		const VkDeviceSize statsSize = (3 + CellQualitySystem::MAX_BIN_COUNT) * sizeof(uint32_t);
+
+		// Inverse of orderedKey in the shaders
+		float orderedValue(uint32_t key) {
+			uint32_t bits = (key & 0x80000000u) != 0 ? key & 0x7fffffffu : ~key;
+			float value;
+			memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+	}
+
+	CellQualitySystem::CellQualitySystem(HexDevice &device, HexPipelineManager &pipelineManager) : hexDevice{device}, pipelineManager{pipelineManager} {
+		try {
+			createDescriptorSetLayout();
+			createDescriptorSet();
+			createPipelineLayout();
+			qualityPipeline = std::make_unique<HexPipeline>(hexDevice, "shaders/cell_quality.comp.spv", pipelineLayout, pipelineManager.getPipelineCache(), &pipelineManager.getShaderLibrary());
+			histogramPipeline = std::make_unique<HexPipeline>(hexDevice, "shaders/cell_histogram.comp.spv", pipelineLayout, pipelineManager.getPipelineCache(), &pipelineManager.getShaderLibrary());
+			createStatsBuffer();
+		} catch (...) {
+			qualityPipeline.reset();
+			histogramPipeline.reset();
+			if (descriptorPool != VK_NULL_HANDLE) vkDestroyDescriptorPool(hexDevice.device(), descriptorPool, nullptr);
+			if (pipelineLayout != VK_NULL_HANDLE) vkDestroyPipelineLayout(hexDevice.device(), pipelineLayout, nullptr);
+			if (descriptorSetLayout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(hexDevice.device(), descriptorSetLayout, nullptr);
+			throw;
+		}
+	}
+
+	CellQualitySystem::~CellQualitySystem() {
+		vkUnmapMemory(hexDevice.device(), statsMemory);
+		vkDestroyBuffer(hexDevice.device(), statsBuffer, nullptr);
+		vkFreeMemory(hexDevice.device(), statsMemory, nullptr);
+		vkDestroyDescriptorPool(hexDevice.device(), descriptorPool, nullptr);
+		// Pipelines before their layout
+		qualityPipeline.reset();
+		histogramPipeline.reset();
+		vkDestroyPipelineLayout(hexDevice.device(), pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(hexDevice.device(), descriptorSetLayout, nullptr);
+	}
+
+	void CellQualitySystem::createDescriptorSetLayout() {
+		std::array<VkDescriptorSetLayoutBinding, bindingCount> bindings{};
+		for (uint32_t i = 0; i < bindings.size(); i++) {
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		if (vkCreateDescriptorSetLayout(hexDevice.device(), &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+			descriptorSetLayout = VK_NULL_HANDLE;
+			throw std::runtime_error("Failed to create descriptor set layout");
+		}
+	}
+
+	void CellQualitySystem::createDescriptorSet() {
+		VkDescriptorPoolSize poolSize{};
+		poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		poolSize.descriptorCount = bindingCount;
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = 1;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &poolSize;
+
+		if (vkCreateDescriptorPool(hexDevice.device(), &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+			descriptorPool = VK_NULL_HANDLE;
+			throw std::runtime_error("Failed to create descriptor pool");
+		}
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = descriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &descriptorSetLayout;
+
+		if (vkAllocateDescriptorSets(hexDevice.device(), &allocInfo, &descriptorSet) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate descriptor set");
+		}
+	}
+
+	void CellQualitySystem::createPipelineLayout() {
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(CellQualityPushConstantData);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(hexDevice.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+			pipelineLayout = VK_NULL_HANDLE;
+			throw std::runtime_error("Failed to create pipeline layout");
+		}
+	}
+
+	void CellQualitySystem::createStatsBuffer() {
+		hexDevice.createBuffer(
+			statsSize,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			statsBuffer,
+			statsMemory
+		);
+
+		void *mapped;
+		vkMapMemory(hexDevice.device(), statsMemory, 0, statsSize, 0, &mapped);
+		stats = static_cast<uint32_t*>(mapped);
+	}
+
+	HexQualityStats CellQualitySystem::compute(const HexVolumeModel &volume, HexCellField &field, HexQualityMetric metric, uint32_t binCount) {
+		if (binCount == 0 || binCount > MAX_BIN_COUNT) {
+			throw std::runtime_error("quality histograms need 1 to 256 bins");
+		}
+		if (field.getValueCount() < volume.getCellCount()) {
+			throw std::runtime_error("cell field has fewer values than the volume has cells");
+		}
+
+		// Frames in flight read the field values
+		vkQueueWaitIdle(hexDevice.graphicsQueue());
+
+		std::array<VkDescriptorBufferInfo, bindingCount> bufferInfos{{
+			{volume.getPointBuffer(), 0, VK_WHOLE_SIZE},
+			{volume.getCellBuffer(), 0, VK_WHOLE_SIZE},
+			{field.getValueBuffer(), 0, field.getValueBufferSize()},
+			{statsBuffer, 0, statsSize}
+		}};
+
+		std::array<VkWriteDescriptorSet, bindingCount> writes{};
+		for (uint32_t i = 0; i < bindingCount; i++) {
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = descriptorSet;
+			writes[i].dstBinding = i;
+			writes[i].descriptorCount = 1;
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+		vkUpdateDescriptorSets(hexDevice.device(), bindingCount, writes.data(), 0, nullptr);
+
+		// Empty range, count and bins
+		stats[0] = ~0u;
+		stats[1] = 0;
+		stats[2] = 0;
+		std::fill(stats + 3, stats + 3 + binCount, 0u);
+
+		uint32_t groupCount = (volume.getCellCount() + qualityWorkgroupSize - 1) / qualityWorkgroupSize;
+		uint32_t groupsX = std::min(groupCount, maxWorkgroupsX);
+		uint32_t groupsY = (groupCount + groupsX - 1) / groupsX;
+
+		CellQualityPushConstantData push{};
+		push.metric = static_cast<uint32_t>(metric);
+		push.cellCount = volume.getCellCount();
+		push.groupsX = groupsX;
+		push.binCount = binCount;
+
+		VkCommandBuffer commandBuffer = hexDevice.beginSingleTimeCommands();
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CellQualityPushConstantData), &push);
+
+		qualityPipeline->bind(commandBuffer);
+		vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		histogramPipeline->bind(commandBuffer);
+		vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+
+		// Values for the draws that follow, stats for the host
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+			0, 1, &barrier, 0, nullptr, 0, nullptr
+		);
+		hexDevice.endSingleTimeCommands(commandBuffer);
+
+		// The range stays empty when every cell is degenerate
+		HexQualityStats result{};
+		if (stats[0] <= stats[1]) {
+			result.min = orderedValue(stats[0]);
+			result.max = orderedValue(stats[1]);
+		}
+		result.degenerate = stats[2];
+		result.histogram.assign(stats + 3, stats + 3 + binCount);
+
+		field.valuesWritten(result.min, result.max);
+		return result;
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "HexCellField.h"
+#include "HexPipeline.h"
+#include "HexPipelineManager.h"
+#include "HexQuality.h"
+#include "HexVolumeModel.h"
+#include "hex_device.h"
+
+#include <memory>
+
+namespace hex {
+
+	// GPU version of HexQuality: a compute pass writes the metric of every volume cell straight
+	// into a cell field and reduces its min / max, a second pass bins the values.
+	class CellQualitySystem {
+		public:
+		// MAX_BIN_COUNT in shaders/cell_quality_common.glsl
+		static constexpr uint32_t MAX_BIN_COUNT = 256;
+
+		CellQualitySystem(HexDevice &device, HexPipelineManager &pipelineManager);
+		~CellQualitySystem();
+
+		CellQualitySystem(const CellQualitySystem&) = delete;
+		CellQualitySystem &operator=(const CellQualitySystem &) = delete;
+
+		// The field shows the metric over its min / max afterwards, it must have a value per
+		// volume cell. Waits for the device: frames in flight may still read the field.
+		HexQualityStats compute(const HexVolumeModel &volume, HexCellField &field, HexQualityMetric metric, uint32_t binCount = HexQuality::DEFAULT_BIN_COUNT);
+
+		private:
+		void createDescriptorSetLayout();
+		void createDescriptorSet();
+		void createPipelineLayout();
+		void createStatsBuffer();
+
+		HexDevice &hexDevice;
+		HexPipelineManager &pipelineManager;
+
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		std::unique_ptr<HexPipeline> qualityPipeline;
+		std::unique_ptr<HexPipeline> histogramPipeline;
+
+		// Written again by every compute call, which waits for the device
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+		// Min / max keys and bins, host visible
+		VkBuffer statsBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory statsMemory = VK_NULL_HANDLE;
+		uint32_t *stats = nullptr;
+	};
+}
@@ -1,7 +1,20 @@
 #include "HexApp.h"
 
+#include "CellFieldRendererSystem.h"
+#include "CellFilterSystem.h"
+#include "CellQualitySystem.h"
 #include "HexCamera.h"
+#include "HexDepthPyramid.h"
+#include "HexGpuProfiler.h"
+#include "HexMeshWinding.h"
+#include "HexParallel.h"
+#include "HexQuality.h"
+#include "HexRenderGraph.h"
+#include "HexVolumeLoader.h"
 #include "KeyboardMovementController.h"
+#include "MeshletRendererSystem.h"
+#include "PagedRendererSystem.h"
+#include "SeriesRendererSystem.h"
 #include "SimpleRendererSystem.h"
 
 #define GLM_FORCE_RADIANS
@@ -12,12 +25,43 @@
 #include <array>
 #include <stdexcept>
 #include <cassert>
+#include <iostream>
 
 #include <chrono>
 
+#include <sys/stat.h>
+
 namespace hex {
 
-	HexApp::HexApp() {
+	namespace {
+		void printQualityStats(HexQualityMetric metric, const HexQualityStats &stats, const char *where, double seconds) {
+			std::cout << "Cell " << HexQuality::name(metric) << " on the " << where << " in " << seconds * 1000.0 << " ms: min "
+				<< stats.min << ", max " << stats.max << ", histogram";
+			for (uint32_t count : stats.histogram) std::cout << ' ' << count;
+			if (stats.degenerate > 0) std::cout << ", " << stats.degenerate << " degenerate";
+			std::cout << std::endl;
+		}
+
+		// 0 when it can't be read, loading reports the error
+		uint64_t fileSize(const std::string &filepath) {
+			struct stat fileStat;
+			if (stat(filepath.c_str(), &fileStat) != 0) return 0;
+			return static_cast<uint64_t>(fileStat.st_size);
+		}
+	}
+
+	HexApp::HexApp(const std::vector<std::string> &modelFiles) : modelFiles{modelFiles} {
+		// Compilations in flight read the swap chain render target
+		hexRenderer.setSwapChainRecreateCallback([this] { pipelineManager.waitIdle(); });
+
+		// Without it, volumes show their whole boundary with the cell field renderer
+		try {
+			cellFilterSystem = std::make_unique<CellFilterSystem>(hexDevice, hexRenderer.getSwapChainRenderTarget(), pipelineManager);
+			std::cout << "Cell wireframe: " << (cellFilterSystem->usesHardwareBarycentrics() ? "fragment shader barycentrics" : "vertex shader barycentrics") << std::endl;
+		} catch (const std::exception &e) {
+			std::cerr << "Cell filtering disabled: " << e.what() << std::endl;
+		}
+
 		loadGameObjects();
 	}
 
@@ -25,8 +69,70 @@ namespace hex {
 	}
 
 	void HexApp::run() {
+		std::cout << "Swap chain pass: " << (hexRenderer.usesDynamicRendering() ? "dynamic rendering" : "render pass and framebuffers") << std::endl;
+
+		SimpleRendererSystem simpleRendererSystem{hexDevice, hexRenderer.getSwapChainRenderTarget(), geometryArena, pipelineManager};
+		std::cout << "Model wireframe: " << (simpleRendererSystem.hasWireframe() ? "fragment shader barycentrics" : "unavailable, no fragment shader barycentrics") << std::endl;
+
+		// Meshlet culling needs its own shaders, without them every model takes the simple path
+		std::unique_ptr<MeshletRendererSystem> meshletRendererSystem;
+		try {
+			meshletRendererSystem = std::make_unique<MeshletRendererSystem>(hexDevice, hexRenderer.getSwapChainRenderTarget(), geometryArena, pipelineManager);
+			std::cout << "Meshlet culling: " << (meshletRendererSystem->usesMeshShaders() ? "mesh shaders"
+				: meshletRendererSystem->usesDrawCount() ? "compute + compacted indirect count draws" : "compute + indirect draws") << std::endl;
+		} catch (const std::exception &e) {
+			std::cerr << "Meshlet culling disabled: " << e.what() << std::endl;
+		}
+
+		// Without it, volume meshes fall back to their vertex colors
+		std::unique_ptr<CellFieldRendererSystem> cellFieldRendererSystem;
+		try {
+			cellFieldRendererSystem = std::make_unique<CellFieldRendererSystem>(hexDevice, hexRenderer.getSwapChainRenderTarget(), geometryArena, pipelineManager);
+		} catch (const std::exception &e) {
+			std::cerr << "Cell fields disabled: " << e.what() << std::endl;
+			// Volumes drawn by the cell filter keep their field
+			for (auto &gameObject : gameObjects) {
+				if (!gameObject.volume) gameObject.cellField.reset();
+			}
+		}
+
+		// Without it, the quality metric shown stays the one computed at load time
+		std::unique_ptr<CellQualitySystem> cellQualitySystem;
+		try {
+			cellQualitySystem = std::make_unique<CellQualitySystem>(hexDevice, pipelineManager);
+		} catch (const std::exception &e) {
+			std::cerr << "GPU cell quality disabled: " << e.what() << std::endl;
+		}
+		// Paged models have no other path, they aren't shown without it
+		std::unique_ptr<PagedRendererSystem> pagedRendererSystem;
+		try {
+			pagedRendererSystem = std::make_unique<PagedRendererSystem>(hexDevice, hexRenderer.getSwapChainRenderTarget(), pipelineManager);
+		} catch (const std::exception &e) {
+			std::cerr << "Paged models disabled: " << e.what() << std::endl;
+			for (auto &gameObject : gameObjects) gameObject.pagedModel.reset();
+		}
 
-		SimpleRendererSystem simpleRendererSystem{hexDevice, hexRenderer.getSwapChainRenderPass()};
+		// Series have no other path either
+		std::unique_ptr<SeriesRendererSystem> seriesRendererSystem;
+		try {
+			seriesRendererSystem = std::make_unique<SeriesRendererSystem>(hexDevice, hexRenderer.getSwapChainRenderTarget(), pipelineManager);
+		} catch (const std::exception &e) {
+			std::cerr << "Series playback disabled: " << e.what() << std::endl;
+			for (auto &gameObject : gameObjects) gameObject.series.reset();
+		}
+
+		// Frame timings, the depth prepass toggle reports the time of each mode
+		std::unique_ptr<HexGpuProfiler> gpuProfiler;
+		try {
+			gpuProfiler = std::make_unique<HexGpuProfiler>(hexDevice, HexSwapChain::MAX_FRAMES_IN_FLIGHT);
+		} catch (const std::exception &e) {
+			std::cerr << "GPU profiler disabled: " << e.what() << std::endl;
+		}
+
+		// Pipelines the last run drew with are compiled before the first frame, the others while drawing
+		pipelineManager.warmUp();
+
+		HexQualityMetric qualityMetric = HexQualityMetric::ScaledJacobian;
 		HexCamera camera{};
 		
 		// camera.setViewDirection(glm::vec3{0.f}, glm::vec3{0.5f, 0.f, 1.f});
@@ -35,27 +141,210 @@ namespace hex {
 		auto viewerObject = HexGameObject::createGameObject();
 		KeyboardMovementController cameraController{};
 
+		float frameTime = 0.f;
+
+		// Indirect meshlet draws have a depth only variant. Without it (mesh shaders) their objects take
+		// the simple path during the depth prepass, and the meshlet renderer records nothing then.
+		// Meshlet draws have no wireframe either, it takes every model to the simple path too.
+		auto meshletRenderer = [&]() -> MeshletRendererSystem* {
+			if (!meshletRendererSystem) return nullptr;
+			if (simpleRendererSystem.getWireframe()) return nullptr;
+			if (simpleRendererSystem.usesDepthPrepass() && !meshletRendererSystem->hasDepthPrepass()) return nullptr;
+			return meshletRendererSystem.get();
+		};
+
+		// Compute work before the swap chain pass, its systems place their own barriers
+		auto recordUpdates = [&](VkCommandBuffer commandBuffer) {
+			if (MeshletRendererSystem *meshlets = meshletRenderer()) meshlets->cullGameObjects(commandBuffer, gameObjects, camera);
+			simpleRendererSystem.cullGameObjects(commandBuffer, static_cast<uint32_t>(hexRenderer.getFrameIndex()), gameObjects, camera, meshletRenderer());
+			if (cellFilterSystem) cellFilterSystem->updateGameObjects(commandBuffer, hexRenderer.getFrameIndex(), gameObjects);
+			if (pagedRendererSystem) pagedRendererSystem->updateGameObjects(commandBuffer, gameObjects, camera, static_cast<float>(hexRenderer.getExtent().height));
+			if (seriesRendererSystem) seriesRendererSystem->updateGameObjects(commandBuffer, hexRenderer.getFrameIndex(), frameTime, gameObjects);
+		};
+		auto recordScene = [&](VkCommandBuffer commandBuffer) {
+			if (simpleRendererSystem.usesDepthPrepass()) {
+				if (gpuProfiler) gpuProfiler->beginScope(commandBuffer, "depth prepass");
+				simpleRendererSystem.renderDepthPrepass(commandBuffer, gameObjects, camera, meshletRenderer());
+				if (MeshletRendererSystem *meshlets = meshletRenderer()) meshlets->renderDepthPrepass(commandBuffer, gameObjects, camera);
+				if (gpuProfiler) gpuProfiler->endScope(commandBuffer);
+			}
+			if (gpuProfiler) gpuProfiler->beginScope(commandBuffer, "simple models");
+			simpleRendererSystem.renderGameObjectObjects(commandBuffer, gameObjects, camera, meshletRenderer());
+			if (gpuProfiler) gpuProfiler->endScope(commandBuffer);
+			if (MeshletRendererSystem *meshlets = meshletRenderer()) meshlets->renderGameObjects(commandBuffer, gameObjects, camera);
+			if (cellFieldRendererSystem) cellFieldRendererSystem->renderGameObjects(commandBuffer, gameObjects, camera);
+			if (cellFilterSystem) cellFilterSystem->renderGameObjects(commandBuffer, gameObjects, camera);
+			if (pagedRendererSystem) pagedRendererSystem->renderGameObjects(commandBuffer, gameObjects, camera);
+			if (seriesRendererSystem) seriesRendererSystem->renderGameObjects(commandBuffer, hexRenderer.getFrameIndex(), gameObjects, camera);
+		};
+
+		// The frame as a render graph when the swap chain pass uses dynamic rendering, the swap
+		// chain images are imported every frame. Otherwise the swap chain render pass.
+		std::unique_ptr<HexRenderGraph> renderGraph;
+		HexRenderGraph::ResourceId swapChainColor = HexRenderGraph::NO_RESOURCE;
+		HexRenderGraph::ResourceId swapChainDepth = HexRenderGraph::NO_RESOURCE;
+		// Farthest depths of the scene pass, both renderers test what it missed against them
+		std::unique_ptr<HexDepthPyramid> depthPyramid;
+		auto disableOcclusionCulling = [&]() {
+			if (meshletRendererSystem) meshletRendererSystem->setOcclusionCulling(false, HexSwapChain::MAX_FRAMES_IN_FLIGHT);
+			simpleRendererSystem.setOcclusionCulling(false, HexSwapChain::MAX_FRAMES_IN_FLIGHT);
+			depthPyramid.reset();
+			hexRenderer.setSampledDepth(false);
+		};
+		if (hexRenderer.usesDynamicRendering()) {
+			// Meshlets and simple objects hidden behind the scene depths are culled in a second phase between
+			// two scene passes, only the graph records those
+			try {
+				depthPyramid = std::make_unique<HexDepthPyramid>(hexDevice, HexSwapChain::MAX_FRAMES_IN_FLIGHT, pipelineManager);
+				hexRenderer.setSampledDepth(true);
+				if (meshletRendererSystem && !meshletRendererSystem->usesMeshShaders()) {
+					try {
+						meshletRendererSystem->setOcclusionCulling(true, HexSwapChain::MAX_FRAMES_IN_FLIGHT);
+					} catch (const std::exception &e) {
+						std::cerr << "Meshlet occlusion culling disabled: " << e.what() << std::endl;
+					}
+				}
+				try {
+					simpleRendererSystem.setOcclusionCulling(true, HexSwapChain::MAX_FRAMES_IN_FLIGHT);
+				} catch (const std::exception &e) {
+					std::cerr << "Object occlusion culling disabled: " << e.what() << std::endl;
+				}
+				if (!simpleRendererSystem.usesOcclusionCulling() && !(meshletRendererSystem && meshletRendererSystem->usesOcclusionCulling())) {
+					disableOcclusionCulling();
+				}
+			} catch (const std::exception &e) {
+				std::cerr << "Occlusion culling disabled: " << e.what() << std::endl;
+				disableOcclusionCulling();
+			}
+			try {
+				renderGraph = std::make_unique<HexRenderGraph>(hexDevice, HexSwapChain::MAX_FRAMES_IN_FLIGHT);
+				renderGraph->setExtent(hexRenderer.getExtent());
+				// Acquiring the image is waited for at color output, presenting after
+				swapChainColor = renderGraph->importImage("swap chain color", hexRenderer.getSwapChainImageFormat(),
+					{VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0},
+					{VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0});
+				// Last written by the depth tests of an earlier frame, not needed after
+				swapChainDepth = renderGraph->importImage("swap chain depth", hexRenderer.getSwapChainDepthFormat(),
+					{VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT},
+					{});
+				renderGraph->addPass("update", recordUpdates).sideEffect();
+				renderGraph->addPass("scene", recordScene)
+					.colorAttachment(swapChainColor, VK_ATTACHMENT_LOAD_OP_CLEAR, {{0.1f, 0.1f, 0.1f, 0.f}})
+					.depthAttachment(swapChainDepth, VK_ATTACHMENT_LOAD_OP_CLEAR, 1.f);
+				if (depthPyramid) {
+					renderGraph->addPass("occlusion cull", [&](VkCommandBuffer commandBuffer) {
+						uint32_t frameIndex = static_cast<uint32_t>(hexRenderer.getFrameIndex());
+						depthPyramid->build(commandBuffer, frameIndex, hexRenderer.getSwapChainDepthImageView(), hexRenderer.getExtent());
+						if (MeshletRendererSystem *meshlets = meshletRenderer()) {
+							meshlets->cullOccludedGameObjects(commandBuffer, frameIndex, *depthPyramid, gameObjects, camera);
+						}
+						simpleRendererSystem.cullOccludedGameObjects(commandBuffer, frameIndex, *depthPyramid);
+					})
+						.read(swapChainDepth, HexRenderGraph::Access::ComputeSampled)
+						.sideEffect();
+					renderGraph->addPass("disoccluded objects", [&](VkCommandBuffer commandBuffer) {
+						simpleRendererSystem.renderDisoccludedGameObjects(commandBuffer, gameObjects, camera);
+						if (MeshletRendererSystem *meshlets = meshletRenderer()) meshlets->renderGameObjects(commandBuffer, gameObjects, camera);
+					})
+						.colorAttachment(swapChainColor, VK_ATTACHMENT_LOAD_OP_LOAD)
+						.depthAttachment(swapChainDepth, VK_ATTACHMENT_LOAD_OP_LOAD);
+				}
+				renderGraph->compile();
+				renderGraph->setProfiler(gpuProfiler.get());
+			} catch (const std::exception &e) {
+				std::cerr << "Render graph disabled: " << e.what() << std::endl;
+				renderGraph.reset();
+				// Nothing would run the second phase
+				disableOcclusionCulling();
+			}
+		}
+
 		auto currentTime = std::chrono::high_resolution_clock::now();
 
 		while (!hexWindow.shouldClose()) {
 			glfwPollEvents();
 
 			auto newTime = std::chrono::high_resolution_clock::now();
-			float frameTime = std::chrono::duration<float, std::chrono::seconds::period>(newTime - currentTime).count();
+			frameTime = std::chrono::duration<float, std::chrono::seconds::period>(newTime - currentTime).count();
 			currentTime = newTime;
 
 			cameraController.moveInPlaneXZ(hexWindow.getGLFWWindow(), frameTime, viewerObject);
 			camera.setViewYXZ(viewerObject.transform.translation, viewerObject.transform.rotation);
+			for (auto &gameObject : gameObjects) {
+				cameraController.moveClipPlane(hexWindow.getGLFWWindow(), frameTime, gameObject);
+				cameraController.shrinkCells(hexWindow.getGLFWWindow(), frameTime, gameObject);
+			}
+
+			if (cameraController.toggleWireframePressed(hexWindow.getGLFWWindow())) {
+				if (cellFilterSystem) cellFilterSystem->setWireframe(!cellFilterSystem->getWireframe());
+				simpleRendererSystem.setWireframe(!simpleRendererSystem.getWireframe());
+			}
+
+			if (cameraController.togglePlaybackPressed(hexWindow.getGLFWWindow())) {
+				for (auto &gameObject : gameObjects) {
+					if (gameObject.series) gameObject.series->setPlaying(!gameObject.series->isPlaying());
+				}
+			}
+
+			if (cameraController.toggleDepthPrepassPressed(hexWindow.getGLFWWindow())) {
+				if (!simpleRendererSystem.hasDepthPrepass()) {
+					std::cout << "Depth prepass unavailable, shaders/depth_prepass.vert.spv didn't load" << std::endl;
+				} else {
+					// Timings so far are those of the previous mode
+					if (gpuProfiler) {
+						gpuProfiler->report();
+						gpuProfiler->reset();
+					}
+					simpleRendererSystem.setDepthPrepass(!simpleRendererSystem.usesDepthPrepass());
+					std::cout << "Depth prepass: " << (simpleRendererSystem.usesDepthPrepass() ? "on" : "off") << std::endl;
+				}
+			}
+
+			if (cameraController.nextQualityMetricPressed(hexWindow.getGLFWWindow()) && cellQualitySystem) {
+				qualityMetric = static_cast<HexQualityMetric>((static_cast<uint32_t>(qualityMetric) + 1) % QUALITY_METRIC_COUNT);
+				for (auto &gameObject : gameObjects) {
+					if (!gameObject.volume || !gameObject.cellField) continue;
+					auto start = std::chrono::high_resolution_clock::now();
+					HexQualityStats stats = cellQualitySystem->compute(*gameObject.volume, *gameObject.cellField, qualityMetric);
+					double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+					printQualityStats(qualityMetric, stats, "GPU", seconds);
+				}
+			}
 
 			float aspect = hexRenderer.getAspectRatio();
 			// camera.setOrthographicProjection(-aspect, aspect, -1, 1, -1, 1);
 			camera.setPerspectiveProjection(glm::radians(50.f), aspect, 0.1f, 100.f);
 
 			if (auto commandBuffer = hexRenderer.beginFrame()) {
-				hexRenderer.beginSwapChainRenderPass(commandBuffer);
-				simpleRendererSystem.renderGameObjectObjects(commandBuffer, gameObjects, camera);
-				hexRenderer.endSwapChainRenderPass(commandBuffer);
+				simpleRendererSystem.updateLods(gameObjects, camera, static_cast<float>(hexRenderer.getExtent().height));
+				if (gpuProfiler) gpuProfiler->beginFrame(commandBuffer, static_cast<uint32_t>(hexRenderer.getFrameIndex()));
+
+				if (renderGraph) {
+					// Recreates the transients after the swap chain was resized
+					renderGraph->setExtent(hexRenderer.getExtent());
+					renderGraph->setImage(swapChainColor, hexRenderer.getSwapChainImage(), hexRenderer.getSwapChainImageView(), hexRenderer.getExtent());
+					renderGraph->setImage(swapChainDepth, hexRenderer.getSwapChainDepthImage(), hexRenderer.getSwapChainDepthImageView(), hexRenderer.getExtent());
+					renderGraph->execute(commandBuffer, static_cast<uint32_t>(hexRenderer.getFrameIndex()));
+				} else {
+					// Same scopes as the graph passes
+					if (gpuProfiler) gpuProfiler->beginScope(commandBuffer, "update");
+					recordUpdates(commandBuffer);
+					if (gpuProfiler) gpuProfiler->endScope(commandBuffer);
+					if (gpuProfiler) gpuProfiler->beginScope(commandBuffer, "scene");
+					hexRenderer.beginSwapChainRenderPass(commandBuffer);
+					recordScene(commandBuffer);
+					hexRenderer.endSwapChainRenderPass(commandBuffer);
+					if (gpuProfiler) gpuProfiler->endScope(commandBuffer);
+				}
+				if (gpuProfiler) gpuProfiler->endFrame(commandBuffer);
+				// Read back by the occlusion pass, from the last frame using the same frame index
+				MeshletRendererSystem *meshlets = meshletRenderer();
+				if (gpuProfiler && renderGraph && meshlets && meshlets->usesOcclusionCulling()) {
+					gpuProfiler->addCount("occluded objects", meshlets->getOccludedObjects());
+					gpuProfiler->addCount("occluded meshlets", meshlets->getOccludedMeshlets());
+				}
 				hexRenderer.endFrame();
+				pipelineManager.endFrame();
 			}
 						
 		}
@@ -63,16 +352,17 @@ namespace hex {
 		vkDeviceWaitIdle(hexDevice.device());
 	}
 
-	std::unique_ptr<HexModel> createCubeModel(HexDevice& device, glm::vec3 offset) {
-		std::vector<HexModel::Vertex> vertices{
+	std::unique_ptr<HexModel> createCubeModel(HexGeometryArena& arena, glm::vec3 offset) {
+		HexModel::Builder builder{};
+		builder.vertices = {
 		
 			// left face (white)
 			{{-.5f, -.5f, -.5f}, {.9f, .9f, .9f}},
-			{{-.5f, .5f, .5f}, {.9f, .9f, .9f}},
 			{{-.5f, -.5f, .5f}, {.9f, .9f, .9f}},
+			{{-.5f, .5f, .5f}, {.9f, .9f, .9f}},
 			{{-.5f, -.5f, -.5f}, {.9f, .9f, .9f}},
-			{{-.5f, .5f, -.5f}, {.9f, .9f, .9f}},
 			{{-.5f, .5f, .5f}, {.9f, .9f, .9f}},
+			{{-.5f, .5f, -.5f}, {.9f, .9f, .9f}},
 		
 			// right face (yellow)
 			{{.5f, -.5f, -.5f}, {.8f, .8f, .1f}},
@@ -92,11 +382,11 @@ namespace hex {
 		
 			// bottom face (red)
 			{{-.5f, .5f, -.5f}, {.8f, .1f, .1f}},
-			{{.5f, .5f, .5f}, {.8f, .1f, .1f}},
 			{{-.5f, .5f, .5f}, {.8f, .1f, .1f}},
+			{{.5f, .5f, .5f}, {.8f, .1f, .1f}},
 			{{-.5f, .5f, -.5f}, {.8f, .1f, .1f}},
-			{{.5f, .5f, -.5f}, {.8f, .1f, .1f}},
 			{{.5f, .5f, .5f}, {.8f, .1f, .1f}},
+			{{.5f, .5f, -.5f}, {.8f, .1f, .1f}},
 		
 			// nose face (blue)
 			{{-.5f, -.5f, 0.5f}, {.1f, .1f, .8f}},
@@ -108,22 +398,103 @@ namespace hex {
 		
 			// tail face (green)
 			{{-.5f, -.5f, -0.5f}, {.1f, .8f, .1f}},
-			{{.5f, .5f, -0.5f}, {.1f, .8f, .1f}},
 			{{-.5f, .5f, -0.5f}, {.1f, .8f, .1f}},
+			{{.5f, .5f, -0.5f}, {.1f, .8f, .1f}},
 			{{-.5f, -.5f, -0.5f}, {.1f, .8f, .1f}},
-			{{.5f, -.5f, -0.5f}, {.1f, .8f, .1f}},
 			{{.5f, .5f, -0.5f}, {.1f, .8f, .1f}},
+			{{.5f, -.5f, -0.5f}, {.1f, .8f, .1f}},
 		
 		};
-		for (auto& v : vertices) {
+		for (auto& v : builder.vertices) {
 			v.position += offset;
 		}
-		return std::make_unique<HexModel>(device, vertices);
+		// Wound counter clockwise from outside already, this only marks it closed
+		HexMeshWinding::orient(builder);
+		return std::make_unique<HexModel>(arena, builder);
 	}
 
 	void HexApp::loadGameObjects() {
+		std::shared_ptr<HexColormap> colormap;
+
+		// Large surfaces are paged, volumes need their whole boundary for the cell filters
+		auto isPaged = [](const std::string &filepath) {
+			return !HexVolumeLoader::isVolumeFile(filepath) && fileSize(filepath) >= PAGED_MIN_FILE_SIZE;
+		};
+
+		// Meshes load and optimize in parallel, one task per file whose own parallel loops share
+		// the same workers, then upload in order
+		std::vector<size_t> meshFiles;
+		for (size_t i = 0; i < modelFiles.size(); i++) {
+			if (!HexSeriesFile::isSeriesFile(modelFiles[i]) && !isPaged(modelFiles[i])) meshFiles.push_back(i);
+		}
+		std::vector<HexModel::LoadedFile> loadedFiles(modelFiles.size());
+		// Volumes drawn by the cell filter never need their boundary surface
+		bool volumesOnly = cellFilterSystem != nullptr;
+		parallelTasks(meshFiles.size(), [&](size_t i) {
+			loadedFiles[meshFiles[i]] = HexModel::loadFile(modelFiles[meshFiles[i]], volumesOnly);
+		});
+
+		for (size_t i = 0; i < modelFiles.size(); i++) {
+			const std::string &filepath = modelFiles[i];
+			auto object = HexGameObject::createGameObject();
+			glm::vec3 boundsMin;
+			glm::vec3 boundsMax;
+			std::shared_ptr<HexVolumeMesh> volumeMesh;
+			if (HexSeriesFile::isSeriesFile(filepath)) {
+				object.series = HexSeriesModel::createFromFile(hexDevice, filepath);
+				boundsMin = object.series->getBoundsMin();
+				boundsMax = object.series->getBoundsMax();
+			} else if (isPaged(filepath)) {
+				object.pagedModel = HexPagedModel::createFromFile(hexDevice, filepath);
+				boundsMin = object.pagedModel->getBoundsMin();
+				boundsMax = object.pagedModel->getBoundsMax();
+			} else if (loadedFiles[i].volume && cellFilterSystem) {
+				volumeMesh = std::move(loadedFiles[i].volume);
+				loadedFiles[i] = {};
+				object.volume = std::make_shared<HexVolumeModel>(hexDevice, *volumeMesh);
+				boundsMin = object.volume->getBoundsMin();
+				boundsMax = object.volume->getBoundsMax();
+			} else {
+				object.model = HexModel::createModelFromFile(geometryArena, loadedFiles[i]);
+				volumeMesh = std::move(loadedFiles[i].volume);
+				loadedFiles[i] = {};
+				boundsMin = object.model->getBoundsMin();
+				boundsMax = object.model->getBoundsMax();
+			}
+
+			// Fit the model in a unit box in front of the camera, whatever its units are
+			glm::vec3 extent = boundsMax - boundsMin;
+			float maxExtent = glm::max(extent.x, glm::max(extent.y, extent.z));
+			float scale = maxExtent > 0.f ? 1.f / maxExtent : 1.f;
+			glm::vec3 center = (boundsMin + boundsMax) * .5f;
+
+			object.transform.translation = glm::vec3{.0f, .0f, 2.5f} - center * scale;
+			object.transform.scale = glm::vec3{scale};
+
+			// Volume meshes show the scaled Jacobian of their cells, other metrics are computed
+			// on demand. Without the cell filter, the field is shown on the boundary model.
+			bool cellField = object.volume || (object.model && object.model->hasTriangleCells());
+			if (volumeMesh && cellField) {
+				if (!colormap) colormap = std::make_shared<HexColormap>(hexDevice);
+				const HexVolumeMesh &mesh = *volumeMesh;
+				if (object.volume) object.cellField = std::make_shared<HexCellField>(hexDevice, mesh.cellCount(), colormap);
+				else object.cellField = std::make_shared<HexCellField>(hexDevice, *object.model, colormap);
+
+				auto start = std::chrono::high_resolution_clock::now();
+				std::vector<float> quality = HexQuality::compute(mesh, HexQualityMetric::ScaledJacobian);
+				HexQualityStats stats = HexQuality::statistics(quality);
+				double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+				printQualityStats(HexQualityMetric::ScaledJacobian, stats, "CPU", seconds);
+
+				object.cellField->setValues(quality.data(), static_cast<uint32_t>(quality.size()), stats.min, stats.max);
+			}
+			gameObjects.push_back(std::move(object));
+		}
+
+		if (!gameObjects.empty())
+			return;
 
-		std::shared_ptr<HexModel> hexModel = createCubeModel(hexDevice, {.0f,.0f,.0f});
+		std::shared_ptr<HexModel> hexModel = createCubeModel(geometryArena, {.0f,.0f,.0f});
 
 		auto cube = HexGameObject::createGameObject();
 		cube.model = hexModel;
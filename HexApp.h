@@ -4,17 +4,26 @@
 #include "hex_device.h"
 #include "HexRenderer.h"
 #include "HexGameObject.h"
+#include "HexGeometryArena.h"
+#include "HexPipelineManager.h"
 
+#include <cstdint>
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace hex {
+	class CellFilterSystem;
+
 	class HexApp {
 		public:
 		static constexpr int WIDTH = 800;
 		static constexpr int HEIGHT = 600;
+		// Surface mesh files from this size on are streamed in pages rather than loaded whole
+		static constexpr uint64_t PAGED_MIN_FILE_SIZE = 512ull * 1024 * 1024;
 
-		HexApp();
+		// Mesh files (.obj / .ply / .mesh / .vtk) or time series (.hexseries) to display, the default cube is shown when empty
+		explicit HexApp(const std::vector<std::string> &modelFiles = {});
 		~HexApp();
 
 		HexApp(const HexApp&) = delete;
@@ -30,8 +39,17 @@ namespace hex {
 		HexDevice hexDevice{hexWindow};
 
 		HexRenderer hexRenderer{hexWindow, hexDevice};
+		// Outlives the render systems, which release their pipelines when destroyed
+		HexPipelineManager pipelineManager{hexDevice};
+		// Declared before the game objects so models are released first
+		HexGeometryArena geometryArena{hexDevice};
 
+		std::vector<std::string> modelFiles;
 		std::vector<HexGameObject> gameObjects;
 
+		// Created before loading, volumes it draws skip their boundary surface.
+		// Destroyed before the volumes it draws.
+		std::unique_ptr<CellFilterSystem> cellFilterSystem;
+
 	};
 }
\ No newline at end of file
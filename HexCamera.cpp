@@ -28,6 +28,7 @@ namespace hex {
 	}
 
 	void HexCamera::setViewDirection(glm::vec3 position, glm::vec3 direction, glm::vec3 up) {
+		this->position = position;
 		const glm::vec3 w{glm::normalize(direction)};
 		const glm::vec3 u{glm::normalize(glm::cross(w, up))};
 		const glm::vec3 v{glm::cross(w, u)};
@@ -52,6 +53,7 @@ namespace hex {
 	}
 
 	void HexCamera::setViewYXZ(glm::vec3 position, glm::vec3 rotation) {
+		this->position = position;
 		const float c3 = glm::cos(rotation.z);
 		const float s3 = glm::sin(rotation.z);
 		const float c2 = glm::cos(rotation.x);
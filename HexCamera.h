@@ -19,9 +19,11 @@ namespace hex {
 
 		const glm::mat4& getProjection() const { return projectionMatrix; }
 		const glm::mat4& getViewMatrix() const { return viewMatrix; }
+		const glm::vec3& getPosition() const { return position; }
 
 		private:
 		glm::mat4 projectionMatrix{1.f};
 		glm::mat4 viewMatrix{1.f};
+		glm::vec3 position{0.f};
 	};
 }
\ No newline at end of file
@@ -0,0 +1,126 @@
+#include "HexCellField.h"
+#include "HexParallel.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+
+namespace hex {
+
+	HexCellField::HexCellField(HexDevice &device, const HexModel &model, std::shared_ptr<HexColormap> colormap) : hexDevice{device}, colormap{std::move(colormap)} {
+		assert(model.hasTriangleCells() && "Cell fields need a model built from a volume mesh");
+
+		const std::vector<uint32_t> &triangleCells = model.getTriangleCells();
+		triangleCount = static_cast<uint32_t>(triangleCells.size());
+		referencedCellCount = *std::max_element(triangleCells.begin(), triangleCells.end()) + 1;
+
+		hexDevice.createBuffer(
+			getTriangleCellBufferSize(),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			triangleCellBuffer,
+			triangleCellMemory
+		);
+		uploadBuffer(triangleCells.data(), getTriangleCellBufferSize(), triangleCellBuffer);
+
+		// Zero until a field is set, shaders never read past the referenced cells
+		std::vector<float> zeros(referencedCellCount, 0.f);
+		setValues(zeros.data(), referencedCellCount, 0.f, 1.f);
+	}
+
+	HexCellField::HexCellField(HexDevice &device, uint32_t cellCount, std::shared_ptr<HexColormap> colormap) : hexDevice{device}, colormap{std::move(colormap)} {
+		assert(cellCount > 0 && "Cell fields need cells");
+		referencedCellCount = cellCount;
+
+		std::vector<float> zeros(referencedCellCount, 0.f);
+		setValues(zeros.data(), referencedCellCount, 0.f, 1.f);
+	}
+
+	HexCellField::~HexCellField() {
+		vkDestroyBuffer(hexDevice.device(), triangleCellBuffer, nullptr);
+		vkFreeMemory(hexDevice.device(), triangleCellMemory, nullptr);
+		vkDestroyBuffer(hexDevice.device(), valueBuffer, nullptr);
+		vkFreeMemory(hexDevice.device(), valueMemory, nullptr);
+	}
+
+	void HexCellField::setValues(const std::vector<float> &values) {
+		float low = std::numeric_limits<float>::max();
+		float high = std::numeric_limits<float>::lowest();
+		std::mutex mutex;
+		parallelFor(values.size(), 1 << 16, [&](size_t begin, size_t end) {
+			auto range = std::minmax_element(values.begin() + begin, values.begin() + end);
+			std::lock_guard<std::mutex> lock{mutex};
+			low = std::min(low, *range.first);
+			high = std::max(high, *range.second);
+		});
+		setValues(values.data(), static_cast<uint32_t>(values.size()), low, high);
+	}
+
+	void HexCellField::setValues(const float *values, uint32_t count, float rangeMin, float rangeMax) {
+		if (count < referencedCellCount) {
+			throw std::runtime_error("cell field has fewer values than the model has cells");
+		}
+
+		// Frames in flight read the current buffer
+		vkQueueWaitIdle(hexDevice.graphicsQueue());
+
+		if (count > valueCount) {
+			vkDestroyBuffer(hexDevice.device(), valueBuffer, nullptr);
+			vkFreeMemory(hexDevice.device(), valueMemory, nullptr);
+			hexDevice.createBuffer(
+				count * sizeof(float),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				valueBuffer,
+				valueMemory
+			);
+			valueCount = count;
+			generation++;
+		}
+
+		uploadBuffer(values, count * sizeof(float), valueBuffer);
+		valueVersion++;
+		setRange(rangeMin, rangeMax);
+	}
+
+	void HexCellField::setRange(float rangeMin, float rangeMax) {
+		this->rangeMin = rangeMin;
+		this->rangeMax = rangeMax;
+	}
+
+	void HexCellField::valuesWritten(float rangeMin, float rangeMax) {
+		valueVersion++;
+		setRange(rangeMin, rangeMax);
+	}
+
+	void HexCellField::setColormap(std::shared_ptr<HexColormap> colormap) {
+		vkQueueWaitIdle(hexDevice.graphicsQueue());
+		this->colormap = std::move(colormap);
+		generation++;
+	}
+
+	void HexCellField::uploadBuffer(const void *data, VkDeviceSize size, VkBuffer buffer) {
+		VkBuffer stagingBuffer;
+		VkDeviceMemory stagingBufferMemory;
+		hexDevice.createBuffer(
+			size,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			stagingBuffer,
+			stagingBufferMemory
+		);
+
+		void *mapped;
+		vkMapMemory(hexDevice.device(), stagingBufferMemory, 0, size, 0, &mapped);
+		memcpy(mapped, data, static_cast<size_t>(size));
+		vkUnmapMemory(hexDevice.device(), stagingBufferMemory);
+
+		hexDevice.copyBuffer(stagingBuffer, buffer, size);
+
+		vkDestroyBuffer(hexDevice.device(), stagingBuffer, nullptr);
+		vkFreeMemory(hexDevice.device(), stagingBufferMemory, nullptr);
+	}
+}
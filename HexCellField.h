@@ -0,0 +1,73 @@
+#pragma once
+
+#include "HexColormap.h"
+#include "HexModel.h"
+#include "hex_device.h"
+
+#include <memory>
+#include <vector>
+
+namespace hex {
+
+	// Scalar value per volume cell displayed on the boundary of a model built from a volume
+	// mesh. The triangle to cell map is uploaded once, changing the displayed attribute
+	// only uploads one float per cell and vertices are never touched.
+	class HexCellField {
+		public:
+		HexCellField(HexDevice &device, const HexModel &model, std::shared_ptr<HexColormap> colormap);
+		// Values only, for volumes drawn from their cells (CellFilterSystem) rather than a boundary model
+		HexCellField(HexDevice &device, uint32_t cellCount, std::shared_ptr<HexColormap> colormap);
+		~HexCellField();
+
+		HexCellField(const HexCellField &) = delete;
+		HexCellField &operator=(const HexCellField &) = delete;
+
+		// Values of every cell, the displayed range is set to their min / max.
+		// Waits for the GPU: frames in flight may still read the previous values.
+		void setValues(const std::vector<float> &values);
+		void setValues(const float *values, uint32_t count, float rangeMin, float rangeMax);
+		// Values mapped to the ends of the colormap, outside values are clamped
+		void setRange(float rangeMin, float rangeMax);
+		// Values were written on the GPU through getValueBuffer (see CellQualitySystem)
+		void valuesWritten(float rangeMin, float rangeMax);
+		void setColormap(std::shared_ptr<HexColormap> colormap);
+
+		// Cells referenced by the model triangles (or every cell), fields need at least this many values
+		uint32_t getReferencedCellCount() const { return referencedCellCount; }
+		uint32_t getValueCount() const { return valueCount; }
+		float getRangeMin() const { return rangeMin; }
+		float getRangeMax() const { return rangeMax; }
+
+		// Null for fields without a model
+		VkBuffer getTriangleCellBuffer() const { return triangleCellBuffer; }
+		VkDeviceSize getTriangleCellBufferSize() const { return triangleCount * sizeof(uint32_t); }
+		VkBuffer getValueBuffer() const { return valueBuffer; }
+		VkDeviceSize getValueBufferSize() const { return valueCount * sizeof(float); }
+		const HexColormap &getColormap() const { return *colormap; }
+
+		// Changes whenever a buffer or the colormap is replaced, descriptors must be rewritten
+		uint64_t getGeneration() const { return generation; }
+		// Changes whenever values are uploaded, passes deriving data from them must rerun
+		uint64_t getValueVersion() const { return valueVersion; }
+
+		private:
+		void uploadBuffer(const void *data, VkDeviceSize size, VkBuffer buffer);
+
+		HexDevice &hexDevice;
+		std::shared_ptr<HexColormap> colormap;
+
+		VkBuffer triangleCellBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory triangleCellMemory = VK_NULL_HANDLE;
+		uint32_t triangleCount = 0;
+		uint32_t referencedCellCount = 0;
+
+		VkBuffer valueBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory valueMemory = VK_NULL_HANDLE;
+		uint32_t valueCount = 0;
+		float rangeMin = 0.f;
+		float rangeMax = 1.f;
+
+		uint64_t generation = 0;
+		uint64_t valueVersion = 0;
+	};
+}
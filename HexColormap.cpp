@@ -0,0 +1,159 @@
+#include "HexColormap.h"
+
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+namespace hex {
+
+	HexColormap::HexColormap(HexDevice &device, Preset preset) : HexColormap{device, presetColors(preset)} {}
+
+	HexColormap::HexColormap(HexDevice &device, const std::vector<glm::vec3> &controlColors) : hexDevice{device} {
+		assert(controlColors.size() >= 2 && "A colormap needs at least 2 control colors");
+		createImage(controlColors);
+		createSampler();
+	}
+
+	HexColormap::~HexColormap() {
+		vkDestroySampler(hexDevice.device(), sampler, nullptr);
+		vkDestroyImageView(hexDevice.device(), imageView, nullptr);
+		vkDestroyImage(hexDevice.device(), image, nullptr);
+		vkFreeMemory(hexDevice.device(), imageMemory, nullptr);
+	}
+
+	std::vector<glm::vec3> HexColormap::presetColors(Preset preset) {
+		switch (preset) {
+			case Preset::CoolWarm:
+				// Moreland diverging map
+				return {
+					{.230f, .299f, .754f},
+					{.552f, .690f, .996f},
+					{.866f, .866f, .866f},
+					{.956f, .604f, .483f},
+					{.706f, .016f, .150f}
+				};
+			case Preset::Grayscale:
+				return {{0.f, 0.f, 0.f}, {1.f, 1.f, 1.f}};
+			case Preset::Viridis:
+			default:
+				return {
+					{.267f, .005f, .329f},
+					{.283f, .141f, .458f},
+					{.254f, .265f, .530f},
+					{.207f, .372f, .553f},
+					{.164f, .471f, .558f},
+					{.128f, .567f, .551f},
+					{.135f, .659f, .518f},
+					{.267f, .749f, .441f},
+					{.478f, .821f, .318f},
+					{.741f, .873f, .150f},
+					{.993f, .906f, .144f}
+				};
+		}
+	}
+
+	void HexColormap::createImage(const std::vector<glm::vec3> &controlColors) {
+		std::array<uint8_t, SIZE * 4> texels{};
+		float segments = static_cast<float>(controlColors.size() - 1);
+		for (uint32_t i = 0; i < SIZE; i++) {
+			float position = static_cast<float>(i) / static_cast<float>(SIZE - 1) * segments;
+			size_t segment = glm::min(static_cast<size_t>(position), controlColors.size() - 2);
+			glm::vec3 color = glm::mix(controlColors[segment], controlColors[segment + 1], position - static_cast<float>(segment));
+			color = glm::clamp(color, 0.f, 1.f) * 255.f + .5f;
+			for (int c = 0; c < 3; c++) texels[i * 4 + c] = static_cast<uint8_t>(color[c]);
+			texels[i * 4 + 3] = 255;
+		}
+
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_1D;
+		imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+		imageInfo.extent = {SIZE, 1, 1};
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		hexDevice.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, imageMemory);
+
+		VkBuffer stagingBuffer;
+		VkDeviceMemory stagingBufferMemory;
+		hexDevice.createBuffer(
+			texels.size(),
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			stagingBuffer,
+			stagingBufferMemory
+		);
+
+		void *mapped;
+		vkMapMemory(hexDevice.device(), stagingBufferMemory, 0, texels.size(), 0, &mapped);
+		memcpy(mapped, texels.data(), texels.size());
+		vkUnmapMemory(hexDevice.device(), stagingBufferMemory);
+
+		// Transfer layout, copy, then shader read layout in one submission
+		VkCommandBuffer commandBuffer = hexDevice.beginSingleTimeCommands();
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkBufferImageCopy region{};
+		region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+		region.imageExtent = {SIZE, 1, 1};
+		vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		hexDevice.endSingleTimeCommands(commandBuffer);
+
+		vkDestroyBuffer(hexDevice.device(), stagingBuffer, nullptr);
+		vkFreeMemory(hexDevice.device(), stagingBufferMemory, nullptr);
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_1D;
+		viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+		viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+		if (vkCreateImageView(hexDevice.device(), &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create colormap image view");
+		}
+	}
+
+	void HexColormap::createSampler() {
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_LINEAR;
+		samplerInfo.minFilter = VK_FILTER_LINEAR;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.maxLod = 0.f;
+
+		if (vkCreateSampler(hexDevice.device(), &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create colormap sampler");
+		}
+	}
+
+	VkDescriptorImageInfo HexColormap::descriptorInfo() const {
+		return {sampler, imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+	}
+}
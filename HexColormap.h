@@ -0,0 +1,47 @@
+#pragma once
+
+#include "hex_device.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace hex {
+
+	// Transfer function texture: a 1D RGBA8 lookup sampled with a normalized scalar value.
+	// Built from evenly spaced control colors, linearly interpolated.
+	class HexColormap {
+		public:
+		static constexpr uint32_t SIZE = 256;
+
+		enum class Preset {
+			Viridis,
+			CoolWarm,
+			Grayscale
+		};
+
+		HexColormap(HexDevice &device, Preset preset = Preset::Viridis);
+		HexColormap(HexDevice &device, const std::vector<glm::vec3> &controlColors);
+		~HexColormap();
+
+		HexColormap(const HexColormap &) = delete;
+		HexColormap &operator=(const HexColormap &) = delete;
+
+		// Combined image sampler, clamped to the end colors
+		VkDescriptorImageInfo descriptorInfo() const;
+
+		static std::vector<glm::vec3> presetColors(Preset preset);
+
+		private:
+		void createImage(const std::vector<glm::vec3> &controlColors);
+		void createSampler();
+
+		HexDevice &hexDevice;
+		VkImage image = VK_NULL_HANDLE;
+		VkDeviceMemory imageMemory = VK_NULL_HANDLE;
+		VkImageView imageView = VK_NULL_HANDLE;
+		VkSampler sampler = VK_NULL_HANDLE;
+	};
+}
@@ -0,0 +1,288 @@
+#include "HexDepthPyramid.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace hex {
+
+	// Layout of shaders/depth_pyramid.comp
+	struct DepthPyramidPushConstantData {
+		int32_t sourceSize[2];
+		int32_t destinationSize[2];
+	};
+
+	namespace {
+		const uint32_t workgroupSize = 8;
+
+		uint32_t levelSize(uint32_t depthSize, uint32_t level) {
+			uint32_t size = depthSize >> (level + 1);
+			return size > 0 ? size : 1;
+		}
+	}
+
+	HexDepthPyramid::HexDepthPyramid(HexDevice &device, uint32_t framesInFlight, HexPipelineManager &pipelineManager)
+		: hexDevice{device}, framesInFlight{framesInFlight}, pipelineManager{pipelineManager} {
+		createDescriptorSetLayout();
+		try {
+			createPipeline();
+			createSampler();
+		} catch (...) {
+			pipeline.reset();
+			if (pipelineLayout != VK_NULL_HANDLE) vkDestroyPipelineLayout(hexDevice.device(), pipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(hexDevice.device(), descriptorSetLayout, nullptr);
+			throw;
+		}
+		depthViews.resize(framesInFlight, VK_NULL_HANDLE);
+	}
+
+	HexDepthPyramid::~HexDepthPyramid() {
+		destroyImage();
+		vkDestroySampler(hexDevice.device(), sampler, nullptr);
+		// Pipeline before its layout
+		pipeline.reset();
+		vkDestroyPipelineLayout(hexDevice.device(), pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(hexDevice.device(), descriptorSetLayout, nullptr);
+	}
+
+	void HexDepthPyramid::createDescriptorSetLayout() {
+		// Level above (or depth buffer), level written
+		std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+		bindings[0].binding = 0;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[0].descriptorCount = 1;
+		bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[1].binding = 1;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		bindings[1].descriptorCount = 1;
+		bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		if (vkCreateDescriptorSetLayout(hexDevice.device(), &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create descriptor set layout");
+		}
+	}
+
+	void HexDepthPyramid::createPipeline() {
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(DepthPyramidPushConstantData);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(hexDevice.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create pipeline layout");
+		}
+
+		pipeline = std::make_unique<HexPipeline>(hexDevice, "shaders/depth_pyramid.comp.spv", pipelineLayout, pipelineManager.getPipelineCache(), &pipelineManager.getShaderLibrary());
+	}
+
+	void HexDepthPyramid::createSampler() {
+		// Only read with texelFetch, the sampler just has to cover every level
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+		if (vkCreateSampler(hexDevice.device(), &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create depth pyramid sampler");
+		}
+	}
+
+	void HexDepthPyramid::createImage(VkExtent2D extent) {
+		depthExtent = extent;
+		uint32_t width = levelSize(extent.width, 0);
+		uint32_t height = levelSize(extent.height, 0);
+		uint32_t levelCount = 1;
+		while ((width >> levelCount) > 0 || (height >> levelCount) > 0) levelCount++;
+
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = FORMAT;
+		imageInfo.extent = {width, height, 1};
+		imageInfo.mipLevels = levelCount;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		hexDevice.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, imageMemory);
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = FORMAT;
+		viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1};
+		if (vkCreateImageView(hexDevice.device(), &viewInfo, nullptr, &view) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create depth pyramid image view");
+		}
+
+		levelViews.resize(levelCount, VK_NULL_HANDLE);
+		for (uint32_t level = 0; level < levelCount; level++) {
+			viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+			if (vkCreateImageView(hexDevice.device(), &viewInfo, nullptr, &levelViews[level]) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create depth pyramid image view");
+			}
+		}
+
+		VkDescriptorPoolSize poolSizes[] = {
+			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, framesInFlight * levelCount},
+			{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, framesInFlight * levelCount}
+		};
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = framesInFlight * levelCount;
+		poolInfo.poolSizeCount = 2;
+		poolInfo.pPoolSizes = poolSizes;
+
+		if (vkCreateDescriptorPool(hexDevice.device(), &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create descriptor pool");
+		}
+
+		std::vector<VkDescriptorSetLayout> layouts(framesInFlight * levelCount, descriptorSetLayout);
+		descriptorSets.resize(layouts.size());
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = descriptorPool;
+		allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+		allocInfo.pSetLayouts = layouts.data();
+
+		if (vkAllocateDescriptorSets(hexDevice.device(), &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate descriptor sets");
+		}
+
+		// Every level but the first reads the one above, the first is written with the depth buffer of the frame
+		std::vector<VkDescriptorImageInfo> imageInfos(framesInFlight * levelCount * 2);
+		std::vector<VkWriteDescriptorSet> writes;
+		for (uint32_t frame = 0; frame < framesInFlight; frame++) {
+			for (uint32_t level = 0; level < levelCount; level++) {
+				uint32_t set = frame * levelCount + level;
+				VkDescriptorImageInfo &source = imageInfos[set * 2];
+				VkDescriptorImageInfo &destination = imageInfos[set * 2 + 1];
+				source = {sampler, level > 0 ? levelViews[level - 1] : VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL};
+				destination = {VK_NULL_HANDLE, levelViews[level], VK_IMAGE_LAYOUT_GENERAL};
+
+				VkWriteDescriptorSet write{};
+				write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				write.dstSet = descriptorSets[set];
+				write.descriptorCount = 1;
+				if (level > 0) {
+					write.dstBinding = 0;
+					write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+					write.pImageInfo = &source;
+					writes.push_back(write);
+				}
+				write.dstBinding = 1;
+				write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+				write.pImageInfo = &destination;
+				writes.push_back(write);
+			}
+		}
+		vkUpdateDescriptorSets(hexDevice.device(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+		std::fill(depthViews.begin(), depthViews.end(), VK_NULL_HANDLE);
+		generation++;
+	}
+
+	void HexDepthPyramid::destroyImage() {
+		if (descriptorPool != VK_NULL_HANDLE) vkDestroyDescriptorPool(hexDevice.device(), descriptorPool, nullptr);
+		descriptorPool = VK_NULL_HANDLE;
+		descriptorSets.clear();
+		for (VkImageView levelView : levelViews) {
+			if (levelView != VK_NULL_HANDLE) vkDestroyImageView(hexDevice.device(), levelView, nullptr);
+		}
+		levelViews.clear();
+		if (view != VK_NULL_HANDLE) vkDestroyImageView(hexDevice.device(), view, nullptr);
+		view = VK_NULL_HANDLE;
+		if (image != VK_NULL_HANDLE) {
+			vkDestroyImage(hexDevice.device(), image, nullptr);
+			vkFreeMemory(hexDevice.device(), imageMemory, nullptr);
+		}
+		image = VK_NULL_HANDLE;
+		imageMemory = VK_NULL_HANDLE;
+	}
+
+	void HexDepthPyramid::build(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkImageView depthView, VkExtent2D extent) {
+		if (image == VK_NULL_HANDLE || extent.width != depthExtent.width || extent.height != depthExtent.height) {
+			// Only on resize, earlier frames may still test against the old pyramid
+			vkDeviceWaitIdle(hexDevice.device());
+			destroyImage();
+			createImage(extent);
+		}
+
+		uint32_t levelCount = getLevelCount();
+		if (depthViews[frameIndex] != depthView) {
+			// The frame's previous submission is done, nothing else uses its sets
+			VkDescriptorImageInfo depthInfo{sampler, depthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+			VkWriteDescriptorSet write{};
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = descriptorSets[frameIndex * levelCount];
+			write.dstBinding = 0;
+			write.descriptorCount = 1;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			write.pImageInfo = &depthInfo;
+			vkUpdateDescriptorSets(hexDevice.device(), 1, &write, 0, nullptr);
+			depthViews[frameIndex] = depthView;
+		}
+
+		// Earlier frames only read the pyramid from compute shaders, the content isn't kept
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		pipeline->bind(commandBuffer);
+
+		// Each level waits for the one above
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		DepthPyramidPushConstantData push{};
+		push.sourceSize[0] = static_cast<int32_t>(extent.width);
+		push.sourceSize[1] = static_cast<int32_t>(extent.height);
+		for (uint32_t level = 0; level < levelCount; level++) {
+			uint32_t width = levelSize(extent.width, level);
+			uint32_t height = levelSize(extent.height, level);
+			push.destinationSize[0] = static_cast<int32_t>(width);
+			push.destinationSize[1] = static_cast<int32_t>(height);
+
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[frameIndex * levelCount + level], 0, nullptr);
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DepthPyramidPushConstantData), &push);
+			vkCmdDispatch(commandBuffer, (width + workgroupSize - 1) / workgroupSize, (height + workgroupSize - 1) / workgroupSize, 1);
+
+			barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+			push.sourceSize[0] = push.destinationSize[0];
+			push.sourceSize[1] = push.destinationSize[1];
+		}
+	}
+}
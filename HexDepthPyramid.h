@@ -0,0 +1,69 @@
+#pragma once
+
+#include "HexPipeline.h"
+#include "HexPipelineManager.h"
+#include "hex_device.h"
+
+#include <memory>
+#include <vector>
+
+namespace hex {
+
+	// Farthest depth mip chain of a depth buffer, for occlusion tests (shaders/depth_pyramid.comp).
+	// Level 0 is half the depth buffer size rounded down like any mip, every texel keeps the
+	// farthest depth of the pixels it covers, the last texel of a row or column the extra pixel
+	// of an odd size too. Pixel p of the depth buffer is under texel min(p >> (level + 1), size - 1).
+	// A box whose nearest depth is farther than the texels under it is hidden.
+	class HexDepthPyramid {
+		public:
+		static constexpr VkFormat FORMAT = VK_FORMAT_R32_SFLOAT;
+
+		HexDepthPyramid(HexDevice &device, uint32_t framesInFlight, HexPipelineManager &pipelineManager);
+		~HexDepthPyramid();
+
+		HexDepthPyramid(const HexDepthPyramid &) = delete;
+		HexDepthPyramid &operator=(const HexDepthPyramid &) = delete;
+
+		// Outside of a render pass. depthView must be in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL with
+		// its writes visible to compute shaders. Waits for the device and recreates the pyramid when
+		// extent changes. The pyramid is then in VK_IMAGE_LAYOUT_GENERAL, visible to compute shaders.
+		void build(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkImageView depthView, VkExtent2D extent);
+
+		// All levels, for texelFetch from a compute shader. Valid once built.
+		VkDescriptorImageInfo descriptorInfo() const { return {sampler, view, VK_IMAGE_LAYOUT_GENERAL}; }
+		uint32_t getLevelCount() const { return static_cast<uint32_t>(levelViews.size()); }
+		// Of the depth buffer it was built from
+		VkExtent2D getDepthExtent() const { return depthExtent; }
+		// Changes when the image is recreated, descriptor sets holding descriptorInfo() must be rewritten
+		uint64_t getGeneration() const { return generation; }
+
+		private:
+		void createDescriptorSetLayout();
+		void createPipeline();
+		void createSampler();
+		void createImage(VkExtent2D extent);
+		void destroyImage();
+
+		HexDevice &hexDevice;
+		uint32_t framesInFlight;
+		HexPipelineManager &pipelineManager;
+
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		std::unique_ptr<HexPipeline> pipeline;
+		VkSampler sampler = VK_NULL_HANDLE;
+
+		VkExtent2D depthExtent{0, 0};
+		VkImage image = VK_NULL_HANDLE;
+		VkDeviceMemory imageMemory = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		std::vector<VkImageView> levelViews;
+		uint64_t generation = 0;
+
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		// Per frame in flight and level, level 0 reads the frame's depth buffer
+		std::vector<VkDescriptorSet> descriptorSets;
+		// Depth view the level 0 set of each frame was written for
+		std::vector<VkImageView> depthViews;
+	};
+}
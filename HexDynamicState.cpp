@@ -0,0 +1,100 @@
+#include "HexDynamicState.h"
+
+#include <iostream>
+
+namespace hex {
+
+	namespace {
+		template <typename T>
+		T loadCommand(HexDevice &device, bool supported, const char *name) {
+			if (!supported) return nullptr;
+			return reinterpret_cast<T>(vkGetDeviceProcAddr(device.device(), name));
+		}
+	}
+
+	HexDynamicState::HexDynamicState(HexDevice &device, const std::string &name) : name{name} {
+		bool extended = device.extendedDynamicStateSupported();
+		cmdSetCullMode = loadCommand<PFN_vkCmdSetCullModeEXT>(device, extended, "vkCmdSetCullModeEXT");
+		cmdSetFrontFace = loadCommand<PFN_vkCmdSetFrontFaceEXT>(device, extended, "vkCmdSetFrontFaceEXT");
+		cmdSetPrimitiveTopology = loadCommand<PFN_vkCmdSetPrimitiveTopologyEXT>(device, extended, "vkCmdSetPrimitiveTopologyEXT");
+		cmdSetDepthTestEnable = loadCommand<PFN_vkCmdSetDepthTestEnableEXT>(device, extended, "vkCmdSetDepthTestEnableEXT");
+		cmdSetDepthWriteEnable = loadCommand<PFN_vkCmdSetDepthWriteEnableEXT>(device, extended, "vkCmdSetDepthWriteEnableEXT");
+		cmdSetDepthCompareOp = loadCommand<PFN_vkCmdSetDepthCompareOpEXT>(device, extended, "vkCmdSetDepthCompareOpEXT");
+
+		bool extended2 = device.extendedDynamicState2Supported();
+		cmdSetDepthBiasEnable = loadCommand<PFN_vkCmdSetDepthBiasEnableEXT>(device, extended2, "vkCmdSetDepthBiasEnableEXT");
+		cmdSetPrimitiveRestartEnable = loadCommand<PFN_vkCmdSetPrimitiveRestartEnableEXT>(device, extended2, "vkCmdSetPrimitiveRestartEnableEXT");
+
+		cmdSetPolygonMode = loadCommand<PFN_vkCmdSetPolygonModeEXT>(device, device.extendedDynamicState3PolygonModeSupported(), "vkCmdSetPolygonModeEXT");
+	}
+
+	HexDynamicState::~HexDynamicState() {
+		if (frames == 0) return;
+		double perFrame = 1.0 / static_cast<double>(frames);
+		std::cout << name << " per frame: " << binds * perFrame << " pipeline binds (" << skippedBinds * perFrame << " skipped), "
+			<< stateSets * perFrame << " dynamic state sets (" << skippedStateSets * perFrame << " skipped)" << std::endl;
+	}
+
+	void HexDynamicState::begin(VkCommandBuffer commandBuffer) {
+		this->commandBuffer = commandBuffer;
+		boundPipeline = nullptr;
+		known = 0;
+		frames++;
+	}
+
+	template <typename T, typename SetT>
+	void HexDynamicState::set(uint32_t bit, T &current, T value, SetT setState) {
+		if ((known & bit) != 0 && current == value) {
+			skippedStateSets++;
+			return;
+		}
+		setState(value);
+		current = value;
+		known |= bit;
+		stateSets++;
+	}
+
+	bool HexDynamicState::bindPipeline(HexPipeline &pipeline, const RenderState &state) {
+		bool bound = &pipeline != boundPipeline;
+		if (bound) {
+			pipeline.bind(commandBuffer);
+			boundPipeline = &pipeline;
+			binds++;
+			// States the pipeline bakes override what was set
+			known &= pipeline.getDynamicRenderStates();
+		} else {
+			skippedBinds++;
+		}
+
+		uint32_t dynamic = pipeline.getDynamicRenderStates();
+		VkCommandBuffer cmd = commandBuffer;
+		if (dynamic & RenderState::CULL_MODE) {
+			set(RenderState::CULL_MODE, current.cullMode, state.cullMode, [&](VkCullModeFlags value) { cmdSetCullMode(cmd, value); });
+		}
+		if (dynamic & RenderState::FRONT_FACE) {
+			set(RenderState::FRONT_FACE, current.frontFace, state.frontFace, [&](VkFrontFace value) { cmdSetFrontFace(cmd, value); });
+		}
+		if (dynamic & RenderState::PRIMITIVE_TOPOLOGY) {
+			set(RenderState::PRIMITIVE_TOPOLOGY, current.topology, state.topology, [&](VkPrimitiveTopology value) { cmdSetPrimitiveTopology(cmd, value); });
+		}
+		if (dynamic & RenderState::DEPTH_TEST_ENABLE) {
+			set(RenderState::DEPTH_TEST_ENABLE, current.depthTestEnable, state.depthTestEnable, [&](VkBool32 value) { cmdSetDepthTestEnable(cmd, value); });
+		}
+		if (dynamic & RenderState::DEPTH_WRITE_ENABLE) {
+			set(RenderState::DEPTH_WRITE_ENABLE, current.depthWriteEnable, state.depthWriteEnable, [&](VkBool32 value) { cmdSetDepthWriteEnable(cmd, value); });
+		}
+		if (dynamic & RenderState::DEPTH_COMPARE_OP) {
+			set(RenderState::DEPTH_COMPARE_OP, current.depthCompareOp, state.depthCompareOp, [&](VkCompareOp value) { cmdSetDepthCompareOp(cmd, value); });
+		}
+		if (dynamic & RenderState::DEPTH_BIAS_ENABLE) {
+			set(RenderState::DEPTH_BIAS_ENABLE, current.depthBiasEnable, state.depthBiasEnable, [&](VkBool32 value) { cmdSetDepthBiasEnable(cmd, value); });
+		}
+		if (dynamic & RenderState::PRIMITIVE_RESTART_ENABLE) {
+			set(RenderState::PRIMITIVE_RESTART_ENABLE, current.primitiveRestartEnable, state.primitiveRestartEnable, [&](VkBool32 value) { cmdSetPrimitiveRestartEnable(cmd, value); });
+		}
+		if (dynamic & RenderState::POLYGON_MODE) {
+			set(RenderState::POLYGON_MODE, current.polygonMode, state.polygonMode, [&](VkPolygonMode value) { cmdSetPolygonMode(cmd, value); });
+		}
+		return bound;
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "HexPipeline.h"
+#include "hex_device.h"
+
+#include <cstdint>
+#include <string>
+
+namespace hex {
+
+	// Pipeline and render state of a command buffer being recorded by one system. Binding a
+	// pipeline already bound, or setting a dynamic state to the value it already has, records
+	// nothing. Counts what it records and skips, logged per frame on destruction.
+	class HexDynamicState {
+		public:
+		HexDynamicState(HexDevice &device, const std::string &name);
+		~HexDynamicState();
+
+		HexDynamicState(const HexDynamicState &) = delete;
+		HexDynamicState &operator=(const HexDynamicState &) = delete;
+
+		// Once per frame before the system binds anything, and again after anything else
+		// bound pipelines: nothing is known to be set
+		void begin(VkCommandBuffer commandBuffer);
+		// Binds unless bound, then sets the part of the state the pipeline takes from the command
+		// buffer. True when the pipeline was bound, resources bound with it may need binding again.
+		bool bindPipeline(HexPipeline &pipeline, const RenderState &state);
+
+		private:
+		template <typename T, typename SetT>
+		void set(uint32_t bit, T &current, T value, SetT setState);
+
+		std::string name;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		HexPipeline *boundPipeline = nullptr;
+		RenderState current;
+		// RenderState bits of the states set since begin
+		uint32_t known = 0;
+
+		PFN_vkCmdSetCullModeEXT cmdSetCullMode = nullptr;
+		PFN_vkCmdSetFrontFaceEXT cmdSetFrontFace = nullptr;
+		PFN_vkCmdSetPrimitiveTopologyEXT cmdSetPrimitiveTopology = nullptr;
+		PFN_vkCmdSetDepthTestEnableEXT cmdSetDepthTestEnable = nullptr;
+		PFN_vkCmdSetDepthWriteEnableEXT cmdSetDepthWriteEnable = nullptr;
+		PFN_vkCmdSetDepthCompareOpEXT cmdSetDepthCompareOp = nullptr;
+		PFN_vkCmdSetDepthBiasEnableEXT cmdSetDepthBiasEnable = nullptr;
+		PFN_vkCmdSetPrimitiveRestartEnableEXT cmdSetPrimitiveRestartEnable = nullptr;
+		PFN_vkCmdSetPolygonModeEXT cmdSetPolygonMode = nullptr;
+
+		uint64_t frames = 0;
+		uint64_t binds = 0;
+		uint64_t skippedBinds = 0;
+		uint64_t stateSets = 0;
+		uint64_t skippedStateSets = 0;
+	};
+}
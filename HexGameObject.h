@@ -1,6 +1,10 @@
 #pragma once 
 
+#include "HexCellField.h"
 #include "HexModel.h"
+#include "HexPagedModel.h"
+#include "HexSeriesModel.h"
+#include "HexVolumeModel.h"
 
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -62,8 +66,19 @@ namespace hex {
 		id_t getId() { return id; }
 
 		std::shared_ptr<HexModel> model{};
+		// Mesh too large for the GPU, streamed in pages instead of model
+		std::shared_ptr<HexPagedModel> pagedModel{};
+		// Time series played back instead of model
+		std::shared_ptr<HexSeriesModel> series{};
 		glm::vec3 color{};
 		TransformComponent transform{};
+		// Level of detail drawn last frame, the renderer keeps it unless the error moves out of its hysteresis band
+		uint32_t lod{0};
+		// Per cell attribute shown instead of the vertex colors (volume mesh models only)
+		std::shared_ptr<HexCellField> cellField{};
+		// Volume the model boundary was extracted from, with a field it's drawn through cellFilter
+		std::shared_ptr<HexVolumeModel> volume{};
+		HexCellFilter cellFilter{};
 
 		private:
 		
@@ -0,0 +1,321 @@
+#include "HexGeometryArena.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace hex {
+
+	HexGeometryArena::HexGeometryArena(HexDevice &device) : hexDevice{device} {
+		pools.resize(VERTEX_FORMAT_COUNT + 1);
+		for (uint32_t format = 0; format < VERTEX_FORMAT_COUNT; format++) {
+			Pool &pool = pools[format];
+			pool.streams.resize(2);
+			pool.streams[POSITION_STREAM].stride = positionStride(static_cast<HexVertexFormat>(format));
+			pool.streams[ATTRIBUTE_STREAM].stride = attributeStride(static_cast<HexVertexFormat>(format));
+			// Storage usage lets mesh shaders pull vertices
+			pool.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		}
+
+		indexPool = VERTEX_FORMAT_COUNT;
+		pools[indexPool].streams.resize(1);
+		pools[indexPool].streams[0].stride = sizeof(uint32_t);
+		pools[indexPool].usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+	}
+
+	HexGeometryArena::~HexGeometryArena() {
+		for (auto &pool : pools) {
+			for (auto &stream : pool.streams) {
+				if (stream.buffer != VK_NULL_HANDLE) {
+					vkDestroyBuffer(hexDevice.device(), stream.buffer, nullptr);
+					vkFreeMemory(hexDevice.device(), stream.memory, nullptr);
+				}
+			}
+		}
+	}
+
+	uint32_t HexGeometryArena::positionStride(HexVertexFormat format) {
+		switch (format) {
+			case HexVertexFormat::Float: return sizeof(FloatPosition);
+			case HexVertexFormat::Quantized: return sizeof(QuantizedPosition);
+		}
+		throw std::runtime_error("Unsupported vertex format");
+	}
+
+	uint32_t HexGeometryArena::attributeStride(HexVertexFormat format) {
+		switch (format) {
+			case HexVertexFormat::Float: return sizeof(FloatAttributes);
+			case HexVertexFormat::Quantized: return sizeof(QuantizedAttributes);
+		}
+		throw std::runtime_error("Unsupported vertex format");
+	}
+
+	HexGeometryArena::AllocationId HexGeometryArena::allocateVertices(HexVertexFormat format, const void *positions, const void *attributes, uint32_t vertexCount) {
+		const void *data[] = {positions, attributes};
+		return allocate(poolIndex(format), data, vertexCount);
+	}
+
+	HexGeometryArena::AllocationId HexGeometryArena::allocateIndices(const uint32_t *data, uint32_t indexCount) {
+		const void *streams[] = {data};
+		return allocate(indexPool, streams, indexCount);
+	}
+
+	HexGeometryArena::AllocationId HexGeometryArena::allocate(uint32_t poolIndex, const void *const *data, uint32_t count) {
+		assert(count > 0 && "Cannot allocate empty geometry");
+
+		Pool &pool = pools[poolIndex];
+		uint32_t offset = reserve(pool, count);
+		for (size_t stream = 0; stream < pool.streams.size(); stream++) {
+			upload(pool.streams[stream], offset, data[stream], count);
+		}
+
+		AllocationId id;
+		if (!freeAllocationIds.empty()) {
+			id = freeAllocationIds.back();
+			freeAllocationIds.pop_back();
+		} else {
+			id = static_cast<AllocationId>(allocations.size());
+			allocations.emplace_back();
+		}
+		allocations[id] = {poolIndex, offset, count, true};
+		return id;
+	}
+
+	void HexGeometryArena::free(AllocationId allocation) {
+		if (allocation == INVALID_ALLOCATION) return;
+
+		Allocation &record = allocations[allocation];
+		assert(record.live && "Geometry allocation freed twice");
+		release(pools[record.pool], record.offset, record.count);
+		record.live = false;
+		freeAllocationIds.push_back(allocation);
+	}
+
+	// First fit in the holes, then the end of the pool, then grow the pool
+	uint32_t HexGeometryArena::reserve(Pool &pool, uint32_t count) {
+		for (auto it = pool.freeRanges.begin(); it != pool.freeRanges.end(); ++it) {
+			if (it->second < count) continue;
+
+			uint32_t offset = it->first;
+			uint32_t remaining = it->second - count;
+			pool.freeRanges.erase(it);
+			if (remaining > 0) pool.freeRanges[offset + count] = remaining;
+			return offset;
+		}
+
+		uint64_t end = static_cast<uint64_t>(pool.used) + count;
+		if (end > pool.capacity) {
+			grow(pool, end);
+		}
+
+		uint32_t offset = pool.used;
+		pool.used += count;
+		return offset;
+	}
+
+	void HexGeometryArena::release(Pool &pool, uint32_t offset, uint32_t count) {
+		// Merge with the following free range
+		auto next = pool.freeRanges.find(offset + count);
+		if (next != pool.freeRanges.end()) {
+			count += next->second;
+			pool.freeRanges.erase(next);
+		}
+
+		// Merge with the preceding free range
+		auto it = pool.freeRanges.lower_bound(offset);
+		if (it != pool.freeRanges.begin()) {
+			auto previous = std::prev(it);
+			if (previous->first + previous->second == offset) {
+				offset = previous->first;
+				count += previous->second;
+				pool.freeRanges.erase(previous);
+			}
+		}
+
+		// A hole at the end just shrinks the used range
+		if (offset + count == pool.used) {
+			pool.used = offset;
+		} else {
+			pool.freeRanges[offset] = count;
+		}
+	}
+
+	void HexGeometryArena::createStreamBuffer(const Pool &pool, const Stream &stream, uint32_t capacity, VkBuffer &buffer, VkDeviceMemory &memory) {
+		hexDevice.createBuffer(
+			static_cast<VkDeviceSize>(capacity) * stream.stride,
+			pool.usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			buffer,
+			memory
+		);
+	}
+
+	void HexGeometryArena::grow(Pool &pool, uint64_t minCapacity) {
+		// Offsets are 32 bits, and pools read by shaders must fit one storage buffer range
+		uint32_t maxStride = 0;
+		for (auto &stream : pool.streams) maxStride = std::max(maxStride, stream.stride);
+		VkDeviceSize maxSize = std::numeric_limits<VkDeviceSize>::max();
+		if (pool.usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) maxSize = hexDevice.properties.limits.maxStorageBufferRange;
+		uint64_t maxCapacity = std::min<uint64_t>(UINT32_MAX, maxSize / maxStride);
+		if (minCapacity > maxCapacity) {
+			throw std::runtime_error("Geometry arena pool is full: " + std::to_string(minCapacity * maxStride)
+				+ " bytes needed in a stream, at most " + std::to_string(maxCapacity * maxStride));
+		}
+
+		VkDeviceSize initialSize = &pool == &pools[indexPool] ? INITIAL_INDEX_POOL_SIZE : INITIAL_VERTEX_POOL_SIZE;
+		uint64_t capacity = std::max<uint64_t>(pool.capacity, initialSize / maxStride);
+		while (capacity < minCapacity) capacity *= 2;
+		capacity = std::min(capacity, maxCapacity);
+
+		// In flight frames may still read the old buffers
+		if (pool.capacity > 0) vkDeviceWaitIdle(hexDevice.device());
+
+		for (auto &stream : pool.streams) {
+			VkBuffer buffer;
+			VkDeviceMemory memory;
+			createStreamBuffer(pool, stream, static_cast<uint32_t>(capacity), buffer, memory);
+
+			if (stream.buffer != VK_NULL_HANDLE) {
+				if (pool.used > 0) {
+					hexDevice.copyBuffer(stream.buffer, buffer, static_cast<VkDeviceSize>(pool.used) * stream.stride);
+				}
+				vkDestroyBuffer(hexDevice.device(), stream.buffer, nullptr);
+				vkFreeMemory(hexDevice.device(), stream.memory, nullptr);
+			}
+
+			stream.buffer = buffer;
+			stream.memory = memory;
+		}
+
+		pool.capacity = static_cast<uint32_t>(capacity);
+		generation++;
+	}
+
+	void HexGeometryArena::upload(const Stream &stream, uint32_t offset, const void *data, uint32_t count) {
+		VkDeviceSize size = static_cast<VkDeviceSize>(count) * stream.stride;
+
+		VkBuffer stagingBuffer;
+		VkDeviceMemory stagingBufferMemory;
+		hexDevice.createBuffer(
+			size,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			stagingBuffer,
+			stagingBufferMemory
+		);
+
+		void *mapped;
+		vkMapMemory(hexDevice.device(), stagingBufferMemory, 0, size, 0, &mapped);
+		memcpy(mapped, data, static_cast<size_t>(size));
+		vkUnmapMemory(hexDevice.device(), stagingBufferMemory);
+
+		hexDevice.copyBuffer(stagingBuffer, stream.buffer, size, 0, static_cast<VkDeviceSize>(offset) * stream.stride);
+
+		vkDestroyBuffer(hexDevice.device(), stagingBuffer, nullptr);
+		vkFreeMemory(hexDevice.device(), stagingBufferMemory, nullptr);
+	}
+
+	void HexGeometryArena::bind(VkCommandBuffer commandBuffer, HexVertexFormat format) {
+		const Pool &pool = pools[poolIndex(format)];
+		if (pool.capacity > 0) {
+			VkBuffer buffers[] = {pool.streams[POSITION_STREAM].buffer, pool.streams[ATTRIBUTE_STREAM].buffer};
+			VkDeviceSize offsets[] = {0, 0};
+			vkCmdBindVertexBuffers(commandBuffer, POSITION_STREAM, 2, buffers, offsets);
+		}
+		bindIndices(commandBuffer);
+	}
+
+	void HexGeometryArena::bindPositions(VkCommandBuffer commandBuffer, HexVertexFormat format) {
+		const Pool &pool = pools[poolIndex(format)];
+		if (pool.capacity > 0) {
+			VkBuffer buffers[] = {pool.streams[POSITION_STREAM].buffer};
+			VkDeviceSize offsets[] = {0};
+			vkCmdBindVertexBuffers(commandBuffer, POSITION_STREAM, 1, buffers, offsets);
+		}
+		bindIndices(commandBuffer);
+	}
+
+	void HexGeometryArena::bindIndices(VkCommandBuffer commandBuffer) {
+		VkBuffer indexBuffer = pools[indexPool].streams[0].buffer;
+		if (indexBuffer != VK_NULL_HANDLE) {
+			vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+		}
+	}
+
+	float HexGeometryArena::getFragmentation() const {
+		uint64_t used = 0;
+		uint64_t holes = 0;
+		for (auto &pool : pools) {
+			uint64_t stride = 0;
+			for (auto &stream : pool.streams) stride += stream.stride;
+			used += pool.used * stride;
+			for (auto &range : pool.freeRanges) holes += range.second * stride;
+		}
+		return used > 0 ? static_cast<float>(holes) / static_cast<float>(used) : 0.f;
+	}
+
+	void HexGeometryArena::compact() {
+		vkDeviceWaitIdle(hexDevice.device());
+
+		for (uint32_t poolIndex = 0; poolIndex < pools.size(); poolIndex++) {
+			Pool &pool = pools[poolIndex];
+			if (pool.freeRanges.empty()) continue;
+
+			// Live allocations of this pool in offset order
+			std::vector<AllocationId> live;
+			for (AllocationId id = 0; id < allocations.size(); id++) {
+				if (allocations[id].live && allocations[id].pool == poolIndex) live.push_back(id);
+			}
+			std::sort(live.begin(), live.end(), [&](AllocationId a, AllocationId b) {
+				return allocations[a].offset < allocations[b].offset;
+			});
+
+			// One copy region per allocation and stream, all in a single submission
+			VkCommandBuffer commandBuffer = hexDevice.beginSingleTimeCommands();
+			std::vector<VkBuffer> buffers(pool.streams.size());
+			std::vector<VkDeviceMemory> memories(pool.streams.size());
+			std::vector<VkBufferCopy> regions;
+			regions.reserve(live.size());
+			for (size_t s = 0; s < pool.streams.size(); s++) {
+				const Stream &stream = pool.streams[s];
+				createStreamBuffer(pool, stream, pool.capacity, buffers[s], memories[s]);
+
+				regions.clear();
+				uint32_t offset = 0;
+				for (AllocationId id : live) {
+					const Allocation &allocation = allocations[id];
+					VkBufferCopy region{};
+					region.srcOffset = static_cast<VkDeviceSize>(allocation.offset) * stream.stride;
+					region.dstOffset = static_cast<VkDeviceSize>(offset) * stream.stride;
+					region.size = static_cast<VkDeviceSize>(allocation.count) * stream.stride;
+					regions.push_back(region);
+					offset += allocation.count;
+				}
+				if (!regions.empty()) {
+					vkCmdCopyBuffer(commandBuffer, stream.buffer, buffers[s], static_cast<uint32_t>(regions.size()), regions.data());
+				}
+			}
+			hexDevice.endSingleTimeCommands(commandBuffer);
+
+			for (size_t s = 0; s < pool.streams.size(); s++) {
+				Stream &stream = pool.streams[s];
+				vkDestroyBuffer(hexDevice.device(), stream.buffer, nullptr);
+				vkFreeMemory(hexDevice.device(), stream.memory, nullptr);
+				stream.buffer = buffers[s];
+				stream.memory = memories[s];
+			}
+
+			uint32_t offset = 0;
+			for (AllocationId id : live) {
+				allocations[id].offset = offset;
+				offset += allocations[id].count;
+			}
+			pool.used = offset;
+			pool.freeRanges.clear();
+			generation++;
+		}
+	}
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "hex_device.h"
+#include "HexVertexFormats.h"
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace hex {
+
+	// Device local buffers shared by every model: one vertex pool per vertex format, made of a
+	// position stream and an attribute stream at the same offsets, and one index buffer,
+	// suballocated with a free list. Models only keep allocation ids, so
+	// buffers can grow or be compacted without them noticing, and a frame binds the
+	// buffers once per vertex format instead of once per object.
+	class HexGeometryArena {
+		public:
+		using AllocationId = uint32_t;
+		static constexpr AllocationId INVALID_ALLOCATION = ~0u;
+
+		// Initial pool sizes, pools double when full. Vertex pools stop at maxStorageBufferRange.
+		static constexpr VkDeviceSize INITIAL_VERTEX_POOL_SIZE = 16 * 1024 * 1024;
+		static constexpr VkDeviceSize INITIAL_INDEX_POOL_SIZE = 16 * 1024 * 1024;
+
+		HexGeometryArena(HexDevice &device);
+		~HexGeometryArena();
+
+		HexGeometryArena(const HexGeometryArena &) = delete;
+		HexGeometryArena &operator=(const HexGeometryArena &) = delete;
+
+		HexDevice &getDevice() { return hexDevice; }
+
+		// Streams of a vertex pool, also their vertex input bindings
+		static constexpr uint32_t POSITION_STREAM = 0;
+		static constexpr uint32_t ATTRIBUTE_STREAM = 1;
+
+		// Upload vertexCount vertices of the given format, both streams already encoded
+		// (e.g. FloatPosition and FloatAttributes)
+		AllocationId allocateVertices(HexVertexFormat format, const void *positions, const void *attributes, uint32_t vertexCount);
+		AllocationId allocateIndices(const uint32_t *data, uint32_t indexCount);
+		// The GPU must be done with the allocation (same rule as destroying a buffer)
+		void free(AllocationId allocation);
+
+		// Offset of the allocation in its pool, in vertices or indices (firstVertex / vertexOffset / firstIndex)
+		uint32_t getOffset(AllocationId allocation) const { return allocations[allocation].offset; }
+		uint32_t getCount(AllocationId allocation) const { return allocations[allocation].count; }
+
+		// Both streams of the format and the index buffer
+		void bind(VkCommandBuffer commandBuffer, HexVertexFormat format);
+		// Position stream of the format and the index buffer, for depth only passes
+		void bindPositions(VkCommandBuffer commandBuffer, HexVertexFormat format);
+
+		// Raw pool buffers, for shaders reading geometry as storage buffers
+		VkBuffer getVertexBuffer(HexVertexFormat format, uint32_t stream) const { return pools[poolIndex(format)].streams[stream].buffer; }
+		VkBuffer getIndexBuffer() const { return pools[indexPool].streams[0].buffer; }
+		uint32_t getVertexStride(HexVertexFormat format, uint32_t stream) const { return pools[poolIndex(format)].streams[stream].stride; }
+		// Changes whenever a pool buffer is replaced or allocations move, descriptors of the buffers must then be rewritten
+		uint64_t getGeneration() const { return generation; }
+
+		// Fraction of the used range lost in holes, over all pools
+		float getFragmentation() const;
+		// Move every live allocation to the start of fresh buffers, waits for the device to be idle
+		void compact();
+
+		private:
+		struct Stream {
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			// Element size in bytes
+			uint32_t stride = 0;
+		};
+
+		struct Pool {
+			// Element i of an allocation is at the same offset in every stream
+			std::vector<Stream> streams;
+			VkBufferUsageFlags usage = 0;
+			// Capacity in elements
+			uint32_t capacity = 0;
+			// End of the highest allocation
+			uint32_t used = 0;
+			// Free ranges (offset -> count), adjacent ranges are merged
+			std::map<uint32_t, uint32_t> freeRanges;
+		};
+
+		struct Allocation {
+			uint32_t pool;
+			uint32_t offset;
+			uint32_t count;
+			bool live;
+		};
+
+		static uint32_t positionStride(HexVertexFormat format);
+		static uint32_t attributeStride(HexVertexFormat format);
+		uint32_t poolIndex(HexVertexFormat format) const { return static_cast<uint32_t>(format); }
+		void bindIndices(VkCommandBuffer commandBuffer);
+
+		// One data pointer per stream of the pool
+		AllocationId allocate(uint32_t poolIndex, const void *const *data, uint32_t count);
+		uint32_t reserve(Pool &pool, uint32_t count);
+		void release(Pool &pool, uint32_t offset, uint32_t count);
+		void grow(Pool &pool, uint64_t minCapacity);
+		void createStreamBuffer(const Pool &pool, const Stream &stream, uint32_t capacity, VkBuffer &buffer, VkDeviceMemory &memory);
+		void upload(const Stream &stream, uint32_t offset, const void *data, uint32_t count);
+
+		HexDevice &hexDevice;
+
+		// Vertex pools indexed by HexVertexFormat, index pool last
+		std::vector<Pool> pools;
+		uint32_t indexPool;
+
+		std::vector<Allocation> allocations;
+		std::vector<AllocationId> freeAllocationIds;
+		uint64_t generation = 0;
+	};
+}
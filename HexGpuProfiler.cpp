@@ -0,0 +1,146 @@
+#include "HexGpuProfiler.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace hex {
+
+	namespace {
+		// Begin and end timestamp
+		const uint32_t queriesPerScope = 2;
+	}
+
+	HexGpuProfiler::HexGpuProfiler(HexDevice &device, uint32_t framesInFlight) : hexDevice{device}, framesInFlight{framesInFlight} {
+		const VkPhysicalDeviceLimits &limits = hexDevice.properties.limits;
+		if (!limits.timestampComputeAndGraphics) {
+			throw std::runtime_error("Device has no timestamps on its graphics queues");
+		}
+		nanosecondsPerTick = static_cast<double>(limits.timestampPeriod);
+
+		VkQueryPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		poolInfo.queryCount = framesInFlight * MAX_SCOPES * queriesPerScope;
+		if (vkCreateQueryPool(hexDevice.device(), &poolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create timestamp query pool");
+		}
+
+		frames.resize(framesInFlight);
+		results.resize(MAX_SCOPES * queriesPerScope);
+	}
+
+	HexGpuProfiler::~HexGpuProfiler() {
+		report();
+		vkDestroyQueryPool(hexDevice.device(), queryPool, nullptr);
+	}
+
+	void HexGpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+		current = frameIndex % framesInFlight;
+		Frame &frame = frames[current];
+		if (frame.pending) collect(current);
+
+		frame.scopes.clear();
+		frame.open.clear();
+		frame.queryCount = 0;
+		vkCmdResetQueryPool(commandBuffer, queryPool, current * MAX_SCOPES * queriesPerScope, MAX_SCOPES * queriesPerScope);
+
+		beginScope(commandBuffer, "frame");
+	}
+
+	void HexGpuProfiler::endFrame(VkCommandBuffer commandBuffer) {
+		Frame &frame = frames[current];
+		while (!frame.open.empty()) endScope(commandBuffer);
+		frame.pending = true;
+	}
+
+	void HexGpuProfiler::beginScope(VkCommandBuffer commandBuffer, const std::string &name) {
+		Frame &frame = frames[current];
+		if (frame.queryCount + queriesPerScope > MAX_SCOPES * queriesPerScope) {
+			frame.open.push_back(NOT_TIMED);
+			return;
+		}
+
+		// Under the innermost timed scope, the frame scope is the root and isn't part of the paths
+		std::string path = name;
+		for (size_t i = frame.open.size(); i-- > 1;) {
+			if (frame.open[i] == NOT_TIMED) continue;
+			path = frame.scopes[frame.open[i]].path + '/' + name;
+			break;
+		}
+
+		uint32_t firstQuery = current * MAX_SCOPES * queriesPerScope + frame.queryCount;
+		frame.queryCount += queriesPerScope;
+		frame.open.push_back(static_cast<uint32_t>(frame.scopes.size()));
+		frame.scopes.push_back({path, firstQuery});
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, firstQuery);
+	}
+
+	void HexGpuProfiler::endScope(VkCommandBuffer commandBuffer) {
+		Frame &frame = frames[current];
+		if (frame.open.empty()) return;
+		uint32_t scope = frame.open.back();
+		frame.open.pop_back();
+		if (scope == NOT_TIMED) return;
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, frame.scopes[scope].firstQuery + 1);
+	}
+
+	void HexGpuProfiler::collect(uint32_t frameSlot) {
+		Frame &frame = frames[frameSlot];
+		frame.pending = false;
+		if (frame.queryCount == 0) return;
+
+		// The frame's fence was waited for, results are only missing if the frame was never submitted
+		VkResult result = vkGetQueryPoolResults(
+			hexDevice.device(), queryPool, frameSlot * MAX_SCOPES * queriesPerScope, frame.queryCount,
+			frame.queryCount * sizeof(uint64_t), results.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+		if (result != VK_SUCCESS) return;
+
+		uint32_t base = frameSlot * MAX_SCOPES * queriesPerScope;
+		for (const Scope &scope : frame.scopes) {
+			uint64_t begin = results[scope.firstQuery - base];
+			uint64_t end = results[scope.firstQuery - base + 1];
+			double milliseconds = end > begin ? static_cast<double>(end - begin) * nanosecondsPerTick * 1e-6 : 0.0;
+
+			auto it = std::find_if(stats.begin(), stats.end(), [&](const Stat &stat) { return stat.path == scope.path; });
+			if (it == stats.end()) {
+				stats.push_back({scope.path});
+				it = stats.end() - 1;
+			}
+			it->milliseconds += milliseconds;
+			it->samples++;
+		}
+
+		collectedFrames++;
+		if (collectedFrames % REPORT_FRAMES == 0) report();
+	}
+
+	void HexGpuProfiler::addCount(const std::string &name, uint64_t value) {
+		auto it = std::find_if(counts.begin(), counts.end(), [&](const Count &count) { return count.name == name; });
+		if (it == counts.end()) {
+			counts.push_back({name});
+			it = counts.end() - 1;
+		}
+		it->total += value;
+		it->samples++;
+	}
+
+	void HexGpuProfiler::report() {
+		if (collectedFrames == 0) return;
+		std::cout << "GPU time over " << collectedFrames << " frames:";
+		for (const Stat &stat : stats) {
+			std::cout << ' ' << stat.path << ' ' << stat.milliseconds / static_cast<double>(stat.samples) << " ms"
+				<< (stat.samples < collectedFrames ? " (some frames)," : ",");
+		}
+		for (const Count &count : counts) {
+			std::cout << ' ' << count.name << ' ' << static_cast<double>(count.total) / static_cast<double>(count.samples) << ',';
+		}
+		std::cout << std::endl;
+	}
+
+	void HexGpuProfiler::reset() {
+		stats.clear();
+		counts.clear();
+		collectedFrames = 0;
+	}
+}
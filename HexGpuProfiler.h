@@ -0,0 +1,84 @@
+#pragma once
+
+#include "hex_device.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace hex {
+
+	// GPU time of named scopes of the frame, from timestamp queries. Each frame in flight has
+	// its own queries, read back when the frame index comes around again (its fence was waited
+	// for), so reading never stalls. Averages are logged every REPORT_FRAMES frames.
+	class HexGpuProfiler {
+		public:
+		static constexpr uint32_t MAX_SCOPES = 32;
+		static constexpr uint32_t REPORT_FRAMES = 600;
+
+		// Throws when the device can't time its graphics and compute queues
+		HexGpuProfiler(HexDevice &device, uint32_t framesInFlight);
+		~HexGpuProfiler();
+
+		HexGpuProfiler(const HexGpuProfiler &) = delete;
+		HexGpuProfiler &operator=(const HexGpuProfiler &) = delete;
+
+		// First and last commands of the frame, outside any render pass. The whole frame is a scope.
+		void beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+		void endFrame(VkCommandBuffer commandBuffer);
+		// Scopes nest, they're reported by path ("scene/depth prepass"). Scopes past
+		// MAX_SCOPES in a frame aren't timed.
+		void beginScope(VkCommandBuffer commandBuffer, const std::string &name);
+		void endScope(VkCommandBuffer commandBuffer);
+		// A count of the frame, e.g. objects culled, its average is logged with the timings
+		void addCount(const std::string &name, uint64_t value);
+
+		// Averages since the last reset, e.g. before switching a rendering mode
+		void report();
+		void reset();
+
+		private:
+		static constexpr uint32_t NOT_TIMED = ~0u;
+
+		struct Scope {
+			std::string path;
+			uint32_t firstQuery;
+		};
+
+		struct Frame {
+			std::vector<Scope> scopes;
+			// Scopes begun and not ended, NOT_TIMED for those over the limit
+			std::vector<uint32_t> open;
+			uint32_t queryCount = 0;
+			bool pending = false;
+		};
+
+		struct Stat {
+			std::string path;
+			double milliseconds = 0.0;
+			uint64_t samples = 0;
+		};
+
+		struct Count {
+			std::string name;
+			uint64_t total = 0;
+			uint64_t samples = 0;
+		};
+
+		void collect(uint32_t frame);
+
+		HexDevice &hexDevice;
+		uint32_t framesInFlight;
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		double nanosecondsPerTick;
+
+		std::vector<Frame> frames;
+		uint32_t current = 0;
+		std::vector<uint64_t> results;
+
+		// In order of first appearance
+		std::vector<Stat> stats;
+		std::vector<Count> counts;
+		uint64_t collectedFrames = 0;
+	};
+}
@@ -0,0 +1,57 @@
+#include "HexMappedFile.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hex {
+
+	HexMappedFile::HexMappedFile(const std::string &filepath, bool randomAccess) : filepath{filepath} {
+		int fd = open(filepath.c_str(), O_RDONLY);
+		if (fd < 0) {
+			throw std::runtime_error("failed to open file: " + filepath);
+		}
+
+		struct stat fileStat;
+		if (fstat(fd, &fileStat) != 0) {
+			close(fd);
+			throw std::runtime_error("failed to stat file: " + filepath);
+		}
+		fileSize = static_cast<size_t>(fileStat.st_size);
+
+		// mmap doesn't accept empty mappings, an empty file just has no data
+		if (fileSize > 0) {
+			mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapping == MAP_FAILED) {
+				mapping = nullptr;
+				close(fd);
+				throw std::runtime_error("failed to map file: " + filepath);
+			}
+			// Start paging in files read whole, random access ones only fault in what they touch
+			madvise(mapping, fileSize, randomAccess ? MADV_RANDOM : MADV_WILLNEED);
+		}
+
+		// Mapping stays valid after closing the descriptor
+		close(fd);
+	}
+
+	HexMappedFile::~HexMappedFile() {
+		if (mapping != nullptr) {
+			munmap(mapping, fileSize);
+		}
+	}
+
+	void HexMappedFile::prefetch(size_t offset, size_t size) const {
+		if (mapping == nullptr || offset >= fileSize) return;
+
+		// madvise takes page aligned addresses
+		size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		size_t start = offset / pageSize * pageSize;
+		size_t end = std::min(offset + size, fileSize);
+		madvise(static_cast<char*>(mapping) + start, end - start, MADV_WILLNEED);
+	}
+}
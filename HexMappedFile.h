@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace hex {
+
+	// Read only memory mapping of a whole file, unmapped on destruction
+	class HexMappedFile {
+		public:
+		// Files read from start to end are paged in ahead. Random access files (page files
+		// larger than memory) only read what is touched.
+		HexMappedFile(const std::string &filepath, bool randomAccess = false);
+		~HexMappedFile();
+
+		HexMappedFile(const HexMappedFile &) = delete;
+		HexMappedFile &operator=(const HexMappedFile &) = delete;
+
+		const char *data() const { return static_cast<const char*>(mapping); }
+		size_t size() const { return fileSize; }
+		const std::string &path() const { return filepath; }
+
+		// Start reading a range in the background, for random access files read in order
+		void prefetch(size_t offset, size_t size) const;
+
+		private:
+		std::string filepath;
+		void *mapping = nullptr;
+		size_t fileSize = 0;
+	};
+}
@@ -0,0 +1,333 @@
+#include "HexMeshCache.h"
+#include "HexParallel.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace hex {
+
+	namespace {
+
+		const char cacheMagic[8] = {'H', 'E', 'X', 'M', 'E', 'S', 'H', '\0'};
+
+		// Blocks hashed independently, then block hashes are hashed in order
+		const size_t hashBlockSize = 1 << 20;
+		// Sampled hashes read this many blocks of this size, first and last included
+		const size_t sampleBlockCount = 256;
+		const size_t sampleBlockSize = 1 << 16;
+
+		const uint64_t prime1 = 0x9E3779B185EBCA87ull;
+		const uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+
+		inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+		inline uint64_t mix(uint64_t hash, uint64_t value) {
+			hash ^= rotl(value * prime2, 31) * prime1;
+			return rotl(hash, 27) * prime1 + prime2;
+		}
+
+		uint64_t hashBytes(const char *data, size_t size, uint64_t seed) {
+			uint64_t hash = seed ^ (size * prime1);
+			size_t i = 0;
+			for (; i + 8 <= size; i += 8) {
+				uint64_t word;
+				memcpy(&word, data + i, 8);
+				hash = mix(hash, word);
+			}
+			uint64_t tail = 0;
+			memcpy(&tail, data + i, size - i);
+			hash = mix(hash, tail);
+
+			// Final avalanche
+			hash ^= hash >> 33;
+			hash *= prime2;
+			hash ^= hash >> 29;
+			return hash;
+		}
+
+		uint64_t alignUp(uint64_t value, uint64_t alignment) {
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		// Written so that corrupt offsets and counts can't overflow
+		bool blobFits(uint64_t offset, uint64_t count, uint64_t stride, uint64_t fileSize) {
+			return offset % HexMeshCache::BLOB_ALIGNMENT == 0 && offset >= sizeof(HexMeshCache::Header)
+				&& offset <= fileSize && count <= (fileSize - offset) / stride;
+		}
+
+		// Element sizes of the two vertex streams of a format, 0 for unknown formats
+		void streamStrides(uint32_t format, uint32_t &positionStride, uint32_t &attributeStride) {
+			switch (static_cast<HexVertexFormat>(format)) {
+				case HexVertexFormat::Float:
+					positionStride = sizeof(FloatPosition);
+					attributeStride = sizeof(FloatAttributes);
+					return;
+				case HexVertexFormat::Quantized:
+					positionStride = sizeof(QuantizedPosition);
+					attributeStride = sizeof(QuantizedAttributes);
+					return;
+			}
+			positionStride = attributeStride = 0;
+		}
+
+		// Meshlets index the vertices and the full resolution triangles, and their local
+		// triangle indices their own vertex range
+		bool meshletsValid(const HexMeshCache::Header &header, const HexMeshlet *meshlets, const uint32_t *vertices, const uint32_t *triangles, const HexModel::Lod *lods) {
+			uint64_t fullTriangles = header.lodCount > 0 ? lods[0].indexCount / 3 : header.indexCount / 3;
+			for (uint64_t i = 0; i < header.meshletCount; i++) {
+				const HexMeshlet &meshlet = meshlets[i];
+				if (meshlet.vertexCount > HexMeshletBuilder::MAX_VERTICES || meshlet.triangleCount > HexMeshletBuilder::MAX_TRIANGLES
+					|| static_cast<uint64_t>(meshlet.vertexOffset) + meshlet.vertexCount > header.meshletVertexCount
+					|| static_cast<uint64_t>(meshlet.triangleOffset) + meshlet.triangleCount > header.meshletTriangleCount
+					|| static_cast<uint64_t>(meshlet.triangleOffset) + meshlet.triangleCount > fullTriangles)
+					return false;
+			}
+
+			std::atomic<bool> invalid{false};
+			parallelFor(header.meshletCount, 1 << 10, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end && !invalid; i++) {
+					const HexMeshlet &meshlet = meshlets[i];
+					for (uint32_t v = 0; v < meshlet.vertexCount; v++) {
+						if (vertices[meshlet.vertexOffset + v] >= header.vertexCount) invalid = true;
+					}
+					for (uint32_t t = 0; t < meshlet.triangleCount; t++) {
+						uint32_t packed = triangles[meshlet.triangleOffset + t];
+						if ((packed & 0xff) >= meshlet.vertexCount || (packed >> 8 & 0xff) >= meshlet.vertexCount
+							|| (packed >> 16 & 0xff) >= meshlet.vertexCount || (packed >> 24) != 0)
+							invalid = true;
+					}
+				}
+			});
+			return !invalid;
+		}
+	}
+
+	HexMeshCache::HexMeshCache(std::unique_ptr<HexMappedFile> file) : file{std::move(file)} {
+		header = reinterpret_cast<const Header*>(this->file->data());
+	}
+
+	std::string HexMeshCache::cachePath(const std::string &sourcePath) {
+		return sourcePath + ".hexcache";
+	}
+
+	uint64_t HexMeshCache::hashFile(const HexMappedFile &file) {
+		size_t blockCount = (file.size() + hashBlockSize - 1) / hashBlockSize;
+		std::vector<uint64_t> blockHashes(blockCount);
+
+		parallelTasks(blockCount, [&](size_t block) {
+			size_t begin = block * hashBlockSize;
+			size_t size = std::min(hashBlockSize, file.size() - begin);
+			blockHashes[block] = hashBytes(file.data() + begin, size, block);
+		});
+
+		return hashBytes(reinterpret_cast<const char*>(blockHashes.data()), blockHashes.size() * sizeof(uint64_t), file.size());
+	}
+
+	uint64_t HexMeshCache::hashFileSampled(const HexMappedFile &file) {
+		if (file.size() <= sampleBlockCount * sampleBlockSize) return hashFile(file);
+
+		std::vector<uint64_t> blockHashes(sampleBlockCount + 1);
+		size_t lastBegin = file.size() - sampleBlockSize;
+		parallelTasks(sampleBlockCount, [&](size_t block) {
+			size_t begin = static_cast<size_t>(static_cast<uint64_t>(lastBegin) * block / (sampleBlockCount - 1));
+			blockHashes[block] = hashBytes(file.data() + begin, sampleBlockSize, block);
+		});
+
+		struct stat fileStat;
+		blockHashes[sampleBlockCount] = stat(file.path().c_str(), &fileStat) == 0 ? static_cast<uint64_t>(fileStat.st_mtime) : 0;
+
+		return hashBytes(reinterpret_cast<const char*>(blockHashes.data()), blockHashes.size() * sizeof(uint64_t), file.size());
+	}
+
+	std::unique_ptr<HexMeshCache> HexMeshCache::open(const std::string &sourcePath, uint64_t sourceSize, uint64_t sourceHash, HexVertexFormat format) {
+		std::unique_ptr<HexMappedFile> file;
+		try {
+			file = std::make_unique<HexMappedFile>(cachePath(sourcePath));
+		} catch (const std::runtime_error &) {
+			// No cache yet
+			return nullptr;
+		}
+
+		if (file->size() < sizeof(Header))
+			return nullptr;
+
+		Header header;
+		memcpy(&header, file->data(), sizeof(Header));
+
+		// Any layout change bumps the version or changes a stride, old caches are just rebuilt.
+		// Caches of another vertex format are rebuilt too.
+		uint32_t positionStride;
+		uint32_t attributeStride;
+		streamStrides(static_cast<uint32_t>(format), positionStride, attributeStride);
+		if (memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0
+			|| header.version != VERSION
+			|| header.vertexFormat != static_cast<uint32_t>(format)
+			|| header.positionStride != positionStride
+			|| header.attributeStride != attributeStride
+			|| header.indexStride != sizeof(uint32_t)
+			|| header.lodStride != sizeof(HexModel::Lod)
+			|| header.meshletStride != sizeof(HexMeshlet)
+			|| header.sourceSize != sourceSize
+			|| header.sourceHash != sourceHash)
+			return nullptr;
+
+		if (header.vertexCount < 3 || header.vertexCount > UINT32_MAX || header.indexCount > UINT32_MAX || header.lodCount > UINT32_MAX
+			|| header.meshletCount > UINT32_MAX || header.meshletVertexCount > UINT32_MAX || header.meshletTriangleCount > UINT32_MAX
+			|| header.indexCount % 3 != 0 || (header.triangleCellCount != 0 && header.triangleCellCount * 3 != header.indexCount)
+			|| !blobFits(header.positionOffset, header.vertexCount, header.positionStride, file->size())
+			|| !blobFits(header.attributeOffset, header.vertexCount, header.attributeStride, file->size())
+			|| !blobFits(header.indexOffset, header.indexCount, header.indexStride, file->size())
+			|| !blobFits(header.lodOffset, header.lodCount, header.lodStride, file->size())
+			|| !blobFits(header.triangleCellOffset, header.triangleCellCount, sizeof(uint32_t), file->size())
+			|| !blobFits(header.meshletOffset, header.meshletCount, header.meshletStride, file->size())
+			|| !blobFits(header.meshletVertexOffset, header.meshletVertexCount, sizeof(uint32_t), file->size())
+			|| !blobFits(header.meshletTriangleOffset, header.meshletTriangleCount, sizeof(uint32_t), file->size()))
+			return nullptr;
+
+		// A corrupt cache must not make draws read out of bounds, it's rebuilt instead
+		auto cache = std::unique_ptr<HexMeshCache>(new HexMeshCache(std::move(file)));
+		const uint32_t *indices = cache->indices();
+		std::atomic<bool> invalidIndex{false};
+		parallelFor(header.indexCount, 1 << 16, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				if (indices[i] >= header.vertexCount) {
+					invalidIndex = true;
+					return;
+				}
+			}
+		});
+		if (invalidIndex)
+			return nullptr;
+
+		const HexModel::Lod *lods = cache->lods();
+		for (uint64_t i = 0; i < header.lodCount; i++) {
+			if (lods[i].indexCount % 3 != 0 || static_cast<uint64_t>(lods[i].firstIndex) + lods[i].indexCount > header.indexCount)
+				return nullptr;
+		}
+
+		const char *data = cache->file->data();
+		if (!meshletsValid(header, reinterpret_cast<const HexMeshlet*>(data + header.meshletOffset),
+			reinterpret_cast<const uint32_t*>(data + header.meshletVertexOffset),
+			reinterpret_cast<const uint32_t*>(data + header.meshletTriangleOffset), lods))
+			return nullptr;
+
+		return cache;
+	}
+
+	void HexMeshCache::write(const std::string &sourcePath, uint64_t sourceSize, uint64_t sourceHash, const HexModel::Builder &builder,
+		const HexModel::VertexStreams &vertices, const HexMeshletBuilder::Meshlets &meshlets) {
+		Header header{};
+		memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+		header.version = VERSION;
+		header.vertexFormat = static_cast<uint32_t>(vertices.format);
+		streamStrides(header.vertexFormat, header.positionStride, header.attributeStride);
+		header.indexStride = sizeof(uint32_t);
+		header.lodStride = sizeof(HexModel::Lod);
+		header.meshletStride = sizeof(HexMeshlet);
+		header.flags = builder.closed ? FLAG_CLOSED : 0;
+		header.vertexCount = builder.vertices.size();
+		header.indexCount = builder.indices.size();
+		header.lodCount = builder.lods.size();
+		header.triangleCellCount = builder.triangleCells.size();
+		header.meshletCount = meshlets.meshlets.size();
+		header.meshletVertexCount = meshlets.vertices.size();
+		header.meshletTriangleCount = meshlets.triangles.size();
+		header.sourceSize = sourceSize;
+		header.sourceHash = sourceHash;
+
+		if (vertices.positions.size() != header.vertexCount * header.positionStride
+			|| vertices.attributes.size() != header.vertexCount * header.attributeStride) {
+			throw std::runtime_error("mesh cache vertices don't match the builder: " + sourcePath);
+		}
+
+		// Blobs in file order, each one aligned
+		struct Blob {
+			uint64_t *offset;
+			const void *data;
+			uint64_t size;
+		};
+		Blob blobs[] = {
+			{&header.positionOffset, vertices.positions.data(), vertices.positions.size()},
+			{&header.attributeOffset, vertices.attributes.data(), vertices.attributes.size()},
+			{&header.indexOffset, builder.indices.data(), header.indexCount * header.indexStride},
+			{&header.lodOffset, builder.lods.data(), header.lodCount * header.lodStride},
+			{&header.triangleCellOffset, builder.triangleCells.data(), header.triangleCellCount * sizeof(uint32_t)},
+			{&header.meshletOffset, meshlets.meshlets.data(), header.meshletCount * header.meshletStride},
+			{&header.meshletVertexOffset, meshlets.vertices.data(), header.meshletVertexCount * sizeof(uint32_t)},
+			{&header.meshletTriangleOffset, meshlets.triangles.data(), header.meshletTriangleCount * sizeof(uint32_t)},
+		};
+		uint64_t end = sizeof(Header);
+		for (auto &blob : blobs) {
+			*blob.offset = alignUp(end, BLOB_ALIGNMENT);
+			end = *blob.offset + blob.size;
+		}
+
+		glm::vec3 boundsMin{0.f};
+		glm::vec3 boundsMax{0.f};
+		if (!builder.vertices.empty()) HexModel::computeBounds(builder.vertices, boundsMin, boundsMax);
+		for (int i = 0; i < 3; i++) {
+			header.boundsMin[i] = boundsMin[i];
+			header.boundsMax[i] = boundsMax[i];
+		}
+
+		std::string path = cachePath(sourcePath);
+		std::string temporaryPath = path + ".tmp";
+		{
+			std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+			if (!file.is_open()) {
+				throw std::runtime_error("failed to create mesh cache: " + temporaryPath);
+			}
+
+			const char padding[BLOB_ALIGNMENT] = {};
+			file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+			uint64_t written = sizeof(Header);
+			for (auto &blob : blobs) {
+				file.write(padding, *blob.offset - written);
+				file.write(reinterpret_cast<const char*>(blob.data), blob.size);
+				written = *blob.offset + blob.size;
+			}
+
+			if (!file) {
+				file.close();
+				std::remove(temporaryPath.c_str());
+				throw std::runtime_error("failed to write mesh cache: " + temporaryPath);
+			}
+		}
+
+		// Readers never see a half written cache
+		if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+			std::remove(temporaryPath.c_str());
+			throw std::runtime_error("failed to write mesh cache: " + path);
+		}
+	}
+
+	const uint32_t *HexMeshCache::indices() const {
+		return reinterpret_cast<const uint32_t*>(file->data() + header->indexOffset);
+	}
+
+	const HexModel::Lod *HexMeshCache::lods() const {
+		return reinterpret_cast<const HexModel::Lod*>(file->data() + header->lodOffset);
+	}
+
+	const uint32_t *HexMeshCache::triangleCells() const {
+		return reinterpret_cast<const uint32_t*>(file->data() + header->triangleCellOffset);
+	}
+
+	HexMeshletBuilder::Meshlets HexMeshCache::meshlets() const {
+		HexMeshletBuilder::Meshlets meshlets{};
+		const char *data = file->data();
+		auto *first = reinterpret_cast<const HexMeshlet*>(data + header->meshletOffset);
+		meshlets.meshlets.assign(first, first + header->meshletCount);
+		auto *vertices = reinterpret_cast<const uint32_t*>(data + header->meshletVertexOffset);
+		meshlets.vertices.assign(vertices, vertices + header->meshletVertexCount);
+		auto *triangles = reinterpret_cast<const uint32_t*>(data + header->meshletTriangleOffset);
+		meshlets.triangles.assign(triangles, triangles + header->meshletTriangleCount);
+		return meshlets;
+	}
+}
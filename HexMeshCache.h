@@ -0,0 +1,103 @@
+#pragma once
+
+#include "HexModel.h"
+#include "HexMappedFile.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace hex {
+
+	// Binary mesh file stored next to its source as <source>.hexcache.
+	// Vertex streams are stored encoded in one vertex format, and the index, lod, triangle cell and
+	// meshlet blobs are laid out exactly like HexModel data, so loading is a mmap and a copy into
+	// the staging buffer. The cache is only used while the size and sampled hash of the source
+	// file match the ones recorded in its header, and for the format it was written with.
+	class HexMeshCache {
+		public:
+		static constexpr uint32_t VERSION = 8;
+		// Blobs start on this alignment, relative to the file start
+		static constexpr uint64_t BLOB_ALIGNMENT = 64;
+		// Header flags
+		static constexpr uint32_t FLAG_CLOSED = 1 << 0;
+
+		struct Header {
+			char magic[8];
+			uint32_t version;
+			// HexVertexFormat of the vertex streams
+			uint32_t vertexFormat;
+			uint32_t positionStride;
+			uint32_t attributeStride;
+			uint32_t indexStride;
+			uint32_t lodStride;
+			uint32_t meshletStride;
+			uint32_t flags;
+			uint64_t vertexCount;
+			uint64_t indexCount;
+			uint64_t lodCount;
+			uint64_t positionOffset;
+			uint64_t attributeOffset;
+			uint64_t indexOffset;
+			uint64_t lodOffset;
+			// Volume cell of each triangle, stored as uint32_t
+			uint64_t triangleCellCount;
+			uint64_t triangleCellOffset;
+			// HexMeshletBuilder::Meshlets arrays, meshlet vertices and triangles as uint32_t
+			uint64_t meshletCount;
+			uint64_t meshletOffset;
+			uint64_t meshletVertexCount;
+			uint64_t meshletVertexOffset;
+			uint64_t meshletTriangleCount;
+			uint64_t meshletTriangleOffset;
+			float boundsMin[4];
+			float boundsMax[4];
+			uint64_t sourceSize;
+			uint64_t sourceHash;
+		};
+
+		~HexMeshCache() = default;
+
+		HexMeshCache(const HexMeshCache &) = delete;
+		HexMeshCache &operator=(const HexMeshCache &) = delete;
+
+		static std::string cachePath(const std::string &sourcePath);
+
+		// 64 bits content hash, blocks are hashed in parallel (not cryptographic)
+		static uint64_t hashFile(const HexMappedFile &file);
+		// Hash of evenly spaced blocks and the modification time, for sources too large to read
+		// whole at every start. Edits keeping the size and time of the file go unnoticed.
+		static uint64_t hashFileSampled(const HexMappedFile &file);
+
+		// Returns nullptr when there's no valid cache for this source content and vertex format, or
+		// when its blobs don't fit the file or its indices the vertices (truncated or corrupt caches get rebuilt)
+		static std::unique_ptr<HexMeshCache> open(const std::string &sourcePath, uint64_t sourceSize, uint64_t sourceHash, HexVertexFormat format);
+
+		// Write the cache atomically (temporary file then rename). The vertices are the builder ones
+		// encoded (HexModel::encodeVertices), the meshlets built from the builder.
+		static void write(const std::string &sourcePath, uint64_t sourceSize, uint64_t sourceHash, const HexModel::Builder &builder,
+			const HexModel::VertexStreams &vertices, const HexMeshletBuilder::Meshlets &meshlets);
+
+		HexVertexFormat vertexFormat() const { return static_cast<HexVertexFormat>(header->vertexFormat); }
+		const void *positions() const { return file->data() + header->positionOffset; }
+		const void *attributes() const { return file->data() + header->attributeOffset; }
+		const uint32_t *indices() const;
+		const HexModel::Lod *lods() const;
+		const uint32_t *triangleCells() const;
+		// Copied out of the mapping, renderers keep them next to the model
+		HexMeshletBuilder::Meshlets meshlets() const;
+		uint32_t vertexCount() const { return static_cast<uint32_t>(header->vertexCount); }
+		uint32_t indexCount() const { return static_cast<uint32_t>(header->indexCount); }
+		uint32_t lodCount() const { return static_cast<uint32_t>(header->lodCount); }
+		uint32_t triangleCellCount() const { return static_cast<uint32_t>(header->triangleCellCount); }
+		bool closed() const { return (header->flags & FLAG_CLOSED) != 0; }
+		glm::vec3 boundsMin() const { return {header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]}; }
+		glm::vec3 boundsMax() const { return {header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]}; }
+
+		private:
+		HexMeshCache(std::unique_ptr<HexMappedFile> file);
+
+		std::unique_ptr<HexMappedFile> file;
+		const Header *header;
+	};
+}
@@ -0,0 +1,724 @@
+#include "HexMeshLoader.h"
+#include "HexParallel.h"
+#include "HexParsing.h"
+#include "HexVolumeLoader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace hex {
+
+	namespace {
+
+		// Color given to vertices when the file doesn't provide one
+		const glm::vec3 defaultColor{.9f, .9f, .9f};
+
+		// Part of a mesh parsed by one task, merged in file order at the end
+		struct MeshChunk {
+			std::vector<HexModel::Vertex> vertices;
+			std::vector<uint32_t> indices;
+			// OBJ negative indices are relative to the vertices read so far, they're stored as
+			// (entry in indices, index relative to this chunk first vertex) and fixed on merge
+			std::vector<std::pair<size_t, int64_t>> relativeIndices;
+		};
+
+		HexModel::Builder mergeChunks(std::vector<MeshChunk> &chunks, const std::string &filepath) {
+			std::vector<size_t> vertexBase(chunks.size() + 1, 0);
+			std::vector<size_t> indexBase(chunks.size() + 1, 0);
+			for (size_t i = 0; i < chunks.size(); i++) {
+				vertexBase[i + 1] = vertexBase[i] + chunks[i].vertices.size();
+				indexBase[i + 1] = indexBase[i] + chunks[i].indices.size();
+			}
+
+			size_t vertexCount = vertexBase.back();
+			if (vertexCount > std::numeric_limits<uint32_t>::max()) {
+				throw std::runtime_error("too many vertices for 32 bit indices in: " + filepath);
+			}
+
+			HexModel::Builder builder{};
+			builder.vertices.resize(vertexCount);
+			builder.indices.resize(indexBase.back());
+
+			std::atomic<bool> invalidIndex{false};
+
+			parallelTasks(chunks.size(), [&](size_t i) {
+				MeshChunk &chunk = chunks[i];
+				std::copy(chunk.vertices.begin(), chunk.vertices.end(), builder.vertices.begin() + vertexBase[i]);
+				std::copy(chunk.indices.begin(), chunk.indices.end(), builder.indices.begin() + indexBase[i]);
+
+				for (auto &relative : chunk.relativeIndices) {
+					int64_t index = static_cast<int64_t>(vertexBase[i]) + relative.second;
+					if (index < 0) invalidIndex = true;
+					builder.indices[indexBase[i] + relative.first] = static_cast<uint32_t>(index);
+				}
+
+				// Release chunk memory as soon as possible, big meshes are big
+				chunk = MeshChunk{};
+			});
+
+			parallelFor(builder.indices.size(), 1 << 16, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++) {
+					if (builder.indices[i] >= vertexCount) {
+						invalidIndex = true;
+						return;
+					}
+				}
+			});
+
+			if (invalidIndex) {
+				throw std::runtime_error("vertex index out of range in: " + filepath);
+			}
+
+			return builder;
+		}
+
+		// Corner of a polygon while it's being read
+		struct Corner {
+			int64_t index;
+			bool relative;
+		};
+
+		void addPolygon(MeshChunk &chunk, const std::vector<Corner> &corners, const std::string &filepath) {
+			auto push = [&](const Corner &corner) {
+				if (corner.relative) {
+					chunk.relativeIndices.emplace_back(chunk.indices.size(), corner.index);
+					chunk.indices.push_back(0);
+				} else {
+					chunk.indices.push_back(static_cast<uint32_t>(corner.index));
+				}
+			};
+
+			// Absolute indices must fit 32 bits before they're narrowed, relative ones are checked on merge
+			for (const Corner &corner : corners) {
+				if (!corner.relative && (corner.index < 0 || corner.index > std::numeric_limits<uint32_t>::max())) {
+					throw std::runtime_error("vertex index out of range in: " + filepath);
+				}
+			}
+
+			// Triangle fan around the first corner
+			for (size_t i = 1; i + 1 < corners.size(); i++) {
+				push(corners[0]);
+				push(corners[i]);
+				push(corners[i + 1]);
+			}
+		}
+
+		void parseObjChunk(const char *p, const char *end, MeshChunk &chunk, const std::string &filepath) {
+			std::vector<Corner> corners;
+
+			while (p < end) {
+				p = skipSpaces(p, end);
+				if (p + 1 < end && isSpace(p[1])) {
+					if (p[0] == 'v') {
+						HexModel::Vertex vertex{};
+						vertex.color = defaultColor;
+
+						const char *q = p + 1;
+						for (int i = 0; i < 3; i++) {
+							q = parseFloat(q, end, vertex.position[i]);
+							if (!q) throw std::runtime_error("invalid vertex in: " + filepath);
+						}
+
+						// Optional vertex colors (x y z r g b), a single extra value is w and ignored
+						float extra[3];
+						int extraCount = 0;
+						while (extraCount < 3 && (q = parseFloat(q, end, extra[extraCount]))) extraCount++;
+						if (extraCount == 3) vertex.color = {extra[0], extra[1], extra[2]};
+
+						chunk.vertices.push_back(vertex);
+					} else if (p[0] == 'f') {
+						corners.clear();
+						const char *q = p + 1;
+						while (true) {
+							int64_t index;
+							const char *next = parseInt(q, end, index);
+							if (!next) break;
+							// Skip texture coordinate and normal indices (v/vt/vn)
+							q = skipToken(next, end);
+
+							if (index > 0) {
+								corners.push_back({index - 1, false});
+							} else if (index < 0) {
+								corners.push_back({static_cast<int64_t>(chunk.vertices.size()) + index, true});
+							} else {
+								throw std::runtime_error("invalid face index in: " + filepath);
+							}
+						}
+						addPolygon(chunk, corners, filepath);
+					}
+				}
+				p = nextLine(p, end);
+			}
+		}
+
+		enum class PlyFormat { Ascii, BinaryLittleEndian, BinaryBigEndian };
+		enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+		struct PlyProperty {
+			std::string name;
+			PlyType type;
+			bool isList = false;
+			PlyType countType;
+			// Byte offset in the element record, only meaningful for fixed size records
+			size_t offset = 0;
+		};
+
+		struct PlyElement {
+			std::string name;
+			size_t count = 0;
+			std::vector<PlyProperty> properties;
+			bool hasList = false;
+			// Record size in binary files when there is no list property
+			size_t recordSize = 0;
+
+			int findProperty(const std::string &propertyName) const {
+				for (size_t i = 0; i < properties.size(); i++) {
+					if (properties[i].name == propertyName) return static_cast<int>(i);
+				}
+				return -1;
+			}
+		};
+
+		size_t plyTypeSize(PlyType type) {
+			switch (type) {
+				case PlyType::Int8: case PlyType::UInt8: return 1;
+				case PlyType::Int16: case PlyType::UInt16: return 2;
+				case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+				case PlyType::Float64: return 8;
+			}
+			return 0;
+		}
+
+		PlyType parsePlyType(const std::string &name, const std::string &filepath) {
+			if (name == "char" || name == "int8") return PlyType::Int8;
+			if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+			if (name == "short" || name == "int16") return PlyType::Int16;
+			if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+			if (name == "int" || name == "int32") return PlyType::Int32;
+			if (name == "uint" || name == "uint32") return PlyType::UInt32;
+			if (name == "float" || name == "float32") return PlyType::Float32;
+			if (name == "double" || name == "float64") return PlyType::Float64;
+			throw std::runtime_error("unknown PLY property type '" + name + "' in: " + filepath);
+		}
+
+		// Scale that maps integer colors to [0, 1]
+		float plyColorScale(PlyType type) {
+			switch (type) {
+				case PlyType::Int8: case PlyType::UInt8: return 1.f / 255.f;
+				case PlyType::Int16: case PlyType::UInt16: return 1.f / 65535.f;
+				default: return 1.f;
+			}
+		}
+
+		inline double readPlyValue(const char *p, PlyType type, bool swapBytes) {
+			switch (type) {
+				case PlyType::Int8: return static_cast<int8_t>(*p);
+				case PlyType::UInt8: return static_cast<uint8_t>(*p);
+				case PlyType::Int16: return readBinary<int16_t>(p, swapBytes);
+				case PlyType::UInt16: return readBinary<uint16_t>(p, swapBytes);
+				case PlyType::Int32: return readBinary<int32_t>(p, swapBytes);
+				case PlyType::UInt32: return readBinary<uint32_t>(p, swapBytes);
+				case PlyType::Float32: return readBinary<float>(p, swapBytes);
+				case PlyType::Float64: return readBinary<double>(p, swapBytes);
+			}
+			return 0.0;
+		}
+
+		inline int64_t readPlyInt(const char *p, PlyType type, bool swapBytes) {
+			switch (type) {
+				case PlyType::Int8: return static_cast<int8_t>(*p);
+				case PlyType::UInt8: return static_cast<uint8_t>(*p);
+				case PlyType::Int16: return readBinary<int16_t>(p, swapBytes);
+				case PlyType::UInt16: return readBinary<uint16_t>(p, swapBytes);
+				case PlyType::Int32: return readBinary<int32_t>(p, swapBytes);
+				case PlyType::UInt32: return readBinary<uint32_t>(p, swapBytes);
+				case PlyType::Float32: return static_cast<int64_t>(readBinary<float>(p, swapBytes));
+				case PlyType::Float64: return static_cast<int64_t>(readBinary<double>(p, swapBytes));
+			}
+			return 0;
+		}
+
+		struct PlyHeader {
+			PlyFormat format;
+			std::vector<PlyElement> elements;
+			// First byte after end_header
+			const char *body;
+		};
+
+		PlyHeader parsePlyHeader(const char *p, const char *end, const std::string &filepath) {
+			PlyHeader header{};
+			bool hasFormat = false;
+
+			auto words = splitWords(p, end);
+			if (words.empty() || words[0] != "ply") {
+				throw std::runtime_error("not a PLY file: " + filepath);
+			}
+			p = nextLine(p, end);
+
+			while (true) {
+				if (p >= end) {
+					throw std::runtime_error("missing end_header in: " + filepath);
+				}
+				words = splitWords(p, end);
+				p = nextLine(p, end);
+
+				if (words.empty() || words[0] == "comment" || words[0] == "obj_info") continue;
+
+				if (words[0] == "end_header") break;
+
+				if (words[0] == "format" && words.size() >= 2) {
+					if (words[1] == "ascii") header.format = PlyFormat::Ascii;
+					else if (words[1] == "binary_little_endian") header.format = PlyFormat::BinaryLittleEndian;
+					else if (words[1] == "binary_big_endian") header.format = PlyFormat::BinaryBigEndian;
+					else throw std::runtime_error("unknown PLY format '" + words[1] + "' in: " + filepath);
+					hasFormat = true;
+				} else if (words[0] == "element" && words.size() >= 3) {
+					PlyElement element{};
+					element.name = words[1];
+					int64_t count;
+					const char *countEnd = words[2].data() + words[2].size();
+					if (parseInt(words[2].data(), countEnd, count) != countEnd || count < 0) {
+						throw std::runtime_error("invalid PLY element count '" + words[2] + "' in: " + filepath);
+					}
+					element.count = static_cast<size_t>(count);
+					header.elements.push_back(element);
+				} else if (words[0] == "property" && !header.elements.empty()) {
+					PlyElement &element = header.elements.back();
+					PlyProperty property{};
+					if (words.size() >= 5 && words[1] == "list") {
+						property.isList = true;
+						property.countType = parsePlyType(words[2], filepath);
+						property.type = parsePlyType(words[3], filepath);
+						property.name = words[4];
+						element.hasList = true;
+					} else if (words.size() >= 3) {
+						property.type = parsePlyType(words[1], filepath);
+						property.name = words[2];
+						property.offset = element.recordSize;
+						element.recordSize += plyTypeSize(property.type);
+					} else {
+						throw std::runtime_error("invalid PLY property in: " + filepath);
+					}
+					element.properties.push_back(property);
+				} else {
+					throw std::runtime_error("invalid PLY header line in: " + filepath);
+				}
+			}
+
+			if (!hasFormat) {
+				throw std::runtime_error("missing PLY format in: " + filepath);
+			}
+
+			header.body = p;
+			return header;
+		}
+
+		// Vertex properties we care about, -1 when missing
+		struct PlyVertexLayout {
+			int position[3];
+			int color[3];
+			float colorScale = 1.f;
+
+			PlyVertexLayout(const PlyElement &element, const std::string &filepath) {
+				position[0] = element.findProperty("x");
+				position[1] = element.findProperty("y");
+				position[2] = element.findProperty("z");
+				color[0] = element.findProperty("red");
+				color[1] = element.findProperty("green");
+				color[2] = element.findProperty("blue");
+
+				if (position[0] < 0 || position[1] < 0 || position[2] < 0) {
+					throw std::runtime_error("PLY vertex without x, y, z in: " + filepath);
+				}
+				if (element.hasList) {
+					throw std::runtime_error("PLY vertex with list property in: " + filepath);
+				}
+				if (hasColor()) {
+					colorScale = plyColorScale(element.properties[color[0]].type);
+				}
+			}
+
+			bool hasColor() const { return color[0] >= 0 && color[1] >= 0 && color[2] >= 0; }
+		};
+
+		int findFaceIndexList(const PlyElement &element, const std::string &filepath) {
+			int list = element.findProperty("vertex_indices");
+			if (list < 0) list = element.findProperty("vertex_index");
+			if (list < 0 || !element.properties[list].isList) {
+				throw std::runtime_error("PLY face without vertex_indices list in: " + filepath);
+			}
+			return list;
+		}
+
+		// Size of one binary record starting at p, lists included, the record must end before end
+		size_t binaryRecordSize(const PlyElement &element, const char *p, const char *end, bool swapBytes, const std::string &filepath) {
+			const char *start = p;
+			for (auto &property : element.properties) {
+				if (property.isList) {
+					checkRecords(p, end, 1, plyTypeSize(property.countType), filepath);
+					int64_t count = readPlyInt(p, property.countType, swapBytes);
+					p += plyTypeSize(property.countType);
+					if (count < 0) throw std::runtime_error("invalid PLY list in: " + filepath);
+					checkRecords(p, end, count, plyTypeSize(property.type), filepath);
+					p += count * plyTypeSize(property.type);
+				} else {
+					checkRecords(p, end, 1, plyTypeSize(property.type), filepath);
+					p += plyTypeSize(property.type);
+				}
+			}
+			return p - start;
+		}
+
+		const char *readBinaryVertices(const PlyElement &element, const char *p, const char *end, bool swapBytes, MeshChunk &chunk, const std::string &filepath) {
+			PlyVertexLayout layout{element, filepath};
+			checkRecords(p, end, element.count, element.recordSize, filepath);
+
+			chunk.vertices.resize(element.count);
+			parallelFor(element.count, 1 << 14, [&](size_t begin, size_t last) {
+				for (size_t i = begin; i < last; i++) {
+					const char *record = p + i * element.recordSize;
+					HexModel::Vertex &vertex = chunk.vertices[i];
+					for (int c = 0; c < 3; c++) {
+						auto &property = element.properties[layout.position[c]];
+						vertex.position[c] = static_cast<float>(readPlyValue(record + property.offset, property.type, swapBytes));
+					}
+					if (layout.hasColor()) {
+						for (int c = 0; c < 3; c++) {
+							auto &property = element.properties[layout.color[c]];
+							vertex.color[c] = static_cast<float>(readPlyValue(record + property.offset, property.type, swapBytes)) * layout.colorScale;
+						}
+					} else {
+						vertex.color = defaultColor;
+					}
+				}
+			});
+
+			return p + element.count * element.recordSize;
+		}
+
+		const char *readBinaryFaces(const PlyElement &element, const char *p, const char *end, bool swapBytes, MeshChunk &chunk, const std::string &filepath) {
+			int list = findFaceIndexList(element, filepath);
+			const PlyProperty &indexList = element.properties[list];
+			size_t countSize = plyTypeSize(indexList.countType);
+			size_t indexSize = plyTypeSize(indexList.type);
+
+			// Offset of the index list in the record, the fast path below needs it to be the only list
+			size_t listOffset = 0;
+			int listCount = 0;
+			for (size_t i = 0; i < element.properties.size(); i++) {
+				if (element.properties[i].isList) listCount++;
+				else if (static_cast<int>(i) < list) listOffset += plyTypeSize(element.properties[i].type);
+			}
+			bool uniformCandidate = element.count > 0 && listCount == 1;
+
+			// Fast path: every face has the same corner count (pure triangle or quad meshes), so
+			// records have a fixed size and can be read in parallel. It's checked in parallel too.
+			if (uniformCandidate) {
+				checkRecords(p, end, 1, listOffset + countSize, filepath);
+				int64_t corners = readPlyInt(p + listOffset, indexList.countType, swapBytes);
+				bool uniform = corners >= 3 && recordsFit(p, end, 1, corners * indexSize);
+				size_t recordSize = uniform ? element.recordSize + countSize + corners * indexSize : 0;
+				uniform = uniform && recordsFit(p, end, element.count, recordSize);
+
+				if (uniform) {
+					std::atomic<bool> mismatch{false};
+					parallelFor(element.count, 1 << 16, [&](size_t begin, size_t last) {
+						for (size_t i = begin; i < last; i++) {
+							if (readPlyInt(p + i * recordSize + listOffset, indexList.countType, swapBytes) != corners) {
+								mismatch = true;
+								return;
+							}
+						}
+					});
+					uniform = !mismatch;
+				}
+
+				if (uniform) {
+					size_t trianglesPerFace = corners - 2;
+					chunk.indices.resize(element.count * trianglesPerFace * 3);
+					parallelFor(element.count, 1 << 14, [&](size_t begin, size_t last) {
+						for (size_t i = begin; i < last; i++) {
+							const char *indices = p + i * recordSize + listOffset + countSize;
+							uint32_t *out = &chunk.indices[i * trianglesPerFace * 3];
+							uint32_t first = static_cast<uint32_t>(readPlyInt(indices, indexList.type, swapBytes));
+							for (size_t t = 0; t < trianglesPerFace; t++) {
+								*out++ = first;
+								*out++ = static_cast<uint32_t>(readPlyInt(indices + (t + 1) * indexSize, indexList.type, swapBytes));
+								*out++ = static_cast<uint32_t>(readPlyInt(indices + (t + 2) * indexSize, indexList.type, swapBytes));
+							}
+						}
+					});
+					return p + element.count * recordSize;
+				}
+			}
+
+			// Mixed polygon sizes, read records one after the other
+			std::vector<Corner> corners;
+			for (size_t i = 0; i < element.count; i++) {
+				for (size_t j = 0; j < element.properties.size(); j++) {
+					const PlyProperty &property = element.properties[j];
+					if (!property.isList) {
+						checkRecords(p, end, 1, plyTypeSize(property.type), filepath);
+						p += plyTypeSize(property.type);
+						continue;
+					}
+					checkRecords(p, end, 1, plyTypeSize(property.countType), filepath);
+					int64_t count = readPlyInt(p, property.countType, swapBytes);
+					p += plyTypeSize(property.countType);
+					if (count < 0) throw std::runtime_error("invalid PLY face in: " + filepath);
+					checkRecords(p, end, count, plyTypeSize(property.type), filepath);
+					if (static_cast<int>(j) == list) {
+						corners.clear();
+						for (int64_t c = 0; c < count; c++) {
+							corners.push_back({readPlyInt(p + c * indexSize, indexList.type, swapBytes), false});
+						}
+						addPolygon(chunk, corners, filepath);
+					}
+					p += count * plyTypeSize(property.type);
+				}
+				checkRange(p, end, filepath);
+			}
+			return p;
+		}
+
+		void parseAsciiVertices(const PlyElement &element, const PlyVertexLayout &layout, const char *p, const char *end, MeshChunk &chunk, const std::string &filepath) {
+			std::vector<double> values(element.properties.size());
+			while (p < end) {
+				p = skipSpaces(p, end);
+				if (p < end && *p == '\n') {
+					p++;
+					continue;
+				}
+
+				for (auto &value : values) {
+					p = parseDouble(p, end, value);
+					if (!p) throw std::runtime_error("invalid PLY vertex in: " + filepath);
+				}
+
+				HexModel::Vertex vertex{};
+				vertex.position = {
+					static_cast<float>(values[layout.position[0]]),
+					static_cast<float>(values[layout.position[1]]),
+					static_cast<float>(values[layout.position[2]])
+				};
+				if (layout.hasColor()) {
+					vertex.color = {
+						static_cast<float>(values[layout.color[0]]) * layout.colorScale,
+						static_cast<float>(values[layout.color[1]]) * layout.colorScale,
+						static_cast<float>(values[layout.color[2]]) * layout.colorScale
+					};
+				} else {
+					vertex.color = defaultColor;
+				}
+				chunk.vertices.push_back(vertex);
+
+				p = nextLine(p, end);
+			}
+		}
+
+		void parseAsciiFaces(const PlyElement &element, int list, const char *p, const char *end, MeshChunk &chunk, const std::string &filepath) {
+			std::vector<Corner> corners;
+			while (p < end) {
+				p = skipSpaces(p, end);
+				if (p < end && *p == '\n') {
+					p++;
+					continue;
+				}
+
+				for (size_t j = 0; j < element.properties.size(); j++) {
+					const PlyProperty &property = element.properties[j];
+					int64_t count = 1;
+					if (property.isList) {
+						p = parseInt(p, end, count);
+						if (!p) throw std::runtime_error("invalid PLY face in: " + filepath);
+					}
+
+					bool isIndexList = static_cast<int>(j) == list;
+					if (isIndexList) corners.clear();
+
+					for (int64_t c = 0; c < count; c++) {
+						double value;
+						p = parseDouble(p, end, value);
+						if (!p) throw std::runtime_error("invalid PLY face in: " + filepath);
+						if (isIndexList) {
+							if (!(value >= 0.0 && value <= std::numeric_limits<uint32_t>::max())) {
+								throw std::runtime_error("vertex index out of range in: " + filepath);
+							}
+							corners.push_back({static_cast<int64_t>(value), false});
+						}
+					}
+
+					if (isIndexList) addPolygon(chunk, corners, filepath);
+				}
+
+				p = nextLine(p, end);
+			}
+		}
+
+		void logLoadStats(const std::string &filepath, size_t fileSize, const HexModel::Builder &builder, std::chrono::high_resolution_clock::time_point start) {
+			auto end = std::chrono::high_resolution_clock::now();
+			double seconds = std::chrono::duration<double>(end - start).count();
+			double megabytes = static_cast<double>(fileSize) / (1024.0 * 1024.0);
+
+			std::cout << "Loaded " << filepath << ": "
+				<< builder.vertices.size() << " vertices, "
+				<< builder.indices.size() / 3 << " triangles in "
+				<< seconds * 1000.0 << " ms ("
+				<< (seconds > 0.0 ? megabytes / seconds : 0.0) << " MB/s)" << std::endl;
+		}
+	}
+
+	HexModel::Builder HexMeshLoader::loadFile(const std::string &filepath) {
+		auto start = std::chrono::high_resolution_clock::now();
+
+		std::string extension;
+		auto dot = filepath.find_last_of('.');
+		if (dot != std::string::npos) {
+			extension = filepath.substr(dot + 1);
+			std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+		}
+
+		HexMappedFile file{filepath};
+
+		HexModel::Builder builder{};
+		if (extension == "obj") {
+			builder = loadObj(file);
+		} else if (extension == "ply") {
+			builder = loadPly(file);
+		} else if (extension == "mesh" || extension == "vtk") {
+			builder = loadVolume(file);
+		} else if (extension == "meshb") {
+			throw std::runtime_error("binary MEDIT meshes are not supported, convert to .mesh: " + filepath);
+		} else {
+			throw std::runtime_error("unsupported mesh file format: " + filepath);
+		}
+
+		logLoadStats(filepath, file.size(), builder, start);
+		return builder;
+	}
+
+	HexModel::Builder HexMeshLoader::loadObj(const HexMappedFile &file) {
+		const char *begin = file.data();
+		const char *end = begin + file.size();
+
+		auto ranges = splitLines(begin, end, chunkCountForSize(file.size()));
+		std::vector<MeshChunk> chunks(ranges.size());
+
+		parallelTasks(ranges.size(), [&](size_t i) {
+			parseObjChunk(ranges[i].first, ranges[i].second, chunks[i], file.path());
+		});
+
+		return mergeChunks(chunks, file.path());
+	}
+
+	HexModel::Builder HexMeshLoader::loadPly(const HexMappedFile &file) {
+		const char *p = file.data();
+		const char *end = p + file.size();
+		const std::string &filepath = file.path();
+
+		PlyHeader header = parsePlyHeader(p, end, filepath);
+		p = header.body;
+
+		bool binary = header.format != PlyFormat::Ascii;
+		bool swapBytes = false;
+		if (binary) {
+			uint16_t one = 1;
+			bool hostLittleEndian = *reinterpret_cast<uint8_t*>(&one) == 1;
+			swapBytes = hostLittleEndian != (header.format == PlyFormat::BinaryLittleEndian);
+		}
+
+		// Vertex chunks first then face chunks, merged in this order
+		std::vector<MeshChunk> vertexChunks;
+		std::vector<MeshChunk> faceChunks;
+		bool hasVertices = false;
+
+		for (const PlyElement &element : header.elements) {
+			bool isVertex = element.name == "vertex";
+			bool isFace = element.name == "face";
+
+			if (binary) {
+				if (isVertex) {
+					vertexChunks.emplace_back();
+					p = readBinaryVertices(element, p, end, swapBytes, vertexChunks.back(), filepath);
+				} else if (isFace) {
+					faceChunks.emplace_back();
+					p = readBinaryFaces(element, p, end, swapBytes, faceChunks.back(), filepath);
+				} else if (!element.hasList) {
+					checkRecords(p, end, element.count, element.recordSize, filepath);
+					p += element.count * element.recordSize;
+				} else {
+					for (size_t i = 0; i < element.count; i++) {
+						p += binaryRecordSize(element, p, end, swapBytes, filepath);
+					}
+				}
+				checkRange(p, end, filepath);
+				hasVertices = hasVertices || isVertex;
+				continue;
+			}
+
+			// Ascii: find where the element lines end, then parse line aligned chunks in parallel
+			const char *elementBegin = p;
+			const char *elementEnd = skipLines(p, end, element.count, filepath);
+			p = elementEnd;
+
+			if (!isVertex && !isFace) continue;
+
+			auto ranges = splitLines(elementBegin, elementEnd, chunkCountForSize(elementEnd - elementBegin));
+			std::vector<MeshChunk> &chunks = isVertex ? vertexChunks : faceChunks;
+			size_t firstChunk = chunks.size();
+			chunks.resize(firstChunk + ranges.size());
+
+			if (isVertex) {
+				PlyVertexLayout layout{element, filepath};
+				parallelTasks(ranges.size(), [&](size_t i) {
+					parseAsciiVertices(element, layout, ranges[i].first, ranges[i].second, chunks[firstChunk + i], filepath);
+				});
+				hasVertices = true;
+			} else {
+				int list = findFaceIndexList(element, filepath);
+				parallelTasks(ranges.size(), [&](size_t i) {
+					parseAsciiFaces(element, list, ranges[i].first, ranges[i].second, chunks[firstChunk + i], filepath);
+				});
+			}
+		}
+
+		if (!hasVertices) {
+			throw std::runtime_error("PLY file without vertex element: " + filepath);
+		}
+
+		std::vector<MeshChunk> chunks;
+		chunks.reserve(vertexChunks.size() + faceChunks.size());
+		for (auto &chunk : vertexChunks) chunks.push_back(std::move(chunk));
+		for (auto &chunk : faceChunks) chunks.push_back(std::move(chunk));
+
+		return mergeChunks(chunks, filepath);
+	}
+
+	HexModel::Builder HexMeshLoader::loadVolume(const HexMappedFile &file) {
+		return loadVolume(HexVolumeLoader::load(file), file.path());
+	}
+
+	HexModel::Builder HexMeshLoader::loadVolume(const HexVolumeMesh &mesh, const std::string &filepath) {
+		auto start = std::chrono::high_resolution_clock::now();
+		auto boundary = mesh.extractBoundary();
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		size_t faceCount = static_cast<size_t>(mesh.cellCount()) * HexVolumeMesh::CELL_FACES;
+		std::cout << "Extracted " << boundary.faceCells.size() << " boundary faces of "
+			<< faceCount << " from " << mesh.cellCount() << " hexahedra in "
+			<< seconds * 1000.0 << " ms" << std::endl;
+
+		if (boundary.faceCells.empty()) {
+			throw std::runtime_error("no hexahedra in: " + filepath);
+		}
+		return mesh.buildBoundaryModel(boundary);
+	}
+}
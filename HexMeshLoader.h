@@ -0,0 +1,27 @@
+#pragma once
+
+#include "HexModel.h"
+#include "HexMappedFile.h"
+#include "HexVolumeMesh.h"
+
+#include <string>
+
+namespace hex {
+
+	// Loads triangle meshes from Wavefront OBJ and PLY (ascii / binary) files.
+	// Files are memory mapped, split in line aligned chunks and parsed on all cores,
+	// polygons are triangulated as fans and merged into an indexed HexModel::Builder.
+	// Hexahedral volume meshes (MEDIT / VTK) are reduced to their boundary faces.
+	class HexMeshLoader {
+		public:
+		// Pick the parser from the file extension (.obj / .ply / .mesh / .vtk)
+		static HexModel::Builder loadFile(const std::string &filepath);
+
+		static HexModel::Builder loadObj(const HexMappedFile &file);
+		static HexModel::Builder loadPly(const HexMappedFile &file);
+		// Boundary of a volume mesh, builder.triangleCells maps triangles to their cell
+		static HexModel::Builder loadVolume(const HexMappedFile &file);
+		// Boundary of an already parsed volume
+		static HexModel::Builder loadVolume(const HexVolumeMesh &mesh, const std::string &filepath);
+	};
+}
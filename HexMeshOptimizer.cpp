@@ -0,0 +1,336 @@
+#include "HexMeshOptimizer.h"
+#include "HexParallel.h"
+
+#include <algorithm>
+#include <array>
+#include <numeric>
+
+namespace hex {
+
+	namespace {
+
+		// A cluster is closed as soon as its own cache miss ratio gets this close to the mesh one,
+		// smaller clusters sort better for overdraw but cost cache efficiency
+		const float clusterThreshold = 1.05f;
+
+		// Triangles touching each vertex, in compressed rows
+		struct TriangleAdjacency {
+			std::vector<uint32_t> offsets;
+			std::vector<uint32_t> triangles;
+			std::vector<uint32_t> counts;
+
+			TriangleAdjacency(const std::vector<uint32_t> &indices, size_t vertexCount) {
+				counts.assign(vertexCount, 0);
+				for (uint32_t index : indices) counts[index]++;
+
+				offsets.assign(vertexCount + 1, 0);
+				for (size_t v = 0; v < vertexCount; v++) offsets[v + 1] = offsets[v] + counts[v];
+
+				triangles.resize(indices.size());
+				std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+				for (size_t i = 0; i < indices.size(); i++) {
+					triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+				}
+			}
+		};
+
+		// Count FIFO cache misses of indices[begin, end) starting from an empty cache
+		class CacheSimulator {
+			public:
+			CacheSimulator(size_t vertexCount, uint32_t cacheSize) : timestamps(vertexCount, 0), cacheSize{cacheSize} {}
+
+			void reset() { time += cacheSize + 1; }
+
+			// Returns true on a cache miss
+			bool access(uint32_t vertex) {
+				if (timestamps[vertex] != 0 && time - timestamps[vertex] < cacheSize) return false;
+				timestamps[vertex] = time++;
+				return true;
+			}
+
+			private:
+			std::vector<uint64_t> timestamps;
+			uint64_t time = 1;
+			uint32_t cacheSize;
+		};
+
+		// Triangle corners rotated so the smallest comes first, winding is kept
+		std::array<uint32_t, 3> triangleKey(const uint32_t *corners) {
+			int first = corners[1] < corners[0] ? 1 : 0;
+			if (corners[2] < corners[first]) first = 2;
+			return {corners[first], corners[(first + 1) % 3], corners[(first + 2) % 3]};
+		}
+
+		// Follow per triangle values through a triangle reordering: triangles are matched
+		// by their corners, duplicates take the values in their original order
+		void remapTriangleValues(const std::vector<uint32_t> &before, const std::vector<uint32_t> &after, std::vector<uint32_t> &values) {
+			size_t triangleCount = before.size() / 3;
+			std::vector<std::pair<std::array<uint32_t, 3>, uint32_t>> sorted(triangleCount);
+			parallelFor(triangleCount, 1 << 14, [&](size_t begin, size_t end) {
+				for (size_t t = begin; t < end; t++) sorted[t] = {triangleKey(&before[t * 3]), static_cast<uint32_t>(t)};
+			});
+			std::sort(sorted.begin(), sorted.end());
+
+			std::vector<uint32_t> remapped(triangleCount);
+			std::vector<uint32_t> taken(triangleCount, 0);
+			for (size_t t = 0; t < triangleCount; t++) {
+				auto key = triangleKey(&after[t * 3]);
+				auto match = std::lower_bound(sorted.begin(), sorted.end(), std::make_pair(key, 0u));
+				size_t first = match - sorted.begin();
+				remapped[t] = values[sorted[first + taken[first]++].second];
+			}
+			values = std::move(remapped);
+		}
+	}
+
+	HexMeshOptimizer::Statistics HexMeshOptimizer::analyzeVertexCache(const std::vector<uint32_t> &indices, size_t vertexCount, uint32_t cacheSize) {
+		Statistics statistics{};
+		if (indices.size() < 3) return statistics;
+
+		CacheSimulator cache{vertexCount, cacheSize};
+		std::vector<bool> used(vertexCount, false);
+		size_t misses = 0;
+		size_t usedCount = 0;
+
+		for (uint32_t index : indices) {
+			if (cache.access(index)) misses++;
+			if (!used[index]) {
+				used[index] = true;
+				usedCount++;
+			}
+		}
+
+		statistics.acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+		statistics.atvr = static_cast<float>(misses) / static_cast<float>(usedCount);
+		return statistics;
+	}
+
+	void HexMeshOptimizer::optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount, uint32_t cacheSize) {
+		optimizeVertexCacheClusters(indices, vertexCount, cacheSize);
+	}
+
+	// Tipsify, Sander, Nehab and Barczak 2007: fan around a vertex, then move to the neighbour
+	// that is still in cache and has the most pending triangles.
+	std::vector<uint32_t> HexMeshOptimizer::optimizeVertexCacheClusters(std::vector<uint32_t> &indices, size_t vertexCount, uint32_t cacheSize) {
+		size_t triangleCount = indices.size() / 3;
+		std::vector<uint32_t> clusters;
+		if (triangleCount == 0) return clusters;
+
+		TriangleAdjacency adjacency{indices, vertexCount};
+		std::vector<uint32_t> &liveTriangles = adjacency.counts;
+
+		std::vector<uint32_t> cacheTime(vertexCount, 0);
+		std::vector<bool> emitted(triangleCount, false);
+		std::vector<uint32_t> deadEnd;
+		std::vector<uint32_t> candidates;
+		std::vector<uint32_t> output;
+		output.reserve(indices.size());
+
+		// Timestamps start past the cache size so nothing is considered cached at first
+		uint32_t time = cacheSize + 1;
+		uint32_t cursor = 0;
+		int64_t fanningVertex = 0;
+		bool startCluster = true;
+
+		// Skip to a vertex with pending triangles when the fan is stuck
+		auto skipDeadEnd = [&]() -> int64_t {
+			while (!deadEnd.empty()) {
+				uint32_t vertex = deadEnd.back();
+				deadEnd.pop_back();
+				if (liveTriangles[vertex] > 0) return vertex;
+			}
+			while (cursor < vertexCount) {
+				if (liveTriangles[cursor] > 0) return cursor;
+				cursor++;
+			}
+			return -1;
+		};
+
+		while (fanningVertex >= 0) {
+			uint32_t firstTriangle = static_cast<uint32_t>(output.size() / 3);
+			if (startCluster && (clusters.empty() || clusters.back() != firstTriangle)) {
+				clusters.push_back(firstTriangle);
+			}
+			startCluster = false;
+
+			candidates.clear();
+			uint32_t vertex = static_cast<uint32_t>(fanningVertex);
+			for (uint32_t i = adjacency.offsets[vertex]; i < adjacency.offsets[vertex + 1]; i++) {
+				uint32_t triangle = adjacency.triangles[i];
+				if (emitted[triangle]) continue;
+				emitted[triangle] = true;
+
+				for (int k = 0; k < 3; k++) {
+					uint32_t corner = indices[triangle * 3 + k];
+					output.push_back(corner);
+					deadEnd.push_back(corner);
+					candidates.push_back(corner);
+					liveTriangles[corner]--;
+					if (time - cacheTime[corner] > cacheSize) {
+						cacheTime[corner] = time++;
+					}
+				}
+			}
+
+			// Best candidate still in cache once its remaining triangles are emitted
+			int64_t best = -1;
+			uint32_t bestPriority = 0;
+			for (uint32_t candidate : candidates) {
+				if (liveTriangles[candidate] == 0) continue;
+				uint32_t priority = 0;
+				if (time - cacheTime[candidate] + 2 * liveTriangles[candidate] <= cacheSize) {
+					priority = time - cacheTime[candidate];
+				}
+				if (best < 0 || priority > bestPriority) {
+					best = candidate;
+					bestPriority = priority;
+				}
+			}
+
+			if (best < 0) {
+				best = skipDeadEnd();
+				startCluster = true;
+			}
+			fanningVertex = best;
+		}
+
+		indices.swap(output);
+
+		// Split the fans further into soft clusters (Sander et al. linear speed overdraw)
+		float meshAcmr = analyzeVertexCache(indices, vertexCount, cacheSize).acmr;
+		std::vector<uint32_t> softClusters;
+		CacheSimulator cache{vertexCount, cacheSize};
+
+		for (size_t c = 0; c < clusters.size(); c++) {
+			uint32_t begin = clusters[c];
+			uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : static_cast<uint32_t>(triangleCount);
+
+			cache.reset();
+			softClusters.push_back(begin);
+			uint32_t clusterStart = begin;
+			size_t misses = 0;
+
+			for (uint32_t triangle = begin; triangle < end; triangle++) {
+				for (int k = 0; k < 3; k++) {
+					if (cache.access(indices[triangle * 3 + k])) misses++;
+				}
+
+				uint32_t clusterTriangles = triangle - clusterStart + 1;
+				if (triangle + 1 < end && static_cast<float>(misses) <= clusterThreshold * meshAcmr * clusterTriangles) {
+					clusterStart = triangle + 1;
+					softClusters.push_back(clusterStart);
+					cache.reset();
+					misses = 0;
+				}
+			}
+		}
+
+		return softClusters;
+	}
+
+	// Draw clusters facing away from the mesh center first, they are the most likely to occlude others
+	void HexMeshOptimizer::optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<uint32_t> &clusters, const std::vector<HexModel::Vertex> &vertices) {
+		size_t triangleCount = indices.size() / 3;
+		if (clusters.size() < 2) return;
+
+		struct ClusterInfo {
+			uint32_t begin;
+			uint32_t end;
+			float sortKey;
+		};
+
+		glm::vec3 meshCentroid{0.f};
+		float meshArea = 0.f;
+		std::vector<glm::vec3> clusterCentroids(clusters.size(), glm::vec3{0.f});
+		std::vector<glm::vec3> clusterNormals(clusters.size(), glm::vec3{0.f});
+		std::vector<ClusterInfo> infos(clusters.size());
+
+		for (size_t c = 0; c < clusters.size(); c++) {
+			infos[c].begin = clusters[c];
+			infos[c].end = c + 1 < clusters.size() ? clusters[c + 1] : static_cast<uint32_t>(triangleCount);
+
+			float clusterArea = 0.f;
+			for (uint32_t triangle = infos[c].begin; triangle < infos[c].end; triangle++) {
+				const glm::vec3 &a = vertices[indices[triangle * 3]].position;
+				const glm::vec3 &b = vertices[indices[triangle * 3 + 1]].position;
+				const glm::vec3 &d = vertices[indices[triangle * 3 + 2]].position;
+
+				glm::vec3 normal = glm::cross(b - a, d - a);
+				float area = glm::length(normal);
+				glm::vec3 centroid = (a + b + d) * (area / 3.f);
+
+				clusterCentroids[c] += centroid;
+				clusterNormals[c] += normal;
+				clusterArea += area;
+			}
+
+			meshCentroid += clusterCentroids[c];
+			meshArea += clusterArea;
+			if (clusterArea > 0.f) clusterCentroids[c] /= clusterArea;
+		}
+
+		if (meshArea > 0.f) meshCentroid /= meshArea;
+
+		for (size_t c = 0; c < clusters.size(); c++) {
+			float length = glm::length(clusterNormals[c]);
+			glm::vec3 normal = length > 0.f ? clusterNormals[c] / length : glm::vec3{0.f};
+			infos[c].sortKey = glm::dot(clusterCentroids[c] - meshCentroid, normal);
+		}
+
+		std::stable_sort(infos.begin(), infos.end(), [](const ClusterInfo &a, const ClusterInfo &b) {
+			return a.sortKey > b.sortKey;
+		});
+
+		std::vector<uint32_t> output;
+		output.reserve(indices.size());
+		for (auto &info : infos) {
+			output.insert(output.end(), indices.begin() + info.begin * 3, indices.begin() + info.end * 3);
+		}
+		indices.swap(output);
+	}
+
+	// Vertices in first use order, unreferenced vertices are dropped
+	void HexMeshOptimizer::optimizeVertexFetch(std::vector<uint32_t> &indices, std::vector<HexModel::Vertex> &vertices) {
+		const uint32_t unused = ~0u;
+		std::vector<uint32_t> remap(vertices.size(), unused);
+		std::vector<HexModel::Vertex> output;
+		output.reserve(vertices.size());
+
+		for (auto &index : indices) {
+			if (remap[index] == unused) {
+				remap[index] = static_cast<uint32_t>(output.size());
+				output.push_back(vertices[index]);
+			}
+			index = remap[index];
+		}
+
+		vertices.swap(output);
+	}
+
+	HexMeshOptimizer::Result HexMeshOptimizer::optimize(HexModel::Builder &builder) {
+		Result result{};
+		if (builder.indices.size() < 3) return result;
+
+		result.before = analyzeVertexCache(builder.indices, builder.vertices.size());
+
+		// Triangle reordering keeps the corner values, vertex fetch then renames them
+		std::vector<uint32_t> originalIndices;
+		if (!builder.triangleCells.empty()) originalIndices = builder.indices;
+
+		auto clusters = optimizeVertexCacheClusters(builder.indices, builder.vertices.size());
+		optimizeOverdraw(builder.indices, clusters, builder.vertices);
+		if (!builder.triangleCells.empty()) remapTriangleValues(originalIndices, builder.indices, builder.triangleCells);
+		optimizeVertexFetch(builder.indices, builder.vertices);
+
+		result.after = analyzeVertexCache(builder.indices, builder.vertices.size());
+		return result;
+	}
+
+	std::vector<HexMeshOptimizer::Result> HexMeshOptimizer::optimize(std::vector<HexModel::Builder *> &builders) {
+		std::vector<Result> results(builders.size());
+		parallelTasks(builders.size(), [&](size_t i) {
+			results[i] = optimize(*builders[i]);
+		});
+		return results;
+	}
+}
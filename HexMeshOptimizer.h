@@ -0,0 +1,47 @@
+#pragma once
+
+#include "HexModel.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace hex {
+
+	// Reorders indexed triangle meshes for the GPU:
+	//  - triangles for the post transform vertex cache (Tipsify)
+	//  - clusters of those triangles front to back from the mesh outside, to reduce overdraw
+	//  - vertices in first use order, so vertex fetch reads memory linearly
+	// Meshes are optimized before being written to the binary cache, so it only costs on first load.
+	class HexMeshOptimizer {
+		public:
+		// Post transform cache size used by the reordering and the statistics
+		static constexpr uint32_t CACHE_SIZE = 16;
+
+		struct Statistics {
+			// Average cache miss ratio: transformed vertices per triangle (0.5 is ideal on big grids, 3 is worst)
+			float acmr = 0.f;
+			// Average transform to vertex ratio: transformed vertices per vertex (1 is ideal)
+			float atvr = 0.f;
+		};
+
+		struct Result {
+			Statistics before;
+			Statistics after;
+		};
+
+		// Optimize in place, non indexed meshes are left untouched
+		static Result optimize(HexModel::Builder &builder);
+
+		// Optimize several meshes in parallel, one task per mesh with serial inner loops
+		static std::vector<Result> optimize(std::vector<HexModel::Builder *> &builders);
+
+		// Simulate a FIFO cache of cacheSize entries
+		static Statistics analyzeVertexCache(const std::vector<uint32_t> &indices, size_t vertexCount, uint32_t cacheSize = CACHE_SIZE);
+
+		static void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount, uint32_t cacheSize = CACHE_SIZE);
+		// Returns the first triangle of each cluster (soft boundaries where the cache was flushed)
+		static std::vector<uint32_t> optimizeVertexCacheClusters(std::vector<uint32_t> &indices, size_t vertexCount, uint32_t cacheSize = CACHE_SIZE);
+		static void optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<uint32_t> &clusters, const std::vector<HexModel::Vertex> &vertices);
+		static void optimizeVertexFetch(std::vector<uint32_t> &indices, std::vector<HexModel::Vertex> &vertices);
+	};
+}
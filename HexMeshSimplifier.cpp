@@ -0,0 +1,394 @@
+#include "HexMeshSimplifier.h"
+#include "HexMeshOptimizer.h"
+#include "HexParallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace hex {
+
+	namespace {
+
+		// A level is only kept if it removes at least this fraction of the previous one
+		const float minLevelReduction = .1f;
+
+		// Boundary edges get a constraint plane weighted this much, keeps mesh borders in place
+		const double boundaryWeight = 10.0;
+
+		// Symmetric 4x4 matrix of the sum of squared distances to a set of planes,
+		// with the total weight of those planes
+		struct Quadric {
+			double a2 = 0, ab = 0, ac = 0, ad = 0;
+			double b2 = 0, bc = 0, bd = 0;
+			double c2 = 0, cd = 0;
+			double d2 = 0;
+			double weight = 0;
+
+			static Quadric fromPlane(double a, double b, double c, double d, double weight) {
+				Quadric q;
+				q.a2 = a * a * weight; q.ab = a * b * weight; q.ac = a * c * weight; q.ad = a * d * weight;
+				q.b2 = b * b * weight; q.bc = b * c * weight; q.bd = b * d * weight;
+				q.c2 = c * c * weight; q.cd = c * d * weight;
+				q.d2 = d * d * weight;
+				q.weight = weight;
+				return q;
+			}
+
+			Quadric &operator+=(const Quadric &o) {
+				a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad;
+				b2 += o.b2; bc += o.bc; bd += o.bd;
+				c2 += o.c2; cd += o.cd;
+				d2 += o.d2;
+				weight += o.weight;
+				return *this;
+			}
+
+			// Weighted mean squared distance to the planes, a squared length in model units
+			// whatever the number of planes gathered
+			double meanError(const glm::vec3 &p) const {
+				return weight > 0.0 ? error(p) / weight : 0.0;
+			}
+
+			double error(const glm::vec3 &p) const {
+				double x = p.x, y = p.y, z = p.z;
+				double result =
+					a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+					+ b2 * y * y + 2 * bc * y * z + 2 * bd * y
+					+ c2 * z * z + 2 * cd * z
+					+ d2;
+				return std::max(result, 0.0);
+			}
+		};
+
+		Quadric planeQuadric(const glm::vec3 &p0, const glm::vec3 &normal, double weight) {
+			glm::dvec3 n{normal.x, normal.y, normal.z};
+			double length = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+			if (length == 0.0) return Quadric{};
+			n = n / length;
+			double d = -(n.x * p0.x + n.y * p0.y + n.z * p0.z);
+			return Quadric::fromPlane(n.x, n.y, n.z, d, weight);
+		}
+
+		struct Collapse {
+			uint32_t from;
+			uint32_t to;
+			double cost;
+		};
+
+		// Collapses work on positions: vertices split on an attribute seam (same position, other
+		// color) form one group, indexed by its first vertex, that collapses as a whole.
+		class Simplifier {
+			public:
+			Simplifier(const std::vector<HexModel::Vertex> &vertices, const std::vector<uint32_t> &indices)
+				: vertices{vertices}, indices{indices}, quadrics(vertices.size()) {
+				groupVertices();
+				computeQuadrics();
+			}
+
+			// Collapse edges until the mesh has at most targetTriangles or no collapse stays under maxCost
+			void simplify(size_t targetTriangles, double maxCost) {
+				while (indices.size() / 3 > targetTriangles) {
+					size_t collapsed = collapsePass(targetTriangles, maxCost);
+					if (collapsed == 0) break;
+				}
+			}
+
+			const std::vector<uint32_t> &getIndices() const { return indices; }
+			double getMaxCost() const { return maxCostSoFar; }
+
+			private:
+			void groupVertices() {
+				std::vector<uint32_t> order(vertices.size());
+				for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+				auto less = [&](uint32_t a, uint32_t b) {
+					const glm::vec3 &pa = vertices[a].position;
+					const glm::vec3 &pb = vertices[b].position;
+					if (pa.x != pb.x) return pa.x < pb.x;
+					if (pa.y != pb.y) return pa.y < pb.y;
+					if (pa.z != pb.z) return pa.z < pb.z;
+					return a < b;
+				};
+				std::sort(order.begin(), order.end(), less);
+
+				group.resize(vertices.size());
+				groupOffsets.assign(vertices.size() + 1, 0);
+				for (size_t i = 0; i < order.size(); i++) {
+					bool samePosition = i > 0 && vertices[order[i - 1]].position == vertices[order[i]].position;
+					group[order[i]] = samePosition ? group[order[i - 1]] : order[i];
+					groupOffsets[group[order[i]] + 1]++;
+				}
+				for (size_t v = 0; v < vertices.size(); v++) groupOffsets[v + 1] += groupOffsets[v];
+
+				// Sorted order lists the members of a group together, first vertex first
+				groupMembers.resize(vertices.size());
+				std::vector<uint32_t> fill(groupOffsets.begin(), groupOffsets.end() - 1);
+				for (uint32_t v : order) groupMembers[fill[group[v]]++] = v;
+			}
+
+			void computeQuadrics() {
+				std::vector<std::pair<uint64_t, uint32_t>> edges;
+				edges.reserve(indices.size());
+
+				for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+					const glm::vec3 &p0 = vertices[indices[i]].position;
+					const glm::vec3 &p1 = vertices[indices[i + 1]].position;
+					const glm::vec3 &p2 = vertices[indices[i + 2]].position;
+					glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+
+					Quadric q = planeQuadric(p0, normal, 1.0);
+					for (int k = 0; k < 3; k++) {
+						quadrics[group[indices[i + k]]] += q;
+
+						uint32_t a = group[indices[i + k]];
+						uint32_t b = group[indices[i + (k + 1) % 3]];
+						edges.emplace_back(edgeKey(a, b), static_cast<uint32_t>(i));
+					}
+				}
+
+				// Edges used by a single triangle are on the boundary, seams aren't: their sides
+				// use the same groups
+				std::sort(edges.begin(), edges.end());
+				for (size_t i = 0; i < edges.size(); i++) {
+					bool shared = (i > 0 && edges[i - 1].first == edges[i].first)
+						|| (i + 1 < edges.size() && edges[i + 1].first == edges[i].first);
+					if (shared) continue;
+
+					uint32_t a = static_cast<uint32_t>(edges[i].first >> 32);
+					uint32_t b = static_cast<uint32_t>(edges[i].first & 0xffffffffu);
+					size_t triangle = edges[i].second;
+
+					const glm::vec3 &p0 = vertices[indices[triangle]].position;
+					const glm::vec3 &p1 = vertices[indices[triangle + 1]].position;
+					const glm::vec3 &p2 = vertices[indices[triangle + 2]].position;
+					glm::vec3 faceNormal = glm::cross(p1 - p0, p2 - p0);
+
+					// Plane through the edge, perpendicular to the face
+					glm::vec3 edge = vertices[b].position - vertices[a].position;
+					glm::vec3 normal = glm::cross(edge, faceNormal);
+					Quadric q = planeQuadric(vertices[a].position, normal, boundaryWeight);
+					quadrics[a] += q;
+					quadrics[b] += q;
+				}
+			}
+
+			static uint64_t edgeKey(uint32_t a, uint32_t b) {
+				if (a > b) std::swap(a, b);
+				return (static_cast<uint64_t>(a) << 32) | b;
+			}
+
+			double collapseCost(uint32_t from, uint32_t to) const {
+				Quadric q = quadrics[from];
+				q += quadrics[to];
+				return q.meanError(vertices[to].position);
+			}
+
+			// Vertex of group to sharing a triangle with vertex, or vertex itself when it's no longer
+			// used. Every vertex of a seam group needs one so colors stay on their side of the seam:
+			// seam groups only collapse along the seam.
+			uint32_t collapseTarget(uint32_t vertex, uint32_t from, uint32_t to) const {
+				bool used = false;
+				for (uint32_t i = adjacencyOffsets[from]; i < adjacencyOffsets[from + 1]; i++) {
+					size_t triangle = adjacencyTriangles[i] * 3;
+					uint32_t corners[3] = {indices[triangle], indices[triangle + 1], indices[triangle + 2]};
+					if (corners[0] != vertex && corners[1] != vertex && corners[2] != vertex) continue;
+					used = true;
+					for (uint32_t corner : corners) {
+						if (group[corner] == to) return corner;
+					}
+				}
+				return used ? NO_TARGET : vertex;
+			}
+
+			// Moving group from onto group to must not turn any remaining triangle around
+			bool flipsTriangles(uint32_t from, uint32_t to) const {
+				const glm::vec3 &target = vertices[to].position;
+				for (uint32_t i = adjacencyOffsets[from]; i < adjacencyOffsets[from + 1]; i++) {
+					size_t triangle = adjacencyTriangles[i] * 3;
+					uint32_t corners[3] = {group[indices[triangle]], group[indices[triangle + 1]], group[indices[triangle + 2]]};
+					if (corners[0] == to || corners[1] == to || corners[2] == to) continue;
+
+					glm::vec3 before[3];
+					glm::vec3 after[3];
+					for (int k = 0; k < 3; k++) {
+						before[k] = vertices[corners[k]].position;
+						after[k] = corners[k] == from ? target : before[k];
+					}
+					glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+					glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+					if (glm::dot(n0, n1) <= 0.f) return true;
+				}
+				return false;
+			}
+
+			// Triangles around each group
+			void buildAdjacency() {
+				adjacencyOffsets.assign(vertices.size() + 1, 0);
+				for (uint32_t index : indices) adjacencyOffsets[group[index] + 1]++;
+				for (size_t v = 0; v < vertices.size(); v++) adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+
+				adjacencyTriangles.resize(indices.size());
+				std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+				for (size_t i = 0; i < indices.size(); i++) {
+					adjacencyTriangles[fill[group[indices[i]]]++] = static_cast<uint32_t>(i / 3);
+				}
+			}
+
+			size_t collapsePass(size_t targetTriangles, double maxCost) {
+				buildAdjacency();
+
+				std::vector<uint64_t> edges;
+				edges.reserve(indices.size());
+				for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+					for (int k = 0; k < 3; k++) {
+						uint32_t a = group[indices[i + k]];
+						uint32_t b = group[indices[i + (k + 1) % 3]];
+						if (a != b) edges.push_back(edgeKey(a, b));
+					}
+				}
+				std::sort(edges.begin(), edges.end());
+				edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+				std::vector<Collapse> collapses(edges.size());
+				parallelFor(edges.size(), 1 << 14, [&](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; i++) {
+						uint32_t a = static_cast<uint32_t>(edges[i] >> 32);
+						uint32_t b = static_cast<uint32_t>(edges[i] & 0xffffffffu);
+						double costAB = collapseCost(a, b);
+						double costBA = collapseCost(b, a);
+						collapses[i] = costAB <= costBA ? Collapse{a, b, costAB} : Collapse{b, a, costBA};
+					}
+				});
+
+				std::sort(collapses.begin(), collapses.end(), [](const Collapse &x, const Collapse &y) {
+					return x.cost < y.cost;
+				});
+
+				// Each collapse removes about two triangles
+				size_t triangleCount = indices.size() / 3;
+				size_t collapsesNeeded = (triangleCount - targetTriangles + 1) / 2;
+
+				std::vector<uint32_t> remap(vertices.size());
+				for (uint32_t i = 0; i < remap.size(); i++) remap[i] = i;
+				std::vector<bool> locked(vertices.size(), false);
+				std::vector<uint32_t> targets;
+				size_t collapsed = 0;
+
+				for (const Collapse &collapse : collapses) {
+					if (collapsed >= collapsesNeeded || collapse.cost > maxCost) break;
+					if (locked[collapse.from] || locked[collapse.to]) continue;
+					if (flipsTriangles(collapse.from, collapse.to)) continue;
+
+					targets.clear();
+					for (uint32_t i = groupOffsets[collapse.from]; i < groupOffsets[collapse.from + 1]; i++) {
+						targets.push_back(collapseTarget(groupMembers[i], collapse.from, collapse.to));
+						if (targets.back() == NO_TARGET) break;
+					}
+					if (targets.back() == NO_TARGET) continue;
+
+					for (uint32_t i = groupOffsets[collapse.from]; i < groupOffsets[collapse.from + 1]; i++) {
+						remap[groupMembers[i]] = targets[i - groupOffsets[collapse.from]];
+					}
+					quadrics[collapse.to] += quadrics[collapse.from];
+					maxCostSoFar = std::max(maxCostSoFar, collapse.cost);
+					collapsed++;
+
+					// Triangles around both ends changed, their flip tests are stale for this pass
+					for (uint32_t v : {collapse.from, collapse.to}) {
+						for (uint32_t i = adjacencyOffsets[v]; i < adjacencyOffsets[v + 1]; i++) {
+							size_t triangle = adjacencyTriangles[i] * 3;
+							for (int k = 0; k < 3; k++) locked[group[indices[triangle + k]]] = true;
+						}
+					}
+				}
+
+				if (collapsed == 0) return 0;
+
+				// Remap and drop triangles that became degenerate, two corners of a group are one position
+				size_t write = 0;
+				for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+					uint32_t a = remap[indices[i]];
+					uint32_t b = remap[indices[i + 1]];
+					uint32_t c = remap[indices[i + 2]];
+					if (group[a] == group[b] || group[b] == group[c] || group[c] == group[a]) continue;
+					indices[write++] = a;
+					indices[write++] = b;
+					indices[write++] = c;
+				}
+				indices.resize(write);
+
+				return collapsed;
+			}
+
+			static constexpr uint32_t NO_TARGET = ~0u;
+
+			const std::vector<HexModel::Vertex> &vertices;
+			std::vector<uint32_t> indices;
+			// Indexed by group
+			std::vector<Quadric> quadrics;
+			// Group of each vertex, members of each group (first one first)
+			std::vector<uint32_t> group;
+			std::vector<uint32_t> groupOffsets;
+			std::vector<uint32_t> groupMembers;
+			std::vector<uint32_t> adjacencyOffsets;
+			std::vector<uint32_t> adjacencyTriangles;
+			double maxCostSoFar = 0.0;
+		};
+	}
+
+	std::vector<HexMeshSimplifier::Level> HexMeshSimplifier::buildLodChain(
+		const std::vector<HexModel::Vertex> &vertices,
+		const std::vector<uint32_t> &indices,
+		float maxError,
+		size_t maxLevels,
+		size_t minTriangles) {
+
+		std::vector<Level> levels;
+		if (indices.size() / 3 <= minTriangles) return levels;
+
+		// Quadrics and collapses carry over from one level to the next
+		Simplifier simplifier{vertices, indices};
+		double maxCost = static_cast<double>(maxError) * static_cast<double>(maxError);
+		size_t previousTriangles = indices.size() / 3;
+
+		while (levels.size() < maxLevels && previousTriangles > minTriangles) {
+			size_t target = std::max(previousTriangles / 2, minTriangles);
+			simplifier.simplify(target, maxCost);
+
+			size_t triangles = simplifier.getIndices().size() / 3;
+			if (triangles == 0 || static_cast<float>(triangles) > (1.f - minLevelReduction) * previousTriangles) break;
+
+			// Collapse costs are mean squared distances
+			levels.push_back({simplifier.getIndices(), static_cast<float>(std::sqrt(simplifier.getMaxCost()))});
+			previousTriangles = triangles;
+		}
+
+		return levels;
+	}
+
+	void HexMeshSimplifier::generateLods(HexModel::Builder &builder, float maxRelativeError, size_t maxLevels) {
+		if (builder.indices.size() < 3) return;
+
+		glm::vec3 boundsMin = builder.vertices[0].position;
+		glm::vec3 boundsMax = boundsMin;
+		for (auto &v : builder.vertices) {
+			boundsMin = glm::min(boundsMin, v.position);
+			boundsMax = glm::max(boundsMax, v.position);
+		}
+		float maxError = glm::length(boundsMax - boundsMin) * maxRelativeError;
+
+		auto levels = buildLodChain(builder.vertices, builder.indices, maxError, maxLevels, 64);
+
+		// Reordering a level doesn't depend on the others
+		parallelTasks(levels.size(), [&](size_t i) {
+			HexMeshOptimizer::optimizeVertexCache(levels[i].indices, builder.vertices.size());
+		});
+
+		builder.lods.clear();
+		builder.lods.push_back({0, static_cast<uint32_t>(builder.indices.size()), 0.f});
+		for (auto &level : levels) {
+			builder.lods.push_back({static_cast<uint32_t>(builder.indices.size()), static_cast<uint32_t>(level.indices.size()), level.error});
+			builder.indices.insert(builder.indices.end(), level.indices.begin(), level.indices.end());
+		}
+	}
+}
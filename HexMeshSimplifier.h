@@ -0,0 +1,36 @@
+#pragma once
+
+#include "HexModel.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace hex {
+
+	// Quadric error edge collapse simplification (Garland and Heckbert 1997).
+	// Vertices are only merged into existing vertices, so every level of detail shares the
+	// vertex buffer of the full resolution mesh and only needs its own index range. Vertices
+	// split on a color seam collapse together, along the seam only.
+	class HexMeshSimplifier {
+		public:
+		struct Level {
+			std::vector<uint32_t> indices;
+			// Largest collapse error so far, in model units: root mean square distance of a merged
+			// vertex to the planes of the original faces it gathered
+			float error;
+		};
+
+		// Successive levels of about half the triangles of the previous one, collapses are
+		// rejected past maxError and the chain stops when a level doesn't shrink enough
+		static std::vector<Level> buildLodChain(
+			const std::vector<HexModel::Vertex> &vertices,
+			const std::vector<uint32_t> &indices,
+			float maxError,
+			size_t maxLevels,
+			size_t minTriangles);
+
+		// Build the chain for the builder mesh and append it to builder.indices / builder.lods,
+		// maxRelativeError is relative to the model bounding box diagonal
+		static void generateLods(HexModel::Builder &builder, float maxRelativeError = .02f, size_t maxLevels = 8);
+	};
+}
@@ -0,0 +1,166 @@
+#include "HexMeshWinding.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace hex {
+
+	namespace {
+
+		const uint32_t noNeighbor = ~0u;
+
+		struct PositionHash {
+			size_t operator()(const glm::vec3 &p) const {
+				// -0 and 0 compare equal, they must hash the same
+				glm::vec3 q = p + glm::vec3{0.f};
+				uint32_t bits[3];
+				memcpy(bits, &q, sizeof(bits));
+				return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+			}
+		};
+
+		// Undirected edge key, the direction the triangle runs it in, and which of its edges it is
+		struct HalfEdge {
+			uint64_t key;
+			uint32_t corner;
+			bool forward;
+		};
+
+		// Triangle corners as welded vertex ids, one id per distinct position
+		std::vector<uint32_t> weldCorners(const HexModel::Builder &builder, size_t triangleCount) {
+			std::unordered_map<glm::vec3, uint32_t, PositionHash> ids;
+			ids.reserve(builder.vertices.size());
+			std::vector<uint32_t> vertexIds(builder.vertices.size());
+			for (size_t v = 0; v < builder.vertices.size(); v++) {
+				vertexIds[v] = ids.emplace(builder.vertices[v].position, static_cast<uint32_t>(ids.size())).first->second;
+			}
+
+			std::vector<uint32_t> corners(triangleCount * 3);
+			for (size_t i = 0; i < corners.size(); i++) {
+				corners[i] = vertexIds[builder.indices.empty() ? i : builder.indices[i]];
+			}
+			return corners;
+		}
+	}
+
+	HexMeshWinding::Result HexMeshWinding::orient(HexModel::Builder &builder) {
+		Result result{};
+		builder.closed = false;
+
+		bool indexed = !builder.indices.empty();
+		size_t triangleCount = (indexed ? builder.indices.size() : builder.vertices.size()) / 3;
+		if (triangleCount == 0) return result;
+
+		std::vector<uint32_t> corners = weldCorners(builder, triangleCount);
+
+		// Degenerate triangles have no side, they're left out of the adjacency
+		std::vector<HalfEdge> halfEdges;
+		halfEdges.reserve(corners.size());
+		for (uint32_t corner = 0; corner < corners.size(); corner++) {
+			uint32_t t = corner / 3;
+			uint32_t a = corners[corner];
+			uint32_t b = corners[t * 3 + (corner + 1) % 3];
+			uint32_t c = corners[t * 3 + (corner + 2) % 3];
+			if (a == b || b == c || c == a) continue;
+			uint64_t key = (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+			halfEdges.push_back({key, corner, a < b});
+		}
+		std::sort(halfEdges.begin(), halfEdges.end(), [](const HalfEdge &l, const HalfEdge &r) { return l.key < r.key; });
+
+		// Neighbor across each edge, shifted left once, lowest bit set when both run the edge the same way.
+		// Boundary and non manifold edges (1 or 3+ triangles) have no neighbor.
+		std::vector<uint32_t> neighbors(corners.size(), noNeighbor);
+		std::vector<uint8_t> open(triangleCount, 0);
+		for (size_t begin = 0; begin < halfEdges.size();) {
+			size_t end = begin + 1;
+			while (end < halfEdges.size() && halfEdges[end].key == halfEdges[begin].key) end++;
+
+			if (end - begin == 2) {
+				const HalfEdge &l = halfEdges[begin];
+				const HalfEdge &r = halfEdges[begin + 1];
+				uint32_t same = l.forward == r.forward ? 1 : 0;
+				neighbors[l.corner] = (r.corner / 3) << 1 | same;
+				neighbors[r.corner] = (l.corner / 3) << 1 | same;
+			} else {
+				for (size_t i = begin; i < end; i++) open[halfEdges[i].corner / 3] = 1;
+			}
+			begin = end;
+		}
+
+		// Flood each component, a neighbor running an edge the same way gets the opposite flip
+		std::vector<int8_t> flip(triangleCount, -1);
+		std::vector<uint32_t> component;
+		std::vector<uint32_t> stack;
+		bool allClosed = true;
+		for (uint32_t seed = 0; seed < triangleCount; seed++) {
+			if (flip[seed] >= 0) continue;
+			flip[seed] = 0;
+			component.clear();
+			stack.push_back(seed);
+
+			bool closed = true;
+			bool orientable = true;
+			while (!stack.empty()) {
+				uint32_t t = stack.back();
+				stack.pop_back();
+				component.push_back(t);
+				if (open[t]) closed = false;
+
+				for (uint32_t k = 0; k < 3; k++) {
+					uint32_t neighbor = neighbors[t * 3 + k];
+					if (neighbor == noNeighbor) continue;
+					uint32_t n = neighbor >> 1;
+					int8_t wanted = static_cast<int8_t>(flip[t] ^ (neighbor & 1));
+					if (flip[n] < 0) {
+						flip[n] = wanted;
+						stack.push_back(n);
+					} else if (flip[n] != wanted) {
+						// Moebius strip like, no consistent winding
+						orientable = false;
+					}
+				}
+			}
+
+			// Signed volume of the component as it will be wound, positive when facing outward
+			double volume = 0.0;
+			uint32_t flipped = 0;
+			for (uint32_t t : component) {
+				glm::dvec3 a{builder.vertices[indexed ? builder.indices[t * 3] : t * 3].position};
+				glm::dvec3 b{builder.vertices[indexed ? builder.indices[t * 3 + 1] : t * 3 + 1].position};
+				glm::dvec3 c{builder.vertices[indexed ? builder.indices[t * 3 + 2] : t * 3 + 2].position};
+				double signedVolume = glm::dot(a, glm::cross(b, c));
+				volume += flip[t] ? -signedVolume : signedVolume;
+				flipped += flip[t];
+			}
+
+			bool inverted;
+			if (closed && orientable) {
+				inverted = volume < 0.0;
+			} else {
+				inverted = flipped * 2 > component.size();
+				allClosed = false;
+			}
+			if (inverted) {
+				for (uint32_t t : component) flip[t] ^= 1;
+			}
+			result.components++;
+		}
+
+		for (uint32_t t = 0; t < triangleCount; t++) {
+			if (!flip[t]) continue;
+			if (indexed) {
+				std::swap(builder.indices[t * 3 + 1], builder.indices[t * 3 + 2]);
+			} else {
+				std::swap(builder.vertices[t * 3 + 1], builder.vertices[t * 3 + 2]);
+			}
+			result.flippedTriangles++;
+		}
+
+		result.closed = allClosed;
+		builder.closed = allClosed;
+		return result;
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "HexModel.h"
+
+#include <cstdint>
+
+namespace hex {
+
+	// Makes the winding of a triangle mesh consistent, counter clockwise seen from outside, so
+	// back faces can be culled. Triangles sharing an edge are flipped until they run it in
+	// opposite directions, then every closed component with a negative signed volume is
+	// turned inside out. Corners are welded by position, so vertices split for normals or
+	// colors (and non indexed meshes) still connect. Volume boundaries already take the
+	// winding of their cell faces, this catches the faces of inverted cells.
+	// Open components have no outside, they keep the winding most of their triangles had.
+	class HexMeshWinding {
+		public:
+		struct Result {
+			uint32_t flippedTriangles = 0;
+			uint32_t components = 0;
+			// Every edge is shared by exactly two consistently wound triangles
+			bool closed = false;
+		};
+
+		// Flips triangles in place and sets builder.closed. Run before computing normals,
+		// triangle order and triangle cells are kept.
+		static Result orient(HexModel::Builder &builder);
+	};
+}
@@ -0,0 +1,126 @@
+#include "HexMeshletBuilder.h"
+#include "HexParallel.h"
+
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+namespace hex {
+
+	namespace {
+		const uint32_t unassigned = ~0u;
+	}
+
+	HexMeshletBuilder::Meshlets HexMeshletBuilder::build(const FloatVertex *vertices, uint32_t vertexCount, const uint32_t *indices, uint32_t indexCount) {
+		assert(indexCount % 3 == 0 && "Meshlets are built from triangle lists");
+
+		Meshlets result{};
+		uint32_t triangleCount = indexCount / 3;
+		result.triangles.reserve(triangleCount);
+		result.vertices.reserve(vertexCount + vertexCount / 4);
+		result.meshlets.reserve(triangleCount / MAX_TRIANGLES + 1);
+
+		// Local index of each model vertex in the meshlet being built
+		std::vector<uint32_t> localIndex(vertexCount, unassigned);
+
+		HexMeshlet current{};
+
+		auto flush = [&]() {
+			if (current.triangleCount == 0) return;
+			for (uint32_t i = 0; i < current.vertexCount; i++) {
+				localIndex[result.vertices[current.vertexOffset + i]] = unassigned;
+			}
+			result.meshlets.push_back(current);
+
+			current = HexMeshlet{};
+			current.vertexOffset = static_cast<uint32_t>(result.vertices.size());
+			current.triangleOffset = static_cast<uint32_t>(result.triangles.size());
+		};
+
+		for (uint32_t triangle = 0; triangle < triangleCount; triangle++) {
+			const uint32_t *corners = indices + triangle * 3;
+
+			uint32_t newVertices = 0;
+			for (int k = 0; k < 3; k++) {
+				bool repeated = (k > 0 && corners[k] == corners[0]) || (k > 1 && corners[k] == corners[1]);
+				if (localIndex[corners[k]] == unassigned && !repeated) newVertices++;
+			}
+
+			if (current.vertexCount + newVertices > MAX_VERTICES || current.triangleCount == MAX_TRIANGLES) {
+				flush();
+			}
+
+			uint32_t packed = 0;
+			for (int k = 0; k < 3; k++) {
+				uint32_t &local = localIndex[corners[k]];
+				if (local == unassigned) {
+					local = current.vertexCount++;
+					result.vertices.push_back(corners[k]);
+				}
+				packed |= local << (8 * k);
+			}
+			result.triangles.push_back(packed);
+			current.triangleCount++;
+		}
+		flush();
+
+		parallelFor(result.meshlets.size(), 256, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				computeBounds(result.meshlets[i], result, vertices);
+			}
+		});
+
+		return result;
+	}
+
+	void HexMeshletBuilder::computeBounds(HexMeshlet &meshlet, const Meshlets &meshlets, const FloatVertex *vertices) {
+		const uint32_t *meshletVertices = meshlets.vertices.data() + meshlet.vertexOffset;
+
+		// Sphere around the box center, loose but cheap and conservative
+		glm::vec3 boundsMin{std::numeric_limits<float>::max()};
+		glm::vec3 boundsMax{std::numeric_limits<float>::lowest()};
+		for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+			boundsMin = glm::min(boundsMin, vertices[meshletVertices[i]].position);
+			boundsMax = glm::max(boundsMax, vertices[meshletVertices[i]].position);
+		}
+		meshlet.center = (boundsMin + boundsMax) * .5f;
+		meshlet.radius = 0.f;
+		for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+			meshlet.radius = glm::max(meshlet.radius, glm::length(vertices[meshletVertices[i]].position - meshlet.center));
+		}
+
+		// Geometric triangle normals, the winding decides which side is the front
+		std::vector<glm::vec3> normals;
+		normals.reserve(meshlet.triangleCount);
+		glm::vec3 axis{0.f};
+		for (uint32_t t = 0; t < meshlet.triangleCount; t++) {
+			uint32_t packed = meshlets.triangles[meshlet.triangleOffset + t];
+			const glm::vec3 &a = vertices[meshletVertices[packed & 0xff]].position;
+			const glm::vec3 &b = vertices[meshletVertices[(packed >> 8) & 0xff]].position;
+			const glm::vec3 &c = vertices[meshletVertices[(packed >> 16) & 0xff]].position;
+
+			glm::vec3 normal = glm::cross(b - a, c - a);
+			float length = glm::length(normal);
+			if (length <= 0.f) continue;
+			normals.push_back(normal / length);
+			axis += normals.back();
+		}
+
+		meshlet.coneAxis = glm::vec3{0.f};
+		meshlet.coneCutoff = 1.f;
+
+		float axisLength = glm::length(axis);
+		if (normals.empty() || axisLength <= 0.f) return;
+		meshlet.coneAxis = axis / axisLength;
+
+		float minDot = 1.f;
+		for (auto &normal : normals) minDot = glm::min(minDot, glm::dot(normal, meshlet.coneAxis));
+
+		// Cone wider than ~84 degrees: almost never back facing as a whole, skip the test
+		if (minDot <= .1f) return;
+
+		// The back facing region is the normal cone widened by 90 degrees on each side:
+		// cos(spread + 90) = -sin(spread)
+		meshlet.coneCutoff = std::sqrt(1.f - minDot * minDot);
+	}
+}
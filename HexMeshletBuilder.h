@@ -0,0 +1,58 @@
+#pragma once
+
+#include "HexVertexFormats.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace hex {
+
+	// Cluster of neighbouring triangles culled as a unit. Matches the std430 layout of
+	// shaders/meshlet_common.glsl, so the array is uploaded as is.
+	struct HexMeshlet {
+		// Bounding sphere in model space
+		glm::vec3 center;
+		float radius;
+		// Normal cone: the cluster is back facing when
+		//   dot(center - eye, coneAxis) >= coneCutoff * length(center - eye) + radius
+		// A cutoff of 1 disables the test (normals spread too much)
+		glm::vec3 coneAxis;
+		float coneCutoff;
+		// Range in Meshlets::vertices (model vertex indices)
+		uint32_t vertexOffset;
+		uint32_t vertexCount;
+		// Range in Meshlets::triangles, also the triangle range in the source index buffer
+		uint32_t triangleOffset;
+		uint32_t triangleCount;
+	};
+
+	static_assert(sizeof(HexMeshlet) == 48, "HexMeshlet must match the shader layout");
+
+	// Splits an indexed mesh in meshlets, greedily in index order. Triangles are never
+	// reordered, so each meshlet is also a contiguous range of the index buffer and can be
+	// drawn with a plain indexed draw when mesh shaders are missing. Run it on indices
+	// optimized for the vertex cache, neighbouring triangles are then close in the buffer.
+	class HexMeshletBuilder {
+		public:
+		// Mesh shader output limits (124 keeps the primitive indices under 512 bytes)
+		static constexpr uint32_t MAX_VERTICES = 64;
+		static constexpr uint32_t MAX_TRIANGLES = 124;
+
+		struct Meshlets {
+			std::vector<HexMeshlet> meshlets;
+			// Model vertex index of each meshlet local vertex
+			std::vector<uint32_t> vertices;
+			// Local indices of each triangle, packed as a | b << 8 | c << 16
+			std::vector<uint32_t> triangles;
+		};
+
+		static Meshlets build(const FloatVertex *vertices, uint32_t vertexCount, const uint32_t *indices, uint32_t indexCount);
+
+		private:
+		static void computeBounds(HexMeshlet &meshlet, const Meshlets &meshlets, const FloatVertex *vertices);
+	};
+}
@@ -1,80 +1,297 @@
 #include "HexModel.h"
+#include "HexMeshCache.h"
+#include "HexMeshLoader.h"
+#include "HexMeshOptimizer.h"
+#include "HexMeshSimplifier.h"
+#include "HexMeshWinding.h"
+#include "HexParallel.h"
+#include "HexVolumeLoader.h"
+
+#include <glm/gtc/matrix_transform.hpp>
 
 #include <cassert>
+#include <chrono>
 #include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
 
 namespace hex {
-	
-	HexModel::HexModel(HexDevice &device, const std::vector<Vertex> &vertices) : hexDevice{device} {
-		createVertexBuffers(vertices);
+
+	HexModel::HexModel(HexGeometryArena &arena, const Builder &builder, HexVertexFormat format) : geometryArena{arena}, vertexFormat{format} {
+		create(builder, encodeVertices(builder.vertices, format), buildMeshlets(builder));
+	}
+
+	HexModel::HexModel(HexGeometryArena &arena, const LoadedFile &file) : geometryArena{arena} {
+		if (!file.cache) {
+			vertexFormat = file.vertices.format;
+			create(file.builder, file.vertices, file.meshlets);
+			return;
+		}
+
+		// Everything comes encoded from the mapped cache
+		const HexMeshCache &cache = *file.cache;
+		vertexFormat = cache.vertexFormat();
+		boundsMin = cache.boundsMin();
+		boundsMax = cache.boundsMax();
+
+		createIndexBuffers(cache.indices(), cache.indexCount());
+		setLods(cache.lods(), cache.lodCount());
+		createVertexBuffers(cache.positions(), cache.attributes(), cache.vertexCount());
+		meshlets = cache.meshlets();
+		triangleCells.assign(cache.triangleCells(), cache.triangleCells() + cache.triangleCellCount());
+		closed = cache.closed();
+		doubleSided = !closed;
+	}
+
+	void HexModel::create(const Builder &builder, const VertexStreams &streams, const HexMeshletBuilder::Meshlets &builderMeshlets) {
+		computeBounds(builder.vertices, boundsMin, boundsMax);
+
+		createIndexBuffers(builder.indices.data(), static_cast<uint32_t>(builder.indices.size()));
+		setLods(builder.lods.data(), static_cast<uint32_t>(builder.lods.size()));
+		createVertexBuffers(streams.positions.data(), streams.attributes.data(), static_cast<uint32_t>(builder.vertices.size()));
+		meshlets = builderMeshlets;
+		triangleCells = builder.triangleCells;
+		closed = builder.closed;
+		doubleSided = !closed;
 	}
 
 	HexModel::~HexModel() {
-		vkDestroyBuffer(hexDevice.device(), vertexBuffer, nullptr);
-		vkFreeMemory(hexDevice.device(), vertexBufferMemory, nullptr);
+		geometryArena.free(vertexAllocation);
+		geometryArena.free(indexAllocation);
+	}
+
+	HexModel::LoadedFile::LoadedFile() = default;
+	HexModel::LoadedFile::LoadedFile(LoadedFile &&) = default;
+	HexModel::LoadedFile &HexModel::LoadedFile::operator=(LoadedFile &&) = default;
+	HexModel::LoadedFile::~LoadedFile() = default;
+
+	std::unique_ptr<HexModel> HexModel::createModelFromFile(HexGeometryArena &arena, const std::string &filepath, HexVertexFormat format) {
+		LoadedFile file = loadFile(filepath, false, format);
+		return createModelFromFile(arena, file);
 	}
 
-	void HexModel::createVertexBuffers(const std::vector<Vertex> &vertices) {
+	std::unique_ptr<HexModel> HexModel::createModelFromFile(HexGeometryArena &arena, const LoadedFile &file) {
+		return std::make_unique<HexModel>(arena, file);
+	}
+
+	HexModel::LoadedFile HexModel::loadFile(const std::string &filepath, bool volumeOnly, HexVertexFormat format) {
+		auto start = std::chrono::high_resolution_clock::now();
+		LoadedFile file{};
+
+		uint64_t sourceSize;
+		uint64_t sourceHash;
+		{
+			HexMappedFile source{filepath};
+
+			// Volume models need the cells even when the boundary is cached, parse them once here
+			if (HexVolumeLoader::isVolumeFile(filepath)) {
+				auto volumeStart = std::chrono::high_resolution_clock::now();
+				file.volume = std::make_shared<HexVolumeMesh>(HexVolumeLoader::load(source));
+				float milliseconds = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - volumeStart).count();
+				std::cout << "Loaded " << filepath << ": " << file.volume->points.size() << " points, "
+					<< file.volume->cellCount() << " hexahedra in " << milliseconds << " ms" << std::endl;
+				if (volumeOnly) return file;
+			}
+
+			// Like page files, a sampled hash: large sources would otherwise be read whole at every start
+			sourceSize = source.size();
+			sourceHash = HexMeshCache::hashFileSampled(source);
+		}
+
+		file.cache = HexMeshCache::open(filepath, sourceSize, sourceHash, format);
+		if (file.cache) {
+			float milliseconds = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+			std::cout << "Loaded " << HexMeshCache::cachePath(filepath) << ": "
+				<< file.cache->vertexCount() << " vertices, " << file.cache->indexCount() / 3 << " triangles in "
+				<< milliseconds << " ms" << std::endl;
+			return file;
+		}
+
+		Builder &builder = file.builder;
+		if (file.volume) builder.loadVolume(*file.volume, filepath);
+		else builder.loadModel(filepath);
+
+		// Optimized once here, the cache then stores the optimized mesh
+		auto optimization = HexMeshOptimizer::optimize(builder);
+		if (!builder.indices.empty()) {
+			std::cout << "Optimized " << filepath << ": ACMR "
+				<< optimization.before.acmr << " -> " << optimization.after.acmr << ", ATVR "
+				<< optimization.before.atvr << " -> " << optimization.after.atvr << std::endl;
+		}
+
+		// Levels of detail are appended after the full resolution indices. Volume boundaries
+		// keep their cells only on the full mesh, simplification would break the mapping.
+		if (builder.triangleCells.empty()) HexMeshSimplifier::generateLods(builder);
+		if (builder.lods.size() > 1) {
+			// One write, other files may be loading on other threads
+			std::string triangles;
+			for (auto &lod : builder.lods) triangles += " " + std::to_string(lod.indexCount / 3);
+			std::cout << "Generated " << builder.lods.size() - 1 << " levels of detail for " << filepath << ":"
+				<< triangles << " triangles" << std::endl;
+		}
+
+		// Encoded once here too, a cached start only maps and uploads
+		file.vertices = encodeVertices(builder.vertices, format);
+		file.meshlets = buildMeshlets(builder);
+
+		// A missing cache only costs startup time, don't fail the load for it
+		try {
+			HexMeshCache::write(filepath, sourceSize, sourceHash, builder, file.vertices, file.meshlets);
+		} catch (const std::exception &e) {
+			std::cerr << "Mesh cache not written: " << e.what() << std::endl;
+		}
+
+		return file;
+	}
+
+	void HexModel::computeBounds(const std::vector<Vertex> &vertices, glm::vec3 &boundsMin, glm::vec3 &boundsMax) {
+		boundsMin = glm::vec3{std::numeric_limits<float>::max()};
+		boundsMax = glm::vec3{std::numeric_limits<float>::lowest()};
+		for (auto &v : vertices) {
+			boundsMin = glm::min(boundsMin, v.position);
+			boundsMax = glm::max(boundsMax, v.position);
+		}
+	}
+
+	glm::mat4 HexModel::decodeTransform(HexVertexFormat format, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+		if (format != HexVertexFormat::Quantized) return glm::mat4{1.f};
+
+		// Positions are stored relative to the bounds, flat axes get a unit extent
+		glm::vec3 extent = boundsMax - boundsMin;
+		for (int i = 0; i < 3; i++) {
+			if (extent[i] <= 0.f) extent[i] = 1.f;
+		}
+		return glm::scale(glm::translate(glm::mat4{1.f}, boundsMin), extent);
+	}
+
+	HexModel::VertexStreams HexModel::encodeVertices(const std::vector<Vertex> &vertices, HexVertexFormat format) {
+		VertexStreams streams{};
+		streams.format = format;
+		size_t count = vertices.size();
+
+		switch (format) {
+			case HexVertexFormat::Float: {
+				streams.positions.resize(count * sizeof(FloatPosition));
+				streams.attributes.resize(count * sizeof(FloatAttributes));
+				auto *positions = reinterpret_cast<FloatPosition*>(streams.positions.data());
+				auto *attributes = reinterpret_cast<FloatAttributes*>(streams.attributes.data());
+				for (size_t i = 0; i < count; i++) {
+					positions[i].position = vertices[i].position;
+					attributes[i].color = vertices[i].color;
+				}
+				break;
+			}
+			case HexVertexFormat::Quantized: {
+				glm::vec3 boundsMin;
+				glm::vec3 boundsMax;
+				computeBounds(vertices, boundsMin, boundsMax);
+				glm::mat4 transform = decodeTransform(format, boundsMin, boundsMax);
+				glm::vec3 toUnit = 1.f / glm::vec3{transform[0][0], transform[1][1], transform[2][2]};
+
+				streams.positions.resize(count * sizeof(QuantizedPosition));
+				streams.attributes.resize(count * sizeof(QuantizedAttributes));
+				auto *positions = reinterpret_cast<QuantizedPosition*>(streams.positions.data());
+				auto *attributes = reinterpret_cast<QuantizedAttributes*>(streams.attributes.data());
+
+				parallelFor(count, 1 << 14, [&](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; i++) {
+						const Vertex &v = vertices[i];
+
+						glm::vec3 position = glm::clamp((v.position - boundsMin) * toUnit, 0.f, 1.f) * 65535.f + .5f;
+						glm::vec3 color = glm::clamp(v.color, 0.f, 1.f) * 255.f + .5f;
+
+						for (int c = 0; c < 3; c++) {
+							positions[i].position[c] = static_cast<uint16_t>(position[c]);
+							attributes[i].color[c] = static_cast<uint8_t>(color[c]);
+						}
+						positions[i].position[3] = 0;
+						attributes[i].color[3] = 255;
+					}
+				});
+				break;
+			}
+			default:
+				throw std::runtime_error("Unsupported vertex format");
+		}
+		return streams;
+	}
+
+	HexMeshletBuilder::Meshlets HexModel::buildMeshlets(const Builder &builder) {
+		if (builder.indices.empty()) return {};
+
+		Lod full = builder.lods.empty() ? Lod{0, static_cast<uint32_t>(builder.indices.size()), 0.f} : builder.lods[0];
+		if (full.indexCount / 3 < MESHLET_MIN_TRIANGLES) return {};
+
+		return HexMeshletBuilder::build(builder.vertices.data(), static_cast<uint32_t>(builder.vertices.size()),
+			builder.indices.data() + full.firstIndex, full.indexCount);
+	}
+
+	void HexModel::createVertexBuffers(const void *positions, const void *attributes, uint32_t count) {
 		// Set the number of vertex
-		vertexCount = static_cast<uint32_t>(vertices.size());
-		
+		vertexCount = count;
+
 		// Need at least 3 point to display a triangle
 		assert(vertexCount >= 3 && "Vertex count must be at least 3");
-		
-		// Compute buffer size of the vertex buffer
-		VkDeviceSize bufferSize = sizeof(vertices[0]) * vertexCount;
 
-		// Create a buffer for vertex buffer
-		hexDevice.createBuffer(
-			bufferSize, 
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, 
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			vertexBuffer,
-			vertexBufferMemory
-		);
+		vertexTransform = decodeTransform(vertexFormat, boundsMin, boundsMax);
+		vertexAllocation = geometryArena.allocateVertices(vertexFormat, positions, attributes, vertexCount);
+	}
+
+	void HexModel::createIndexBuffers(const uint32_t *indices, uint32_t count) {
+		indexCount = count;
+		hasIndexBuffer = indexCount > 0;
 
-		void *data;
-		// Create a region of host memory mapped to device memory
-		// and sets data to point to the beginning of the mapped memory range
-		vkMapMemory(hexDevice.device(), vertexBufferMemory, 0, bufferSize, 0, &data);
-		// Copy from vertices to data mapped memory
-		memcpy(data, vertices.data(), static_cast<size_t>(bufferSize));
-		vkUnmapMemory(hexDevice.device(), vertexBufferMemory);
+		if (!hasIndexBuffer)
+			return;
 
+		indexAllocation = geometryArena.allocateIndices(indices, indexCount);
 	}
 
-	void HexModel::draw(VkCommandBuffer commandBuffer) {
-		vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+	void HexModel::setLods(const Lod *lodTable, uint32_t count) {
+		lods.assign(lodTable, lodTable + count);
+		if (lods.empty()) {
+			lods.push_back({0, indexCount, 0.f});
+		}
 	}
 
-	void HexModel::bind(VkCommandBuffer commandBuffer) {
-		VkBuffer buffers[] = {vertexBuffer};
-		VkDeviceSize offsets[] = {0};
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+	void HexModel::draw(VkCommandBuffer commandBuffer, uint32_t lod) {
+		// Offsets are looked up at draw time, compaction may have moved the allocations
+		uint32_t firstVertex = geometryArena.getOffset(vertexAllocation);
+		if (hasIndexBuffer) {
+			assert(lod < lods.size() && "Level of detail out of range");
+			uint32_t firstIndex = geometryArena.getOffset(indexAllocation) + lods[lod].firstIndex;
+			vkCmdDrawIndexed(commandBuffer, lods[lod].indexCount, 1, firstIndex, static_cast<int32_t>(firstVertex), 0);
+		} else {
+			vkCmdDraw(commandBuffer, vertexCount, 1, firstVertex, 0);
+		}
 	}
 
-	std::vector<VkVertexInputBindingDescription> HexModel::Vertex::getBindingDescriptions() {
-		// Binding description, describe binding between vertex buffer and graphic pipeline
-		std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
-		bindingDescriptions[0].binding = 0; // Here we have only one binding and one vertex buffer (so binding = 0)
-		bindingDescriptions[0].stride = sizeof(Vertex); // Each element of vertex buffer contains one vertex
-		bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX; // Input rate to graphic pipeline I suppose (set to input rate for vertex seems nice)
-		return bindingDescriptions;
+	VkDrawIndexedIndirectCommand HexModel::indirectCommand(uint32_t lod) const {
+		assert(hasIndexBuffer && lod < lods.size() && "Indirect commands need an indexed level of detail");
+		VkDrawIndexedIndirectCommand command{};
+		command.indexCount = lods[lod].indexCount;
+		command.instanceCount = 1;
+		command.firstIndex = geometryArena.getOffset(indexAllocation) + lods[lod].firstIndex;
+		command.vertexOffset = static_cast<int32_t>(geometryArena.getOffset(vertexAllocation));
+		return command;
 	}
 
-	std::vector<VkVertexInputAttributeDescription> HexModel::Vertex::getAttributeDescriptions() {
-		// Attribute description, describe attribute in vertex buffer (what this vertex buffer contains)
-		std::vector<VkVertexInputAttributeDescription> attributeDescriptions(2);
-		attributeDescriptions[0].binding = 0; // Associate to binding 0
-		attributeDescriptions[0].location = 0; // Location 0 (see vertex shader, it means position)
-		attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT; // This is the format data expected to represent a position
-		attributeDescriptions[0].offset = offsetof(Vertex, position);
+	void HexModel::Builder::loadModel(const std::string &filepath) {
+		*this = HexMeshLoader::loadFile(filepath);
+		orient(filepath);
+	}
 
-		attributeDescriptions[1].binding = 0; // Associate to binding 0
-		attributeDescriptions[1].location = 1; // Location 1 (see vertex shader, it means fragColor)
-		attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT; // This is the format data expected to represent a color
-		attributeDescriptions[1].offset = offsetof(Vertex, color);
+	void HexModel::Builder::loadVolume(const HexVolumeMesh &volume, const std::string &filepath) {
+		*this = HexMeshLoader::loadVolume(volume, filepath);
+		orient(filepath);
+	}
 
-		return attributeDescriptions;
+	void HexModel::Builder::orient(const std::string &filepath) {
+		auto winding = HexMeshWinding::orient(*this);
+		std::cout << "Oriented " << filepath << ": " << winding.flippedTriangles << " triangles flipped, "
+			<< winding.components << (winding.components == 1 ? " component, " : " components, ")
+			<< (winding.closed ? "closed" : "open, drawn double sided") << std::endl;
 	}
-}
\ No newline at end of file
+}
@@ -1,38 +1,168 @@
 #pragma once
 
 #include "hex_device.h"
+#include "HexGeometryArena.h"
+#include "HexMeshletBuilder.h"
+#include "HexVertexFormats.h"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 
+#include <memory>
+#include <string>
+
 namespace hex {
+	class HexMeshCache;
+	class HexVolumeMesh;
+
 	class HexModel {
 		public:
 
-		struct Vertex {
-			glm::vec3 position;
-			glm::vec3 color;
+		// Meshes are built in full precision, the GPU copy uses the model vertex format
+		using Vertex = FloatVertex;
+
+		// Range of the index buffer drawn for one level of detail, all levels share the vertices
+		struct Lod {
+			uint32_t firstIndex;
+			uint32_t indexCount;
+			// Geometric error compared to the full resolution mesh, in model units
+			// (see HexMeshSimplifier::Level)
+			float error;
+		};
+
+		// CPU side geometry, indices are optional (empty means non indexed draw).
+		// Without lods the whole index buffer is the only level.
+		struct Builder {
+			std::vector<Vertex> vertices{};
+			std::vector<uint32_t> indices{};
+			std::vector<Lod> lods{};
+			// Source volume cell of each full resolution triangle, empty for surface meshes
+			std::vector<uint32_t> triangleCells{};
+			// Consistently wound closed surface, its back faces are never seen (see HexMeshWinding)
+			bool closed = false;
+
+			// Loads and orients the winding
+			void loadModel(const std::string &filepath);
+			// Boundary of a parsed volume, oriented the same way
+			void loadVolume(const HexVolumeMesh &volume, const std::string &filepath);
 
-			static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
-			static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
+			private:
+			void orient(const std::string &filepath);
 		};
 
-		HexModel(HexDevice &device, const std::vector<Vertex> &vertices);
+		// Both arena streams of a vertex format, encoded for upload (see HexGeometryArena::allocateVertices)
+		struct VertexStreams {
+			HexVertexFormat format = HexVertexFormat::Float;
+			std::vector<uint8_t> positions;
+			std::vector<uint8_t> attributes;
+		};
+
+		struct LoadedFile;
+
+		// Geometry lives in the arena, the model only keeps its allocations
+		HexModel(HexGeometryArena &arena, const Builder &builder, HexVertexFormat format = HexVertexFormat::Float);
+		// Upload the streams and meshlets loadFile encoded or mapped from the mesh cache
+		HexModel(HexGeometryArena &arena, const LoadedFile &file);
 		~HexModel();
 
 		HexModel(const HexModel &) = delete;
 		HexModel &operator=(const HexModel &) = delete;
 
-		void bind(VkCommandBuffer commandBuffer);
-		void draw(VkCommandBuffer commandBuffer);
+		// Smaller meshes are never split in meshlets, per object culling is enough for them
+		static constexpr uint32_t MESHLET_MIN_TRIANGLES = 1 << 12;
+
+		// CPU side of a model file: the mapped cache, or what the cache was written from
+		struct LoadedFile {
+			std::unique_ptr<HexMeshCache> cache;
+			Builder builder{};
+			VertexStreams vertices{};
+			HexMeshletBuilder::Meshlets meshlets{};
+			// Cells of volume files, the same parse gives the boundary on a cache miss
+			std::shared_ptr<HexVolumeMesh> volume;
+
+			LoadedFile();
+			LoadedFile(LoadedFile &&);
+			LoadedFile &operator=(LoadedFile &&);
+			~LoadedFile();
+		};
+
+		// Load through the binary cache next to the file, which is (re)built when missing or stale
+		static std::unique_ptr<HexModel> createModelFromFile(HexGeometryArena &arena, const std::string &filepath, HexVertexFormat format = HexVertexFormat::Quantized);
+		// Parsing, optimization, simplification, vertex encoding and meshlets, without touching
+		// the device so several files can load at once (see HexApp::loadGameObjects). With volumeOnly,
+		// volume files only keep their cells and no boundary surface is built.
+		static LoadedFile loadFile(const std::string &filepath, bool volumeOnly = false, HexVertexFormat format = HexVertexFormat::Quantized);
+		// Upload on the calling thread, the arena isn't thread safe
+		static std::unique_ptr<HexModel> createModelFromFile(HexGeometryArena &arena, const LoadedFile &file);
+
+		// Encoded positions are relative to the bounds of the vertices for the quantized format
+		static VertexStreams encodeVertices(const std::vector<Vertex> &vertices, HexVertexFormat format);
+		// Maps encoded positions back to model space
+		static glm::mat4 decodeTransform(HexVertexFormat format, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax);
+		static void computeBounds(const std::vector<Vertex> &vertices, glm::vec3 &boundsMin, glm::vec3 &boundsMax);
+		// Meshlets of the full resolution level, none for small or non indexed meshes
+		static HexMeshletBuilder::Meshlets buildMeshlets(const Builder &builder);
+
+		// Arena buffers of the model vertex format must be bound (HexGeometryArena::bind, or
+		// bindPositions for depth only passes)
+		void draw(VkCommandBuffer commandBuffer, uint32_t lod = 0);
+		// Indexed models only: the command draw records, for renderers drawing from indirect buffers
+		VkDrawIndexedIndirectCommand indirectCommand(uint32_t lod = 0) const;
+		bool isIndexed() const { return hasIndexBuffer; }
+
+		uint32_t getLodCount() const { return static_cast<uint32_t>(lods.size()); }
+		const Lod &getLod(uint32_t lod) const { return lods[lod]; }
+
+		// Axis aligned bounding box of the vertices, in model space
+		glm::vec3 getBoundsMin() const { return boundsMin; }
+		glm::vec3 getBoundsMax() const { return boundsMax; }
+
+		HexVertexFormat getVertexFormat() const { return vertexFormat; }
+		// Maps vertex buffer positions to model space (undo position quantization), apply before the model matrix
+		const glm::mat4 &getVertexTransform() const { return vertexTransform; }
+
+		// Meshlets of the full resolution level, empty for small or non indexed meshes
+		bool hasMeshlets() const { return !meshlets.meshlets.empty(); }
+		const HexMeshletBuilder::Meshlets &getMeshlets() const { return meshlets; }
+		// Allocations for renderers that address the arena buffers themselves
+		HexGeometryArena::AllocationId getVertexAllocation() const { return vertexAllocation; }
+		HexGeometryArena::AllocationId getIndexAllocation() const { return indexAllocation; }
+
+		// Volume cell of each full resolution triangle, empty for surface meshes
+		bool hasTriangleCells() const { return !triangleCells.empty(); }
+		const std::vector<uint32_t> &getTriangleCells() const { return triangleCells; }
+
+		// Closed models are drawn with back faces culled, open surfaces from both sides.
+		// The flag overrides that, e.g. for a closed model the camera can enter.
+		bool isClosed() const { return closed; }
+		bool isDoubleSided() const { return doubleSided; }
+		void setDoubleSided(bool doubleSided) { this->doubleSided = doubleSided; }
+		VkCullModeFlags getCullMode() const { return doubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT; }
 
 		private:
-		void createVertexBuffers(const std::vector<Vertex> &vertices);
+		void create(const Builder &builder, const VertexStreams &streams, const HexMeshletBuilder::Meshlets &builderMeshlets);
+		void createVertexBuffers(const void *positions, const void *attributes, uint32_t count);
+		void createIndexBuffers(const uint32_t *indices, uint32_t count);
+		void setLods(const Lod *lodTable, uint32_t count);
 
-		HexDevice &hexDevice;
-		VkBuffer vertexBuffer;
-		VkDeviceMemory vertexBufferMemory;
+		HexGeometryArena &geometryArena;
+
+		HexGeometryArena::AllocationId vertexAllocation = HexGeometryArena::INVALID_ALLOCATION;
 		uint32_t vertexCount;
+		HexVertexFormat vertexFormat;
+		glm::mat4 vertexTransform{1.f};
+
+		bool hasIndexBuffer = false;
+		HexGeometryArena::AllocationId indexAllocation = HexGeometryArena::INVALID_ALLOCATION;
+		uint32_t indexCount;
+		std::vector<Lod> lods;
+		HexMeshletBuilder::Meshlets meshlets;
+		std::vector<uint32_t> triangleCells;
+		bool closed = false;
+		bool doubleSided = true;
+
+		glm::vec3 boundsMin{0.f};
+		glm::vec3 boundsMax{0.f};
 	};
-}
\ No newline at end of file
+}
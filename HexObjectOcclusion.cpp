@@ -0,0 +1,301 @@
+#include "HexObjectOcclusion.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+namespace hex {
+
+	// Layout of shaders/object_occlusion.comp, object_cull.comp only reads objectCount
+	struct ObjectOcclusionPushConstantData {
+		uint32_t objectCount;
+		uint32_t levelCount;
+		uint32_t depthSize[2];
+	};
+
+	namespace {
+		const uint32_t workgroupSize = 64;
+		// Slots of the first buffers, they grow by doubling
+		const uint32_t minCapacity = 64;
+	}
+
+	HexObjectOcclusion::HexObjectOcclusion(HexDevice &device, uint32_t framesInFlight, HexPipelineManager &pipelineManager)
+		: hexDevice{device}, framesInFlight{framesInFlight}, pipelineManager{pipelineManager} {
+		try {
+			createDescriptorSetLayouts();
+			createPipelines();
+		} catch (...) {
+			// Pipelines before their layout
+			cullPipeline.reset();
+			occlusionPipeline.reset();
+			if (pipelineLayout != VK_NULL_HANDLE) vkDestroyPipelineLayout(hexDevice.device(), pipelineLayout, nullptr);
+			if (pyramidSetLayout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(hexDevice.device(), pyramidSetLayout, nullptr);
+			if (descriptorSetLayout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(hexDevice.device(), descriptorSetLayout, nullptr);
+			throw;
+		}
+	}
+
+	HexObjectOcclusion::~HexObjectOcclusion() {
+		destroyBuffers();
+		// Pipelines before their layout
+		cullPipeline.reset();
+		occlusionPipeline.reset();
+		vkDestroyPipelineLayout(hexDevice.device(), pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(hexDevice.device(), pyramidSetLayout, nullptr);
+		vkDestroyDescriptorSetLayout(hexDevice.device(), descriptorSetLayout, nullptr);
+	}
+
+	void HexObjectOcclusion::createDescriptorSetLayouts() {
+		std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+		for (uint32_t i = 0; i < bindings.size(); i++) {
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		if (vkCreateDescriptorSetLayout(hexDevice.device(), &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create descriptor set layout");
+		}
+
+		VkDescriptorSetLayoutBinding pyramidBinding{};
+		pyramidBinding.binding = 0;
+		pyramidBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		pyramidBinding.descriptorCount = 1;
+		pyramidBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		layoutInfo.bindingCount = 1;
+		layoutInfo.pBindings = &pyramidBinding;
+
+		if (vkCreateDescriptorSetLayout(hexDevice.device(), &layoutInfo, nullptr, &pyramidSetLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create descriptor set layout");
+		}
+	}
+
+	void HexObjectOcclusion::createPipelines() {
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(ObjectOcclusionPushConstantData);
+
+		// Both phases share the layout, the first one doesn't use the pyramid set
+		VkDescriptorSetLayout setLayouts[] = {descriptorSetLayout, pyramidSetLayout};
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 2;
+		pipelineLayoutInfo.pSetLayouts = setLayouts;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(hexDevice.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create pipeline layout");
+		}
+
+		cullPipeline = std::make_unique<HexPipeline>(hexDevice, "shaders/object_cull.comp.spv", pipelineLayout, pipelineManager.getPipelineCache(), &pipelineManager.getShaderLibrary());
+		occlusionPipeline = std::make_unique<HexPipeline>(hexDevice, "shaders/object_occlusion.comp.spv", pipelineLayout, pipelineManager.getPipelineCache(), &pipelineManager.getShaderLibrary());
+	}
+
+	void HexObjectOcclusion::createBuffers(uint32_t newCapacity) {
+		capacity = newCapacity;
+		hexDevice.createBuffer(
+			capacity * sizeof(VkDrawIndexedIndirectCommand),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			drawBuffer,
+			drawMemory
+		);
+		hexDevice.createBuffer(
+			capacity * sizeof(uint32_t),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			visibilityBuffer,
+			visibilityMemory
+		);
+		clearVisibility = true;
+
+		VkDescriptorPoolSize poolSizes[] = {
+			{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * framesInFlight},
+			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, framesInFlight}
+		};
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = 2 * framesInFlight;
+		poolInfo.poolSizeCount = 2;
+		poolInfo.pPoolSizes = poolSizes;
+
+		if (vkCreateDescriptorPool(hexDevice.device(), &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create descriptor pool");
+		}
+
+		frames.resize(framesInFlight);
+		for (Frame &frame : frames) {
+			hexDevice.createBuffer(
+				capacity * sizeof(Object),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				frame.objectBuffer,
+				frame.objectMemory
+			);
+			void *mapped;
+			vkMapMemory(hexDevice.device(), frame.objectMemory, 0, VK_WHOLE_SIZE, 0, &mapped);
+			frame.objects = static_cast<Object*>(mapped);
+
+			VkDescriptorSetLayout layouts[] = {descriptorSetLayout, pyramidSetLayout};
+			VkDescriptorSet sets[2];
+			VkDescriptorSetAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			allocInfo.descriptorPool = descriptorPool;
+			allocInfo.descriptorSetCount = 2;
+			allocInfo.pSetLayouts = layouts;
+
+			if (vkAllocateDescriptorSets(hexDevice.device(), &allocInfo, sets) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to allocate descriptor sets");
+			}
+			frame.descriptorSet = sets[0];
+			frame.pyramidSet = sets[1];
+			// The pyramid is written on first use, once it exists
+			frame.pyramidGeneration = ~0ull;
+
+			std::array<VkDescriptorBufferInfo, 3> bufferInfos{{
+				{frame.objectBuffer, 0, VK_WHOLE_SIZE},
+				{drawBuffer, 0, VK_WHOLE_SIZE},
+				{visibilityBuffer, 0, VK_WHOLE_SIZE}
+			}};
+			std::array<VkWriteDescriptorSet, 3> writes{};
+			for (uint32_t i = 0; i < writes.size(); i++) {
+				writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[i].dstSet = frame.descriptorSet;
+				writes[i].dstBinding = i;
+				writes[i].descriptorCount = 1;
+				writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				writes[i].pBufferInfo = &bufferInfos[i];
+			}
+			vkUpdateDescriptorSets(hexDevice.device(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		}
+	}
+
+	void HexObjectOcclusion::destroyBuffers() {
+		for (Frame &frame : frames) {
+			if (frame.objectBuffer == VK_NULL_HANDLE) continue;
+			vkUnmapMemory(hexDevice.device(), frame.objectMemory);
+			vkDestroyBuffer(hexDevice.device(), frame.objectBuffer, nullptr);
+			vkFreeMemory(hexDevice.device(), frame.objectMemory, nullptr);
+		}
+		frames.clear();
+		if (descriptorPool != VK_NULL_HANDLE) vkDestroyDescriptorPool(hexDevice.device(), descriptorPool, nullptr);
+		descriptorPool = VK_NULL_HANDLE;
+		if (drawBuffer != VK_NULL_HANDLE) {
+			vkDestroyBuffer(hexDevice.device(), drawBuffer, nullptr);
+			vkFreeMemory(hexDevice.device(), drawMemory, nullptr);
+		}
+		drawBuffer = VK_NULL_HANDLE;
+		drawMemory = VK_NULL_HANDLE;
+		if (visibilityBuffer != VK_NULL_HANDLE) {
+			vkDestroyBuffer(hexDevice.device(), visibilityBuffer, nullptr);
+			vkFreeMemory(hexDevice.device(), visibilityMemory, nullptr);
+		}
+		visibilityBuffer = VK_NULL_HANDLE;
+		visibilityMemory = VK_NULL_HANDLE;
+		capacity = 0;
+	}
+
+	void HexObjectOcclusion::beginPhase(VkCommandBuffer commandBuffer) {
+		// Draws may still read the commands, earlier phases wrote the visibility
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	void HexObjectOcclusion::cull(VkCommandBuffer commandBuffer, uint32_t frameIndex, const std::vector<Object> &objects) {
+		objectCount = static_cast<uint32_t>(objects.size());
+		if (objectCount == 0)
+			return;
+
+		if (objectCount > capacity) {
+			// Only when objects are added, earlier frames may still use the buffers
+			vkDeviceWaitIdle(hexDevice.device());
+			uint32_t newCapacity = std::max(std::max(objectCount, 2 * capacity), minCapacity);
+			destroyBuffers();
+			createBuffers(newCapacity);
+		}
+
+		// The frame's previous submission is done, host writes are visible to the next one
+		Frame &frame = frames[frameIndex];
+		memcpy(frame.objects, objects.data(), objects.size() * sizeof(Object));
+
+		beginPhase(commandBuffer);
+		if (clearVisibility) {
+			// Nothing visible yet, the second phase tests every object
+			vkCmdFillBuffer(commandBuffer, visibilityBuffer, 0, VK_WHOLE_SIZE, 0);
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+			clearVisibility = false;
+		}
+
+		ObjectOcclusionPushConstantData push{};
+		push.objectCount = objectCount;
+
+		cullPipeline->bind(commandBuffer);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &frame.descriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ObjectOcclusionPushConstantData), &push);
+		vkCmdDispatch(commandBuffer, (objectCount + workgroupSize - 1) / workgroupSize, 1, 1);
+
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	void HexObjectOcclusion::cullOccluded(VkCommandBuffer commandBuffer, uint32_t frameIndex, const HexDepthPyramid &depthPyramid) {
+		// Slots of this frame's cull, in the frame's object buffer
+		if (objectCount == 0)
+			return;
+
+		Frame &frame = frames[frameIndex];
+		if (frame.pyramidGeneration != depthPyramid.getGeneration()) {
+			VkDescriptorImageInfo pyramidInfo = depthPyramid.descriptorInfo();
+			VkWriteDescriptorSet write{};
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = frame.pyramidSet;
+			write.dstBinding = 0;
+			write.descriptorCount = 1;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			write.pImageInfo = &pyramidInfo;
+			vkUpdateDescriptorSets(hexDevice.device(), 1, &write, 0, nullptr);
+			frame.pyramidGeneration = depthPyramid.getGeneration();
+		}
+
+		ObjectOcclusionPushConstantData push{};
+		push.objectCount = objectCount;
+		push.levelCount = depthPyramid.getLevelCount();
+		push.depthSize[0] = depthPyramid.getDepthExtent().width;
+		push.depthSize[1] = depthPyramid.getDepthExtent().height;
+
+		// The scene pass drew the commands of the first phase, the second replaces their instances
+		beginPhase(commandBuffer);
+		occlusionPipeline->bind(commandBuffer);
+		VkDescriptorSet sets[] = {frame.descriptorSet, frame.pyramidSet};
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 2, sets, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ObjectOcclusionPushConstantData), &push);
+		vkCmdDispatch(commandBuffer, (objectCount + workgroupSize - 1) / workgroupSize, 1, 1);
+
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+}
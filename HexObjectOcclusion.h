@@ -0,0 +1,100 @@
+#pragma once
+
+#include "HexDepthPyramid.h"
+#include "HexPipeline.h"
+#include "HexPipelineManager.h"
+#include "hex_device.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace hex {
+
+	// Two phase occlusion culling of whole objects, one indexed indirect command per object slot
+	// (shaders/object_cull.comp, shaders/object_occlusion.comp):
+	//  - cull, before the scene pass: an instance for the objects visible last frame and in the frustum
+	//  - cullOccluded, after it: objects behind a depth pyramid of its depth buffer are hidden, visible
+	//    objects the first phase didn't draw get an instance for a second draw. The result is the
+	//    visibility of the next frame.
+	// Slots keep their visibility between frames, callers keep an object at the same slot.
+	class HexObjectOcclusion {
+		public:
+		// Same layout as OcclusionObject in shaders/occlusion_common.glsl
+		struct Object {
+			// Model space to clip space
+			glm::mat4 clip{1.f};
+			// Model space
+			glm::vec3 boundsMin{0.f};
+			// 0 for slots without an object, never drawn
+			uint32_t indexCount = 0;
+			glm::vec3 boundsMax{0.f};
+			uint32_t firstIndex = 0;
+			int32_t vertexOffset = 0;
+			uint32_t padding[3]{};
+		};
+
+		static_assert(sizeof(Object) == 112, "Object must match the std430 layout of OcclusionObject");
+
+		HexObjectOcclusion(HexDevice &device, uint32_t framesInFlight, HexPipelineManager &pipelineManager);
+		~HexObjectOcclusion();
+
+		HexObjectOcclusion(const HexObjectOcclusion &) = delete;
+		HexObjectOcclusion &operator=(const HexObjectOcclusion &) = delete;
+
+		// Outside of a render pass, before the draws. Waits for the device when the slots outgrow the buffers.
+		void cull(VkCommandBuffer commandBuffer, uint32_t frameIndex, const std::vector<Object> &objects);
+		// Outside of a render pass after the scene pass, once depthPyramid was built from its depth buffer
+		void cullOccluded(VkCommandBuffer commandBuffer, uint32_t frameIndex, const HexDepthPyramid &depthPyramid);
+
+		// VkDrawIndexedIndirectCommand of the slots culled last, slot i at i * sizeof(VkDrawIndexedIndirectCommand)
+		VkBuffer getDrawBuffer() const { return drawBuffer; }
+
+		private:
+		// Object slots of a frame in flight, host visible
+		struct Frame {
+			VkBuffer objectBuffer = VK_NULL_HANDLE;
+			VkDeviceMemory objectMemory = VK_NULL_HANDLE;
+			Object *objects = nullptr;
+			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+			VkDescriptorSet pyramidSet = VK_NULL_HANDLE;
+			// Pyramid generation pyramidSet was written for
+			uint64_t pyramidGeneration = ~0ull;
+		};
+
+		void createDescriptorSetLayouts();
+		void createPipelines();
+		void createBuffers(uint32_t capacity);
+		void destroyBuffers();
+		// Orders a phase after the draws and phases before it
+		void beginPhase(VkCommandBuffer commandBuffer);
+
+		HexDevice &hexDevice;
+		uint32_t framesInFlight;
+		HexPipelineManager &pipelineManager;
+
+		// Objects, draws, visibility
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		// Depth pyramid, only read by the second phase
+		VkDescriptorSetLayout pyramidSetLayout = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		std::unique_ptr<HexPipeline> cullPipeline;
+		std::unique_ptr<HexPipeline> occlusionPipeline;
+
+		// Recreated with the buffers
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		std::vector<Frame> frames;
+		uint32_t capacity = 0;
+		// Shared by the frames in flight, the second phase of a frame reads the first one's commands
+		VkBuffer drawBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory drawMemory = VK_NULL_HANDLE;
+		VkBuffer visibilityBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory visibilityMemory = VK_NULL_HANDLE;
+		// Cleared by the next cull, new buffers start with nothing visible
+		bool clearVisibility = false;
+		uint32_t objectCount = 0;
+	};
+}
@@ -0,0 +1,311 @@
+#include "HexPageFile.h"
+#include "HexMeshOptimizer.h"
+#include "HexMeshSimplifier.h"
+#include "HexParallel.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace hex {
+
+	namespace {
+
+		const char pageMagic[8] = {'H', 'E', 'X', 'P', 'A', 'G', 'E', '\0'};
+
+		// Proxies are the coarsest of a few halvings of their page
+		const size_t proxyLevels = 4;
+		const size_t proxyMinTriangles = 64;
+		// Relative to the mesh bounding box diagonal
+		const float proxyRelativeError = .05f;
+
+		uint64_t alignUp(uint64_t value, uint64_t alignment) {
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		// Triangle ranges of order with at most PAGE_TRIANGLES each, split at the median
+		// centroid along the longest axis. Ranges come out depth first, neighbours stay close.
+		std::vector<std::pair<size_t, size_t>> splitPages(std::vector<uint32_t> &order, const std::vector<glm::vec3> &centroids) {
+			std::vector<std::pair<size_t, size_t>> pages;
+			std::vector<std::pair<size_t, size_t>> stack{{0, order.size()}};
+
+			while (!stack.empty()) {
+				auto range = stack.back();
+				stack.pop_back();
+
+				if (range.second - range.first <= HexPageFile::PAGE_TRIANGLES) {
+					pages.push_back(range);
+					continue;
+				}
+
+				glm::vec3 low = centroids[order[range.first]];
+				glm::vec3 high = low;
+				for (size_t i = range.first; i < range.second; i++) {
+					low = glm::min(low, centroids[order[i]]);
+					high = glm::max(high, centroids[order[i]]);
+				}
+				glm::vec3 extent = high - low;
+				int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+				size_t middle = range.first + (range.second - range.first) / 2;
+				std::nth_element(order.begin() + range.first, order.begin() + middle, order.begin() + range.second, [&](uint32_t a, uint32_t b) {
+					return centroids[a][axis] < centroids[b][axis];
+				});
+
+				// Left half is taken first
+				stack.push_back({middle, range.second});
+				stack.push_back({range.first, middle});
+			}
+			return pages;
+		}
+	}
+
+	HexPageFile::HexPageFile(std::unique_ptr<HexMappedFile> file) : file{std::move(file)} {
+		header = reinterpret_cast<const Header*>(this->file->data());
+		pages = reinterpret_cast<const Page*>(this->file->data() + header->pageTableOffset);
+	}
+
+	std::string HexPageFile::pagePath(const std::string &sourcePath) {
+		return sourcePath + ".hexpages";
+	}
+
+	std::unique_ptr<HexPageFile> HexPageFile::open(const std::string &sourcePath, uint64_t sourceSize, uint64_t sourceHash) {
+		std::unique_ptr<HexMappedFile> file;
+		try {
+			file = std::make_unique<HexMappedFile>(pagePath(sourcePath), true);
+		} catch (const std::runtime_error &) {
+			// No page file yet
+			return nullptr;
+		}
+
+		if (file->size() < sizeof(Header))
+			return nullptr;
+
+		Header header;
+		memcpy(&header, file->data(), sizeof(Header));
+
+		if (memcmp(header.magic, pageMagic, sizeof(pageMagic)) != 0
+			|| header.version != VERSION
+			|| header.vertexStride != sizeof(HexModel::Vertex)
+			|| header.sourceSize != sourceSize
+			|| header.sourceHash != sourceHash)
+			return nullptr;
+
+		if (header.pageCount == 0
+			|| header.pageTableOffset % alignof(Page) != 0 || header.proxyVertexOffset % alignof(HexModel::Vertex) != 0 || header.proxyIndexOffset % sizeof(uint32_t) != 0
+			|| header.pageTableOffset + static_cast<uint64_t>(header.pageCount) * sizeof(Page) > file->size()
+			|| header.proxyVertexOffset + static_cast<uint64_t>(header.proxyVertexCount) * header.vertexStride > file->size()
+			|| header.proxyIndexOffset + static_cast<uint64_t>(header.proxyIndexCount) * sizeof(uint32_t) > file->size())
+			return nullptr;
+
+		// Pages are read straight from the mapping, a truncated file must not get that far
+		const Page *pages = reinterpret_cast<const Page*>(file->data() + header.pageTableOffset);
+		for (uint32_t i = 0; i < header.pageCount; i++) {
+			const Page &page = pages[i];
+			if (page.dataOffset % PAGE_ALIGNMENT != 0
+				|| page.vertexCount > header.maxPageVertices || page.indexCount > header.maxPageIndices
+				|| page.dataOffset + static_cast<uint64_t>(page.vertexCount) * header.vertexStride + static_cast<uint64_t>(page.indexCount) * sizeof(uint32_t) > file->size()
+				|| static_cast<uint64_t>(page.proxyFirstVertex) + page.proxyVertexCount > header.proxyVertexCount
+				|| static_cast<uint64_t>(page.proxyFirstIndex) + page.proxyIndexCount > header.proxyIndexCount)
+				return nullptr;
+		}
+
+		return std::unique_ptr<HexPageFile>(new HexPageFile(std::move(file)));
+	}
+
+	void HexPageFile::write(const std::string &sourcePath, uint64_t sourceSize, uint64_t sourceHash, const HexModel::Builder &builder) {
+		if (!builder.triangleCells.empty()) {
+			throw std::runtime_error("volume mesh boundaries are not paged: " + sourcePath);
+		}
+
+		// Full resolution level only, pages have their own proxies
+		bool indexed = !builder.indices.empty();
+		size_t firstIndex = 0;
+		size_t indexCount = indexed ? builder.indices.size() : builder.vertices.size();
+		if (indexed && !builder.lods.empty()) {
+			firstIndex = builder.lods[0].firstIndex;
+			indexCount = builder.lods[0].indexCount;
+		}
+		auto vertexOf = [&](size_t index) -> uint32_t {
+			return indexed ? builder.indices[firstIndex + index] : static_cast<uint32_t>(index);
+		};
+
+		size_t triangleCount = indexCount / 3;
+		if (triangleCount == 0) {
+			throw std::runtime_error("mesh has no triangles to page: " + sourcePath);
+		}
+
+		std::vector<glm::vec3> centroids(triangleCount);
+		std::vector<uint32_t> order(triangleCount);
+		parallelFor(triangleCount, 1 << 14, [&](size_t begin, size_t end) {
+			for (size_t t = begin; t < end; t++) {
+				centroids[t] = (builder.vertices[vertexOf(t * 3)].position
+					+ builder.vertices[vertexOf(t * 3 + 1)].position
+					+ builder.vertices[vertexOf(t * 3 + 2)].position) / 3.f;
+				order[t] = static_cast<uint32_t>(t);
+			}
+		});
+		auto ranges = splitPages(order, centroids);
+		centroids = {};
+
+		// Every page gets the vertices it references, in first use order
+		std::vector<HexModel::Builder> pageBuilders(ranges.size());
+		parallelTasks(ranges.size(), [&](size_t p) {
+			HexModel::Builder &page = pageBuilders[p];
+			size_t count = ranges[p].second - ranges[p].first;
+			std::unordered_map<uint32_t, uint32_t> localIndices;
+			localIndices.reserve(count * 2);
+			page.indices.reserve(count * 3);
+
+			for (size_t i = ranges[p].first; i < ranges[p].second; i++) {
+				for (size_t corner = 0; corner < 3; corner++) {
+					uint32_t vertex = vertexOf(static_cast<size_t>(order[i]) * 3 + corner);
+					auto inserted = localIndices.emplace(vertex, static_cast<uint32_t>(page.vertices.size()));
+					if (inserted.second) page.vertices.push_back(builder.vertices[vertex]);
+					page.indices.push_back(inserted.first->second);
+				}
+			}
+		});
+		order = {};
+
+		std::vector<HexModel::Builder *> pagePointers;
+		for (auto &page : pageBuilders) pagePointers.push_back(&page);
+		HexMeshOptimizer::optimize(pagePointers);
+
+		glm::vec3 boundsMin = builder.vertices[0].position;
+		glm::vec3 boundsMax = boundsMin;
+		for (auto &v : builder.vertices) {
+			boundsMin = glm::min(boundsMin, v.position);
+			boundsMax = glm::max(boundsMax, v.position);
+		}
+		float proxyError = glm::length(boundsMax - boundsMin) * proxyRelativeError;
+
+		// Proxy vertices are compacted to the ones the simplified page still uses
+		std::vector<std::vector<HexModel::Vertex>> proxyVertices(pageBuilders.size());
+		std::vector<std::vector<uint32_t>> proxyIndices(pageBuilders.size());
+		parallelTasks(pageBuilders.size(), [&](size_t p) {
+			const HexModel::Builder &page = pageBuilders[p];
+			auto levels = HexMeshSimplifier::buildLodChain(page.vertices, page.indices, proxyError, proxyLevels, proxyMinTriangles);
+			const std::vector<uint32_t> &indices = levels.empty() ? page.indices : levels.back().indices;
+
+			std::vector<uint32_t> remap(page.vertices.size(), UINT32_MAX);
+			proxyIndices[p].reserve(indices.size());
+			for (uint32_t index : indices) {
+				if (remap[index] == UINT32_MAX) {
+					remap[index] = static_cast<uint32_t>(proxyVertices[p].size());
+					proxyVertices[p].push_back(page.vertices[index]);
+				}
+				proxyIndices[p].push_back(remap[index]);
+			}
+		});
+
+		Header header{};
+		memcpy(header.magic, pageMagic, sizeof(pageMagic));
+		header.version = VERSION;
+		header.vertexStride = sizeof(HexModel::Vertex);
+		header.pageCount = static_cast<uint32_t>(pageBuilders.size());
+		for (int i = 0; i < 3; i++) {
+			header.boundsMin[i] = boundsMin[i];
+			header.boundsMax[i] = boundsMax[i];
+		}
+		header.sourceSize = sourceSize;
+		header.sourceHash = sourceHash;
+
+		std::vector<Page> pageTable(pageBuilders.size());
+		for (size_t p = 0; p < pageBuilders.size(); p++) {
+			const HexModel::Builder &pageBuilder = pageBuilders[p];
+			Page &page = pageTable[p];
+
+			glm::vec3 pageMin = pageBuilder.vertices[0].position;
+			glm::vec3 pageMax = pageMin;
+			for (auto &v : pageBuilder.vertices) {
+				pageMin = glm::min(pageMin, v.position);
+				pageMax = glm::max(pageMax, v.position);
+			}
+			for (int i = 0; i < 3; i++) {
+				page.boundsMin[i] = pageMin[i];
+				page.boundsMax[i] = pageMax[i];
+			}
+
+			page.vertexCount = static_cast<uint32_t>(pageBuilder.vertices.size());
+			page.indexCount = static_cast<uint32_t>(pageBuilder.indices.size());
+			page.proxyFirstVertex = header.proxyVertexCount;
+			page.proxyVertexCount = static_cast<uint32_t>(proxyVertices[p].size());
+			page.proxyFirstIndex = header.proxyIndexCount;
+			page.proxyIndexCount = static_cast<uint32_t>(proxyIndices[p].size());
+
+			header.maxPageVertices = std::max(header.maxPageVertices, page.vertexCount);
+			header.maxPageIndices = std::max(header.maxPageIndices, page.indexCount);
+			header.proxyVertexCount += page.proxyVertexCount;
+			header.proxyIndexCount += page.proxyIndexCount;
+		}
+
+		header.pageTableOffset = alignUp(sizeof(Header), alignof(Page));
+		header.proxyVertexOffset = alignUp(header.pageTableOffset + pageTable.size() * sizeof(Page), alignof(HexModel::Vertex));
+		header.proxyIndexOffset = header.proxyVertexOffset + static_cast<uint64_t>(header.proxyVertexCount) * header.vertexStride;
+		uint64_t offset = header.proxyIndexOffset + static_cast<uint64_t>(header.proxyIndexCount) * sizeof(uint32_t);
+		for (auto &page : pageTable) {
+			page.dataOffset = alignUp(offset, PAGE_ALIGNMENT);
+			offset = page.dataOffset + static_cast<uint64_t>(page.vertexCount) * header.vertexStride + static_cast<uint64_t>(page.indexCount) * sizeof(uint32_t);
+		}
+
+		std::string path = pagePath(sourcePath);
+		std::string temporaryPath = path + ".tmp";
+		{
+			std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+			if (!file.is_open()) {
+				throw std::runtime_error("failed to create page file: " + temporaryPath);
+			}
+
+			const char padding[PAGE_ALIGNMENT] = {};
+			uint64_t written = 0;
+			auto writeAt = [&](uint64_t at, const void *data, uint64_t size) {
+				file.write(padding, at - written);
+				file.write(static_cast<const char*>(data), size);
+				written = at + size;
+			};
+
+			writeAt(0, &header, sizeof(Header));
+			writeAt(header.pageTableOffset, pageTable.data(), pageTable.size() * sizeof(Page));
+			for (auto &vertices : proxyVertices) writeAt(written, vertices.data(), vertices.size() * sizeof(HexModel::Vertex));
+			for (auto &indices : proxyIndices) writeAt(written, indices.data(), indices.size() * sizeof(uint32_t));
+			for (size_t p = 0; p < pageTable.size(); p++) {
+				writeAt(pageTable[p].dataOffset, pageBuilders[p].vertices.data(), pageBuilders[p].vertices.size() * sizeof(HexModel::Vertex));
+				writeAt(written, pageBuilders[p].indices.data(), pageBuilders[p].indices.size() * sizeof(uint32_t));
+			}
+
+			if (!file) {
+				file.close();
+				std::remove(temporaryPath.c_str());
+				throw std::runtime_error("failed to write page file: " + temporaryPath);
+			}
+		}
+
+		// Readers never see a half written page file
+		if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+			std::remove(temporaryPath.c_str());
+			throw std::runtime_error("failed to write page file: " + path);
+		}
+	}
+
+	const HexModel::Vertex *HexPageFile::pageVertices(uint32_t page) const {
+		return reinterpret_cast<const HexModel::Vertex*>(file->data() + pages[page].dataOffset);
+	}
+
+	const uint32_t *HexPageFile::pageIndices(uint32_t page) const {
+		return reinterpret_cast<const uint32_t*>(file->data() + pages[page].dataOffset + static_cast<uint64_t>(pages[page].vertexCount) * header->vertexStride);
+	}
+
+	const HexModel::Vertex *HexPageFile::proxyVertices() const {
+		return reinterpret_cast<const HexModel::Vertex*>(file->data() + header->proxyVertexOffset);
+	}
+
+	const uint32_t *HexPageFile::proxyIndices() const {
+		return reinterpret_cast<const uint32_t*>(file->data() + header->proxyIndexOffset);
+	}
+}
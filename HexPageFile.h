@@ -0,0 +1,97 @@
+#pragma once
+
+#include "HexModel.h"
+#include "HexMappedFile.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace hex {
+
+	// Mesh split spatially in pages of at most PAGE_TRIANGLES triangles, stored next to its
+	// source as <source>.hexpages for meshes too large to stay on the GPU. Every page has its
+	// own vertices, and its data starts on a disk page so it's read on its own. A coarse
+	// proxy of every page is stored together at the start of the file, to draw while the page
+	// isn't loaded. Like HexMeshCache, the file is only used while the source hash matches,
+	// a sampled one (HexMeshCache::hashFileSampled).
+	class HexPageFile {
+		public:
+		static constexpr uint32_t VERSION = 2;
+		static constexpr uint32_t PAGE_TRIANGLES = 1 << 15;
+		// Page data alignment, relative to the file start
+		static constexpr uint64_t PAGE_ALIGNMENT = 4096;
+
+		struct Header {
+			char magic[8];
+			uint32_t version;
+			uint32_t vertexStride;
+			uint32_t pageCount;
+			// Largest page, sizes the GPU page slots
+			uint32_t maxPageVertices;
+			uint32_t maxPageIndices;
+			uint32_t proxyVertexCount;
+			uint32_t proxyIndexCount;
+			uint32_t padding;
+			uint64_t pageTableOffset;
+			uint64_t proxyVertexOffset;
+			uint64_t proxyIndexOffset;
+			float boundsMin[4];
+			float boundsMax[4];
+			uint64_t sourceSize;
+			uint64_t sourceHash;
+		};
+
+		struct Page {
+			float boundsMin[4];
+			float boundsMax[4];
+			// Vertices then indices (local to the page)
+			uint64_t dataOffset;
+			uint32_t vertexCount;
+			uint32_t indexCount;
+			// Ranges in the proxy blobs, proxy indices are local to the proxy vertex range
+			uint32_t proxyFirstVertex;
+			uint32_t proxyVertexCount;
+			uint32_t proxyFirstIndex;
+			uint32_t proxyIndexCount;
+		};
+
+		~HexPageFile() = default;
+
+		HexPageFile(const HexPageFile &) = delete;
+		HexPageFile &operator=(const HexPageFile &) = delete;
+
+		static std::string pagePath(const std::string &sourcePath);
+
+		// Returns nullptr when there's no valid page file for this source content
+		static std::unique_ptr<HexPageFile> open(const std::string &sourcePath, uint64_t sourceSize, uint64_t sourceHash);
+
+		// Split the full resolution level of the builder mesh in pages and write them atomically.
+		// The only step that needs the whole mesh in memory.
+		static void write(const std::string &sourcePath, uint64_t sourceSize, uint64_t sourceHash, const HexModel::Builder &builder);
+
+		uint32_t pageCount() const { return header->pageCount; }
+		const Page &page(uint32_t page) const { return pages[page]; }
+		// Reading these touches the disk, keep it off the render thread
+		const HexModel::Vertex *pageVertices(uint32_t page) const;
+		const uint32_t *pageIndices(uint32_t page) const;
+
+		uint32_t maxPageVertices() const { return header->maxPageVertices; }
+		uint32_t maxPageIndices() const { return header->maxPageIndices; }
+
+		const HexModel::Vertex *proxyVertices() const;
+		const uint32_t *proxyIndices() const;
+		uint32_t proxyVertexCount() const { return header->proxyVertexCount; }
+		uint32_t proxyIndexCount() const { return header->proxyIndexCount; }
+
+		glm::vec3 boundsMin() const { return {header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]}; }
+		glm::vec3 boundsMax() const { return {header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]}; }
+
+		private:
+		HexPageFile(std::unique_ptr<HexMappedFile> file);
+
+		std::unique_ptr<HexMappedFile> file;
+		const Header *header;
+		const Page *pages;
+	};
+}
@@ -0,0 +1,411 @@
+#include "HexPagedModel.h"
+#include "HexMeshCache.h"
+#include "HexMeshLoader.h"
+#include "HexSwapChain.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+namespace hex {
+
+	namespace {
+		using Vertex = HexModel::Vertex;
+
+		// View volume planes of a projection view model matrix, in model space. Points are
+		// inside when dot(plane.xyz, p) + plane.w >= 0 for every plane (Gribb and Hartmann).
+		std::array<glm::vec4, 6> frustumPlanes(const glm::mat4 &matrix) {
+			glm::mat4 rows = glm::transpose(matrix);
+			std::array<glm::vec4, 6> planes{
+				rows[3] + rows[0],
+				rows[3] - rows[0],
+				rows[3] + rows[1],
+				rows[3] - rows[1],
+				// Depth is zero to one
+				rows[2],
+				rows[3] - rows[2]
+			};
+			for (auto &plane : planes) plane /= glm::length(glm::vec3{plane});
+			return planes;
+		}
+	}
+
+	HexPagedModel::HexPagedModel(HexDevice &device, std::unique_ptr<HexPageFile> file, VkDeviceSize budget)
+		: hexDevice{device}, pageFile{std::move(file)}, budget{budget} {
+		slotVertexCount = pageFile->maxPageVertices();
+		slotIndexCount = pageFile->maxPageIndices();
+		stagingSlotSize = static_cast<VkDeviceSize>(slotVertexCount) * sizeof(Vertex) + static_cast<VkDeviceSize>(slotIndexCount) * sizeof(uint32_t);
+
+		// At least one slot whatever the budget, never more than there are pages
+		VkDeviceSize slotCount = std::min<VkDeviceSize>(std::max<VkDeviceSize>(budget / stagingSlotSize, 1), pageFile->pageCount());
+		if ((slotCount * slotVertexCount + pageFile->proxyVertexCount()) > static_cast<VkDeviceSize>(std::numeric_limits<int32_t>::max())) {
+			throw std::runtime_error("page slots don't fit 32 bits vertex offsets, lower the budget");
+		}
+
+		pages.resize(pageFile->pageCount());
+		slots.resize(slotCount);
+		stagingSlots.resize(STAGING_SLOT_COUNT);
+
+		try {
+			createBuffers();
+			uploadProxies();
+		} catch (...) {
+			destroyBuffers();
+			throw;
+		}
+
+		streamer = std::thread{&HexPagedModel::streamPages, this};
+	}
+
+	HexPagedModel::~HexPagedModel() {
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			stopping = true;
+		}
+		requestsChanged.notify_all();
+		streamer.join();
+
+		destroyBuffers();
+	}
+
+	std::unique_ptr<HexPagedModel> HexPagedModel::createFromFile(HexDevice &device, const std::string &filepath, VkDeviceSize budget) {
+		auto start = std::chrono::high_resolution_clock::now();
+
+		// Paged sources are too large to hash whole at every start
+		uint64_t sourceSize;
+		uint64_t sourceHash;
+		{
+			HexMappedFile source{filepath};
+			sourceSize = source.size();
+			sourceHash = HexMeshCache::hashFileSampled(source);
+		}
+
+		auto pageFile = HexPageFile::open(filepath, sourceSize, sourceHash);
+		if (!pageFile) {
+			HexModel::Builder builder = HexMeshLoader::loadFile(filepath);
+			HexPageFile::write(filepath, sourceSize, sourceHash, builder);
+			pageFile = HexPageFile::open(filepath, sourceSize, sourceHash);
+			if (!pageFile) {
+				throw std::runtime_error("failed to read back page file: " + HexPageFile::pagePath(filepath));
+			}
+		}
+
+		auto model = std::make_unique<HexPagedModel>(device, std::move(pageFile), budget);
+		float milliseconds = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+		std::cout << "Paged " << HexPageFile::pagePath(filepath) << ": " << model->getPageCount() << " pages, "
+			<< model->getSlotCount() << " resident at most, opened in " << milliseconds << " ms" << std::endl;
+		return model;
+	}
+
+	void HexPagedModel::createBuffers() {
+		VkDeviceSize vertexCount = slots.size() * static_cast<VkDeviceSize>(slotVertexCount) + pageFile->proxyVertexCount();
+		VkDeviceSize indexCount = slots.size() * static_cast<VkDeviceSize>(slotIndexCount) + pageFile->proxyIndexCount();
+
+		hexDevice.createBuffer(
+			vertexCount * sizeof(Vertex),
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			vertexBuffer,
+			vertexMemory
+		);
+		hexDevice.createBuffer(
+			indexCount * sizeof(uint32_t),
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			indexBuffer,
+			indexMemory
+		);
+		hexDevice.createBuffer(
+			stagingSlots.size() * stagingSlotSize,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			stagingBuffer,
+			stagingMemory
+		);
+
+		void *mapped;
+		vkMapMemory(hexDevice.device(), stagingMemory, 0, VK_WHOLE_SIZE, 0, &mapped);
+		staging = static_cast<char*>(mapped);
+	}
+
+	void HexPagedModel::destroyBuffers() {
+		if (staging != nullptr) vkUnmapMemory(hexDevice.device(), stagingMemory);
+
+		VkBuffer buffers[] = {vertexBuffer, indexBuffer, stagingBuffer};
+		VkDeviceMemory memories[] = {vertexMemory, indexMemory, stagingMemory};
+		for (int i = 0; i < 3; i++) {
+			if (buffers[i] == VK_NULL_HANDLE) continue;
+			vkDestroyBuffer(hexDevice.device(), buffers[i], nullptr);
+			vkFreeMemory(hexDevice.device(), memories[i], nullptr);
+		}
+	}
+
+	// Proxies are uploaded once after the slots, they are small enough to stay
+	void HexPagedModel::uploadProxies() {
+		VkDeviceSize vertexSize = static_cast<VkDeviceSize>(pageFile->proxyVertexCount()) * sizeof(Vertex);
+		VkDeviceSize indexSize = static_cast<VkDeviceSize>(pageFile->proxyIndexCount()) * sizeof(uint32_t);
+		if (vertexSize == 0 || indexSize == 0) return;
+
+		VkBuffer proxyStagingBuffer;
+		VkDeviceMemory proxyStagingMemory;
+		hexDevice.createBuffer(
+			vertexSize + indexSize,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			proxyStagingBuffer,
+			proxyStagingMemory
+		);
+
+		void *data;
+		vkMapMemory(hexDevice.device(), proxyStagingMemory, 0, vertexSize + indexSize, 0, &data);
+		memcpy(data, pageFile->proxyVertices(), static_cast<size_t>(vertexSize));
+		memcpy(static_cast<char*>(data) + vertexSize, pageFile->proxyIndices(), static_cast<size_t>(indexSize));
+		vkUnmapMemory(hexDevice.device(), proxyStagingMemory);
+
+		hexDevice.copyBuffer(proxyStagingBuffer, vertexBuffer, vertexSize, 0, slots.size() * static_cast<VkDeviceSize>(slotVertexCount) * sizeof(Vertex));
+		hexDevice.copyBuffer(proxyStagingBuffer, indexBuffer, indexSize, vertexSize, slots.size() * static_cast<VkDeviceSize>(slotIndexCount) * sizeof(uint32_t));
+
+		vkDestroyBuffer(hexDevice.device(), proxyStagingBuffer, nullptr);
+		vkFreeMemory(hexDevice.device(), proxyStagingMemory, nullptr);
+	}
+
+	// Streamer thread: takes the best request, reads the page into its staging slot
+	void HexPagedModel::streamPages() {
+		while (true) {
+			Request request;
+			{
+				std::unique_lock<std::mutex> lock{mutex};
+				requestsChanged.wait(lock, [this] { return stopping || !requests.empty(); });
+				if (stopping) return;
+				request = requests.front();
+				requests.erase(requests.begin());
+			}
+
+			// Faulting in the mapping is the disk read
+			const HexPageFile::Page &page = pageFile->page(request.page);
+			char *target = staging + request.stagingSlot * stagingSlotSize;
+			memcpy(target, pageFile->pageVertices(request.page), page.vertexCount * sizeof(Vertex));
+			memcpy(target + slotVertexCount * sizeof(Vertex), pageFile->pageIndices(request.page), page.indexCount * sizeof(uint32_t));
+
+			std::lock_guard<std::mutex> lock{mutex};
+			completed.push_back(request);
+		}
+	}
+
+	// The renderer waited for the fence of the frame MAX_FRAMES_IN_FLIGHT frames ago before this one
+	bool HexPagedModel::inFlight(uint64_t frameUsed) const {
+		return frameUsed + HexSwapChain::MAX_FRAMES_IN_FLIGHT > frame;
+	}
+
+	// A free slot, otherwise the least recently drawn slot no frame in flight reads, as long as
+	// its page matters less than the new one
+	uint32_t HexPagedModel::acquireSlot(uint32_t page) {
+		uint32_t victim = NO_SLOT;
+		for (uint32_t i = 0; i < slots.size(); i++) {
+			const Slot &slot = slots[i];
+			if (slot.page == NO_PAGE) return i;
+			if (inFlight(slot.lastUsedFrame) || pages[slot.page].priority >= pages[page].priority) continue;
+			if (victim == NO_SLOT || slot.lastUsedFrame < slots[victim].lastUsedFrame) victim = i;
+		}
+
+		if (victim != NO_SLOT) {
+			PageStatus &evicted = pages[slots[victim].page];
+			evicted.state = PageState::Missing;
+			evicted.slot = NO_SLOT;
+			slots[victim].page = NO_PAGE;
+			residentPageCount--;
+		}
+		return victim;
+	}
+
+	void HexPagedModel::update(VkCommandBuffer commandBuffer, const glm::mat4 &modelMatrix, const HexCamera &camera, float viewportHeight) {
+		frame++;
+		for (auto &stagingSlot : stagingSlots) {
+			if (stagingSlot.copying && !inFlight(stagingSlot.copyFrame)) {
+				stagingSlot.copying = false;
+				stagingSlot.free = true;
+			}
+		}
+
+		std::vector<Request> ready;
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			ready.swap(completed);
+			// Requests not started yet are made again with this frame's priorities
+			for (auto &request : requests) {
+				pages[request.page].state = PageState::Missing;
+				stagingSlots[request.stagingSlot].free = true;
+			}
+			requests.clear();
+		}
+
+		updatePriorities(modelMatrix, camera, viewportHeight);
+		recordCopies(commandBuffer, ready);
+
+		// Resident pages in view from their slot, the others through their proxy
+		drawRanges.clear();
+		uint32_t proxyFirstVertex = static_cast<uint32_t>(slots.size()) * slotVertexCount;
+		uint32_t proxyFirstIndex = static_cast<uint32_t>(slots.size()) * slotIndexCount;
+		for (uint32_t i = 0; i < pages.size(); i++) {
+			const PageStatus &status = pages[i];
+			if (!status.inView) continue;
+
+			const HexPageFile::Page &page = pageFile->page(i);
+			if (status.state == PageState::Resident) {
+				slots[status.slot].lastUsedFrame = frame;
+				drawRanges.push_back({page.indexCount, status.slot * slotIndexCount, static_cast<int32_t>(status.slot * slotVertexCount)});
+			} else if (page.proxyIndexCount > 0) {
+				drawRanges.push_back({page.proxyIndexCount, proxyFirstIndex + page.proxyFirstIndex, static_cast<int32_t>(proxyFirstVertex + page.proxyFirstVertex)});
+			}
+		}
+
+		requestPages();
+	}
+
+	// Projected size of the page bounds in pixels, which falls off with the distance to the camera
+	void HexPagedModel::updatePriorities(const glm::mat4 &modelMatrix, const HexCamera &camera, float viewportHeight) {
+		auto planes = frustumPlanes(camera.getProjection() * camera.getViewMatrix() * modelMatrix);
+		// Pixels covered by one world unit at distance 1, projection[1][1] is 1 / tan(fovy / 2)
+		float pixelsPerUnit = camera.getProjection()[1][1] * viewportHeight * .5f;
+		float maxScale = glm::max(glm::length(glm::vec3{modelMatrix[0]}), glm::max(glm::length(glm::vec3{modelMatrix[1]}), glm::length(glm::vec3{modelMatrix[2]})));
+
+		for (uint32_t i = 0; i < pages.size(); i++) {
+			const HexPageFile::Page &page = pageFile->page(i);
+			glm::vec3 boundsMin{page.boundsMin[0], page.boundsMin[1], page.boundsMin[2]};
+			glm::vec3 boundsMax{page.boundsMax[0], page.boundsMax[1], page.boundsMax[2]};
+			glm::vec3 center = (boundsMin + boundsMax) * .5f;
+			float radius = glm::length(boundsMax - boundsMin) * .5f;
+
+			bool inView = true;
+			for (auto &plane : planes) {
+				inView = inView && glm::dot(glm::vec3{plane}, center) + plane.w >= -radius;
+			}
+
+			glm::vec3 worldCenter{modelMatrix * glm::vec4{center, 1.f}};
+			float worldRadius = radius * maxScale;
+			float distance = glm::length(worldCenter - camera.getPosition()) - worldRadius;
+			// Camera inside the bounds, as large as a page gets
+			float coverage = distance > 0.f ? worldRadius * pixelsPerUnit / distance : std::numeric_limits<float>::max();
+
+			PageStatus &status = pages[i];
+			status.inView = inView;
+			status.priority = inView ? coverage : coverage * OUTSIDE_VIEW_PRIORITY;
+		}
+	}
+
+	void HexPagedModel::recordCopies(VkCommandBuffer commandBuffer, const std::vector<Request> &ready) {
+		std::vector<Request> sorted = ready;
+		std::sort(sorted.begin(), sorted.end(), [this](const Request &a, const Request &b) {
+			return pages[a.page].priority > pages[b.page].priority;
+		});
+
+		bool copied = false;
+		for (const Request &request : sorted) {
+			PageStatus &status = pages[request.page];
+			StagingSlot &stagingSlot = stagingSlots[request.stagingSlot];
+
+			uint32_t slot = acquireSlot(request.page);
+			if (slot == NO_SLOT) {
+				// Every slot went to something more important since the request
+				status.state = PageState::Missing;
+				stagingSlot.free = true;
+				continue;
+			}
+
+			const HexPageFile::Page &page = pageFile->page(request.page);
+			VkDeviceSize stagingOffset = request.stagingSlot * stagingSlotSize;
+			VkBufferCopy vertexCopy{
+				stagingOffset,
+				static_cast<VkDeviceSize>(slot) * slotVertexCount * sizeof(Vertex),
+				static_cast<VkDeviceSize>(page.vertexCount) * sizeof(Vertex)
+			};
+			VkBufferCopy indexCopy{
+				stagingOffset + static_cast<VkDeviceSize>(slotVertexCount) * sizeof(Vertex),
+				static_cast<VkDeviceSize>(slot) * slotIndexCount * sizeof(uint32_t),
+				static_cast<VkDeviceSize>(page.indexCount) * sizeof(uint32_t)
+			};
+			vkCmdCopyBuffer(commandBuffer, stagingBuffer, vertexBuffer, 1, &vertexCopy);
+			vkCmdCopyBuffer(commandBuffer, stagingBuffer, indexBuffer, 1, &indexCopy);
+
+			stagingSlot.copying = true;
+			stagingSlot.copyFrame = frame;
+			status.state = PageState::Resident;
+			status.slot = slot;
+			slots[slot].page = request.page;
+			slots[slot].lastUsedFrame = frame;
+			residentPageCount++;
+			copied = true;
+		}
+
+		if (!copied)
+			return;
+
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	void HexPagedModel::requestPages() {
+		std::vector<uint32_t> freeStagingSlots;
+		uint32_t reading = 0;
+		for (uint32_t i = 0; i < stagingSlots.size(); i++) {
+			if (stagingSlots[i].free) freeStagingSlots.push_back(i);
+			else if (!stagingSlots[i].copying) reading++;
+		}
+		if (freeStagingSlots.empty()) return;
+
+		// Priority a page must beat to take each slot it could get, free slots first.
+		// Pages the streamer is reading take the lowest ones.
+		std::vector<float> slotPriorities;
+		for (auto &slot : slots) {
+			if (slot.page == NO_PAGE) slotPriorities.push_back(-1.f);
+			else if (!inFlight(slot.lastUsedFrame)) slotPriorities.push_back(pages[slot.page].priority);
+		}
+		std::sort(slotPriorities.begin(), slotPriorities.end());
+		slotPriorities.erase(slotPriorities.begin(), slotPriorities.begin() + std::min<size_t>(reading, slotPriorities.size()));
+
+		size_t count = std::min(freeStagingSlots.size(), slotPriorities.size());
+		if (count == 0) return;
+
+		std::vector<uint32_t> candidates;
+		for (uint32_t i = 0; i < pages.size(); i++) {
+			if (pages[i].state == PageState::Missing) candidates.push_back(i);
+		}
+		count = std::min(count, candidates.size());
+		std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(), [this](uint32_t a, uint32_t b) {
+			return pages[a].priority > pages[b].priority;
+		});
+
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			for (size_t i = 0; i < count; i++) {
+				uint32_t page = candidates[i];
+				// Would evict a page that matters more, so would every following candidate
+				if (pages[page].priority <= slotPriorities[i]) break;
+
+				uint32_t stagingSlot = freeStagingSlots[i];
+				pages[page].state = PageState::Loading;
+				stagingSlots[stagingSlot].free = false;
+				requests.push_back({page, stagingSlot, pages[page].priority});
+			}
+		}
+		requestsChanged.notify_one();
+	}
+
+	void HexPagedModel::draw(VkCommandBuffer commandBuffer) {
+		if (drawRanges.empty()) return;
+
+		VkDeviceSize offset = 0;
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &offset);
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+		for (auto &range : drawRanges) {
+			vkCmdDrawIndexed(commandBuffer, range.indexCount, 1, range.firstIndex, range.vertexOffset, 0);
+		}
+	}
+}
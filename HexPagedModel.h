@@ -0,0 +1,144 @@
+#pragma once
+
+#include "HexCamera.h"
+#include "HexPageFile.h"
+#include "hex_device.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace hex {
+
+	// Out of core model: pages of a HexPageFile are streamed into a fixed number of GPU page
+	// slots sized by a memory budget, their proxies stay resident and are drawn until the page
+	// is in. A streamer thread reads requested pages from the mapped file into host visible
+	// staging, the render thread records the copies in its frame, so it never waits on the
+	// disk. Pages are requested by projected size, nearest first, and slots are taken back
+	// from the least recently drawn pages once no frame in flight draws them.
+	class HexPagedModel {
+		public:
+		static constexpr VkDeviceSize DEFAULT_BUDGET = 256 * 1024 * 1024;
+		// Pages read ahead of their upload, one page slot of host visible memory each
+		static constexpr uint32_t STAGING_SLOT_COUNT = 8;
+		// Pages outside the view keep this fraction of their priority, so turning around finds some loaded
+		static constexpr float OUTSIDE_VIEW_PRIORITY = .1f;
+
+		HexPagedModel(HexDevice &device, std::unique_ptr<HexPageFile> pageFile, VkDeviceSize budget = DEFAULT_BUDGET);
+		~HexPagedModel();
+
+		HexPagedModel(const HexPagedModel &) = delete;
+		HexPagedModel &operator=(const HexPagedModel &) = delete;
+
+		// Through the page file next to the source, built on first use (the only time the whole mesh is in memory)
+		static std::unique_ptr<HexPagedModel> createFromFile(HexDevice &device, const std::string &filepath, VkDeviceSize budget = DEFAULT_BUDGET);
+
+		// Once per frame, outside of a render pass: uploads the pages read since the last frame,
+		// picks the pages and proxies to draw and requests the next pages
+		void update(VkCommandBuffer commandBuffer, const glm::mat4 &modelMatrix, const HexCamera &camera, float viewportHeight);
+		// What the last update picked, FloatVertex layout
+		void draw(VkCommandBuffer commandBuffer);
+
+		glm::vec3 getBoundsMin() const { return pageFile->boundsMin(); }
+		glm::vec3 getBoundsMax() const { return pageFile->boundsMax(); }
+		uint32_t getPageCount() const { return pageFile->pageCount(); }
+		uint32_t getSlotCount() const { return static_cast<uint32_t>(slots.size()); }
+		uint32_t getResidentPageCount() const { return residentPageCount; }
+
+		private:
+		static constexpr uint32_t NO_PAGE = ~0u;
+		static constexpr uint32_t NO_SLOT = ~0u;
+
+		enum class PageState {
+			// Only the proxy is on the GPU
+			Missing,
+			// Requested or being read by the streamer
+			Loading,
+			Resident
+		};
+
+		struct PageStatus {
+			PageState state = PageState::Missing;
+			uint32_t slot = NO_SLOT;
+			float priority = 0.f;
+			bool inView = false;
+		};
+
+		struct Slot {
+			uint32_t page = NO_PAGE;
+			// Frame that last drew or wrote the slot
+			uint64_t lastUsedFrame = 0;
+		};
+
+		struct StagingSlot {
+			bool free = true;
+			// Read by the copy of copyFrame, free again once that frame is done
+			bool copying = false;
+			uint64_t copyFrame = 0;
+		};
+
+		struct Request {
+			uint32_t page;
+			uint32_t stagingSlot;
+			float priority;
+		};
+
+		struct DrawRange {
+			uint32_t indexCount;
+			uint32_t firstIndex;
+			int32_t vertexOffset;
+		};
+
+		void createBuffers();
+		void destroyBuffers();
+		void uploadProxies();
+		void streamPages();
+		bool inFlight(uint64_t frameUsed) const;
+		uint32_t acquireSlot(uint32_t page);
+		void recordCopies(VkCommandBuffer commandBuffer, const std::vector<Request> &ready);
+		void updatePriorities(const glm::mat4 &modelMatrix, const HexCamera &camera, float viewportHeight);
+		void requestPages();
+
+		HexDevice &hexDevice;
+		std::unique_ptr<HexPageFile> pageFile;
+		VkDeviceSize budget;
+
+		// Page slots then proxies, in one vertex and one index buffer
+		VkBuffer vertexBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory vertexMemory = VK_NULL_HANDLE;
+		VkBuffer indexBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory indexMemory = VK_NULL_HANDLE;
+		uint32_t slotVertexCount;
+		uint32_t slotIndexCount;
+
+		// Slot vertices then slot indices for every staging slot, persistently mapped
+		VkBuffer stagingBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+		char *staging = nullptr;
+		VkDeviceSize stagingSlotSize;
+
+		// Render thread state
+		std::vector<PageStatus> pages;
+		std::vector<Slot> slots;
+		std::vector<StagingSlot> stagingSlots;
+		std::vector<DrawRange> drawRanges;
+		uint32_t residentPageCount = 0;
+		uint64_t frame = 0;
+
+		// Shared with the streamer, requests are sorted by decreasing priority
+		std::mutex mutex;
+		std::condition_variable requestsChanged;
+		std::vector<Request> requests;
+		std::vector<Request> completed;
+		bool stopping = false;
+		std::thread streamer;
+	};
+}
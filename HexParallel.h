@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace hex {
+
+	// Number of worker threads used by the parallel helpers (at least 1)
+	inline size_t workerCount() {
+		size_t count = std::thread::hardware_concurrency();
+		return count == 0 ? 1 : count;
+	}
+
+	namespace detail {
+
+		// One parallelTasks call, its tasks are claimed one index at a time
+		struct ParallelJob {
+			void (*invoke)(void *fn, size_t task);
+			void *fn;
+			size_t taskCount;
+			// Guarded by the pool mutex
+			size_t claimed = 0;
+			size_t finished = 0;
+			std::exception_ptr error;
+		};
+
+		// Worker threads shared by every parallelTasks call, nested ones included. A thread
+		// waiting for its job runs queued tasks meanwhile, newest jobs first, so tasks calling
+		// parallelFor still spread over every core instead of running serially, and the
+		// number of running threads never exceeds workerCount().
+		class ParallelPool {
+			public:
+			static ParallelPool &instance() {
+				static ParallelPool pool;
+				return pool;
+			}
+
+			ParallelPool(const ParallelPool &) = delete;
+			ParallelPool &operator=(const ParallelPool &) = delete;
+
+			~ParallelPool() {
+				{
+					std::lock_guard<std::mutex> lock{mutex};
+					stopping = true;
+				}
+				changed.notify_all();
+				for (auto &thread : threads) thread.join();
+			}
+
+			// Returns once every task of the job ran or the job failed
+			void run(ParallelJob &job) {
+				std::unique_lock<std::mutex> lock{mutex};
+				jobs.push_back(&job);
+				changed.notify_all();
+
+				while (job.finished < job.claimed || isQueued(job)) {
+					// Own tasks first, then any queued one rather than sleeping
+					ParallelJob *next = isQueued(job) ? &job : newestJob();
+					if (next != nullptr) {
+						execute(*next, lock);
+					} else {
+						changed.wait(lock);
+					}
+				}
+			}
+
+			private:
+			ParallelPool() {
+				size_t count = workerCount() - 1;
+				threads.reserve(count);
+				for (size_t i = 0; i < count; i++) {
+					threads.emplace_back([this]() {
+						std::unique_lock<std::mutex> lock{mutex};
+						while (!stopping) {
+							ParallelJob *job = newestJob();
+							if (job != nullptr) execute(*job, lock);
+							else changed.wait(lock);
+						}
+					});
+				}
+			}
+
+			bool isQueued(const ParallelJob &job) const {
+				return std::find(jobs.begin(), jobs.end(), &job) != jobs.end();
+			}
+
+			ParallelJob *newestJob() const {
+				return jobs.empty() ? nullptr : jobs.back();
+			}
+
+			// Claims the next task of a queued job and runs it unlocked
+			void execute(ParallelJob &job, std::unique_lock<std::mutex> &lock) {
+				size_t task = job.claimed++;
+				if (job.claimed == job.taskCount) dequeue(job);
+
+				lock.unlock();
+				std::exception_ptr error;
+				try {
+					job.invoke(job.fn, task);
+				} catch (...) {
+					error = std::current_exception();
+				}
+				lock.lock();
+
+				if (error) {
+					if (!job.error) job.error = error;
+					// Drop the remaining tasks
+					dequeue(job);
+				}
+				job.finished++;
+				if (job.finished == job.claimed && !isQueued(job)) changed.notify_all();
+			}
+
+			void dequeue(ParallelJob &job) {
+				auto it = std::find(jobs.begin(), jobs.end(), &job);
+				if (it != jobs.end()) jobs.erase(it);
+			}
+
+			std::mutex mutex;
+			std::condition_variable changed;
+			std::vector<ParallelJob*> jobs;
+			std::vector<std::thread> threads;
+			bool stopping = false;
+		};
+	}
+
+	// Run fn(taskIndex) for every task in [0, taskCount) on the shared worker threads.
+	// Tasks are picked dynamically so uneven tasks still balance, and the first exception
+	// thrown by a task is rethrown on the calling thread once every running task has finished.
+	// Nested calls from inside a task are parallel too.
+	template <typename F>
+	void parallelTasks(size_t taskCount, F &&fn) {
+		if (taskCount == 0) return;
+
+		if (taskCount == 1 || workerCount() == 1) {
+			for (size_t i = 0; i < taskCount; i++) fn(i);
+			return;
+		}
+
+		using Fn = std::remove_reference_t<F>;
+		detail::ParallelJob job{};
+		job.invoke = [](void *f, size_t task) { (*static_cast<Fn*>(f))(task); };
+		job.fn = const_cast<void*>(static_cast<const void*>(&fn));
+		job.taskCount = taskCount;
+		detail::ParallelPool::instance().run(job);
+
+		if (job.error) std::rethrow_exception(job.error);
+	}
+
+	// Split [0, count) in contiguous ranges of at least minRange items
+	// and run fn(begin, end) on each range in parallel
+	template <typename F>
+	void parallelFor(size_t count, size_t minRange, F &&fn) {
+		if (count == 0) return;
+		minRange = std::max<size_t>(minRange, 1);
+
+		// A few ranges per thread so slow ranges don't hold everybody back
+		size_t rangeCount = std::min(workerCount() * 4, (count + minRange - 1) / minRange);
+		size_t rangeSize = (count + rangeCount - 1) / rangeCount;
+
+		parallelTasks(rangeCount, [&](size_t range) {
+			size_t begin = range * rangeSize;
+			size_t end = std::min(count, begin + rangeSize);
+			if (begin < end) fn(begin, end);
+		});
+	}
+}
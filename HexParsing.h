@@ -0,0 +1,228 @@
+#pragma once
+
+#include "HexParallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace hex {
+
+	// Helpers shared by the mesh file parsers: locale free number parsing on memory mapped
+	// text, line aligned chunking for parallel parsing and endian aware binary reads.
+
+	// Don't bother splitting files in chunks smaller than this
+	inline constexpr size_t minChunkSize = 1 << 20;
+
+	// Powers of ten exactly representable as a double
+	inline constexpr double exactPowersOfTen[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+	inline bool isDigit(char c) { return static_cast<unsigned char>(c - '0') < 10; }
+
+	inline const char *skipSpaces(const char *p, const char *end) {
+		while (p < end && isSpace(*p)) p++;
+		return p;
+	}
+
+	inline const char *skipToken(const char *p, const char *end) {
+		while (p < end && !isSpace(*p) && *p != '\n') p++;
+		return p;
+	}
+
+	inline const char *nextLine(const char *p, const char *end) {
+		auto newLine = static_cast<const char*>(memchr(p, '\n', end - p));
+		return newLine ? newLine + 1 : end;
+	}
+
+	inline void checkRange(const char *p, const char *end, const std::string &filepath) {
+		if (p > end) {
+			throw std::runtime_error("unexpected end of file in: " + filepath);
+		}
+	}
+
+	// Whether count records of recordSize bytes fit between p and end, without forming a pointer past end
+	inline bool recordsFit(const char *p, const char *end, uint64_t count, uint64_t recordSize) {
+		return p <= end && (recordSize == 0 || count <= static_cast<uint64_t>(end - p) / recordSize);
+	}
+
+	inline void checkRecords(const char *p, const char *end, uint64_t count, uint64_t recordSize, const std::string &filepath) {
+		if (!recordsFit(p, end, count, recordSize)) {
+			throw std::runtime_error("unexpected end of file in: " + filepath);
+		}
+	}
+
+	// Skip count lines, returns the position after the last one
+	inline const char *skipLines(const char *p, const char *end, size_t count, const std::string &filepath) {
+		for (size_t i = 0; i < count; i++) {
+			if (p >= end) {
+				throw std::runtime_error("unexpected end of file in: " + filepath);
+			}
+			p = nextLine(p, end);
+		}
+		return p;
+	}
+
+	// Parse a decimal number without locale nor iostream.
+	// Returns the position after the number, or nullptr if there is no number at p.
+	inline const char *parseDouble(const char *p, const char *end, double &out) {
+		p = skipSpaces(p, end);
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = *p == '-';
+			p++;
+		}
+
+		// Keep the 19 first significant digits, enough for a double
+		uint64_t mantissa = 0;
+		int significantDigits = 0;
+		int exponent = 0;
+		bool hasDigits = false;
+
+		while (p < end && isDigit(*p)) {
+			if (significantDigits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa != 0) significantDigits++;
+			} else {
+				exponent++;
+			}
+			hasDigits = true;
+			p++;
+		}
+
+		if (p < end && *p == '.') {
+			p++;
+			while (p < end && isDigit(*p)) {
+				if (significantDigits < 19) {
+					mantissa = mantissa * 10 + (*p - '0');
+					if (mantissa != 0) significantDigits++;
+					exponent--;
+				}
+				hasDigits = true;
+				p++;
+			}
+		}
+
+		if (!hasDigits) return nullptr;
+
+		if (p < end && (*p == 'e' || *p == 'E')) {
+			const char *q = p + 1;
+			bool negativeExponent = false;
+			if (q < end && (*q == '-' || *q == '+')) {
+				negativeExponent = *q == '-';
+				q++;
+			}
+			if (q < end && isDigit(*q)) {
+				int value = 0;
+				while (q < end && isDigit(*q)) {
+					if (value < 10000) value = value * 10 + (*q - '0');
+					q++;
+				}
+				exponent += negativeExponent ? -value : value;
+				p = q;
+			}
+		}
+
+		double value = static_cast<double>(mantissa);
+		if (mantissa != 0 && exponent != 0) {
+			if (exponent < 0 && exponent >= -22) {
+				value /= exactPowersOfTen[-exponent];
+			} else if (exponent > 0 && exponent <= 22) {
+				value *= exactPowersOfTen[exponent];
+			} else {
+				value *= std::pow(10.0, exponent);
+			}
+		}
+
+		out = negative ? -value : value;
+		return p;
+	}
+
+	inline const char *parseFloat(const char *p, const char *end, float &out) {
+		double value;
+		p = parseDouble(p, end, value);
+		if (p) out = static_cast<float>(value);
+		return p;
+	}
+
+	// Parse a decimal integer, returns nullptr if there is no integer at p. Values that don't fit
+	// saturate to the int64_t range so range checks reject them.
+	inline const char *parseInt(const char *p, const char *end, int64_t &out) {
+		p = skipSpaces(p, end);
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = *p == '-';
+			p++;
+		}
+
+		if (p >= end || !isDigit(*p)) return nullptr;
+
+		const int64_t limit = std::numeric_limits<int64_t>::max();
+		int64_t value = 0;
+		while (p < end && isDigit(*p)) {
+			int digit = *p - '0';
+			value = value > (limit - digit) / 10 ? limit : value * 10 + digit;
+			p++;
+		}
+
+		out = negative ? -value : value;
+		return p;
+	}
+
+	// Split [begin, end) in at most chunkCount ranges starting at the beginning of a line
+	inline std::vector<std::pair<const char*, const char*>> splitLines(const char *begin, const char *end, size_t chunkCount) {
+		std::vector<std::pair<const char*, const char*>> chunks;
+		size_t size = end - begin;
+		const char *chunkBegin = begin;
+
+		for (size_t i = 1; i <= chunkCount && chunkBegin < end; i++) {
+			const char *chunkEnd = end;
+			if (i < chunkCount) {
+				chunkEnd = std::max(chunkBegin + 1, begin + size / chunkCount * i);
+				// Move boundary after the end of the current line
+				chunkEnd = chunkEnd < end ? nextLine(chunkEnd - 1, end) : end;
+			}
+			chunks.emplace_back(chunkBegin, chunkEnd);
+			chunkBegin = chunkEnd;
+		}
+
+		return chunks;
+	}
+
+	inline size_t chunkCountForSize(size_t size) {
+		return std::max<size_t>(1, std::min(workerCount() * 4, size / minChunkSize));
+	}
+
+	inline std::vector<std::string> splitWords(const char *p, const char *end) {
+		std::vector<std::string> words;
+		while (true) {
+			p = skipSpaces(p, end);
+			if (p >= end || *p == '\n') break;
+			const char *wordEnd = skipToken(p, end);
+			words.emplace_back(p, wordEnd);
+			p = wordEnd;
+		}
+		return words;
+	}
+
+	template <typename T>
+	inline T readBinary(const char *p, bool swapBytes) {
+		char bytes[sizeof(T)];
+		memcpy(bytes, p, sizeof(T));
+		if (swapBytes) std::reverse(bytes, bytes + sizeof(T));
+		T value;
+		memcpy(&value, bytes, sizeof(T));
+		return value;
+	}
+}
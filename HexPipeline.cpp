@@ -1,7 +1,6 @@
 #include "HexPipeline.h"
-#include "HexModel.h"
 
-#include <fstream>
+#include <algorithm>
 #include <stdexcept>
 #include <iostream>
 #include <vector>
@@ -10,74 +9,142 @@
 
 namespace hex {
 
-	HexPipeline::HexPipeline(HexDevice &device, const std::string &vertFilePath, const std::string &fragFilePath, const PipelineConfigInfo &configInfo) : hexDevice{device} {
-		createGraphicsPipeline(vertFilePath, fragFilePath, configInfo);
+	namespace {
+		uint32_t renderStateBit(VkDynamicState state) {
+			switch (state) {
+				case VK_DYNAMIC_STATE_CULL_MODE_EXT: return RenderState::CULL_MODE;
+				case VK_DYNAMIC_STATE_FRONT_FACE_EXT: return RenderState::FRONT_FACE;
+				case VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY_EXT: return RenderState::PRIMITIVE_TOPOLOGY;
+				case VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT: return RenderState::DEPTH_TEST_ENABLE;
+				case VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT: return RenderState::DEPTH_WRITE_ENABLE;
+				case VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT: return RenderState::DEPTH_COMPARE_OP;
+				case VK_DYNAMIC_STATE_DEPTH_BIAS_ENABLE_EXT: return RenderState::DEPTH_BIAS_ENABLE;
+				case VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE_EXT: return RenderState::PRIMITIVE_RESTART_ENABLE;
+				case VK_DYNAMIC_STATE_POLYGON_MODE_EXT: return RenderState::POLYGON_MODE;
+				default: return 0;
+			}
+		}
 	}
 
-	HexPipeline::~HexPipeline() {
-		vkDestroyShaderModule(hexDevice.device(), vertShaderModule, nullptr);
-		vkDestroyShaderModule(hexDevice.device(), fragShaderModule, nullptr);
-		vkDestroyPipeline(hexDevice.device(), graphicsPipeline, nullptr);
+	RenderState RenderState::fromConfig(const PipelineConfigInfo &configInfo) {
+		RenderState state;
+		state.cullMode = configInfo.rasterizationInfo.cullMode;
+		state.frontFace = configInfo.rasterizationInfo.frontFace;
+		state.topology = configInfo.inputAssemblyInfo.topology;
+		state.depthTestEnable = configInfo.depthStencilInfo.depthTestEnable;
+		state.depthWriteEnable = configInfo.depthStencilInfo.depthWriteEnable;
+		state.depthCompareOp = configInfo.depthStencilInfo.depthCompareOp;
+		state.depthBiasEnable = configInfo.rasterizationInfo.depthBiasEnable;
+		state.primitiveRestartEnable = configInfo.inputAssemblyInfo.primitiveRestartEnable;
+		state.polygonMode = configInfo.rasterizationInfo.polygonMode;
+		return state;
+	}
+
+	uint32_t RenderState::dynamicStatesOf(const PipelineConfigInfo &configInfo) {
+		uint32_t states = 0;
+		for (VkDynamicState state : configInfo.dynamicStateEnables) states |= renderStateBit(state);
+		return states;
 	}
 
-	std::vector<char> HexPipeline::readFile(const std::string &filepath) {
-		std::ifstream file(filepath, std::ios::ate | std::ios::binary);
+	bool RenderState::operator==(const RenderState &other) const {
+		return cullMode == other.cullMode
+			&& frontFace == other.frontFace
+			&& topology == other.topology
+			&& depthTestEnable == other.depthTestEnable
+			&& depthWriteEnable == other.depthWriteEnable
+			&& depthCompareOp == other.depthCompareOp
+			&& depthBiasEnable == other.depthBiasEnable
+			&& primitiveRestartEnable == other.primitiveRestartEnable
+			&& polygonMode == other.polygonMode;
+	}
+
+	HexPipeline::HexPipeline(HexDevice &device, const std::string &vertFilePath, const std::string &fragFilePath, const PipelineConfigInfo &configInfo)
+		: HexPipeline{device, {{VK_SHADER_STAGE_VERTEX_BIT, vertFilePath}, {VK_SHADER_STAGE_FRAGMENT_BIT, fragFilePath}}, configInfo} {
+	}
 
-		if (!file.is_open()) {
-			throw std::runtime_error("failed to open file: " + filepath);
+	HexPipeline::HexPipeline(
+		HexDevice &device,
+		const std::vector<ShaderStageInfo> &stages,
+		const PipelineConfigInfo &configInfo,
+		const std::vector<SpecializationConstant> &specialization,
+		VkPipelineCache pipelineCache,
+		HexShaderLibrary *shaderLibrary) : hexDevice{device} {
+		if (shaderLibrary != nullptr) {
+			createGraphicsPipeline(stages, configInfo, specialization, pipelineCache, *shaderLibrary);
+		} else {
+			HexShaderLibrary ownLibrary{device};
+			createGraphicsPipeline(stages, configInfo, specialization, pipelineCache, ownLibrary);
 		}
+	}
 
-		size_t fileSize = static_cast<size_t>(file.tellg());
-		std::vector<char> buffer(fileSize);
+	HexPipeline::HexPipeline(
+		HexDevice &device,
+		const std::string &compFilePath,
+		VkPipelineLayout pipelineLayout,
+		VkPipelineCache pipelineCache,
+		HexShaderLibrary *shaderLibrary) : hexDevice{device} {
+		if (shaderLibrary != nullptr) {
+			createComputePipeline(compFilePath, pipelineLayout, pipelineCache, *shaderLibrary);
+		} else {
+			HexShaderLibrary ownLibrary{device};
+			createComputePipeline(compFilePath, pipelineLayout, pipelineCache, ownLibrary);
+		}
+	}
 
-		file.seekg(0);
-		file.read(buffer.data(), fileSize);
-		file.close();
-		return buffer;
+	HexPipeline::~HexPipeline() {
+		vkDestroyPipeline(hexDevice.device(), pipeline, nullptr);
 	}
 
-	void HexPipeline::createGraphicsPipeline(const std::string &vertFilePath, const std::string &fragFilePath, const PipelineConfigInfo &configInfo) {
+	void HexPipeline::createGraphicsPipeline(
+		const std::vector<ShaderStageInfo> &stages,
+		const PipelineConfigInfo &configInfo,
+		const std::vector<SpecializationConstant> &specialization,
+		VkPipelineCache pipelineCache,
+		HexShaderLibrary &shaderLibrary) {
 		assert(configInfo.pipelineLayout != VK_NULL_HANDLE && "Cannot create graphics pipeline: no pipelineLayout provided in configInfo");
-		assert(configInfo.renderPass != VK_NULL_HANDLE && "Cannot create graphics pipeline: no renderPass provided in configInfo");
-
-		auto vertCode = readFile(vertFilePath);
-		auto fragCode = readFile(fragFilePath);
-
-		createShaderModule(vertCode, &vertShaderModule);
-		createShaderModule(fragCode, &fragShaderModule);
-
-		VkPipelineShaderStageCreateInfo shaderStages[2];
-		shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-		shaderStages[0].module = vertShaderModule;
-		shaderStages[0].pName = "main";
-		shaderStages[0].flags = 0;
-		shaderStages[0].pNext = nullptr;
-		shaderStages[0].pSpecializationInfo = nullptr;
-
-		shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		shaderStages[1].module = fragShaderModule;
-		shaderStages[1].pName = "main";
-		shaderStages[1].flags = 0;
-		shaderStages[1].pNext = nullptr;
-		shaderStages[1].pSpecializationInfo = nullptr;
-
-		// Get vertex buffer descriptions
-		auto bindingDescriptions = HexModel::Vertex::getBindingDescriptions();
-		auto attributeDescriptions = HexModel::Vertex::getAttributeDescriptions();
+		assert((configInfo.renderPass != VK_NULL_HANDLE || hexDevice.dynamicRenderingSupported()) && "Cannot create graphics pipeline: no renderPass provided in configInfo");
+		dynamicRenderStates = RenderState::dynamicStatesOf(configInfo);
+
+		// Released when the pipeline is created, or on failure
+		std::vector<HexShaderLibrary::Reference> shaders;
+		for (auto &stage : stages) shaders.push_back(shaderLibrary.acquire(stage.filePath));
+
+		std::vector<VkSpecializationMapEntry> specializationEntries(specialization.size());
+		std::vector<uint32_t> specializationData(specialization.size());
+		for (size_t i = 0; i < specialization.size(); i++) {
+			specializationEntries[i].constantID = specialization[i].id;
+			specializationEntries[i].offset = static_cast<uint32_t>(i * sizeof(uint32_t));
+			specializationEntries[i].size = sizeof(uint32_t);
+			specializationData[i] = specialization[i].value;
+		}
+		VkSpecializationInfo specializationInfo{};
+		specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+		specializationInfo.pMapEntries = specializationEntries.data();
+		specializationInfo.dataSize = specializationData.size() * sizeof(uint32_t);
+		specializationInfo.pData = specializationData.data();
+
+		std::vector<VkPipelineShaderStageCreateInfo> shaderStages(stages.size());
+		std::vector<HexShaderLibrary::StageSource> sources(stages.size());
+		for (size_t i = 0; i < stages.size(); i++) {
+			shaderStages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			shaderStages[i].stage = stages[i].stage;
+			shaderStages[i].pName = "main";
+			shaderStages[i].flags = 0;
+			shaderStages[i].pSpecializationInfo = specialization.empty() ? nullptr : &specializationInfo;
+		}
 
+		// Vertex buffer descriptions, compile time arrays of the vertex layout
 		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-		vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
-		vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-		vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
+		vertexInputInfo.vertexAttributeDescriptionCount = configInfo.attributeDescriptionCount;
+		vertexInputInfo.vertexBindingDescriptionCount = configInfo.bindingDescriptionCount;
+		vertexInputInfo.pVertexAttributeDescriptions = configInfo.attributeDescriptions;
+		vertexInputInfo.pVertexBindingDescriptions = configInfo.bindingDescriptions;
 
 		VkGraphicsPipelineCreateInfo pipelineInfo{};
 		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineInfo.stageCount = 2;
-		pipelineInfo.pStages = shaderStages;
+		pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+		pipelineInfo.pStages = shaderStages.data();
 		pipelineInfo.pVertexInputState = &vertexInputInfo;
 		pipelineInfo.pInputAssemblyState = &configInfo.inputAssemblyInfo;
 		pipelineInfo.pViewportState = &configInfo.viewportInfo;
@@ -91,31 +158,74 @@ namespace hex {
 		pipelineInfo.renderPass = configInfo.renderPass;
 		pipelineInfo.subpass = configInfo.subpass;
 
+		// Without a render pass the attachment formats are all the pipeline knows of the pass
+		VkPipelineRenderingCreateInfo renderingInfo{};
+		if (configInfo.renderPass == VK_NULL_HANDLE) {
+			renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+			renderingInfo.colorAttachmentCount = configInfo.colorAttachmentFormat != VK_FORMAT_UNDEFINED ? 1 : 0;
+			renderingInfo.pColorAttachmentFormats = &configInfo.colorAttachmentFormat;
+			renderingInfo.depthAttachmentFormat = configInfo.depthAttachmentFormat;
+			pipelineInfo.pNext = &renderingInfo;
+		}
+
 		pipelineInfo.basePipelineIndex = -1;
 		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // For derivating new pipeline from existing one !
 
-		// std::cout << "Vertex shader code file size: " << vertCode.size() << std::endl;
-		// std::cout << "Fragment shader code file size: " << fragCode.size() << std::endl;
-
-		if (vkCreateGraphicsPipelines(hexDevice.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to create graphic pipeline");
+		// A pipeline already in the cache needs only the identifiers of its shaders
+		bool byIdentifier = pipelineCache != VK_NULL_HANDLE && shaderLibrary.hasIdentifiers();
+		while (true) {
+			for (size_t i = 0; i < stages.size(); i++) {
+				shaderLibrary.setStageShader(*shaders[i].get(), byIdentifier, shaderStages[i], sources[i]);
+			}
+			pipelineInfo.flags = byIdentifier ? VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT : 0;
+
+			VkResult result = vkCreateGraphicsPipelines(hexDevice.device(), pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+			if (result == VK_PIPELINE_COMPILE_REQUIRED && byIdentifier) {
+				byIdentifier = false;
+				continue;
+			}
+			if (result != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create graphic pipeline");
+			}
+			break;
 		}
 
 	}
 
-	void HexPipeline::createShaderModule(const std::vector<char> &code, VkShaderModule *shaderModule) {
-		VkShaderModuleCreateInfo createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-		createInfo.codeSize = code.size();
-		createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+	void HexPipeline::createComputePipeline(const std::string &compFilePath, VkPipelineLayout pipelineLayout, VkPipelineCache pipelineCache, HexShaderLibrary &shaderLibrary) {
+		assert(pipelineLayout != VK_NULL_HANDLE && "Cannot create compute pipeline: no pipelineLayout provided");
+		bindPoint = VK_PIPELINE_BIND_POINT_COMPUTE;
 
-		if (vkCreateShaderModule(hexDevice.device(), &createInfo, nullptr, shaderModule) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to create shader module");
+		HexShaderLibrary::Reference shader = shaderLibrary.acquire(compFilePath);
+		HexShaderLibrary::StageSource source;
+
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = pipelineLayout;
+		pipelineInfo.basePipelineIndex = -1;
+
+		bool byIdentifier = pipelineCache != VK_NULL_HANDLE && shaderLibrary.hasIdentifiers();
+		while (true) {
+			shaderLibrary.setStageShader(*shader.get(), byIdentifier, pipelineInfo.stage, source);
+			pipelineInfo.flags = byIdentifier ? VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT : 0;
+
+			VkResult result = vkCreateComputePipelines(hexDevice.device(), pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+			if (result == VK_PIPELINE_COMPILE_REQUIRED && byIdentifier) {
+				byIdentifier = false;
+				continue;
+			}
+			if (result != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create compute pipeline");
+			}
+			break;
 		}
 	}
 
 	void HexPipeline::bind(VkCommandBuffer commandBuffer) {
-		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+		vkCmdBindPipeline(commandBuffer, bindPoint, pipeline);
 	}
 
 	void HexPipeline::defaultPipelineConfigInfo(PipelineConfigInfo & configInfo) {
@@ -137,7 +247,7 @@ namespace hex {
 		configInfo.rasterizationInfo.rasterizerDiscardEnable = VK_FALSE;
 		configInfo.rasterizationInfo.polygonMode = VK_POLYGON_MODE_FILL;
 		configInfo.rasterizationInfo.lineWidth = 1.0f;
-		configInfo.rasterizationInfo.cullMode = VK_CULL_MODE_NONE; // Maybe modify on the fly ?
+		configInfo.rasterizationInfo.cullMode = VK_CULL_MODE_BACK_BIT; // Models are wound counter clockwise from outside, open ones need VK_CULL_MODE_NONE
 		configInfo.rasterizationInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
 		configInfo.rasterizationInfo.depthBiasEnable = VK_FALSE;
 		// All optionals, only if depthBiasEnable set to VK_TRUE
@@ -192,5 +302,42 @@ namespace hex {
 		configInfo.dynamicStateInfo.pDynamicStates = configInfo.dynamicStateEnables.data();
 		configInfo.dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(configInfo.dynamicStateEnables.size());
 		configInfo.dynamicStateInfo.flags = 0;
+
+		setVertexLayout<FloatVertex>(configInfo);
+	}
+
+	void HexPipeline::setRenderTarget(PipelineConfigInfo &configInfo, const RenderTargetInfo &renderTarget) {
+		configInfo.renderPass = renderTarget.renderPass;
+		configInfo.subpass = renderTarget.subpass;
+		configInfo.colorAttachmentFormat = renderTarget.colorFormat;
+		configInfo.depthAttachmentFormat = renderTarget.depthFormat;
+	}
+
+	void HexPipeline::enableDynamicRenderState(PipelineConfigInfo &configInfo, const HexDevice &device) {
+		std::vector<VkDynamicState> states;
+		if (device.extendedDynamicStateSupported()) {
+			states.insert(states.end(), {
+				VK_DYNAMIC_STATE_CULL_MODE_EXT,
+				VK_DYNAMIC_STATE_FRONT_FACE_EXT,
+				// Only within the topology class of the config
+				VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY_EXT,
+				VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT,
+				VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT,
+				VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT});
+		}
+		if (device.extendedDynamicState2Supported()) {
+			states.insert(states.end(), {VK_DYNAMIC_STATE_DEPTH_BIAS_ENABLE_EXT, VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE_EXT});
+		}
+		if (device.extendedDynamicState3PolygonModeSupported()) {
+			states.push_back(VK_DYNAMIC_STATE_POLYGON_MODE_EXT);
+		}
+
+		for (VkDynamicState state : states) {
+			if (std::find(configInfo.dynamicStateEnables.begin(), configInfo.dynamicStateEnables.end(), state) == configInfo.dynamicStateEnables.end()) {
+				configInfo.dynamicStateEnables.push_back(state);
+			}
+		}
+		configInfo.dynamicStateInfo.pDynamicStates = configInfo.dynamicStateEnables.data();
+		configInfo.dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(configInfo.dynamicStateEnables.size());
 	}
 }
\ No newline at end of file
@@ -1,12 +1,24 @@
 #pragma once
 
 #include "hex_device.h"
+#include "HexShaderLibrary.h"
+#include "HexVertexFormats.h"
 
 #include <string>
 #include <vector>
 
 namespace hex {
 
+	// What the pipelines of a pass draw into: a render pass subpass or, with dynamic rendering
+	// (no render pass), the formats of the attachments the pass begins with
+	struct RenderTargetInfo {
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		uint32_t subpass = 0;
+		// VK_FORMAT_UNDEFINED when the pass has no such attachment
+		VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+		VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+	};
+
 	struct PipelineConfigInfo {
 
 		PipelineConfigInfo(const PipelineConfigInfo&) = delete;
@@ -22,31 +34,126 @@ namespace hex {
 		std::vector<VkDynamicState> dynamicStateEnables;
 		VkPipelineDynamicStateCreateInfo dynamicStateInfo;
 
+		// Vertex input, points to the compile time arrays of a VertexLayout (see setVertexLayout)
+		const VkVertexInputBindingDescription *bindingDescriptions = nullptr;
+		uint32_t bindingDescriptionCount = 0;
+		const VkVertexInputAttributeDescription *attributeDescriptions = nullptr;
+		uint32_t attributeDescriptionCount = 0;
+
 		VkPipelineLayout pipelineLayout = nullptr;
+		// Either a render pass, or none and the attachment formats (see setRenderTarget)
 		VkRenderPass renderPass = nullptr;
 		uint32_t subpass = 0;
+		VkFormat colorAttachmentFormat = VK_FORMAT_UNDEFINED;
+		VkFormat depthAttachmentFormat = VK_FORMAT_UNDEFINED;
+	};
+
+	// SPIR-V file for one stage of a graphics pipeline
+	struct ShaderStageInfo {
+		VkShaderStageFlagBits stage;
+		std::string filePath;
+	};
+
+	// 32 bit specialization constant (layout (constant_id = id)), bools are VkBool32 and
+	// floats are passed bit for bit. Applied to every stage, stages ignore the ids they don't declare.
+	struct SpecializationConstant {
+		uint32_t id;
+		uint32_t value;
 	};
 
+	// Rasterization and depth state a draw needs. Pipelines created with dynamic render state
+	// (HexPipeline::enableDynamicRenderState) take it from the command buffer, see HexDynamicState,
+	// others bake what their config says.
+	struct RenderState {
+		// One bit per state, for the states a pipeline has dynamic
+		enum : uint32_t {
+			CULL_MODE = 1 << 0,
+			FRONT_FACE = 1 << 1,
+			PRIMITIVE_TOPOLOGY = 1 << 2,
+			DEPTH_TEST_ENABLE = 1 << 3,
+			DEPTH_WRITE_ENABLE = 1 << 4,
+			DEPTH_COMPARE_OP = 1 << 5,
+			DEPTH_BIAS_ENABLE = 1 << 6,
+			PRIMITIVE_RESTART_ENABLE = 1 << 7,
+			POLYGON_MODE = 1 << 8
+		};
+
+		VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+		VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+		VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		VkBool32 depthTestEnable = VK_TRUE;
+		VkBool32 depthWriteEnable = VK_TRUE;
+		VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+		VkBool32 depthBiasEnable = VK_FALSE;
+		VkBool32 primitiveRestartEnable = VK_FALSE;
+		VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+
+		// The state a pipeline created from the config draws with
+		static RenderState fromConfig(const PipelineConfigInfo &configInfo);
+		// Bits of the states the config leaves to the command buffer
+		static uint32_t dynamicStatesOf(const PipelineConfigInfo &configInfo);
+
+		bool operator==(const RenderState &other) const;
+		bool operator!=(const RenderState &other) const { return !(*this == other); }
+	};
+
+	// Shaders come from the given library, shared with other pipelines, or from one of
+	// the pipeline's own. Either way they're released once the pipeline is created.
 	class HexPipeline {
 		public:
 		HexPipeline(HexDevice &device, const std::string &vertFilePath, const std::string &fragFilePath, const PipelineConfigInfo &configInfo);
+		// Any stage combination, e.g. task + mesh + fragment (vertex input is then ignored)
+		HexPipeline(
+			HexDevice &device,
+			const std::vector<ShaderStageInfo> &stages,
+			const PipelineConfigInfo &configInfo,
+			const std::vector<SpecializationConstant> &specialization = {},
+			VkPipelineCache pipelineCache = VK_NULL_HANDLE,
+			HexShaderLibrary *shaderLibrary = nullptr);
+		// Compute pipeline
+		HexPipeline(
+			HexDevice &device,
+			const std::string &compFilePath,
+			VkPipelineLayout pipelineLayout,
+			VkPipelineCache pipelineCache = VK_NULL_HANDLE,
+			HexShaderLibrary *shaderLibrary = nullptr);
 		~HexPipeline();
 
 		HexPipeline(const HexPipeline&) = delete;
 		HexPipeline& operator=(const HexPipeline&) = delete;
 
 		void bind(VkCommandBuffer commandBuffer);
+		// RenderState bits this pipeline takes from the command buffer
+		uint32_t getDynamicRenderStates() const { return dynamicRenderStates; }
 
 		static void defaultPipelineConfigInfo(PipelineConfigInfo &configInfo);
+		static void setRenderTarget(PipelineConfigInfo &configInfo, const RenderTargetInfo &renderTarget);
+		// Leaves the render state the device can set on the command buffer to it (extended
+		// dynamic state), pipelines then only differ by their shaders and formats. The pipeline
+		// must be bound with HexDynamicState. Vertex input pipelines only, mesh shaders have
+		// no topology.
+		static void enableDynamicRenderState(PipelineConfigInfo &configInfo, const HexDevice &device);
+
+		template <typename VertexT>
+		static void setVertexLayout(PipelineConfigInfo &configInfo) {
+			configInfo.bindingDescriptions = VertexLayout<VertexT>::bindings.data();
+			configInfo.bindingDescriptionCount = static_cast<uint32_t>(VertexLayout<VertexT>::bindings.size());
+			configInfo.attributeDescriptions = VertexLayout<VertexT>::attributes.data();
+			configInfo.attributeDescriptionCount = static_cast<uint32_t>(VertexLayout<VertexT>::attributes.size());
+		}
 
 		private:
-		static std::vector<char> readFile(const std::string &filepath);
-		void createGraphicsPipeline(const std::string &vertFilePath, const std::string &fragFilePath, const PipelineConfigInfo &configInfo);
-		void createShaderModule(const std::vector<char> &code, VkShaderModule *shaderModule);
+		void createGraphicsPipeline(
+			const std::vector<ShaderStageInfo> &stages,
+			const PipelineConfigInfo &configInfo,
+			const std::vector<SpecializationConstant> &specialization,
+			VkPipelineCache pipelineCache,
+			HexShaderLibrary &shaderLibrary);
+		void createComputePipeline(const std::string &compFilePath, VkPipelineLayout pipelineLayout, VkPipelineCache pipelineCache, HexShaderLibrary &shaderLibrary);
 		HexDevice &hexDevice;
-		VkPipeline graphicsPipeline;
-		VkShaderModule vertShaderModule;
-		VkShaderModule fragShaderModule;
+		VkPipeline pipeline;
+		VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		uint32_t dynamicRenderStates = 0;
 
 	};
 }
\ No newline at end of file
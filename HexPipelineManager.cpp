@@ -0,0 +1,554 @@
+#include "HexPipelineManager.h"
+#include "HexParallel.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+
+namespace hex {
+
+	namespace {
+		const std::string manifestVersion = "hexpipelines 1";
+
+		// FNV-1a over the fields one by one, struct padding never gets in the key
+		struct KeyHasher {
+			uint64_t hash = 14695981039346656037ull;
+
+			void addBytes(const void *data, size_t size) {
+				const unsigned char *bytes = static_cast<const unsigned char*>(data);
+				for (size_t i = 0; i < size; i++) {
+					hash ^= bytes[i];
+					hash *= 1099511628211ull;
+				}
+			}
+
+			template <typename T>
+			void add(const T &value) {
+				static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "hash fields one by one");
+				addBytes(&value, sizeof(T));
+			}
+
+			// Non dispatchable handles are pointers or 64 bit integers depending on the platform
+			template <typename T>
+			void addHandle(const T &handle) {
+				uint64_t bits = 0;
+				memcpy(&bits, &handle, sizeof(T));
+				add(bits);
+			}
+
+			void add(const std::string &value) {
+				add(static_cast<uint64_t>(value.size()));
+				addBytes(value.data(), value.size());
+			}
+
+			void add(const VkStencilOpState &state) {
+				add(state.failOp);
+				add(state.passOp);
+				add(state.depthFailOp);
+				add(state.compareOp);
+				add(state.compareMask);
+				add(state.writeMask);
+				add(state.reference);
+			}
+		};
+
+		// Dynamic topologies stay within the class the pipeline was created with
+		uint32_t topologyClass(VkPrimitiveTopology topology) {
+			switch (topology) {
+				case VK_PRIMITIVE_TOPOLOGY_POINT_LIST: return 0;
+				case VK_PRIMITIVE_TOPOLOGY_LINE_LIST:
+				case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
+				case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
+				case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY: return 1;
+				case VK_PRIMITIVE_TOPOLOGY_PATCH_LIST: return 3;
+				default: return 2;
+			}
+		}
+
+		// VkPipelineCacheHeaderVersionOne
+		struct CacheHeader {
+			uint32_t headerSize;
+			uint32_t headerVersion;
+			uint32_t vendorID;
+			uint32_t deviceID;
+			uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+		};
+	}
+
+	HexPipelineManager::HexPipelineManager(HexDevice &device) : hexDevice{device}, shaderLibrary{device}, created{std::chrono::steady_clock::now()} {
+		createPipelineCache();
+		loadManifest();
+
+		// One core stays with the render thread
+		size_t workerThreads = std::max<size_t>(1, workerCount() - 1);
+		for (size_t i = 0; i < workerThreads; i++) {
+			workers.emplace_back(&HexPipelineManager::compilePipelines, this);
+		}
+	}
+
+	HexPipelineManager::~HexPipelineManager() {
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			stopping = true;
+		}
+		queueChanged.notify_all();
+		for (auto &worker : workers) worker.join();
+
+		std::cout << "Pipelines: " << requests << " requests, " << pipelinesCreated << " pipelines created, "
+			<< foldedRequests << " requests differing only in dynamic render state" << std::endl;
+
+		entries.clear();
+		savePipelineCache();
+		saveManifest();
+		vkDestroyPipelineCache(hexDevice.device(), pipelineCache, nullptr);
+	}
+
+	// The cache of the last run, unless it was written by another device or driver
+	void HexPipelineManager::createPipelineCache() {
+		std::vector<char> data;
+		std::ifstream file(CACHE_PATH, std::ios::binary);
+		if (file.is_open()) {
+			data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		}
+
+		if (data.size() >= sizeof(CacheHeader)) {
+			CacheHeader header;
+			memcpy(&header, data.data(), sizeof(CacheHeader));
+			if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+				|| header.vendorID != hexDevice.properties.vendorID
+				|| header.deviceID != hexDevice.properties.deviceID
+				|| memcmp(header.pipelineCacheUUID, hexDevice.properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+				data.clear();
+			}
+		} else {
+			data.clear();
+		}
+
+		VkPipelineCacheCreateInfo cacheInfo{};
+		cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		cacheInfo.initialDataSize = data.size();
+		cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+		if (vkCreatePipelineCache(hexDevice.device(), &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+			// A corrupted cache isn't worth failing for, start empty
+			cacheInfo.initialDataSize = 0;
+			cacheInfo.pInitialData = nullptr;
+			if (vkCreatePipelineCache(hexDevice.device(), &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create pipeline cache");
+			}
+		}
+	}
+
+	void HexPipelineManager::savePipelineCache() {
+		size_t size = 0;
+		if (vkGetPipelineCacheData(hexDevice.device(), pipelineCache, &size, nullptr) != VK_SUCCESS || size == 0) return;
+		std::vector<char> data(size);
+		if (vkGetPipelineCacheData(hexDevice.device(), pipelineCache, &size, data.data()) != VK_SUCCESS) return;
+
+		// Not worth failing the shutdown for, the next run compiles again
+		std::string temporaryPath = std::string{CACHE_PATH} + ".tmp";
+		{
+			std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+			file.write(data.data(), size);
+			if (!file) {
+				std::cerr << "Failed to write pipeline cache: " << temporaryPath << std::endl;
+				return;
+			}
+		}
+		if (std::rename(temporaryPath.c_str(), CACHE_PATH) != 0) {
+			std::remove(temporaryPath.c_str());
+			std::cerr << "Failed to write pipeline cache: " << CACHE_PATH << std::endl;
+		}
+	}
+
+	// One stable key per line in hex, after a version line
+	void HexPipelineManager::loadManifest() {
+		std::ifstream file(MANIFEST_PATH);
+		std::string line;
+		if (!file.is_open() || !std::getline(file, line) || line != manifestVersion) return;
+
+		while (std::getline(file, line)) {
+			char *end;
+			uint64_t key = std::strtoull(line.c_str(), &end, 16);
+			if (line.empty() || *end != '\0') {
+				// Stale manifests only cost compile order, a damaged one is ignored whole
+				std::cerr << "Ignoring damaged pipeline manifest: " << MANIFEST_PATH << std::endl;
+				manifestOrder.clear();
+				return;
+			}
+			manifestOrder.emplace(key, manifestOrder.size());
+		}
+	}
+
+	void HexPipelineManager::saveManifest() {
+		// A run that never drew keeps the last manifest
+		if (usedKeys.empty()) return;
+
+		std::string temporaryPath = std::string{MANIFEST_PATH} + ".tmp";
+		{
+			std::ofstream file(temporaryPath, std::ios::trunc);
+			file << manifestVersion << '\n' << std::hex;
+			for (uint64_t key : usedKeys) file << key << '\n';
+			if (!file) {
+				std::cerr << "Failed to write pipeline manifest: " << temporaryPath << std::endl;
+				return;
+			}
+		}
+		if (std::rename(temporaryPath.c_str(), MANIFEST_PATH) != 0) {
+			std::remove(temporaryPath.c_str());
+			std::cerr << "Failed to write pipeline manifest: " << MANIFEST_PATH << std::endl;
+		}
+	}
+
+	uint64_t HexPipelineManager::hashRequest(
+		const std::vector<ShaderStageInfo> &stages,
+		const PipelineConfigInfo &configInfo,
+		const std::vector<SpecializationConstant> &specialization) {
+		KeyHasher hasher;
+
+		hasher.add(static_cast<uint64_t>(stages.size()));
+		for (auto &stage : stages) {
+			hasher.add(stage.stage);
+			hasher.add(stage.filePath);
+		}
+		hasher.add(static_cast<uint64_t>(specialization.size()));
+		for (auto &constant : specialization) {
+			hasher.add(constant.id);
+			hasher.add(constant.value);
+		}
+
+		hasher.add(configInfo.viewportInfo.viewportCount);
+		hasher.add(configInfo.viewportInfo.scissorCount);
+
+		// Render state left to the command buffer doesn't make another pipeline
+		RenderState renderState = RenderState::fromConfig(configInfo);
+		uint32_t dynamic = RenderState::dynamicStatesOf(configInfo);
+		if (dynamic & RenderState::PRIMITIVE_TOPOLOGY) {
+			hasher.add(topologyClass(renderState.topology));
+		} else {
+			hasher.add(renderState.topology);
+		}
+		if (!(dynamic & RenderState::PRIMITIVE_RESTART_ENABLE)) hasher.add(renderState.primitiveRestartEnable);
+		if (!(dynamic & RenderState::POLYGON_MODE)) hasher.add(renderState.polygonMode);
+		if (!(dynamic & RenderState::CULL_MODE)) hasher.add(renderState.cullMode);
+		if (!(dynamic & RenderState::FRONT_FACE)) hasher.add(renderState.frontFace);
+		if (!(dynamic & RenderState::DEPTH_BIAS_ENABLE)) hasher.add(renderState.depthBiasEnable);
+		if (!(dynamic & RenderState::DEPTH_TEST_ENABLE)) hasher.add(renderState.depthTestEnable);
+		if (!(dynamic & RenderState::DEPTH_WRITE_ENABLE)) hasher.add(renderState.depthWriteEnable);
+		if (!(dynamic & RenderState::DEPTH_COMPARE_OP)) hasher.add(renderState.depthCompareOp);
+
+		auto &rasterization = configInfo.rasterizationInfo;
+		hasher.add(rasterization.depthClampEnable);
+		hasher.add(rasterization.rasterizerDiscardEnable);
+		hasher.add(rasterization.depthBiasConstantFactor);
+		hasher.add(rasterization.depthBiasClamp);
+		hasher.add(rasterization.depthBiasSlopeFactor);
+		hasher.add(rasterization.lineWidth);
+
+		auto &multisample = configInfo.multisampleInfo;
+		hasher.add(multisample.rasterizationSamples);
+		hasher.add(multisample.sampleShadingEnable);
+		hasher.add(multisample.minSampleShading);
+		hasher.add(multisample.alphaToCoverageEnable);
+		hasher.add(multisample.alphaToOneEnable);
+
+		auto &blend = configInfo.colorBlendAttachment;
+		hasher.add(blend.blendEnable);
+		hasher.add(blend.srcColorBlendFactor);
+		hasher.add(blend.dstColorBlendFactor);
+		hasher.add(blend.colorBlendOp);
+		hasher.add(blend.srcAlphaBlendFactor);
+		hasher.add(blend.dstAlphaBlendFactor);
+		hasher.add(blend.alphaBlendOp);
+		hasher.add(blend.colorWriteMask);
+		hasher.add(configInfo.colorBlendInfo.logicOpEnable);
+		hasher.add(configInfo.colorBlendInfo.logicOp);
+		hasher.add(configInfo.colorBlendInfo.attachmentCount);
+		for (float constant : configInfo.colorBlendInfo.blendConstants) hasher.add(constant);
+
+		auto &depthStencil = configInfo.depthStencilInfo;
+		hasher.add(depthStencil.depthBoundsTestEnable);
+		hasher.add(depthStencil.stencilTestEnable);
+		hasher.add(depthStencil.front);
+		hasher.add(depthStencil.back);
+		hasher.add(depthStencil.minDepthBounds);
+		hasher.add(depthStencil.maxDepthBounds);
+
+		hasher.add(static_cast<uint64_t>(configInfo.dynamicStateEnables.size()));
+		for (auto state : configInfo.dynamicStateEnables) hasher.add(state);
+
+		hasher.add(configInfo.bindingDescriptionCount);
+		for (uint32_t i = 0; i < configInfo.bindingDescriptionCount; i++) {
+			auto &binding = configInfo.bindingDescriptions[i];
+			hasher.add(binding.binding);
+			hasher.add(binding.stride);
+			hasher.add(binding.inputRate);
+		}
+		hasher.add(configInfo.attributeDescriptionCount);
+		for (uint32_t i = 0; i < configInfo.attributeDescriptionCount; i++) {
+			auto &attribute = configInfo.attributeDescriptions[i];
+			hasher.add(attribute.location);
+			hasher.add(attribute.binding);
+			hasher.add(attribute.format);
+			hasher.add(attribute.offset);
+		}
+
+		hasher.add(configInfo.subpass);
+		hasher.add(configInfo.colorAttachmentFormat);
+		hasher.add(configInfo.depthAttachmentFormat);
+		return hasher.hash;
+	}
+
+	// Requests with another layout or render pass are other pipelines within a run
+	uint64_t HexPipelineManager::runtimeKey(uint64_t stableKey, const PipelineConfigInfo &configInfo) {
+		KeyHasher hasher;
+		hasher.add(stableKey);
+		hasher.addHandle(configInfo.pipelineLayout);
+		hasher.addHandle(configInfo.renderPass);
+		return hasher.hash;
+	}
+
+	// Config structs point into themselves and at the caller's arrays, the copy points into the entry
+	void HexPipelineManager::copyConfig(const PipelineConfigInfo &from, Entry &entry) {
+		assert(from.multisampleInfo.pSampleMask == nullptr && "Sample masks aren't copied");
+
+		entry.config = std::unique_ptr<PipelineConfigInfo>(new PipelineConfigInfo{});
+		PipelineConfigInfo &to = *entry.config;
+		to.viewportInfo = from.viewportInfo;
+		to.inputAssemblyInfo = from.inputAssemblyInfo;
+		to.rasterizationInfo = from.rasterizationInfo;
+		to.multisampleInfo = from.multisampleInfo;
+		to.colorBlendAttachment = from.colorBlendAttachment;
+		to.colorBlendInfo = from.colorBlendInfo;
+		to.colorBlendInfo.pAttachments = &to.colorBlendAttachment;
+		to.depthStencilInfo = from.depthStencilInfo;
+		to.dynamicStateEnables = from.dynamicStateEnables;
+		to.dynamicStateInfo = from.dynamicStateInfo;
+		to.dynamicStateInfo.pDynamicStates = to.dynamicStateEnables.data();
+		to.dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(to.dynamicStateEnables.size());
+
+		entry.bindings.assign(from.bindingDescriptions, from.bindingDescriptions + from.bindingDescriptionCount);
+		entry.attributes.assign(from.attributeDescriptions, from.attributeDescriptions + from.attributeDescriptionCount);
+		to.bindingDescriptions = entry.bindings.data();
+		to.bindingDescriptionCount = from.bindingDescriptionCount;
+		to.attributeDescriptions = entry.attributes.data();
+		to.attributeDescriptionCount = from.attributeDescriptionCount;
+
+		to.pipelineLayout = from.pipelineLayout;
+		to.renderPass = from.renderPass;
+		to.subpass = from.subpass;
+		to.colorAttachmentFormat = from.colorAttachmentFormat;
+		to.depthAttachmentFormat = from.depthAttachmentFormat;
+	}
+
+	HexPipelineManager::Handle HexPipelineManager::request(
+		const std::vector<ShaderStageInfo> &stages,
+		const PipelineConfigInfo &configInfo,
+		const std::vector<SpecializationConstant> &specialization,
+		Handle fallback) {
+		// Missing shaders still fail the caller right away, systems disable themselves on it
+		std::vector<HexShaderLibrary::Reference> shaders;
+		for (auto &stage : stages) shaders.push_back(shaderLibrary.acquire(stage.filePath));
+
+		uint64_t stableKey = hashRequest(stages, configInfo, specialization);
+		uint64_t key = runtimeKey(stableKey, configInfo);
+		RenderState renderState = RenderState::fromConfig(configInfo);
+
+		std::lock_guard<std::mutex> lock{mutex};
+		requests++;
+		auto found = handlesByKey.find(key);
+		if (found != handlesByKey.end()) {
+			Entry &existing = *entries[found->second];
+			if (existing.renderState != renderState) foldedRequests++;
+			existing.references++;
+			return found->second;
+		}
+
+		auto entry = std::make_unique<Entry>();
+		entry->key = key;
+		entry->stableKey = stableKey;
+		entry->renderState = renderState;
+		auto listed = manifestOrder.find(stableKey);
+		if (listed != manifestOrder.end()) entry->manifestIndex = listed->second;
+		entry->stages = stages;
+		entry->specialization = specialization;
+		entry->shaders = std::move(shaders);
+		copyConfig(configInfo, *entry);
+		// Kept alive as long as the entry may fall back to it
+		entry->fallback = fallback;
+		if (fallback != NO_PIPELINE) entries[fallback]->references++;
+
+		Handle handle;
+		if (!freeHandles.empty()) {
+			handle = freeHandles.back();
+			freeHandles.pop_back();
+			entries[handle] = std::move(entry);
+		} else {
+			handle = static_cast<Handle>(entries.size());
+			entries.push_back(std::move(entry));
+		}
+		handlesByKey[key] = handle;
+		// Listed pipelines go in manifest order ahead of the others
+		size_t manifestIndex = entries[handle]->manifestIndex;
+		auto position = manifestIndex == NOT_LISTED ? queue.end() : std::find_if(queue.begin(), queue.end(), [this, manifestIndex](Handle queued) {
+			return entries[queued]->manifestIndex > manifestIndex;
+		});
+		queue.insert(position, handle);
+		queueChanged.notify_one();
+		return handle;
+	}
+
+	void HexPipelineManager::release(Handle handle) {
+		if (handle == NO_PIPELINE) return;
+
+		std::unique_lock<std::mutex> lock{mutex};
+		while (handle != NO_PIPELINE) {
+			Entry &entry = *entries[handle];
+			if (--entry.references > 0) return;
+
+			entryDone.wait(lock, [&entry] { return entry.state != State::Compiling; });
+			if (entry.state == State::Queued) {
+				queue.erase(std::find(queue.begin(), queue.end(), handle));
+			}
+
+			Handle fallback = entry.fallback;
+			handlesByKey.erase(entry.key);
+			entries[handle].reset();
+			freeHandles.push_back(handle);
+			handle = fallback;
+		}
+	}
+
+	HexPipeline *HexPipelineManager::get(Handle handle) {
+		if (handle == NO_PIPELINE) return nullptr;
+
+		std::lock_guard<std::mutex> lock{mutex};
+		Handle requested = handle;
+		while (handle != NO_PIPELINE) {
+			Entry &entry = *entries[handle];
+			if (entry.state == State::Ready) {
+				if (handle != requested) waitedDrawsInFrame++;
+				if (!entry.used) {
+					entry.used = true;
+					if (usedKeySet.insert(entry.stableKey).second) usedKeys.push_back(entry.stableKey);
+				}
+				return entry.pipeline.get();
+			}
+			handle = entry.fallback;
+		}
+		waitedDrawsInFrame++;
+		return nullptr;
+	}
+
+	bool HexPipelineManager::isReady(Handle handle) {
+		std::lock_guard<std::mutex> lock{mutex};
+		return handle != NO_PIPELINE && entries[handle]->state == State::Ready;
+	}
+
+	HexPipeline *HexPipelineManager::wait(Handle handle) {
+		if (handle == NO_PIPELINE) return nullptr;
+
+		std::unique_lock<std::mutex> lock{mutex};
+		Entry &entry = *entries[handle];
+		entryDone.wait(lock, [&entry] { return entry.state == State::Ready || entry.state == State::Failed; });
+		return entry.pipeline.get();
+	}
+
+	void HexPipelineManager::waitIdle() {
+		std::unique_lock<std::mutex> lock{mutex};
+		entryDone.wait(lock, [this] {
+			if (!queue.empty()) return false;
+			for (auto &entry : entries) {
+				if (entry && entry->state == State::Compiling) return false;
+			}
+			return true;
+		});
+	}
+
+	void HexPipelineManager::warmUp() {
+		auto start = std::chrono::steady_clock::now();
+		size_t listed = 0;
+		size_t compiled = 0;
+		{
+			std::unique_lock<std::mutex> lock{mutex};
+			entryDone.wait(lock, [this] {
+				for (auto &entry : entries) {
+					if (entry && entry->manifestIndex != NOT_LISTED && (entry->state == State::Queued || entry->state == State::Compiling)) return false;
+				}
+				return true;
+			});
+			for (auto &entry : entries) {
+				if (!entry || entry->manifestIndex == NOT_LISTED) continue;
+				listed++;
+				if (entry->state == State::Ready) compiled++;
+			}
+		}
+
+		if (manifestOrder.empty()) {
+			std::cout << "Pipeline warm-up: no manifest, pipelines compile while drawing" << std::endl;
+			return;
+		}
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "Pipeline warm-up: " << compiled << " of " << listed << " requested pipelines from the manifest ("
+			<< manifestOrder.size() << " listed) in " << milliseconds << " ms" << std::endl;
+	}
+
+	void HexPipelineManager::endFrame() {
+		std::lock_guard<std::mutex> lock{mutex};
+		frames++;
+		waitedDraws += waitedDrawsInFrame;
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - created).count();
+		const char *manifest = manifestOrder.empty() ? "without manifest" : "with manifest";
+
+		if (frames == 1) {
+			std::cout << "First frame " << milliseconds << " ms after startup, " << manifest << std::endl;
+		}
+		// The first frame the scene is drawn whole, the user sees what they interact with
+		if (!allReadyLogged && waitedDrawsInFrame == 0) {
+			allReadyLogged = true;
+			std::cout << "Every draw had its pipeline from frame " << frames << ", " << milliseconds << " ms after startup, "
+				<< waitedDraws << " draws waited before, " << manifest << std::endl;
+		}
+		waitedDrawsInFrame = 0;
+	}
+
+	// Worker thread: compiles queued requests in queue order
+	void HexPipelineManager::compilePipelines() {
+		while (true) {
+			Entry *entry;
+			{
+				std::unique_lock<std::mutex> lock{mutex};
+				queueChanged.wait(lock, [this] { return stopping || !queue.empty(); });
+				if (stopping) return;
+				entry = entries[queue.front()].get();
+				queue.pop_front();
+				entry->state = State::Compiling;
+			}
+
+			// Entries being compiled aren't released, the entry stays valid without the lock
+			std::unique_ptr<HexPipeline> pipeline;
+			try {
+				pipeline = std::make_unique<HexPipeline>(hexDevice, entry->stages, *entry->config, entry->specialization, pipelineCache, &shaderLibrary);
+			} catch (const std::exception &e) {
+				std::cerr << "Pipeline " << entry->stages.front().filePath << " failed: " << e.what() << std::endl;
+			}
+			// Shaders no other request waits for are unloaded
+			entry->shaders.clear();
+
+			{
+				std::lock_guard<std::mutex> lock{mutex};
+				entry->state = pipeline ? State::Ready : State::Failed;
+				if (pipeline) pipelinesCreated++;
+				entry->pipeline = std::move(pipeline);
+			}
+			entryDone.notify_all();
+		}
+	}
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "HexPipeline.h"
+#include "HexShaderLibrary.h"
+#include "hex_device.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace hex {
+
+	// Graphics pipeline permutations compiled on worker threads through one pipeline cache,
+	// saved next to the executable between runs. A permutation is keyed by a hash of its
+	// shaders, specialization constants and PipelineConfigInfo, identical requests share it,
+	// requests differing only in render state the config leaves dynamic too.
+	// get() never waits: until a pipeline is compiled it returns its fallback (or nullptr),
+	// so the frame loop draws what it can instead of hitching.
+	// The pipelines a run draws with are listed in a manifest next to the cache, in order of
+	// first use. The next run compiles them ahead of the other requests and warmUp() waits for them.
+	class HexPipelineManager {
+		public:
+		using Handle = uint32_t;
+		static constexpr Handle NO_PIPELINE = ~0u;
+
+		static constexpr const char *CACHE_PATH = "hex_pipelines.cache";
+		static constexpr const char *MANIFEST_PATH = "hex_pipelines.manifest";
+
+		explicit HexPipelineManager(HexDevice &device);
+		~HexPipelineManager();
+
+		HexPipelineManager(const HexPipelineManager &) = delete;
+		HexPipelineManager &operator=(const HexPipelineManager &) = delete;
+
+		// Throws when a shader file is missing or isn't SPIR-V, other errors only show as a pipeline that is never ready.
+		// The config is copied, its vertex input arrays too. The pipeline layout and render pass
+		// must outlive the pipeline (until release). The fallback must be compatible with the
+		// same layout and vertex input, it's drawn with the same bindings.
+		Handle request(
+			const std::vector<ShaderStageInfo> &stages,
+			const PipelineConfigInfo &configInfo,
+			const std::vector<SpecializationConstant> &specialization = {},
+			Handle fallback = NO_PIPELINE);
+		// Once per request, waits for a compilation in progress (it may use the layout)
+		void release(Handle handle);
+
+		// The pipeline if compiled, otherwise its fallback's, nullptr when neither is ready
+		HexPipeline *get(Handle handle);
+		bool isReady(Handle handle);
+		// Blocks until compiled, nullptr if compilation failed
+		HexPipeline *wait(Handle handle);
+		void waitIdle();
+		// Blocks until the requested pipelines listed in the manifest are compiled, before the first frame
+		void warmUp();
+		// Once per rendered frame, logs the startup timings
+		void endFrame();
+
+		// For pipelines still built directly with HexPipeline
+		VkPipelineCache getPipelineCache() const { return pipelineCache; }
+		HexShaderLibrary &getShaderLibrary() { return shaderLibrary; }
+
+		// Same between runs, the layout and render pass handles aren't part of it
+		static uint64_t hashRequest(
+			const std::vector<ShaderStageInfo> &stages,
+			const PipelineConfigInfo &configInfo,
+			const std::vector<SpecializationConstant> &specialization);
+
+		private:
+		enum class State {
+			Queued,
+			Compiling,
+			Ready,
+			Failed
+		};
+
+		static constexpr size_t NOT_LISTED = ~size_t{0};
+
+		struct Entry {
+			uint64_t key;
+			uint64_t stableKey;
+			// Position in the manifest, listed entries are compiled first
+			size_t manifestIndex = NOT_LISTED;
+			bool used = false;
+			// Of the first request, later ones may differ in the state the pipeline leaves dynamic
+			RenderState renderState;
+			uint32_t references = 1;
+			Handle fallback;
+			State state = State::Queued;
+
+			// Copy of the request the worker compiles
+			std::vector<ShaderStageInfo> stages;
+			std::vector<SpecializationConstant> specialization;
+			std::unique_ptr<PipelineConfigInfo> config;
+			std::vector<VkVertexInputBindingDescription> bindings;
+			std::vector<VkVertexInputAttributeDescription> attributes;
+			// Loaded from the request until compiled
+			std::vector<HexShaderLibrary::Reference> shaders;
+
+			std::unique_ptr<HexPipeline> pipeline;
+		};
+
+		void createPipelineCache();
+		void savePipelineCache();
+		void loadManifest();
+		void saveManifest();
+		void compilePipelines();
+		static uint64_t runtimeKey(uint64_t stableKey, const PipelineConfigInfo &configInfo);
+		static void copyConfig(const PipelineConfigInfo &from, Entry &entry);
+
+		HexDevice &hexDevice;
+		VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+		HexShaderLibrary shaderLibrary;
+
+		std::mutex mutex;
+		std::condition_variable queueChanged;
+		std::condition_variable entryDone;
+		// Handles index entries, released entries are null and their handle reused
+		std::vector<std::unique_ptr<Entry>> entries;
+		std::vector<Handle> freeHandles;
+		std::unordered_map<uint64_t, Handle> handlesByKey;
+		std::deque<Handle> queue;
+		bool stopping = false;
+		std::vector<std::thread> workers;
+
+		// Manifest of the last run, stable key to position
+		std::unordered_map<uint64_t, size_t> manifestOrder;
+		// This run's, in order of first use
+		std::vector<uint64_t> usedKeys;
+		std::unordered_set<uint64_t> usedKeySet;
+
+		// Startup timings
+		std::chrono::steady_clock::time_point created;
+		uint64_t frames = 0;
+		// Draws that got a fallback or nothing
+		uint64_t waitedDraws = 0;
+		uint64_t waitedDrawsInFrame = 0;
+		bool allReadyLogged = false;
+
+		// Pipelines saved by dynamic render state, logged on destruction
+		uint64_t requests = 0;
+		uint64_t foldedRequests = 0;
+		uint64_t pipelinesCreated = 0;
+	};
+}
@@ -0,0 +1,284 @@
+#include "HexQuality.h"
+#include "HexParallel.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <mutex>
+
+namespace hex {
+
+	namespace {
+		// Cells per batch, enough for 256 bit float registers
+		constexpr uint32_t LANES = 8;
+		constexpr uint32_t CORNERS = HexVolumeMesh::CELL_CORNERS;
+
+		// Corner coordinates of LANES cells, one array per corner and axis
+		struct CellBatch {
+			float x[CORNERS][LANES];
+			float y[CORNERS][LANES];
+			float z[CORNERS][LANES];
+		};
+
+		constexpr uint32_t EDGE_COUNT = 12;
+
+		constexpr uint8_t EDGES[EDGE_COUNT][2] = {
+			{0, 1}, {1, 2}, {2, 3}, {3, 0},
+			{4, 5}, {5, 6}, {6, 7}, {7, 4},
+			{0, 4}, {1, 5}, {2, 6}, {3, 7}
+		};
+
+		// Corners linked to each corner, a right handed frame in a positive cell
+		constexpr uint8_t CORNER_FRAMES[CORNERS][3] = {
+			{1, 3, 4}, {2, 0, 5}, {3, 1, 6}, {0, 2, 7},
+			{7, 5, 0}, {4, 6, 1}, {5, 7, 2}, {6, 4, 3}
+		};
+
+		// EDGES index of each CORNER_FRAMES vector
+		constexpr uint8_t CORNER_FRAME_EDGES[CORNERS][3] = {
+			{0, 3, 8}, {1, 0, 9}, {2, 1, 10}, {3, 2, 11},
+			{7, 4, 8}, {4, 5, 9}, {5, 6, 10}, {6, 7, 11}
+		};
+
+		// Shorter edges and axes count as degenerate
+		constexpr float MIN_LENGTH_SQUARED = 1e-30f;
+
+		// Lanes past the last cell repeat it, their results are dropped
+		void gatherCells(const HexVolumeMesh &mesh, size_t first, size_t count, CellBatch &batch) {
+			for (uint32_t lane = 0; lane < LANES; lane++) {
+				size_t cell = first + std::min<size_t>(lane, count - 1);
+				const uint32_t *corners = mesh.cells.data() + cell * CORNERS;
+				for (uint32_t corner = 0; corner < CORNERS; corner++) {
+					const glm::vec3 &point = mesh.points[corners[corner]];
+					batch.x[corner][lane] = point.x;
+					batch.y[corner][lane] = point.y;
+					batch.z[corner][lane] = point.z;
+				}
+			}
+
+			// Same orientation as HexVolumeModel: inverted cells swap their quads.
+			// HexVolumeMesh::isInverted on the gathered corners.
+			for (uint32_t lane = 0; lane < LANES; lane++) {
+				glm::vec3 origin{batch.x[0][lane], batch.y[0][lane], batch.z[0][lane]};
+				glm::vec3 u = glm::vec3{batch.x[1][lane], batch.y[1][lane], batch.z[1][lane]} - origin;
+				glm::vec3 v = glm::vec3{batch.x[3][lane], batch.y[3][lane], batch.z[3][lane]} - origin;
+				glm::vec3 w = glm::vec3{batch.x[4][lane], batch.y[4][lane], batch.z[4][lane]} - origin;
+				if (glm::dot(glm::cross(u, v), w) >= 0.f) continue;
+
+				for (uint32_t corner = 0; corner < 4; corner++) {
+					std::swap(batch.x[corner][lane], batch.x[corner + 4][lane]);
+					std::swap(batch.y[corner][lane], batch.y[corner + 4][lane]);
+					std::swap(batch.z[corner][lane], batch.z[corner + 4][lane]);
+				}
+			}
+		}
+
+		// 1 / length of every edge, 0 for degenerate edges
+		void inverseEdgeLengths(const CellBatch &b, float inverseLengths[EDGE_COUNT][LANES]) {
+			for (uint32_t edge = 0; edge < EDGE_COUNT; edge++) {
+				uint32_t from = EDGES[edge][0];
+				uint32_t to = EDGES[edge][1];
+				for (uint32_t lane = 0; lane < LANES; lane++) {
+					float dx = b.x[to][lane] - b.x[from][lane];
+					float dy = b.y[to][lane] - b.y[from][lane];
+					float dz = b.z[to][lane] - b.z[from][lane];
+					float length = dx * dx + dy * dy + dz * dz;
+					inverseLengths[edge][lane] = length < MIN_LENGTH_SQUARED ? 0.f : 1.f / std::sqrt(length);
+				}
+			}
+		}
+
+		// Sums of the 4 parallel edges along each cell direction
+		void principalAxes(const CellBatch &b, float axes[3][3][LANES]) {
+			for (uint32_t lane = 0; lane < LANES; lane++) {
+				axes[0][0][lane] = (b.x[1][lane] - b.x[0][lane]) + (b.x[2][lane] - b.x[3][lane]) + (b.x[5][lane] - b.x[4][lane]) + (b.x[6][lane] - b.x[7][lane]);
+				axes[0][1][lane] = (b.y[1][lane] - b.y[0][lane]) + (b.y[2][lane] - b.y[3][lane]) + (b.y[5][lane] - b.y[4][lane]) + (b.y[6][lane] - b.y[7][lane]);
+				axes[0][2][lane] = (b.z[1][lane] - b.z[0][lane]) + (b.z[2][lane] - b.z[3][lane]) + (b.z[5][lane] - b.z[4][lane]) + (b.z[6][lane] - b.z[7][lane]);
+				axes[1][0][lane] = (b.x[3][lane] - b.x[0][lane]) + (b.x[2][lane] - b.x[1][lane]) + (b.x[7][lane] - b.x[4][lane]) + (b.x[6][lane] - b.x[5][lane]);
+				axes[1][1][lane] = (b.y[3][lane] - b.y[0][lane]) + (b.y[2][lane] - b.y[1][lane]) + (b.y[7][lane] - b.y[4][lane]) + (b.y[6][lane] - b.y[5][lane]);
+				axes[1][2][lane] = (b.z[3][lane] - b.z[0][lane]) + (b.z[2][lane] - b.z[1][lane]) + (b.z[7][lane] - b.z[4][lane]) + (b.z[6][lane] - b.z[5][lane]);
+				axes[2][0][lane] = (b.x[4][lane] - b.x[0][lane]) + (b.x[5][lane] - b.x[1][lane]) + (b.x[6][lane] - b.x[2][lane]) + (b.x[7][lane] - b.x[3][lane]);
+				axes[2][1][lane] = (b.y[4][lane] - b.y[0][lane]) + (b.y[5][lane] - b.y[1][lane]) + (b.y[6][lane] - b.y[2][lane]) + (b.y[7][lane] - b.y[3][lane]);
+				axes[2][2][lane] = (b.z[4][lane] - b.z[0][lane]) + (b.z[5][lane] - b.z[1][lane]) + (b.z[6][lane] - b.z[2][lane]) + (b.z[7][lane] - b.z[3][lane]);
+			}
+		}
+
+		inline float determinant(
+			float ax, float ay, float az,
+			float bx, float by, float bz,
+			float cx, float cy, float cz) {
+			return (ay * bz - az * by) * cx + (az * bx - ax * bz) * cy + (ax * by - ay * bx) * cz;
+		}
+
+		inline float inverseLength(float x, float y, float z) {
+			float length = x * x + y * y + z * z;
+			return length < MIN_LENGTH_SQUARED ? 0.f : 1.f / std::sqrt(length);
+		}
+
+		// Determinants over the product of their vector lengths, degenerate frames give 0.
+		// Every edge is in two corner frames, its length is computed once.
+		void scaledJacobian(const CellBatch &b, float *out) {
+			float result[LANES];
+			float axes[3][3][LANES];
+			principalAxes(b, axes);
+			for (uint32_t lane = 0; lane < LANES; lane++) {
+				float det = determinant(
+					axes[0][0][lane], axes[0][1][lane], axes[0][2][lane],
+					axes[1][0][lane], axes[1][1][lane], axes[1][2][lane],
+					axes[2][0][lane], axes[2][1][lane], axes[2][2][lane]);
+				result[lane] = det
+					* inverseLength(axes[0][0][lane], axes[0][1][lane], axes[0][2][lane])
+					* inverseLength(axes[1][0][lane], axes[1][1][lane], axes[1][2][lane])
+					* inverseLength(axes[2][0][lane], axes[2][1][lane], axes[2][2][lane]);
+			}
+
+			float inverseLengths[EDGE_COUNT][LANES];
+			inverseEdgeLengths(b, inverseLengths);
+
+			for (uint32_t corner = 0; corner < CORNERS; corner++) {
+				const uint8_t *frame = CORNER_FRAMES[corner];
+				const uint8_t *edges = CORNER_FRAME_EDGES[corner];
+				for (uint32_t lane = 0; lane < LANES; lane++) {
+					float det = determinant(
+						b.x[frame[0]][lane] - b.x[corner][lane], b.y[frame[0]][lane] - b.y[corner][lane], b.z[frame[0]][lane] - b.z[corner][lane],
+						b.x[frame[1]][lane] - b.x[corner][lane], b.y[frame[1]][lane] - b.y[corner][lane], b.z[frame[1]][lane] - b.z[corner][lane],
+						b.x[frame[2]][lane] - b.x[corner][lane], b.y[frame[2]][lane] - b.y[corner][lane], b.z[frame[2]][lane] - b.z[corner][lane]);
+					float scaled = det * inverseLengths[edges[0]][lane] * inverseLengths[edges[1]][lane] * inverseLengths[edges[2]][lane];
+					result[lane] = std::min(result[lane], scaled);
+				}
+			}
+			std::copy(result, result + LANES, out);
+		}
+
+		void edgeRatio(const CellBatch &b, float *out) {
+			float shortest[LANES];
+			float longest[LANES];
+			std::fill(shortest, shortest + LANES, std::numeric_limits<float>::max());
+			std::fill(longest, longest + LANES, 0.f);
+
+			for (const auto &edge : EDGES) {
+				for (uint32_t lane = 0; lane < LANES; lane++) {
+					float dx = b.x[edge[1]][lane] - b.x[edge[0]][lane];
+					float dy = b.y[edge[1]][lane] - b.y[edge[0]][lane];
+					float dz = b.z[edge[1]][lane] - b.z[edge[0]][lane];
+					float length = dx * dx + dy * dy + dz * dz;
+					shortest[lane] = std::min(shortest[lane], length);
+					longest[lane] = std::max(longest[lane], length);
+				}
+			}
+
+			for (uint32_t lane = 0; lane < LANES; lane++) {
+				bool degenerate = shortest[lane] < MIN_LENGTH_SQUARED;
+				out[lane] = degenerate ? HexQuality::DEGENERATE : std::sqrt(longest[lane] / shortest[lane]);
+			}
+		}
+
+		void skew(const CellBatch &b, float *out) {
+			float axes[3][3][LANES];
+			principalAxes(b, axes);
+
+			for (uint32_t lane = 0; lane < LANES; lane++) {
+				float inverseLengths[3];
+				for (uint32_t i = 0; i < 3; i++) {
+					inverseLengths[i] = inverseLength(axes[i][0][lane], axes[i][1][lane], axes[i][2][lane]);
+				}
+
+				float result = 0.f;
+				for (uint32_t i = 0; i < 2; i++) {
+					for (uint32_t j = i + 1; j < 3; j++) {
+						float dot = axes[i][0][lane] * axes[j][0][lane] + axes[i][1][lane] * axes[j][1][lane] + axes[i][2][lane] * axes[j][2][lane];
+						result = std::max(result, std::abs(dot) * inverseLengths[i] * inverseLengths[j]);
+					}
+				}
+				// A degenerate axis is as skewed as it gets
+				bool degenerate = inverseLengths[0] == 0.f || inverseLengths[1] == 0.f || inverseLengths[2] == 0.f;
+				out[lane] = degenerate ? 1.f : result;
+			}
+		}
+	}
+
+	std::vector<float> HexQuality::compute(const HexVolumeMesh &mesh, HexQualityMetric metric) {
+		assert(mesh.cells.size() % CORNERS == 0 && "Cells must have 8 corners");
+
+		size_t cellCount = mesh.cellCount();
+		size_t batchCount = (cellCount + LANES - 1) / LANES;
+		std::vector<float> values(cellCount);
+
+		parallelFor(batchCount, 1 << 10, [&](size_t begin, size_t end) {
+			CellBatch batch;
+			float results[LANES];
+			for (size_t i = begin; i < end; i++) {
+				size_t first = i * LANES;
+				size_t count = std::min<size_t>(LANES, cellCount - first);
+				gatherCells(mesh, first, count, batch);
+
+				switch (metric) {
+					case HexQualityMetric::ScaledJacobian: scaledJacobian(batch, results); break;
+					case HexQualityMetric::EdgeRatio: edgeRatio(batch, results); break;
+					case HexQualityMetric::Skew: skew(batch, results); break;
+				}
+				std::copy(results, results + count, values.begin() + first);
+			}
+		});
+		return values;
+	}
+
+	HexQualityStats HexQuality::statistics(const std::vector<float> &values, uint32_t binCount) {
+		assert(binCount > 0 && "Histograms need at least one bin");
+
+		HexQualityStats stats{};
+		stats.histogram.assign(binCount, 0);
+		if (values.empty())
+			return stats;
+
+		// Degenerate cells would stretch the range over every other cell, they're only counted
+		float low = std::numeric_limits<float>::max();
+		float high = std::numeric_limits<float>::lowest();
+		std::mutex mutex;
+		parallelFor(values.size(), 1 << 16, [&](size_t begin, size_t end) {
+			float rangeLow = std::numeric_limits<float>::max();
+			float rangeHigh = std::numeric_limits<float>::lowest();
+			uint32_t degenerate = 0;
+			for (size_t i = begin; i < end; i++) {
+				if (values[i] == DEGENERATE) {
+					degenerate++;
+					continue;
+				}
+				rangeLow = std::min(rangeLow, values[i]);
+				rangeHigh = std::max(rangeHigh, values[i]);
+			}
+			std::lock_guard<std::mutex> lock{mutex};
+			low = std::min(low, rangeLow);
+			high = std::max(high, rangeHigh);
+			stats.degenerate += degenerate;
+		});
+		if (stats.degenerate == values.size())
+			return stats;
+		stats.min = low;
+		stats.max = high;
+
+		// Same binning as shaders/cell_histogram.comp
+		float scale = high > low ? static_cast<float>(binCount) / (high - low) : 0.f;
+		parallelFor(values.size(), 1 << 16, [&](size_t begin, size_t end) {
+			std::vector<uint32_t> bins(binCount, 0);
+			for (size_t i = begin; i < end; i++) {
+				if (values[i] == DEGENERATE) continue;
+				float bin = (values[i] - low) * scale;
+				bins[std::min(static_cast<uint32_t>(bin), binCount - 1)]++;
+			}
+			std::lock_guard<std::mutex> lock{mutex};
+			for (uint32_t i = 0; i < binCount; i++) stats.histogram[i] += bins[i];
+		});
+		return stats;
+	}
+
+	const char *HexQuality::name(HexQualityMetric metric) {
+		switch (metric) {
+			case HexQualityMetric::ScaledJacobian: return "scaled Jacobian";
+			case HexQualityMetric::EdgeRatio: return "edge ratio";
+			case HexQualityMetric::Skew: return "skew";
+		}
+		return "unknown";
+	}
+}
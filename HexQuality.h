@@ -0,0 +1,48 @@
+#pragma once
+
+#include "HexVolumeMesh.h"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace hex {
+
+	// Per cell hexahedron quality, Verdict definitions. Cells are measured with the orientation
+	// HexVolumeModel uploads them with, so mirrored cells count as valid and only tangled
+	// cells get negative Jacobians.
+	enum class HexQualityMetric {
+		// Smallest normalized Jacobian determinant of the 8 corners and the center, in [-1, 1], 1 for a cube
+		ScaledJacobian,
+		// Longest over shortest edge, 1 for a cube, HexQuality::DEGENERATE with a zero length edge
+		EdgeRatio,
+		// Largest cosine between two principal axes, in [0, 1], 0 for a cube
+		Skew
+	};
+
+	constexpr uint32_t QUALITY_METRIC_COUNT = 3;
+
+	struct HexQualityStats {
+		float min = 0.f;
+		float max = 0.f;
+		// Evenly spaced bins over [min, max], the max falls in the last bin
+		std::vector<uint32_t> histogram;
+		// Cells valued HexQuality::DEGENERATE, left out of min, max and the histogram
+		uint32_t degenerate = 0;
+	};
+
+	class HexQuality {
+		public:
+		static constexpr uint32_t DEFAULT_BIN_COUNT = 16;
+		// Value of cells the metric is undefined for, DEGENERATE_VALUE in shaders/cell_quality_common.glsl
+		static constexpr float DEGENERATE = std::numeric_limits<float>::max();
+
+		// Metric of every cell. Cells are gathered in batches of corner coordinates and the
+		// metric runs lane by lane over a batch so it vectorizes, batches run on all cores.
+		static std::vector<float> compute(const HexVolumeMesh &mesh, HexQualityMetric metric);
+
+		static HexQualityStats statistics(const std::vector<float> &values, uint32_t binCount = DEFAULT_BIN_COUNT);
+
+		static const char *name(HexQualityMetric metric);
+	};
+}
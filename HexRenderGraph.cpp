@@ -0,0 +1,736 @@
+#include "HexRenderGraph.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace hex {
+
+	namespace {
+
+		struct AccessInfo {
+			VkPipelineStageFlags stages;
+			VkAccessFlags access;
+			// Undefined for buffer accesses
+			VkImageLayout layout;
+			VkImageUsageFlags usage;
+		};
+
+		const VkAccessFlags writeAccesses = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+		const VkImageUsageFlags attachmentUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+		const VkPipelineStageFlags fragmentTests = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+
+		AccessInfo accessInfo(HexRenderGraph::Access access) {
+			using Access = HexRenderGraph::Access;
+			switch (access) {
+				case Access::ColorAttachment:
+					return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+						VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT};
+				case Access::DepthAttachment:
+					return {fragmentTests, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+						VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT};
+				case Access::DepthAttachmentRead:
+					return {fragmentTests, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+						VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT};
+				case Access::FragmentSampled:
+					return {VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+						VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT};
+				case Access::ComputeSampled:
+					return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+						VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT};
+				case Access::ComputeStorageRead:
+					return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+						VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT};
+				case Access::ComputeStorageWrite:
+					return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+						VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT};
+				case Access::TransferRead:
+					return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+						VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT};
+				case Access::TransferWrite:
+					return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+						VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT};
+				case Access::IndirectRead:
+					return {VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0};
+				case Access::VertexRead:
+					return {VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0};
+			}
+			throw std::runtime_error("Unknown render graph access");
+		}
+
+		bool hasStencil(VkFormat format) {
+			return format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+		}
+
+		bool isDepthFormat(VkFormat format) {
+			return format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_X8_D24_UNORM_PACK32 || format == VK_FORMAT_D32_SFLOAT || hasStencil(format);
+		}
+
+		VkImageAspectFlags aspectMask(VkFormat format) {
+			if (!isDepthFormat(format)) return VK_IMAGE_ASPECT_COLOR_BIT;
+			return VK_IMAGE_ASPECT_DEPTH_BIT | (hasStencil(format) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0u);
+		}
+
+		// How a pass touches a resource, for culling and store ops
+		enum class PassUse {
+			None,
+			// Cleared or don't care attachment, the earlier content isn't needed
+			Overwrite,
+			Read
+		};
+
+		template <typename PassT>
+		PassUse passUse(const PassT &pass, uint32_t resource) {
+			for (const auto &attachment : pass.colorAttachments) {
+				if (attachment.image == resource && attachment.loadOp != VK_ATTACHMENT_LOAD_OP_LOAD) return PassUse::Overwrite;
+			}
+			if (pass.depthAttachment.image == resource && pass.depthAttachment.loadOp != VK_ATTACHMENT_LOAD_OP_LOAD) return PassUse::Overwrite;
+			for (const auto &use : pass.uses) {
+				if (use.resource == resource) return PassUse::Read;
+			}
+			return PassUse::None;
+		}
+	}
+
+	HexRenderGraph::PassBuilder &HexRenderGraph::PassBuilder::read(ResourceId resource, Access access) {
+		graph.addUse(pass, resource, access, false);
+		return *this;
+	}
+
+	HexRenderGraph::PassBuilder &HexRenderGraph::PassBuilder::write(ResourceId resource, Access access) {
+		graph.addUse(pass, resource, access, true);
+		return *this;
+	}
+
+	HexRenderGraph::PassBuilder &HexRenderGraph::PassBuilder::colorAttachment(ResourceId image, VkAttachmentLoadOp loadOp, VkClearColorValue clearColor) {
+		graph.addUse(pass, image, Access::ColorAttachment, true);
+		Attachment attachment{};
+		attachment.image = image;
+		attachment.loadOp = loadOp;
+		attachment.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		attachment.clearValue.color = clearColor;
+		graph.passes[pass].colorAttachments.push_back(attachment);
+		return *this;
+	}
+
+	HexRenderGraph::PassBuilder &HexRenderGraph::PassBuilder::depthAttachment(ResourceId image, VkAttachmentLoadOp loadOp, float clearDepth, bool depthWrite) {
+		Pass &p = graph.passes[pass];
+		if (p.depthAttachment.image != NO_RESOURCE) {
+			throw std::runtime_error("Render graph pass " + p.name + " has two depth attachments");
+		}
+		if (!depthWrite && loadOp != VK_ATTACHMENT_LOAD_OP_LOAD) {
+			throw std::runtime_error("Render graph pass " + p.name + " clears a read only depth attachment");
+		}
+		graph.addUse(pass, image, depthWrite ? Access::DepthAttachment : Access::DepthAttachmentRead, depthWrite);
+		p.depthAttachment.image = image;
+		p.depthAttachment.loadOp = loadOp;
+		p.depthAttachment.layout = depthWrite ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		p.depthAttachment.clearValue.depthStencil = {clearDepth, 0};
+		return *this;
+	}
+
+	HexRenderGraph::PassBuilder &HexRenderGraph::PassBuilder::sideEffect() {
+		graph.passes[pass].sideEffect = true;
+		return *this;
+	}
+
+	HexRenderGraph::HexRenderGraph(HexDevice &device, uint32_t framesInFlight) : hexDevice{device}, framesInFlight{framesInFlight} {}
+
+	HexRenderGraph::~HexRenderGraph() {
+		destroyTransients();
+	}
+
+	HexRenderGraph::ResourceId HexRenderGraph::createImage(const std::string &name, VkFormat format, VkExtent2D extent) {
+		Resource resource{};
+		resource.name = name;
+		resource.image = true;
+		resource.imported = false;
+		resource.format = format;
+		resource.extent = extent;
+		resources.push_back(resource);
+		return static_cast<ResourceId>(resources.size() - 1);
+	}
+
+	HexRenderGraph::ResourceId HexRenderGraph::createImage(const std::string &name, VkFormat format) {
+		ResourceId image = createImage(name, format, extent);
+		resources[image].followsExtent = true;
+		return image;
+	}
+
+	HexRenderGraph::ResourceId HexRenderGraph::importImage(const std::string &name, VkFormat format, const ResourceState &initial, const ResourceState &final) {
+		Resource resource{};
+		resource.name = name;
+		resource.image = true;
+		resource.imported = true;
+		resource.format = format;
+		resource.initial = initial;
+		resource.final = final;
+		resources.push_back(resource);
+		return static_cast<ResourceId>(resources.size() - 1);
+	}
+
+	HexRenderGraph::ResourceId HexRenderGraph::importBuffer(const std::string &name, VkBuffer buffer, const ResourceState &initial) {
+		Resource resource{};
+		resource.name = name;
+		resource.image = false;
+		resource.imported = true;
+		resource.initial = initial;
+		resource.buffer = buffer;
+		resources.push_back(resource);
+		return static_cast<ResourceId>(resources.size() - 1);
+	}
+
+	void HexRenderGraph::setImage(ResourceId image, VkImage handle, VkImageView view, VkExtent2D extent) {
+		Resource &resource = resources.at(image);
+		if (!resource.image || !resource.imported) {
+			throw std::runtime_error("Render graph resource " + resource.name + " isn't an imported image");
+		}
+		resource.handle = handle;
+		resource.view = view;
+		resource.extent = extent;
+	}
+
+	void HexRenderGraph::setExtent(VkExtent2D newExtent) {
+		if (newExtent.width == extent.width && newExtent.height == extent.height) return;
+		extent = newExtent;
+
+		bool resized = false;
+		for (Resource &resource : resources) {
+			if (!resource.followsExtent) continue;
+			resource.extent = extent;
+			resized = resized || !resource.images.empty();
+		}
+		if (!compiled || !resized) return;
+
+		// Earlier frames may still use the old images. Memory requirements change with the size,
+		// so does the aliasing and the barriers waiting for it.
+		vkDeviceWaitIdle(hexDevice.device());
+		destroyTransients();
+		for (Resource &resource : resources) {
+			resource.memoryBlock = ~0u;
+			resource.previousAlias = NO_RESOURCE;
+		}
+		for (Pass &pass : passes) pass.before = {};
+		after = {};
+		createTransients();
+		computeBarriers();
+	}
+
+	HexRenderGraph::PassBuilder HexRenderGraph::addPass(const std::string &name, Record record) {
+		if (compiled) throw std::runtime_error("Render graph pass " + name + " added after compiling");
+		Pass pass{};
+		pass.name = name;
+		pass.record = std::move(record);
+		passes.push_back(std::move(pass));
+		return PassBuilder{*this, static_cast<uint32_t>(passes.size() - 1)};
+	}
+
+	void HexRenderGraph::addUse(uint32_t pass, ResourceId resource, Access access, bool write) {
+		if (resource >= resources.size()) {
+			throw std::runtime_error("Render graph pass " + passes[pass].name + " uses an unknown resource");
+		}
+		if (!resources[resource].image && accessInfo(access).layout != VK_IMAGE_LAYOUT_UNDEFINED) {
+			throw std::runtime_error("Render graph pass " + passes[pass].name + " uses buffer " + resources[resource].name + " as an image");
+		}
+		passes[pass].uses.push_back({resource, access, write});
+	}
+
+	void HexRenderGraph::compile() {
+		if (compiled) throw std::runtime_error("Render graph compiled twice");
+
+		for (const Pass &pass : passes) {
+			bool attachments = !pass.colorAttachments.empty() || pass.depthAttachment.image != NO_RESOURCE;
+			if (attachments && !hexDevice.dynamicRenderingSupported()) {
+				throw std::runtime_error("Render graph pass " + pass.name + " has attachments, the device has no dynamic rendering");
+			}
+		}
+
+		cullPasses();
+		computeLifetimes();
+		chooseStoreOps();
+		// Aliases are known once memory is assigned, their last uses are waited for
+		createTransients();
+		computeBarriers();
+		compiled = true;
+	}
+
+	void HexRenderGraph::cullPasses() {
+		// Backwards from what's read outside the graph. Writes other than cleared attachments
+		// may be partial, they keep the earlier writers.
+		std::vector<uint8_t> needed(resources.size(), 0);
+		for (size_t r = 0; r < resources.size(); r++) needed[r] = resources[r].imported ? 1 : 0;
+
+		for (size_t p = passes.size(); p-- > 0;) {
+			Pass &pass = passes[p];
+			bool alive = pass.sideEffect;
+			for (const Use &use : pass.uses) {
+				if (use.write && needed[use.resource]) alive = true;
+			}
+			pass.culled = !alive;
+			if (!alive) continue;
+
+			for (const Use &use : pass.uses) {
+				if (passUse(pass, use.resource) == PassUse::Overwrite) {
+					if (!resources[use.resource].imported) needed[use.resource] = 0;
+				} else if (!use.write) {
+					needed[use.resource] = 1;
+				}
+			}
+			// Loaded attachments read what was there
+			for (const Attachment &attachment : pass.colorAttachments) {
+				if (attachment.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD) needed[attachment.image] = 1;
+			}
+			if (pass.depthAttachment.image != NO_RESOURCE && pass.depthAttachment.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD) {
+				needed[pass.depthAttachment.image] = 1;
+			}
+		}
+	}
+
+	void HexRenderGraph::computeLifetimes() {
+		for (uint32_t p = 0; p < passes.size(); p++) {
+			if (passes[p].culled) continue;
+			for (const Use &use : passes[p].uses) {
+				Resource &resource = resources[use.resource];
+				resource.firstPass = std::min(resource.firstPass, p);
+				resource.lastPass = std::max(resource.lastPass, p);
+				resource.usage |= accessInfo(use.access).usage;
+			}
+		}
+	}
+
+	void HexRenderGraph::chooseStoreOps() {
+		for (uint32_t p = 0; p < passes.size(); p++) {
+			Pass &pass = passes[p];
+			if (pass.culled) continue;
+
+			auto storeOp = [&](const Attachment &attachment) {
+				// Depth tests alone leave the content as it was
+				if (attachment.layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL) return VK_ATTACHMENT_STORE_OP_NONE;
+
+				const Resource &resource = resources[attachment.image];
+				for (uint32_t q = p + 1; q < passes.size(); q++) {
+					if (passes[q].culled) continue;
+					PassUse use = passUse(passes[q], attachment.image);
+					if (use == PassUse::Read) return VK_ATTACHMENT_STORE_OP_STORE;
+					if (use == PassUse::Overwrite) return VK_ATTACHMENT_STORE_OP_DONT_CARE;
+				}
+				bool readAfter = resource.imported && resource.final.layout != VK_IMAGE_LAYOUT_UNDEFINED;
+				return readAfter ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			};
+
+			for (Attachment &attachment : pass.colorAttachments) attachment.storeOp = storeOp(attachment);
+			if (pass.depthAttachment.image != NO_RESOURCE) pass.depthAttachment.storeOp = storeOp(pass.depthAttachment);
+		}
+	}
+
+	void HexRenderGraph::computeBarriers() {
+		// Last writer and the readers since, the stages its writes are visible to
+		struct State {
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkPipelineStageFlags writeStages = 0;
+			VkAccessFlags writeAccess = 0;
+			VkPipelineStageFlags readStages = 0;
+			VkPipelineStageFlags visibleStages = 0;
+			VkAccessFlags visibleAccess = 0;
+		};
+
+		std::vector<State> states(resources.size());
+		for (size_t r = 0; r < resources.size(); r++) {
+			const Resource &resource = resources[r];
+			if (!resource.imported) continue;
+			states[r].layout = resource.initial.layout;
+			states[r].writeStages = resource.initial.stages & ~VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			states[r].writeAccess = resource.initial.access & writeAccesses;
+		}
+
+		// One use per resource and pass, the union of its accesses
+		struct Merged {
+			ResourceId resource;
+			VkPipelineStageFlags stages;
+			VkAccessFlags access;
+			VkImageLayout layout;
+			bool write;
+		};
+		std::vector<Merged> merged;
+
+		for (uint32_t p = 0; p < passes.size(); p++) {
+			Pass &pass = passes[p];
+			if (pass.culled) continue;
+
+			merged.clear();
+			for (const Use &use : pass.uses) {
+				AccessInfo info = accessInfo(use.access);
+				auto it = std::find_if(merged.begin(), merged.end(), [&](const Merged &m) { return m.resource == use.resource; });
+				if (it == merged.end()) {
+					merged.push_back({use.resource, info.stages, info.access, info.layout, use.write});
+					continue;
+				}
+				if (it->layout != info.layout) {
+					throw std::runtime_error("Render graph pass " + pass.name + " uses " + resources[use.resource].name + " in two layouts");
+				}
+				it->stages |= info.stages;
+				it->access |= info.access;
+				it->write = it->write || use.write;
+			}
+
+			for (const Merged &m : merged) {
+				const Resource &resource = resources[m.resource];
+				State &state = states[m.resource];
+
+				// A transient starts where the image before it in the same memory ended
+				if (!resource.imported && p == resource.firstPass && resource.previousAlias != NO_RESOURCE) {
+					const State &alias = states[resource.previousAlias];
+					state.writeStages = alias.writeStages | alias.readStages;
+					state.writeAccess = alias.writeAccess;
+				}
+
+				bool transition = resource.image && m.layout != state.layout;
+				bool write = m.write || (m.access & writeAccesses) != 0;
+
+				bool barrier;
+				VkPipelineStageFlags srcStages;
+				if (write || transition) {
+					// Write after write and write after read, layout transitions write too
+					barrier = transition || state.writeStages != 0 || state.readStages != 0;
+					srcStages = state.writeStages | state.readStages;
+				} else {
+					// Read after write, once per reading stage and access
+					barrier = state.writeStages != 0 &&
+						((m.stages & ~state.visibleStages) != 0 || (m.access & ~state.visibleAccess) != 0);
+					srcStages = state.writeStages;
+				}
+
+				if (barrier) {
+					pass.before.srcStages |= srcStages != 0 ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+					pass.before.dstStages |= m.stages;
+					pass.before.barriers.push_back({m.resource, state.layout, resource.image ? m.layout : state.layout, state.writeAccess, m.access});
+				}
+
+				if (write) {
+					state.writeStages = m.stages;
+					state.writeAccess = m.access & writeAccesses;
+					state.readStages = 0;
+					state.visibleStages = 0;
+					state.visibleAccess = 0;
+				} else if (transition) {
+					state.writeStages = m.stages;
+					state.writeAccess = 0;
+					state.readStages = m.stages;
+					state.visibleStages = m.stages;
+					state.visibleAccess = m.access;
+				} else {
+					state.readStages |= m.stages;
+					if (barrier) {
+						state.visibleStages |= m.stages;
+						state.visibleAccess |= m.access;
+					}
+				}
+				if (resource.image) state.layout = m.layout;
+			}
+		}
+
+		for (size_t r = 0; r < resources.size(); r++) {
+			const Resource &resource = resources[r];
+			if (!resource.image || !resource.imported || resource.final.layout == VK_IMAGE_LAYOUT_UNDEFINED) continue;
+			const State &state = states[r];
+			if (state.layout == resource.final.layout && state.writeAccess == 0) continue;
+
+			VkPipelineStageFlags srcStages = state.writeStages | state.readStages;
+			after.srcStages |= srcStages != 0 ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			after.dstStages |= resource.final.stages;
+			after.barriers.push_back({static_cast<ResourceId>(r), state.layout, resource.final.layout, state.writeAccess, resource.final.access});
+		}
+	}
+
+	void HexRenderGraph::createTransients() {
+		std::vector<ResourceId> transients;
+		for (ResourceId r = 0; r < resources.size(); r++) {
+			Resource &resource = resources[r];
+			if (resource.imported || resource.firstPass == ~0u) continue;
+			transients.push_back(r);
+			resource.lazy = (resource.usage & ~attachmentUsage) == 0;
+		}
+		// Loaded or stored content has to be in memory
+		for (const Pass &pass : passes) {
+			if (pass.culled) continue;
+			auto inMemory = [&](const Attachment &attachment) {
+				if (attachment.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD || attachment.storeOp != VK_ATTACHMENT_STORE_OP_DONT_CARE) {
+					resources[attachment.image].lazy = false;
+				}
+			};
+			for (const Attachment &attachment : pass.colorAttachments) inMemory(attachment);
+			if (pass.depthAttachment.image != NO_RESOURCE) inMemory(pass.depthAttachment);
+		}
+
+		std::vector<VkMemoryRequirements> requirements(resources.size());
+		for (ResourceId r : transients) {
+			Resource &resource = resources[r];
+			if (resource.extent.width == 0 || resource.extent.height == 0) {
+				throw std::runtime_error("Render graph image " + resource.name + " has no extent");
+			}
+
+			VkImageCreateInfo imageInfo{};
+			imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.extent = {resource.extent.width, resource.extent.height, 1};
+			imageInfo.mipLevels = 1;
+			imageInfo.arrayLayers = 1;
+			imageInfo.format = resource.format;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageInfo.usage = resource.usage | (resource.lazy ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0u);
+			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+			resource.images.resize(framesInFlight, VK_NULL_HANDLE);
+			for (VkImage &image : resource.images) {
+				if (vkCreateImage(hexDevice.device(), &imageInfo, nullptr, &image) != VK_SUCCESS) {
+					throw std::runtime_error("Failed to create render graph image " + resource.name);
+				}
+			}
+			vkGetImageMemoryRequirements(hexDevice.device(), resource.images[0], &requirements[r]);
+		}
+
+		// Largest first into the first block whose images all live in other passes
+		std::sort(transients.begin(), transients.end(), [&](ResourceId l, ResourceId r) { return requirements[l].size > requirements[r].size; });
+		VkDeviceSize unaliasedSize = 0;
+		for (ResourceId r : transients) {
+			Resource &resource = resources[r];
+			const VkMemoryRequirements &required = requirements[r];
+			unaliasedSize += required.size;
+
+			uint32_t chosen = ~0u;
+			for (uint32_t b = 0; b < memoryBlocks.size() && chosen == ~0u; b++) {
+				const MemoryBlock &block = memoryBlocks[b];
+				if (block.lazy != resource.lazy || (block.memoryTypeBits & required.memoryTypeBits) == 0) continue;
+				bool overlaps = std::any_of(block.images.begin(), block.images.end(), [&](ResourceId other) {
+					return resources[other].firstPass <= resource.lastPass && resource.firstPass <= resources[other].lastPass;
+				});
+				if (!overlaps) chosen = b;
+			}
+			if (chosen == ~0u) {
+				chosen = static_cast<uint32_t>(memoryBlocks.size());
+				memoryBlocks.emplace_back();
+				memoryBlocks.back().lazy = resource.lazy;
+			}
+
+			// Bound at offset 0, the allocation is aligned for any image
+			MemoryBlock &block = memoryBlocks[chosen];
+			block.size = std::max(block.size, required.size);
+			block.memoryTypeBits &= required.memoryTypeBits;
+			block.images.push_back(r);
+			resource.memoryBlock = chosen;
+		}
+
+		VkDeviceSize aliasedSize = 0;
+		VkDeviceSize lazySize = 0;
+		for (MemoryBlock &block : memoryBlocks) {
+			// Lifetimes in a block don't overlap, by first pass is by last pass too
+			std::sort(block.images.begin(), block.images.end(), [&](ResourceId l, ResourceId r) { return resources[l].firstPass < resources[r].firstPass; });
+			for (size_t i = 1; i < block.images.size(); i++) {
+				resources[block.images[i]].previousAlias = block.images[i - 1];
+			}
+
+			VkMemoryAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			allocInfo.allocationSize = block.size;
+			VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+			if (block.lazy && hexDevice.hasMemoryType(block.memoryTypeBits, properties | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) {
+				properties |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+				lazySize += block.size;
+			}
+			allocInfo.memoryTypeIndex = hexDevice.findMemoryType(block.memoryTypeBits, properties);
+
+			block.memory.resize(framesInFlight, VK_NULL_HANDLE);
+			for (uint32_t frame = 0; frame < framesInFlight; frame++) {
+				if (vkAllocateMemory(hexDevice.device(), &allocInfo, nullptr, &block.memory[frame]) != VK_SUCCESS) {
+					throw std::runtime_error("Failed to allocate render graph memory");
+				}
+				for (ResourceId r : block.images) {
+					vkBindImageMemory(hexDevice.device(), resources[r].images[frame], block.memory[frame], 0);
+				}
+			}
+			aliasedSize += block.size;
+		}
+
+		for (ResourceId r : transients) {
+			Resource &resource = resources[r];
+			VkImageViewCreateInfo viewInfo{};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = resource.format;
+			viewInfo.subresourceRange = {aspectMask(resource.format), 0, 1, 0, 1};
+
+			resource.views.resize(framesInFlight, VK_NULL_HANDLE);
+			for (uint32_t frame = 0; frame < framesInFlight; frame++) {
+				viewInfo.image = resource.images[frame];
+				if (vkCreateImageView(hexDevice.device(), &viewInfo, nullptr, &resource.views[frame]) != VK_SUCCESS) {
+					throw std::runtime_error("Failed to create render graph image view " + resource.name);
+				}
+			}
+		}
+
+		size_t culled = std::count_if(passes.begin(), passes.end(), [](const Pass &pass) { return pass.culled; });
+		double megabytes = 1.0 / (1024.0 * 1024.0);
+		std::cout << "Render graph: " << passes.size() << " passes (" << culled << " culled), "
+			<< transients.size() << " transient images in " << memoryBlocks.size() << " blocks, "
+			<< aliasedSize * framesInFlight * megabytes << " MB (" << unaliasedSize * framesInFlight * megabytes << " MB without aliasing, "
+			<< lazySize * framesInFlight * megabytes << " MB lazily allocated)" << std::endl;
+	}
+
+	void HexRenderGraph::destroyTransients() {
+		for (Resource &resource : resources) {
+			for (VkImageView view : resource.views) {
+				if (view != VK_NULL_HANDLE) vkDestroyImageView(hexDevice.device(), view, nullptr);
+			}
+			for (VkImage image : resource.images) {
+				if (image != VK_NULL_HANDLE) vkDestroyImage(hexDevice.device(), image, nullptr);
+			}
+			resource.views.clear();
+			resource.images.clear();
+		}
+		for (MemoryBlock &block : memoryBlocks) {
+			for (VkDeviceMemory memory : block.memory) {
+				if (memory != VK_NULL_HANDLE) vkFreeMemory(hexDevice.device(), memory, nullptr);
+			}
+		}
+		memoryBlocks.clear();
+	}
+
+	VkImage HexRenderGraph::getImage(ResourceId image, uint32_t frameIndex) const {
+		const Resource &resource = resources.at(image);
+		if (resource.imported) return resource.handle;
+		return resource.images.empty() ? VK_NULL_HANDLE : resource.images[frameIndex % framesInFlight];
+	}
+
+	VkImageView HexRenderGraph::getImageView(ResourceId image, uint32_t frameIndex) const {
+		const Resource &resource = resources.at(image);
+		if (resource.imported) return resource.view;
+		return resource.views.empty() ? VK_NULL_HANDLE : resource.views[frameIndex % framesInFlight];
+	}
+
+	const HexRenderGraph::Pass &HexRenderGraph::findPass(const std::string &name) const {
+		auto it = std::find_if(passes.begin(), passes.end(), [&](const Pass &pass) { return pass.name == name; });
+		if (it == passes.end()) throw std::runtime_error("Render graph has no pass " + name);
+		return *it;
+	}
+
+	bool HexRenderGraph::isCulled(const std::string &pass) const {
+		return findPass(pass).culled;
+	}
+
+	const HexRenderGraph::Barriers &HexRenderGraph::getBarriers(const std::string &pass) const {
+		return findPass(pass).before;
+	}
+
+	bool HexRenderGraph::sharesMemory(ResourceId image, ResourceId other) const {
+		const Resource &resource = resources.at(image);
+		return resource.memoryBlock != ~0u && resource.memoryBlock == resources.at(other).memoryBlock;
+	}
+
+	void HexRenderGraph::recordBarriers(VkCommandBuffer commandBuffer, const Barriers &barriers, uint32_t frameIndex) const {
+		if (barriers.barriers.empty()) return;
+
+		std::vector<VkImageMemoryBarrier> imageBarriers;
+		std::vector<VkBufferMemoryBarrier> bufferBarriers;
+		for (const Barrier &barrier : barriers.barriers) {
+			const Resource &resource = resources[barrier.resource];
+			if (resource.image) {
+				VkImageMemoryBarrier imageBarrier{};
+				imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				imageBarrier.srcAccessMask = barrier.srcAccess;
+				imageBarrier.dstAccessMask = barrier.dstAccess;
+				imageBarrier.oldLayout = barrier.oldLayout;
+				imageBarrier.newLayout = barrier.newLayout;
+				imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				imageBarrier.image = getImage(barrier.resource, frameIndex);
+				imageBarrier.subresourceRange = {aspectMask(resource.format), 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+				imageBarriers.push_back(imageBarrier);
+			} else {
+				VkBufferMemoryBarrier bufferBarrier{};
+				bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+				bufferBarrier.srcAccessMask = barrier.srcAccess;
+				bufferBarrier.dstAccessMask = barrier.dstAccess;
+				bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				bufferBarrier.buffer = resource.buffer;
+				bufferBarrier.offset = 0;
+				bufferBarrier.size = VK_WHOLE_SIZE;
+				bufferBarriers.push_back(bufferBarrier);
+			}
+		}
+
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			barriers.srcStages,
+			barriers.dstStages,
+			0, 0, nullptr,
+			static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+			static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+	}
+
+	void HexRenderGraph::beginRendering(VkCommandBuffer commandBuffer, const Pass &pass, uint32_t frameIndex) const {
+		auto attachmentInfo = [&](const Attachment &attachment) {
+			VkRenderingAttachmentInfo info{};
+			info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+			info.imageView = getImageView(attachment.image, frameIndex);
+			info.imageLayout = attachment.layout;
+			info.loadOp = attachment.loadOp;
+			info.storeOp = attachment.storeOp;
+			info.clearValue = attachment.clearValue;
+			return info;
+		};
+
+		std::vector<VkRenderingAttachmentInfo> colorAttachments;
+		for (const Attachment &attachment : pass.colorAttachments) colorAttachments.push_back(attachmentInfo(attachment));
+		bool depth = pass.depthAttachment.image != NO_RESOURCE;
+		VkRenderingAttachmentInfo depthAttachment = depth ? attachmentInfo(pass.depthAttachment) : VkRenderingAttachmentInfo{};
+
+		ResourceId first = pass.colorAttachments.empty() ? pass.depthAttachment.image : pass.colorAttachments[0].image;
+		VkExtent2D extent = resources[first].extent;
+
+		VkRenderingInfo renderingInfo{};
+		renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+		renderingInfo.renderArea.offset = {0, 0};
+		renderingInfo.renderArea.extent = extent;
+		renderingInfo.layerCount = 1;
+		renderingInfo.colorAttachmentCount = static_cast<uint32_t>(colorAttachments.size());
+		renderingInfo.pColorAttachments = colorAttachments.data();
+		renderingInfo.pDepthAttachment = depth ? &depthAttachment : nullptr;
+		vkCmdBeginRendering(commandBuffer, &renderingInfo);
+
+		VkViewport viewport{};
+		viewport.x = 0.0f;
+		viewport.y = 0.0f;
+		viewport.width = static_cast<float>(extent.width);
+		viewport.height = static_cast<float>(extent.height);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		VkRect2D scissor{};
+		scissor.offset = {0, 0};
+		scissor.extent = extent;
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+	}
+
+	void HexRenderGraph::execute(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+		if (!compiled) throw std::runtime_error("Render graph executed before compiling");
+
+		for (const Pass &pass : passes) {
+			if (pass.culled) continue;
+			if (profiler != nullptr) profiler->beginScope(commandBuffer, pass.name);
+			recordBarriers(commandBuffer, pass.before, frameIndex);
+
+			bool attachments = !pass.colorAttachments.empty() || pass.depthAttachment.image != NO_RESOURCE;
+			if (attachments) beginRendering(commandBuffer, pass, frameIndex);
+			if (pass.record) pass.record(commandBuffer);
+			if (attachments) vkCmdEndRendering(commandBuffer);
+			if (profiler != nullptr) profiler->endScope(commandBuffer);
+		}
+		recordBarriers(commandBuffer, after, frameIndex);
+	}
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include "HexGpuProfiler.h"
+#include "hex_device.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace hex {
+
+	// Frame graph. Passes declare how they use images and buffers, compile() then:
+	//  - culls passes whose results nothing reads (imported resources are read outside the graph)
+	//  - computes the barriers and layout transitions between passes, one vkCmdPipelineBarrier per pass
+	//  - picks attachment store ops, results nothing reads later are not stored
+	//  - creates the transient images, one set per frame in flight. Images whose lifetimes don't
+	//    overlap share memory. Attachments that are neither loaded nor stored are transient
+	//    attachments in lazily allocated memory where the device has it.
+	// Passes with attachments begin dynamic rendering on them and get the viewport and scissor of
+	// the render area, the device must support dynamic rendering. Passes run in declaration order.
+	class HexRenderGraph {
+		public:
+		using ResourceId = uint32_t;
+		static constexpr ResourceId NO_RESOURCE = ~0u;
+
+		enum class Access {
+			ColorAttachment,
+			DepthAttachment,
+			// Depth tests without depth writes
+			DepthAttachmentRead,
+			FragmentSampled,
+			ComputeSampled,
+			ComputeStorageRead,
+			ComputeStorageWrite,
+			TransferRead,
+			TransferWrite,
+			IndirectRead,
+			VertexRead
+		};
+
+		// Last use of an imported resource before the graph, or the use it's left for after it
+		struct ResourceState {
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkPipelineStageFlags stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			VkAccessFlags access = 0;
+		};
+
+		class PassBuilder {
+			public:
+			PassBuilder &read(ResourceId resource, Access access);
+			PassBuilder &write(ResourceId resource, Access access);
+			// Clear or don't care loads overwrite the whole image, earlier writers aren't needed for it
+			PassBuilder &colorAttachment(ResourceId image, VkAttachmentLoadOp loadOp, VkClearColorValue clearColor = {});
+			PassBuilder &depthAttachment(ResourceId image, VkAttachmentLoadOp loadOp, float clearDepth = 1.f, bool depthWrite = true);
+			// Never culled, e.g. the pass records work outside the graph's resources
+			PassBuilder &sideEffect();
+
+			private:
+			friend class HexRenderGraph;
+			PassBuilder(HexRenderGraph &graph, uint32_t pass) : graph{graph}, pass{pass} {}
+
+			HexRenderGraph &graph;
+			uint32_t pass;
+		};
+
+		using Record = std::function<void(VkCommandBuffer commandBuffer)>;
+
+		HexRenderGraph(HexDevice &device, uint32_t framesInFlight);
+		~HexRenderGraph();
+
+		HexRenderGraph(const HexRenderGraph &) = delete;
+		HexRenderGraph &operator=(const HexRenderGraph &) = delete;
+
+		// Transient, owned by the graph and only valid within the frame
+		ResourceId createImage(const std::string &name, VkFormat format, VkExtent2D extent);
+		// Transient of the graph's extent, follows it (setExtent)
+		ResourceId createImage(const std::string &name, VkFormat format);
+		// The image and its view are set every frame (setImage). A final layout of
+		// VK_IMAGE_LAYOUT_UNDEFINED leaves the image as the last pass did.
+		ResourceId importImage(const std::string &name, VkFormat format, const ResourceState &initial, const ResourceState &final);
+		ResourceId importBuffer(const std::string &name, VkBuffer buffer, const ResourceState &initial);
+		void setImage(ResourceId image, VkImage handle, VkImageView view, VkExtent2D extent);
+		// E.g. the swap chain's, set before compiling. Once compiled, a new extent waits for the
+		// device to be idle and recreates the transients following it.
+		void setExtent(VkExtent2D extent);
+
+		PassBuilder addPass(const std::string &name, Record record);
+
+		// Once all passes are added, throws when a pass can't run on this device
+		void compile();
+		void execute(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+		// Times every pass, barriers included, in a scope named after it
+		void setProfiler(HexGpuProfiler *gpuProfiler) { profiler = gpuProfiler; }
+
+		// Valid while recording the frame
+		VkImage getImage(ResourceId image, uint32_t frameIndex) const;
+		VkImageView getImageView(ResourceId image, uint32_t frameIndex) const;
+
+		struct Barrier {
+			ResourceId resource;
+			VkImageLayout oldLayout;
+			VkImageLayout newLayout;
+			VkAccessFlags srcAccess;
+			VkAccessFlags dstAccess;
+		};
+
+		struct Barriers {
+			VkPipelineStageFlags srcStages = 0;
+			VkPipelineStageFlags dstStages = 0;
+			std::vector<Barrier> barriers;
+		};
+
+		// What compile decided, for tests and debugging
+		bool isCulled(const std::string &pass) const;
+		const Barriers &getBarriers(const std::string &pass) const;
+		// Transients bound to the same memory
+		bool sharesMemory(ResourceId image, ResourceId other) const;
+
+		private:
+		struct Use {
+			ResourceId resource;
+			Access access;
+			bool write;
+		};
+
+		struct Attachment {
+			ResourceId image = NO_RESOURCE;
+			VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			VkAttachmentStoreOp storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkClearValue clearValue{};
+		};
+
+		struct Pass {
+			std::string name;
+			Record record;
+			std::vector<Use> uses;
+			std::vector<Attachment> colorAttachments;
+			Attachment depthAttachment;
+			bool sideEffect = false;
+			bool culled = false;
+			Barriers before;
+		};
+
+		struct Resource {
+			std::string name;
+			bool image;
+			bool imported;
+			VkFormat format = VK_FORMAT_UNDEFINED;
+			VkExtent2D extent{};
+			// Transient of the graph's extent
+			bool followsExtent = false;
+			ResourceState initial;
+			ResourceState final;
+			// Imported handles
+			VkImage handle = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+			VkBuffer buffer = VK_NULL_HANDLE;
+
+			// Transient images, filled by compile
+			VkImageUsageFlags usage = 0;
+			uint32_t firstPass = ~0u;
+			uint32_t lastPass = 0;
+			uint32_t memoryBlock = ~0u;
+			// Only ever a cleared attachment nothing reads after, may live in tile memory
+			bool lazy = false;
+			// Transient using the memory before it, its last use is waited for
+			ResourceId previousAlias = NO_RESOURCE;
+			// Per frame in flight
+			std::vector<VkImage> images;
+			std::vector<VkImageView> views;
+		};
+
+		// Memory of transients, per frame in flight
+		struct MemoryBlock {
+			VkDeviceSize size = 0;
+			uint32_t memoryTypeBits = ~0u;
+			bool lazy = false;
+			std::vector<ResourceId> images;
+			std::vector<VkDeviceMemory> memory;
+		};
+
+		void addUse(uint32_t pass, ResourceId resource, Access access, bool write);
+		void cullPasses();
+		void computeLifetimes();
+		void computeBarriers();
+		void chooseStoreOps();
+		void createTransients();
+		void destroyTransients();
+		const Pass &findPass(const std::string &name) const;
+		void recordBarriers(VkCommandBuffer commandBuffer, const Barriers &barriers, uint32_t frameIndex) const;
+		void beginRendering(VkCommandBuffer commandBuffer, const Pass &pass, uint32_t frameIndex) const;
+
+		HexDevice &hexDevice;
+		uint32_t framesInFlight;
+		std::vector<Resource> resources;
+		std::vector<Pass> passes;
+		std::vector<MemoryBlock> memoryBlocks;
+		VkExtent2D extent{};
+		// Imported images to their final state
+		Barriers after;
+		bool compiled = false;
+		HexGpuProfiler *profiler = nullptr;
+	};
+}
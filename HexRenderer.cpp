@@ -24,12 +24,13 @@ namespace hex {
 		}
 
 		vkDeviceWaitIdle(hexDevice.device());
+		if (swapChainRecreateCallback) swapChainRecreateCallback();
 
 		if (hexSwapChain == nullptr) {
-			hexSwapChain = std::make_unique<HexSwapChain>(hexDevice, extent);
+			hexSwapChain = std::make_unique<HexSwapChain>(hexDevice, extent, sampledDepth);
 		} else {
 			std::shared_ptr<HexSwapChain> oldSwapChain = std::move(hexSwapChain);
-			hexSwapChain = std::make_unique<HexSwapChain>(hexDevice, extent, oldSwapChain);
+			hexSwapChain = std::make_unique<HexSwapChain>(hexDevice, extent, oldSwapChain, sampledDepth);
 
 			if (!oldSwapChain->compareSwapFormat(*hexSwapChain.get())) {
 				// Maybe not throw an error here, make a callback to get error
@@ -40,6 +41,13 @@ namespace hex {
 
 	}
 
+	void HexRenderer::setSampledDepth(bool sampled) {
+		assert(!isFrameStarted && "Cannot change the depth buffers while frame in progress");
+		if (sampled == sampledDepth) return;
+		sampledDepth = sampled;
+		recreateSwapChain();
+	}
+
 	void HexRenderer::createCommandBuffers() {
 		commandBuffers.resize(HexSwapChain::MAX_FRAMES_IN_FLIGHT);
 		VkCommandBufferAllocateInfo allocInfo{};
@@ -115,26 +123,37 @@ namespace hex {
 		currentFrameIndex = (currentFrameIndex + 1) % HexSwapChain::MAX_FRAMES_IN_FLIGHT;
 	}
 
+	RenderTargetInfo HexRenderer::getSwapChainRenderTarget() const {
+		RenderTargetInfo renderTarget{};
+		renderTarget.renderPass = hexSwapChain->getRenderPass();
+		renderTarget.colorFormat = hexSwapChain->getSwapChainImageFormat();
+		renderTarget.depthFormat = hexSwapChain->getSwapChainDepthFormat();
+		return renderTarget;
+	}
+
 	void HexRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer) {
 		assert(isFrameStarted && "Can't call beginSwapChainRenderPass while frame is not in progress");
 		assert(commandBuffer == getCurrentCommandBuffer() && "Can't begin render pass on a command buffer from a different frame");
 
-		VkRenderPassBeginInfo renderPassInfo{};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = hexSwapChain->getRenderPass();
-		renderPassInfo.framebuffer = hexSwapChain->getFrameBuffer(currentImageIndex);
-		renderPassInfo.renderArea.offset = {0, 0};
-		renderPassInfo.renderArea.extent = hexSwapChain->getSwapChainExtent();
-
 		std::array<VkClearValue, 2> clearValues{};
 		clearValues[0].color = {0.1f, 0.1f, 0.1f};
 		clearValues[1].depthStencil.depth = 1.0f;
 		clearValues[1].depthStencil.stencil = 0;
 
-		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-		renderPassInfo.pClearValues = clearValues.data();
-
-		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		if (hexSwapChain->usesDynamicRendering()) {
+			beginSwapChainRendering(commandBuffer, clearValues);
+		} else {
+			VkRenderPassBeginInfo renderPassInfo{};
+			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			renderPassInfo.renderPass = hexSwapChain->getRenderPass();
+			renderPassInfo.framebuffer = hexSwapChain->getFrameBuffer(currentImageIndex, currentFrameIndex);
+			renderPassInfo.renderArea.offset = {0, 0};
+			renderPassInfo.renderArea.extent = hexSwapChain->getSwapChainExtent();
+			renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+			renderPassInfo.pClearValues = clearValues.data();
+
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		}
 
 		VkViewport viewport{};
 		viewport.x = 0.0f;
@@ -154,7 +173,87 @@ namespace hex {
 		assert(isFrameStarted && "Can't call endSwapChainRenderPass while already in progress");
 		assert(commandBuffer == getCurrentCommandBuffer() && "Can't end render pass on a command buffer from a different frame");
 
-		vkCmdEndRenderPass(commandBuffer);
+		if (!hexSwapChain->usesDynamicRendering()) {
+			vkCmdEndRenderPass(commandBuffer);
+			return;
+		}
+
+		vkCmdEndRendering(commandBuffer);
+
+		// What the render pass final layout did
+		VkImageMemoryBarrier presentBarrier{};
+		presentBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		presentBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		presentBarrier.dstAccessMask = 0;
+		presentBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		presentBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		presentBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		presentBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		presentBarrier.image = hexSwapChain->getImage(currentImageIndex);
+		presentBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &presentBarrier);
+	}
+
+	void HexRenderer::beginSwapChainRendering(VkCommandBuffer commandBuffer, const std::array<VkClearValue, 2> &clearValues) {
+		// Both attachments are cleared, their previous content is discarded like the render
+		// pass initial layouts did. The depth write after the previous frame's depth tests is
+		// the same dependency as the render pass external subpass dependency.
+		VkFormat depthFormat = hexSwapChain->getSwapChainDepthFormat();
+		bool stencil = depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || depthFormat == VK_FORMAT_D24_UNORM_S8_UINT;
+
+		std::array<VkImageMemoryBarrier, 2> barriers{};
+		for (auto &barrier : barriers) {
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		}
+		barriers[0].srcAccessMask = 0;
+		barriers[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		barriers[0].newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		barriers[0].image = hexSwapChain->getImage(currentImageIndex);
+		barriers[0].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+		barriers[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		barriers[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		barriers[1].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		barriers[1].image = hexSwapChain->getDepthImage(currentFrameIndex);
+		barriers[1].subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT | (stencil ? VK_IMAGE_ASPECT_STENCIL_BIT : 0u), 0, 1, 0, 1};
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+		VkRenderingAttachmentInfo colorAttachment{};
+		colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+		colorAttachment.imageView = hexSwapChain->getImageView(currentImageIndex);
+		colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		colorAttachment.clearValue = clearValues[0];
+
+		VkRenderingAttachmentInfo depthAttachment{};
+		depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+		depthAttachment.imageView = hexSwapChain->getDepthImageView(currentFrameIndex);
+		depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.clearValue = clearValues[1];
+
+		VkRenderingInfo renderingInfo{};
+		renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+		renderingInfo.renderArea.offset = {0, 0};
+		renderingInfo.renderArea.extent = hexSwapChain->getSwapChainExtent();
+		renderingInfo.layerCount = 1;
+		renderingInfo.colorAttachmentCount = 1;
+		renderingInfo.pColorAttachments = &colorAttachment;
+		renderingInfo.pDepthAttachment = &depthAttachment;
+
+		vkCmdBeginRendering(commandBuffer, &renderingInfo);
 	}
 
 }
\ No newline at end of file
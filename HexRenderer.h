@@ -1,9 +1,12 @@
 #pragma once
 
+#include "HexPipeline.h"
 #include "HexWindow.h"
 #include "hex_device.h"
 #include "HexSwapChain.h"
 
+#include <array>
+#include <functional>
 #include <memory>
 #include <vector>
 #include <cassert>
@@ -20,7 +23,17 @@ namespace hex {
 		HexRenderer(const HexRenderer&) = delete;
 		HexRenderer &operator=(const HexRenderer &) = delete;
 		float getAspectRatio() const { return hexSwapChain->extentAspectRatio(); }
-		VkRenderPass getSwapChainRenderPass() const { return hexSwapChain->getRenderPass(); }
+		VkExtent2D getExtent() const { return hexSwapChain->getSwapChainExtent(); }
+		// Pipelines drawing in the swap chain pass are created against it. Same across swap chain
+		// recreations: formats don't change and the render pass is handed over.
+		RenderTargetInfo getSwapChainRenderTarget() const;
+		// Called before the swap chain is recreated, once the device is idle, e.g. to finish
+		// pipeline compilations
+		void setSwapChainRecreateCallback(std::function<void()> callback) { swapChainRecreateCallback = std::move(callback); }
+		bool usesDynamicRendering() const { return hexSwapChain->usesDynamicRendering(); }
+		// Depth buffers read after the scene pass, e.g. by depth pyramids. Recreates the swap chain
+		// when it changes, outside of a frame.
+		void setSampledDepth(bool sampled);
 
 		bool isFrameInProgress() const { return isFrameStarted; }
 
@@ -36,14 +49,24 @@ namespace hex {
 
 		VkCommandBuffer beginFrame();
 		void endFrame();
+		// Dynamic rendering on the swap chain image when the device has it, the render pass otherwise
 		void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
 		void endSwapChainRenderPass(VkCommandBuffer commandBuffer);
 
+		// Of the image acquired for the frame in progress, and its depth buffer, for render graphs importing them
+		VkImage getSwapChainImage() const { return hexSwapChain->getImage(currentImageIndex); }
+		VkImageView getSwapChainImageView() const { return hexSwapChain->getImageView(currentImageIndex); }
+		VkImage getSwapChainDepthImage() const { return hexSwapChain->getDepthImage(currentFrameIndex); }
+		VkImageView getSwapChainDepthImageView() const { return hexSwapChain->getDepthImageView(currentFrameIndex); }
+		VkFormat getSwapChainImageFormat() const { return hexSwapChain->getSwapChainImageFormat(); }
+		VkFormat getSwapChainDepthFormat() const { return hexSwapChain->getSwapChainDepthFormat(); }
+
 		private:
 
 		void createCommandBuffers();
 		void freeCommandBuffers();
 		void recreateSwapChain();
+		void beginSwapChainRendering(VkCommandBuffer commandBuffer, const std::array<VkClearValue, 2> &clearValues);
 
 		HexWindow& hexWindow;
 		HexDevice& hexDevice;
@@ -53,6 +76,8 @@ namespace hex {
 		uint32_t currentImageIndex;
 		int currentFrameIndex{0};
 		bool isFrameStarted{false};
+		bool sampledDepth{false};
+		std::function<void()> swapChainRecreateCallback;
 
 	};
 }
\ No newline at end of file
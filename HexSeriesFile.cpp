@@ -0,0 +1,272 @@
+#include "HexSeriesFile.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace hex {
+
+	namespace {
+
+		const char seriesMagic[8] = {'H', 'E', 'X', 'S', 'E', 'R', 'S', '\0'};
+
+		uint64_t alignUp(uint64_t value, uint64_t alignment) {
+			return (value + alignment - 1) / alignment * alignment;
+		}
+	}
+
+	HexSeriesFile::Writer::Writer(const std::string &filepath, uint32_t vertexCount, const std::vector<uint32_t> &indices, float frameRate, bool hasScalars, float deltaTolerance)
+		: filepath{filepath}, temporaryPath{filepath + ".tmp"}, deltaTolerance{deltaTolerance} {
+		if (vertexCount == 0 || indices.empty() || indices.size() % 3 != 0) {
+			throw std::runtime_error("series needs vertices and whole triangles: " + filepath);
+		}
+		if (!(frameRate > 0.f)) {
+			throw std::runtime_error("series frame rate must be positive: " + filepath);
+		}
+		for (uint32_t index : indices) {
+			if (index >= vertexCount) {
+				throw std::runtime_error("series index out of range: " + filepath);
+			}
+		}
+
+		file.open(temporaryPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			throw std::runtime_error("failed to create series file: " + temporaryPath);
+		}
+
+		memcpy(header.magic, seriesMagic, sizeof(seriesMagic));
+		header.version = VERSION;
+		header.flags = hasScalars ? HAS_SCALARS : 0;
+		header.vertexCount = vertexCount;
+		header.indexCount = static_cast<uint32_t>(indices.size());
+		header.frameRate = frameRate;
+		header.indexOffset = sizeof(Header);
+		for (int i = 0; i < 3; i++) {
+			header.boundsMin[i] = std::numeric_limits<float>::max();
+			header.boundsMax[i] = std::numeric_limits<float>::lowest();
+		}
+		header.scalarMin = std::numeric_limits<float>::max();
+		header.scalarMax = std::numeric_limits<float>::lowest();
+
+		// The header is written again by finish, once the frames are known
+		write(&header, sizeof(Header));
+		write(indices.data(), indices.size() * sizeof(uint32_t));
+	}
+
+	HexSeriesFile::Writer::~Writer() {
+		if (!finished) {
+			file.close();
+			std::remove(temporaryPath.c_str());
+		}
+	}
+
+	void HexSeriesFile::Writer::write(const void *data, uint64_t size) {
+		file.write(static_cast<const char*>(data), size);
+		written += size;
+	}
+
+	void HexSeriesFile::Writer::addFrame(const glm::vec3 *positions, const float *scalars) {
+		if (finished) {
+			throw std::runtime_error("series file already finished: " + filepath);
+		}
+		bool hasScalars = (header.flags & HAS_SCALARS) != 0;
+		if (hasScalars && scalars == nullptr) {
+			throw std::runtime_error("series frame without its scalars: " + filepath);
+		}
+
+		uint32_t vertexCount = header.vertexCount;
+		for (uint32_t i = 0; i < vertexCount; i++) {
+			for (int c = 0; c < 3; c++) {
+				header.boundsMin[c] = std::min(header.boundsMin[c], positions[i][c]);
+				header.boundsMax[c] = std::max(header.boundsMax[c], positions[i][c]);
+			}
+		}
+
+		Frame frame{written, Encoding::Raw, 0.f};
+
+		// The first frame is always whole, the others are deltas while the quantization step is fine enough
+		if (!frames.empty() && deltaTolerance > 0.f) {
+			float maxDelta = 0.f;
+			for (uint32_t i = 0; i < vertexCount; i++) {
+				glm::vec3 delta = glm::abs(positions[i] - decoded[i]);
+				maxDelta = std::max(maxDelta, std::max(delta.x, std::max(delta.y, delta.z)));
+			}
+			float scale = maxDelta / 32767.f;
+
+			// Rounding moves a position by half a step at most
+			if (scale * .5f <= deltaTolerance) {
+				frame.encoding = Encoding::Delta;
+				frame.deltaScale = scale;
+
+				deltas.resize(static_cast<size_t>(vertexCount) * 3);
+				for (uint32_t i = 0; i < vertexCount; i++) {
+					for (int c = 0; c < 3; c++) {
+						int16_t q = scale > 0.f ? static_cast<int16_t>(std::lround((positions[i][c] - decoded[i][c]) / scale)) : 0;
+						deltas[i * 3 + c] = q;
+						// Exactly what readFrame computes, errors don't add up over frames
+						decoded[i][c] += static_cast<float>(q) * scale;
+					}
+				}
+
+				const char padding[4] = {};
+				uint64_t size = deltas.size() * sizeof(int16_t);
+				write(deltas.data(), size);
+				write(padding, alignUp(size, 4) - size);
+			}
+		}
+
+		if (frame.encoding == Encoding::Raw) {
+			write(positions, static_cast<uint64_t>(vertexCount) * sizeof(glm::vec3));
+			decoded.assign(positions, positions + vertexCount);
+		}
+
+		if (hasScalars) {
+			for (uint32_t i = 0; i < vertexCount; i++) {
+				header.scalarMin = std::min(header.scalarMin, scalars[i]);
+				header.scalarMax = std::max(header.scalarMax, scalars[i]);
+			}
+			write(scalars, static_cast<uint64_t>(vertexCount) * sizeof(float));
+		}
+
+		frames.push_back(frame);
+	}
+
+	void HexSeriesFile::Writer::finish() {
+		if (finished) return;
+		if (frames.empty()) {
+			throw std::runtime_error("series has no frames: " + filepath);
+		}
+		if ((header.flags & HAS_SCALARS) == 0) {
+			header.scalarMin = 0.f;
+			header.scalarMax = 0.f;
+		}
+
+		const char padding[8] = {};
+		header.frameTableOffset = alignUp(written, alignof(Frame));
+		write(padding, header.frameTableOffset - written);
+		write(frames.data(), frames.size() * sizeof(Frame));
+		header.frameCount = static_cast<uint32_t>(frames.size());
+
+		file.seekp(0);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+		file.close();
+		if (!file) {
+			throw std::runtime_error("failed to write series file: " + temporaryPath);
+		}
+
+		// Readers never see a half written series
+		if (std::rename(temporaryPath.c_str(), filepath.c_str()) != 0) {
+			throw std::runtime_error("failed to write series file: " + filepath);
+		}
+		finished = true;
+	}
+
+	HexSeriesFile::HexSeriesFile(std::unique_ptr<HexMappedFile> file) : file{std::move(file)} {
+		header = reinterpret_cast<const Header*>(this->file->data());
+		frames = reinterpret_cast<const Frame*>(this->file->data() + header->frameTableOffset);
+		for (uint32_t i = 0; i < header->frameCount; i++) {
+			if (frames[i].encoding == Encoding::Delta) deltaFrames = true;
+		}
+	}
+
+	bool HexSeriesFile::isSeriesFile(const std::string &filepath) {
+		auto dot = filepath.find_last_of('.');
+		if (dot == std::string::npos) return false;
+		std::string extension = filepath.substr(dot + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+		return extension == "hexseries";
+	}
+
+	uint64_t HexSeriesFile::frameSize(const Header &header, Encoding encoding) {
+		uint64_t vertexCount = header.vertexCount;
+		uint64_t size = encoding == Encoding::Raw ? vertexCount * sizeof(glm::vec3) : alignUp(vertexCount * 3 * sizeof(int16_t), 4);
+		if ((header.flags & HAS_SCALARS) != 0) size += vertexCount * sizeof(float);
+		return size;
+	}
+
+	std::unique_ptr<HexSeriesFile> HexSeriesFile::open(const std::string &filepath) {
+		// Frames are read in order with prefetch, not the whole file up front
+		auto file = std::make_unique<HexMappedFile>(filepath, true);
+
+		if (file->size() < sizeof(Header)) {
+			throw std::runtime_error("truncated series file: " + filepath);
+		}
+
+		Header header;
+		memcpy(&header, file->data(), sizeof(Header));
+
+		if (memcmp(header.magic, seriesMagic, sizeof(seriesMagic)) != 0 || header.version != VERSION) {
+			throw std::runtime_error("not a series file or unsupported version: " + filepath);
+		}
+
+		if (header.vertexCount == 0 || header.frameCount == 0 || header.indexCount == 0 || header.indexCount % 3 != 0 || !(header.frameRate > 0.f)
+			|| header.indexOffset % sizeof(uint32_t) != 0 || header.frameTableOffset % alignof(Frame) != 0
+			|| header.indexOffset + static_cast<uint64_t>(header.indexCount) * sizeof(uint32_t) > file->size()
+			|| header.frameTableOffset + static_cast<uint64_t>(header.frameCount) * sizeof(Frame) > file->size()) {
+			throw std::runtime_error("corrupted series file: " + filepath);
+		}
+
+		// Frames are decoded straight from the mapping, a truncated file must not get that far
+		const Frame *frames = reinterpret_cast<const Frame*>(file->data() + header.frameTableOffset);
+		for (uint32_t i = 0; i < header.frameCount; i++) {
+			const Frame &frame = frames[i];
+			bool encodingValid = frame.encoding == Encoding::Raw || (frame.encoding == Encoding::Delta && i > 0);
+			if (!encodingValid || frame.offset % 4 != 0 || frame.offset + frameSize(header, frame.encoding) > file->size()) {
+				throw std::runtime_error("corrupted series file: " + filepath);
+			}
+		}
+
+		const uint32_t *indices = reinterpret_cast<const uint32_t*>(file->data() + header.indexOffset);
+		for (uint32_t i = 0; i < header.indexCount; i++) {
+			if (indices[i] >= header.vertexCount) {
+				throw std::runtime_error("series index out of range: " + filepath);
+			}
+		}
+
+		return std::unique_ptr<HexSeriesFile>(new HexSeriesFile(std::move(file)));
+	}
+
+	const uint32_t *HexSeriesFile::indices() const {
+		return reinterpret_cast<const uint32_t*>(file->data() + header->indexOffset);
+	}
+
+	void HexSeriesFile::readFrame(uint32_t frame, glm::vec3 *positions, float *scalars, glm::vec3 *previous) const {
+		assert((previous != nullptr || !deltaFrames) && "Delta frames decode on top of the previous frame");
+		const Frame &entry = frames[frame];
+		const char *data = file->data() + entry.offset;
+		uint32_t vertexCount = header->vertexCount;
+
+		if (entry.encoding == Encoding::Raw) {
+			size_t size = static_cast<size_t>(vertexCount) * sizeof(glm::vec3);
+			memcpy(positions, data, size);
+			if (previous != nullptr) memcpy(previous, data, size);
+			data += size;
+		} else {
+			// One pass, positions are written once and never read back
+			const int16_t *deltas = reinterpret_cast<const int16_t*>(data);
+			for (uint32_t i = 0; i < vertexCount; i++) {
+				glm::vec3 position = previous[i];
+				for (int c = 0; c < 3; c++) {
+					position[c] += static_cast<float>(deltas[i * 3 + c]) * entry.deltaScale;
+				}
+				previous[i] = position;
+				positions[i] = position;
+			}
+			data += alignUp(static_cast<uint64_t>(vertexCount) * 3 * sizeof(int16_t), 4);
+		}
+
+		if (hasScalars() && scalars != nullptr) {
+			memcpy(scalars, data, static_cast<size_t>(vertexCount) * sizeof(float));
+		}
+	}
+
+	void HexSeriesFile::prefetch(uint32_t frame) const {
+		const Frame &entry = frames[frame];
+		file->prefetch(static_cast<size_t>(entry.offset), static_cast<size_t>(frameSize(*header, entry.encoding)));
+	}
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "HexMappedFile.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace hex {
+
+	// Time series of a triangle mesh (.hexseries): the topology once, then one block per
+	// frame with the vertex positions and optionally a scalar per vertex. Positions of a
+	// frame can be stored as 16 bit quantized deltas from the previous frame, so frames
+	// are decoded in order from the first one, which is always stored whole. No converter
+	// ships with the viewer, series are written by solvers through Writer.
+	class HexSeriesFile {
+		public:
+		static constexpr uint32_t VERSION = 1;
+
+		enum Flags : uint32_t {
+			HAS_SCALARS = 1
+		};
+
+		enum class Encoding : uint32_t {
+			// float x, y, z per vertex
+			Raw,
+			// int16 x, y, z per vertex times the frame delta scale, added to the previous frame
+			Delta
+		};
+
+		struct Header {
+			char magic[8];
+			uint32_t version;
+			uint32_t flags;
+			uint32_t vertexCount;
+			uint32_t indexCount;
+			uint32_t frameCount;
+			// Frames per second the series was sampled at
+			float frameRate;
+			uint64_t indexOffset;
+			uint64_t frameTableOffset;
+			// Over every frame
+			float boundsMin[4];
+			float boundsMax[4];
+			float scalarMin;
+			float scalarMax;
+		};
+
+		struct Frame {
+			// Positions then scalars, 4 byte aligned
+			uint64_t offset;
+			Encoding encoding;
+			float deltaScale;
+		};
+
+		// Written one frame at a time, a solver never holds more than one frame. The file only
+		// appears at its path once finish() succeeds.
+		class Writer {
+			public:
+			// deltaTolerance is the largest position error a delta frame may add, 0 stores every frame whole
+			Writer(const std::string &filepath, uint32_t vertexCount, const std::vector<uint32_t> &indices, float frameRate, bool hasScalars, float deltaTolerance = 0.f);
+			~Writer();
+
+			Writer(const Writer &) = delete;
+			Writer &operator=(const Writer &) = delete;
+
+			// scalars is ignored without HAS_SCALARS
+			void addFrame(const glm::vec3 *positions, const float *scalars = nullptr);
+			void finish();
+
+			private:
+			void write(const void *data, uint64_t size);
+
+			std::string filepath;
+			std::string temporaryPath;
+			std::ofstream file;
+			Header header{};
+			float deltaTolerance;
+			std::vector<Frame> frames;
+			// Positions as a reader decodes them, deltas are taken from these
+			std::vector<glm::vec3> decoded;
+			std::vector<int16_t> deltas;
+			uint64_t written = 0;
+			bool finished = false;
+		};
+
+		~HexSeriesFile() = default;
+
+		HexSeriesFile(const HexSeriesFile &) = delete;
+		HexSeriesFile &operator=(const HexSeriesFile &) = delete;
+
+		static std::unique_ptr<HexSeriesFile> open(const std::string &filepath);
+		static bool isSeriesFile(const std::string &filepath);
+
+		uint32_t vertexCount() const { return header->vertexCount; }
+		uint32_t frameCount() const { return header->frameCount; }
+		float frameRate() const { return header->frameRate; }
+		bool hasScalars() const { return (header->flags & HAS_SCALARS) != 0; }
+		bool hasDeltaFrames() const { return deltaFrames; }
+		float scalarMin() const { return header->scalarMin; }
+		float scalarMax() const { return header->scalarMax; }
+		glm::vec3 boundsMin() const { return {header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]}; }
+		glm::vec3 boundsMax() const { return {header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]}; }
+
+		const uint32_t *indices() const;
+		uint32_t indexCount() const { return header->indexCount; }
+
+		// Decode a frame into positions and scalars, which are only written so they can be mapped
+		// staging memory. Delta frames add to previous, the frame decoded before, and every frame
+		// is stored back into it. previous may be null without delta frames.
+		// Reads the disk, keep it off the render thread.
+		void readFrame(uint32_t frame, glm::vec3 *positions, float *scalars, glm::vec3 *previous) const;
+		// Have the kernel read a frame ahead of readFrame
+		void prefetch(uint32_t frame) const;
+
+		private:
+		HexSeriesFile(std::unique_ptr<HexMappedFile> file);
+
+		static uint64_t frameSize(const Header &header, Encoding encoding);
+
+		std::unique_ptr<HexMappedFile> file;
+		const Header *header;
+		const Frame *frames;
+		bool deltaFrames = false;
+	};
+}
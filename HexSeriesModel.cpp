@@ -0,0 +1,239 @@
+#include "HexSeriesModel.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace hex {
+
+	HexSeriesModel::HexSeriesModel(HexDevice &device, std::unique_ptr<HexSeriesFile> file) : hexDevice{device}, seriesFile{std::move(file)} {
+		VkDeviceSize vertexCount = seriesFile->vertexCount();
+		positionsSize = vertexCount * sizeof(glm::vec3);
+		frameSize = positionsSize + (seriesFile->hasScalars() ? vertexCount * sizeof(float) : 0);
+
+		try {
+			createBuffers();
+			uploadIndices();
+		} catch (...) {
+			destroyBuffers();
+			throw;
+		}
+
+		reader = std::thread{&HexSeriesModel::readFrames, this};
+	}
+
+	HexSeriesModel::~HexSeriesModel() {
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			stopping = true;
+		}
+		slotReleased.notify_all();
+		reader.join();
+
+		destroyBuffers();
+	}
+
+	std::unique_ptr<HexSeriesModel> HexSeriesModel::createFromFile(HexDevice &device, const std::string &filepath) {
+		auto model = std::make_unique<HexSeriesModel>(device, HexSeriesFile::open(filepath));
+		std::cout << "Series " << filepath << ": " << model->getFrameCount() << " frames of " << model->seriesFile->vertexCount()
+			<< " vertices at " << model->seriesFile->frameRate() << " fps" << (model->hasScalars() ? " with scalars" : "") << std::endl;
+		return model;
+	}
+
+	void HexSeriesModel::createBuffers() {
+		hexDevice.createBuffer(
+			static_cast<VkDeviceSize>(seriesFile->indexCount()) * sizeof(uint32_t),
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			indexBuffer,
+			indexMemory
+		);
+
+		if (!seriesFile->hasScalars()) {
+			VkDeviceSize size = static_cast<VkDeviceSize>(seriesFile->vertexCount()) * sizeof(float);
+			hexDevice.createBuffer(
+				size,
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				zeroBuffer,
+				zeroMemory
+			);
+			VkCommandBuffer commandBuffer = hexDevice.beginSingleTimeCommands();
+			vkCmdFillBuffer(commandBuffer, zeroBuffer, 0, size, 0);
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+			hexDevice.endSingleTimeCommands(commandBuffer);
+		}
+
+		for (auto &stream : streams) {
+			hexDevice.createBuffer(
+				frameSize,
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				stream.buffer,
+				stream.memory
+			);
+		}
+
+		hexDevice.createBuffer(
+			RING_SIZE * frameSize,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			stagingBuffer,
+			stagingMemory
+		);
+
+		void *mapped;
+		vkMapMemory(hexDevice.device(), stagingMemory, 0, VK_WHOLE_SIZE, 0, &mapped);
+		staging = static_cast<char*>(mapped);
+	}
+
+	void HexSeriesModel::destroyBuffers() {
+		if (staging != nullptr) vkUnmapMemory(hexDevice.device(), stagingMemory);
+
+		std::vector<std::pair<VkBuffer, VkDeviceMemory>> buffers{{indexBuffer, indexMemory}, {zeroBuffer, zeroMemory}, {stagingBuffer, stagingMemory}};
+		for (auto &stream : streams) buffers.push_back({stream.buffer, stream.memory});
+		for (auto &buffer : buffers) {
+			if (buffer.first == VK_NULL_HANDLE) continue;
+			vkDestroyBuffer(hexDevice.device(), buffer.first, nullptr);
+			vkFreeMemory(hexDevice.device(), buffer.second, nullptr);
+		}
+	}
+
+	// Topology never changes, only positions and scalars are streamed
+	void HexSeriesModel::uploadIndices() {
+		VkDeviceSize size = static_cast<VkDeviceSize>(seriesFile->indexCount()) * sizeof(uint32_t);
+
+		VkBuffer indexStagingBuffer;
+		VkDeviceMemory indexStagingMemory;
+		hexDevice.createBuffer(
+			size,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			indexStagingBuffer,
+			indexStagingMemory
+		);
+
+		void *data;
+		vkMapMemory(hexDevice.device(), indexStagingMemory, 0, size, 0, &data);
+		memcpy(data, seriesFile->indices(), static_cast<size_t>(size));
+		vkUnmapMemory(hexDevice.device(), indexStagingMemory);
+
+		hexDevice.copyBuffer(indexStagingBuffer, indexBuffer, size);
+
+		vkDestroyBuffer(hexDevice.device(), indexStagingBuffer, nullptr);
+		vkFreeMemory(hexDevice.device(), indexStagingMemory, nullptr);
+	}
+
+	// Reader thread: decodes every series frame in order into the next free ring slot
+	void HexSeriesModel::readFrames() {
+		uint32_t frameCount = seriesFile->frameCount();
+		// Delta frames decode on top of the previous one, kept in cached memory: staging
+		// memory may be uncached and is only written
+		std::vector<glm::vec3> previous(seriesFile->hasDeltaFrames() ? seriesFile->vertexCount() : 0);
+
+		while (true) {
+			uint64_t sequence;
+			{
+				std::unique_lock<std::mutex> lock{mutex};
+				slotReleased.wait(lock, [this] { return stopping || written - releasedShared < RING_SIZE; });
+				if (stopping) return;
+				sequence = written;
+			}
+
+			uint32_t seriesFrame = static_cast<uint32_t>(sequence % frameCount);
+			// The next frame comes from the disk while this one is decoded
+			seriesFile->prefetch((seriesFrame + 1) % frameCount);
+			char *target = staging + (sequence % RING_SIZE) * frameSize;
+			seriesFile->readFrame(
+				seriesFrame,
+				reinterpret_cast<glm::vec3*>(target),
+				hasScalars() ? reinterpret_cast<float*>(target + positionsSize) : nullptr,
+				previous.empty() ? nullptr : previous.data());
+
+			std::lock_guard<std::mutex> lock{mutex};
+			written++;
+		}
+	}
+
+	// The renderer waited for the fence of the frame MAX_FRAMES_IN_FLIGHT frames ago before this one
+	bool HexSeriesModel::inFlight(uint64_t frameUsed) const {
+		return frameUsed + HexSwapChain::MAX_FRAMES_IN_FLIGHT > frame;
+	}
+
+	// Give the reader back the slots before the current one once no frame in flight copies them
+	void HexSeriesModel::releaseSlots() {
+		uint64_t previous = released;
+		while (released + 1 < consumed) {
+			RingSlot &slot = slots[released % RING_SIZE];
+			if (slot.copied && inFlight(slot.copyFrame)) break;
+			slot.copied = false;
+			released++;
+		}
+		if (released == previous) return;
+
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			releasedShared = released;
+		}
+		slotReleased.notify_one();
+	}
+
+	void HexSeriesModel::update(VkCommandBuffer commandBuffer, int frameIndex, float dt) {
+		frame++;
+
+		uint64_t decoded;
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			decoded = written;
+		}
+		if (decoded == 0) return;
+
+		// The clock waits at the first frame not decoded yet, slow disks slow the playback down
+		// instead of skipping frames
+		double frameRate = seriesFile->frameRate();
+		if (playing) time += dt;
+		time = std::min(time, static_cast<double>(decoded) / frameRate);
+		uint64_t target = std::min(static_cast<uint64_t>(time * frameRate), decoded - 1);
+
+		// Frames the clock went past are skipped, their slots are released below
+		if (consumed <= target) {
+			consumed = target + 1;
+			current = target;
+		}
+
+		Streams &streamsOfFrame = streams[frameIndex];
+		if (streamsOfFrame.sequence != current) {
+			VkBufferCopy copy{(current % RING_SIZE) * frameSize, 0, frameSize};
+			vkCmdCopyBuffer(commandBuffer, stagingBuffer, streamsOfFrame.buffer, 1, &copy);
+
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+			RingSlot &slot = slots[current % RING_SIZE];
+			slot.copied = true;
+			slot.copyFrame = frame;
+			streamsOfFrame.sequence = current;
+		}
+
+		releaseSlots();
+	}
+
+	void HexSeriesModel::bind(VkCommandBuffer commandBuffer, int frameIndex) {
+		VkBuffer buffers[] = {streams[frameIndex].buffer, hasScalars() ? streams[frameIndex].buffer : zeroBuffer};
+		VkDeviceSize offsets[] = {0, hasScalars() ? positionsSize : 0};
+		vkCmdBindVertexBuffers(commandBuffer, 0, 2, buffers, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+	}
+
+	void HexSeriesModel::draw(VkCommandBuffer commandBuffer) {
+		vkCmdDrawIndexed(commandBuffer, seriesFile->indexCount(), 1, 0, 0, 0);
+	}
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "HexSeriesFile.h"
+#include "HexSwapChain.h"
+#include "hex_device.h"
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace hex {
+
+	// Playback of a HexSeriesFile. The topology is uploaded once, a reader thread decodes the
+	// frames in order straight into a ring of host visible staging slots, ahead of the playback
+	// time, and each rendered frame copies the current series frame into its own vertex streams
+	// (positions, scalars). The playback clock never runs ahead of the decoded frames, a
+	// series is played as fast as the disk allows, up to its frame rate. Loops at the end.
+	class HexSeriesModel {
+		public:
+		// Series frames decoded ahead of the playback time
+		static constexpr uint32_t RING_SIZE = 8;
+
+		HexSeriesModel(HexDevice &device, std::unique_ptr<HexSeriesFile> seriesFile);
+		~HexSeriesModel();
+
+		HexSeriesModel(const HexSeriesModel &) = delete;
+		HexSeriesModel &operator=(const HexSeriesModel &) = delete;
+
+		static std::unique_ptr<HexSeriesModel> createFromFile(HexDevice &device, const std::string &filepath);
+
+		// Once per frame, outside of a render pass: advances the playback clock by dt and copies
+		// the current series frame into the streams of frameIndex
+		void update(VkCommandBuffer commandBuffer, int frameIndex, float dt);
+		// Positions at binding 0 and scalars at binding 1 (zeros without scalars)
+		void bind(VkCommandBuffer commandBuffer, int frameIndex);
+		void draw(VkCommandBuffer commandBuffer);
+
+		void setPlaying(bool playing) { this->playing = playing; }
+		bool isPlaying() const { return playing; }
+		// False until the first frame is decoded
+		bool hasFrame() const { return current != NO_SEQUENCE; }
+
+		bool hasScalars() const { return seriesFile->hasScalars(); }
+		float getScalarMin() const { return seriesFile->scalarMin(); }
+		float getScalarMax() const { return seriesFile->scalarMax(); }
+		glm::vec3 getBoundsMin() const { return seriesFile->boundsMin(); }
+		glm::vec3 getBoundsMax() const { return seriesFile->boundsMax(); }
+		uint32_t getFrameCount() const { return seriesFile->frameCount(); }
+
+		private:
+		static constexpr uint64_t NO_SEQUENCE = ~0ull;
+
+		// Holds the series frame of every sequence number congruent to its index
+		struct RingSlot {
+			// Last rendered frame that copied the slot
+			uint64_t copyFrame = 0;
+			bool copied = false;
+		};
+
+		struct Streams {
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			uint64_t sequence = NO_SEQUENCE;
+		};
+
+		void createBuffers();
+		void destroyBuffers();
+		void uploadIndices();
+		void readFrames();
+		bool inFlight(uint64_t frameUsed) const;
+		void releaseSlots();
+
+		HexDevice &hexDevice;
+		std::unique_ptr<HexSeriesFile> seriesFile;
+
+		VkBuffer indexBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory indexMemory = VK_NULL_HANDLE;
+		// A zero per vertex, bound as the scalars of series without any
+		VkBuffer zeroBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory zeroMemory = VK_NULL_HANDLE;
+		// Positions then scalars, the same layout in staging slots and streams
+		VkDeviceSize positionsSize;
+		VkDeviceSize frameSize;
+		std::array<Streams, HexSwapChain::MAX_FRAMES_IN_FLIGHT> streams{};
+
+		VkBuffer stagingBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+		char *staging = nullptr;
+
+		// Render thread state
+		std::array<RingSlot, RING_SIZE> slots{};
+		// Sequence numbers count series frames from the start of playback, loops keep counting.
+		// Slots in [released, consumed) were taken by the render thread, the last one is current.
+		uint64_t consumed = 0;
+		uint64_t released = 0;
+		uint64_t current = NO_SEQUENCE;
+		uint64_t frame = 0;
+		double time = 0.0;
+		bool playing = true;
+
+		// Shared with the reader, slots in [consumed, written) are decoded
+		std::mutex mutex;
+		std::condition_variable slotReleased;
+		uint64_t written = 0;
+		uint64_t releasedShared = 0;
+		bool stopping = false;
+		std::thread reader;
+	};
+}
@@ -0,0 +1,145 @@
+#include "HexShaderLibrary.h"
+
+#include <cassert>
+#include <stdexcept>
+
+namespace hex {
+
+	namespace {
+		const uint32_t spirvMagic = 0x07230203;
+
+		// FNV-1a over the whole SPIR-V
+		uint64_t hashCode(const char *data, size_t size) {
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < size; i++) {
+				hash ^= static_cast<unsigned char>(data[i]);
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+	}
+
+	HexShaderLibrary::Reference &HexShaderLibrary::Reference::operator=(Reference &&other) noexcept {
+		if (this != &other) {
+			reset();
+			library = other.library;
+			shader = other.shader;
+			other.shader = nullptr;
+		}
+		return *this;
+	}
+
+	void HexShaderLibrary::Reference::reset() {
+		if (shader != nullptr) library->release(shader);
+		shader = nullptr;
+	}
+
+	HexShaderLibrary::HexShaderLibrary(HexDevice &device) : hexDevice{device}, inlineCode{device.maintenance5Supported()} {
+		if (device.shaderModuleIdentifierSupported()) {
+			getShaderModuleCreateInfoIdentifier = reinterpret_cast<PFN_vkGetShaderModuleCreateInfoIdentifierEXT>(
+				vkGetDeviceProcAddr(device.device(), "vkGetShaderModuleCreateInfoIdentifierEXT"));
+		}
+	}
+
+	HexShaderLibrary::~HexShaderLibrary() {
+		assert(shaders.empty() && "Shaders still referenced");
+		for (auto &shader : shaders) {
+			if (shader.second->module != VK_NULL_HANDLE) vkDestroyShaderModule(hexDevice.device(), shader.second->module, nullptr);
+		}
+	}
+
+	HexShaderLibrary::Reference HexShaderLibrary::acquire(const std::string &filePath) {
+		std::lock_guard<std::mutex> lock{mutex};
+
+		auto known = shadersByPath.find(filePath);
+		if (known != shadersByPath.end()) {
+			known->second->references++;
+			return Reference{this, known->second};
+		}
+
+		auto file = std::make_unique<HexMappedFile>(filePath);
+		// Mappings are page aligned, the words are read in place
+		if (file->size() < sizeof(uint32_t) || file->size() % sizeof(uint32_t) != 0
+			|| reinterpret_cast<uintptr_t>(file->data()) % alignof(uint32_t) != 0
+			|| *reinterpret_cast<const uint32_t*>(file->data()) != spirvMagic) {
+			throw std::runtime_error("not a SPIR-V file: " + filePath);
+		}
+
+		uint64_t hash = hashCode(file->data(), file->size());
+		auto found = shaders.find(hash);
+		Shader *shader;
+		if (found != shaders.end()) {
+			// Same code under another path, its mapping is enough
+			shader = found->second.get();
+		} else {
+			auto created = std::make_unique<Shader>();
+			created->hash = hash;
+			created->file = std::move(file);
+
+			if (getShaderModuleCreateInfoIdentifier != nullptr) {
+				VkShaderModuleCreateInfo moduleInfo{};
+				moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+				moduleInfo.codeSize = created->codeSize();
+				moduleInfo.pCode = created->code();
+				VkShaderModuleIdentifierEXT identifier{};
+				identifier.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_IDENTIFIER_EXT;
+				getShaderModuleCreateInfoIdentifier(hexDevice.device(), &moduleInfo, &identifier);
+				created->identifier.assign(identifier.identifier, identifier.identifier + identifier.identifierSize);
+			}
+
+			shader = created.get();
+			shaders.emplace(hash, std::move(created));
+		}
+
+		shader->paths.push_back(filePath);
+		shadersByPath[filePath] = shader;
+		shader->references++;
+		return Reference{this, shader};
+	}
+
+	void HexShaderLibrary::release(Shader *shader) {
+		std::lock_guard<std::mutex> lock{mutex};
+		if (--shader->references > 0) return;
+
+		if (shader->module != VK_NULL_HANDLE) vkDestroyShaderModule(hexDevice.device(), shader->module, nullptr);
+		for (auto &path : shader->paths) shadersByPath.erase(path);
+		shaders.erase(shader->hash);
+	}
+
+	VkShaderModule HexShaderLibrary::getModule(Shader &shader) {
+		std::lock_guard<std::mutex> lock{mutex};
+		if (shader.module != VK_NULL_HANDLE) return shader.module;
+
+		VkShaderModuleCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		createInfo.codeSize = shader.codeSize();
+		createInfo.pCode = shader.code();
+
+		if (vkCreateShaderModule(hexDevice.device(), &createInfo, nullptr, &shader.module) != VK_SUCCESS) {
+			shader.module = VK_NULL_HANDLE;
+			throw std::runtime_error("Failed to create shader module");
+		}
+		return shader.module;
+	}
+
+	void HexShaderLibrary::setStageShader(Shader &shader, bool byIdentifier, VkPipelineShaderStageCreateInfo &stageInfo, StageSource &source) {
+		stageInfo.module = VK_NULL_HANDLE;
+		stageInfo.pNext = nullptr;
+
+		if (byIdentifier) {
+			assert(!shader.identifier.empty() && "No shader module identifiers on this device");
+			source.identifierInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_MODULE_IDENTIFIER_CREATE_INFO_EXT;
+			source.identifierInfo.identifierSize = static_cast<uint32_t>(shader.identifier.size());
+			source.identifierInfo.pIdentifier = shader.identifier.data();
+			stageInfo.pNext = &source.identifierInfo;
+		} else if (inlineCode) {
+			// Straight from the mapping, no module to create
+			source.moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+			source.moduleInfo.codeSize = shader.codeSize();
+			source.moduleInfo.pCode = shader.code();
+			stageInfo.pNext = &source.moduleInfo;
+		} else {
+			stageInfo.module = getModule(shader);
+		}
+	}
+}
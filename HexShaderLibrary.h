@@ -0,0 +1,96 @@
+#pragma once
+
+#include "HexMappedFile.h"
+#include "hex_device.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace hex {
+
+	// SPIR-V shared by the pipelines. A file is mapped once and checked, shaders with the same
+	// content are one shader, and its VkShaderModule is created once, only when the device
+	// can't take the code directly (VK_KHR_maintenance5). Shaders are released with their last
+	// reference, pipelines hold theirs only while being created.
+	// Thread safe, pipelines are compiled on worker threads.
+	class HexShaderLibrary {
+		public:
+		class Shader;
+
+		// Keeps a shader loaded, released on destruction
+		class Reference {
+			public:
+			Reference() = default;
+			~Reference() { reset(); }
+
+			Reference(Reference &&other) noexcept : library{other.library}, shader{other.shader} { other.shader = nullptr; }
+			Reference &operator=(Reference &&other) noexcept;
+			Reference(const Reference &) = delete;
+			Reference &operator=(const Reference &) = delete;
+
+			Shader *get() const { return shader; }
+			void reset();
+
+			private:
+			friend class HexShaderLibrary;
+			Reference(HexShaderLibrary *library, Shader *shader) : library{library}, shader{shader} {}
+
+			HexShaderLibrary *library = nullptr;
+			Shader *shader = nullptr;
+		};
+
+		// What a stage create info points to, kept alive until the pipeline is created
+		struct StageSource {
+			VkShaderModuleCreateInfo moduleInfo{};
+			VkPipelineShaderStageModuleIdentifierCreateInfoEXT identifierInfo{};
+		};
+
+		explicit HexShaderLibrary(HexDevice &device);
+		~HexShaderLibrary();
+
+		HexShaderLibrary(const HexShaderLibrary &) = delete;
+		HexShaderLibrary &operator=(const HexShaderLibrary &) = delete;
+
+		// Throws when the file is missing or isn't SPIR-V
+		Reference acquire(const std::string &filePath);
+
+		// Points the stage at the shader. By identifier, the pipeline needs
+		// VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT and is created again without
+		// identifiers on VK_PIPELINE_COMPILE_REQUIRED (not in the pipeline cache).
+		void setStageShader(Shader &shader, bool byIdentifier, VkPipelineShaderStageCreateInfo &stageInfo, StageSource &source);
+		// Worth trying first with a pipeline cache
+		bool hasIdentifiers() const { return getShaderModuleCreateInfoIdentifier != nullptr; }
+
+		private:
+		void release(Shader *shader);
+		VkShaderModule getModule(Shader &shader);
+
+		HexDevice &hexDevice;
+		bool inlineCode;
+		PFN_vkGetShaderModuleCreateInfoIdentifierEXT getShaderModuleCreateInfoIdentifier = nullptr;
+
+		std::mutex mutex;
+		// By content hash, paths map to the shader of their content
+		std::unordered_map<uint64_t, std::unique_ptr<Shader>> shaders;
+		std::unordered_map<std::string, Shader*> shadersByPath;
+	};
+
+	class HexShaderLibrary::Shader {
+		public:
+		uint64_t hash;
+		std::unique_ptr<HexMappedFile> file;
+		// Paths mapped to it, forgotten with the shader
+		std::vector<std::string> paths;
+		uint32_t references = 0;
+
+		VkShaderModule module = VK_NULL_HANDLE;
+		std::vector<uint8_t> identifier;
+
+		const uint32_t *code() const { return reinterpret_cast<const uint32_t*>(file->data()); }
+		size_t codeSize() const { return file->size(); }
+	};
+}
@@ -11,13 +11,13 @@
 
 namespace hex {
 
-HexSwapChain::HexSwapChain(HexDevice &deviceRef, VkExtent2D extent)
-    : device{deviceRef}, windowExtent{extent} {
+HexSwapChain::HexSwapChain(HexDevice &deviceRef, VkExtent2D extent, bool sampledDepth)
+    : device{deviceRef}, windowExtent{extent}, sampledDepth{sampledDepth} {
       init();
 }
 
-HexSwapChain::HexSwapChain(HexDevice &deviceRef, VkExtent2D extent, std::shared_ptr<HexSwapChain> previous) 
-  : device{deviceRef}, windowExtent{extent}, oldSwapChain{previous} {
+HexSwapChain::HexSwapChain(HexDevice &deviceRef, VkExtent2D extent, std::shared_ptr<HexSwapChain> previous, bool sampledDepth) 
+  : device{deviceRef}, windowExtent{extent}, sampledDepth{sampledDepth}, oldSwapChain{previous} {
       init();
 
       // clean up old swap chain since it's no longer needed
@@ -27,9 +27,20 @@ HexSwapChain::HexSwapChain(HexDevice &deviceRef, VkExtent2D extent, std::shared_
 void HexSwapChain::init() {
     createSwapChain();
     createImageViews();
-    createRenderPass();
     createDepthResources();
-    createFramebuffers();
+    // With dynamic rendering the renderer begins rendering on the image views, a resize
+    // recreates no render pass or framebuffers
+    if (!device.dynamicRenderingSupported()) {
+      // Pipelines, compiled or still queued, keep the render pass handle: it's handed over
+      // from the previous swap chain while the formats match
+      if (oldSwapChain != nullptr && oldSwapChain->renderPass != VK_NULL_HANDLE && compareSwapFormat(*oldSwapChain)) {
+        renderPass = oldSwapChain->renderPass;
+        oldSwapChain->renderPass = VK_NULL_HANDLE;
+      } else {
+        createRenderPass();
+      }
+      createFramebuffers();
+    }
     createSyncObjects();
 }
 
@@ -54,7 +65,9 @@ HexSwapChain::~HexSwapChain() {
     vkDestroyFramebuffer(device.device(), framebuffer, nullptr);
   }
 
-  vkDestroyRenderPass(device.device(), renderPass, nullptr);
+  if (renderPass != VK_NULL_HANDLE) {
+    vkDestroyRenderPass(device.device(), renderPass, nullptr);
+  }
 
   // cleanup synchronization objects
   for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
@@ -275,9 +288,11 @@ void HexSwapChain::createRenderPass() {
 }
 
 void HexSwapChain::createFramebuffers() {
-  swapChainFramebuffers.resize(imageCount());
-  for (size_t i = 0; i < imageCount(); i++) {
-    std::array<VkImageView, 2> attachments = {swapChainImageViews[i], depthImageViews[i]};
+  swapChainFramebuffers.resize(imageCount() * MAX_FRAMES_IN_FLIGHT);
+  for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
+    std::array<VkImageView, 2> attachments = {
+        swapChainImageViews[i / MAX_FRAMES_IN_FLIGHT],
+        depthImageViews[i % MAX_FRAMES_IN_FLIGHT]};
 
     VkExtent2D swapChainExtent = getSwapChainExtent();
     VkFramebufferCreateInfo framebufferInfo = {};
@@ -304,9 +319,11 @@ void HexSwapChain::createDepthResources() {
   swapChainDepthFormat = depthFormat;
   VkExtent2D swapChainExtent = getSwapChainExtent();
 
-  depthImages.resize(imageCount());
-  depthImageMemorys.resize(imageCount());
-  depthImageViews.resize(imageCount());
+  // Cleared and discarded every frame: transient, and lazily allocated memory where the
+  // device has it (tilers keep it in tile memory). Unless sampled, then it must be stored.
+  depthImages.resize(MAX_FRAMES_IN_FLIGHT);
+  depthImageMemorys.resize(MAX_FRAMES_IN_FLIGHT);
+  depthImageViews.resize(MAX_FRAMES_IN_FLIGHT);
 
   for (int i = 0; i < depthImages.size(); i++) {
     VkImageCreateInfo imageInfo{};
@@ -320,7 +337,8 @@ void HexSwapChain::createDepthResources() {
     imageInfo.format = depthFormat;
     imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
     imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+        (sampledDepth ? VK_IMAGE_USAGE_SAMPLED_BIT : VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT);
     imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     imageInfo.flags = 0;
@@ -329,7 +347,8 @@ void HexSwapChain::createDepthResources() {
         imageInfo,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
         depthImages[i],
-        depthImageMemorys[i]);
+        depthImageMemorys[i],
+        sampledDepth ? 0 : VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
 
     VkImageViewCreateInfo viewInfo{};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -16,16 +16,29 @@ class HexSwapChain {
  public:
   static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
 
-  HexSwapChain(HexDevice &deviceRef, VkExtent2D windowExtent);
-  HexSwapChain(HexDevice &deviceRef, VkExtent2D windowExtent, std::shared_ptr<HexSwapChain> previous);
+  // Sampled depth buffers can be read after the scene pass (depth pyramids), they're then neither
+  // transient nor lazily allocated
+  HexSwapChain(HexDevice &deviceRef, VkExtent2D windowExtent, bool sampledDepth = false);
+  HexSwapChain(HexDevice &deviceRef, VkExtent2D windowExtent, std::shared_ptr<HexSwapChain> previous, bool sampledDepth = false);
   ~HexSwapChain();
 
   HexSwapChain(const HexSwapChain &) = delete;
   HexSwapChain& operator=(const HexSwapChain &) = delete;
 
-  VkFramebuffer getFrameBuffer(int index) { return swapChainFramebuffers[index]; }
+  // Without dynamic rendering only, VK_NULL_HANDLE otherwise. One per image and frame in
+  // flight, the depth buffer is the frame's.
+  VkFramebuffer getFrameBuffer(int imageIndex, int frameIndex) {
+    return swapChainFramebuffers[imageIndex * MAX_FRAMES_IN_FLIGHT + frameIndex];
+  }
+  // Handed over to the swap chain recreated from this one, so it lives as long as the renderer
   VkRenderPass getRenderPass() { return renderPass; }
+  bool usesDynamicRendering() const { return renderPass == VK_NULL_HANDLE; }
+  VkImage getImage(int index) { return swapChainImages[index]; }
   VkImageView getImageView(int index) { return swapChainImageViews[index]; }
+  // Per frame in flight, not per image: only the frames in flight draw at once
+  VkImage getDepthImage(int frameIndex) { return depthImages[frameIndex]; }
+  VkImageView getDepthImageView(int frameIndex) { return depthImageViews[frameIndex]; }
+  VkFormat getSwapChainDepthFormat() { return swapChainDepthFormat; }
   size_t imageCount() { return swapChainImages.size(); }
   VkFormat getSwapChainImageFormat() { return swapChainImageFormat; }
   VkExtent2D getSwapChainExtent() { return swapChainExtent; }
@@ -41,8 +54,8 @@ class HexSwapChain {
   VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex);
 
   bool compareSwapFormat(const HexSwapChain &swapChain) const {
-    return swapChain.swapChainDepthFormat == swapChainDepthFormat && 
-      swapChain.swapChainImageFormat && swapChainImageFormat;
+    return swapChain.swapChainDepthFormat == swapChainDepthFormat &&
+      swapChain.swapChainImageFormat == swapChainImageFormat;
   }
 
  private:
@@ -66,7 +79,7 @@ class HexSwapChain {
   VkExtent2D swapChainExtent;
 
   std::vector<VkFramebuffer> swapChainFramebuffers;
-  VkRenderPass renderPass;
+  VkRenderPass renderPass = VK_NULL_HANDLE;
 
   std::vector<VkImage> depthImages;
   std::vector<VkDeviceMemory> depthImageMemorys;
@@ -76,6 +89,7 @@ class HexSwapChain {
 
   HexDevice &device;
   VkExtent2D windowExtent;
+  bool sampledDepth;
 
   VkSwapchainKHR swapChain;
   std::shared_ptr<HexSwapChain> oldSwapChain;
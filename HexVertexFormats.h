@@ -0,0 +1,134 @@
+#pragma once
+
+#include "hex_device.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace hex {
+
+	// Vertex layouts a model can be uploaded with, every format feeds the same shader locations:
+	// 0 position, 1 color
+	enum class HexVertexFormat {
+		Float,
+		Quantized
+	};
+
+	constexpr uint32_t VERTEX_FORMAT_COUNT = 2;
+
+	// Full precision vertex (24 bytes), also the layout meshes are built and cached with
+	struct FloatVertex {
+		glm::vec3 position;
+		glm::vec3 color;
+	};
+
+	// The arena stores every format as two streams at the same vertex offsets: positions at
+	// binding 0, the other attributes at binding 1. Depth only passes bind the positions alone.
+
+	// Float format (12 + 12 bytes)
+	struct FloatPosition {
+		glm::vec3 position;
+	};
+
+	struct FloatAttributes {
+		glm::vec3 color;
+	};
+
+	// Quantized format (8 + 4 bytes).
+	// Position is 16 bit normalized inside the model bounds, the model transform maps it back,
+	// color is RGBA8.
+	struct QuantizedPosition {
+		uint16_t position[4];
+	};
+
+	struct QuantizedAttributes {
+		uint8_t color[4];
+	};
+
+	static_assert(sizeof(QuantizedPosition) == 8 && sizeof(QuantizedAttributes) == 4, "Quantized streams must stay tightly packed");
+
+	// Both streams of a format, the vertex input of passes reading the colors
+	struct FloatStreams {};
+	struct QuantizedStreams {};
+
+	// Compile time vertex input descriptions of a vertex type, used by the pipeline config
+	template <typename VertexT>
+	struct VertexLayout;
+
+	template <>
+	struct VertexLayout<FloatVertex> {
+		static constexpr HexVertexFormat format = HexVertexFormat::Float;
+
+		static constexpr std::array<VkVertexInputBindingDescription, 1> bindings{{
+			{0, sizeof(FloatVertex), VK_VERTEX_INPUT_RATE_VERTEX}
+		}};
+
+		// {location, binding, format, offset}
+		static constexpr std::array<VkVertexInputAttributeDescription, 2> attributes{{
+			{0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(FloatVertex, position)},
+			{1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(FloatVertex, color)}
+		}};
+	};
+
+	template <>
+	struct VertexLayout<FloatStreams> {
+		static constexpr HexVertexFormat format = HexVertexFormat::Float;
+
+		static constexpr std::array<VkVertexInputBindingDescription, 2> bindings{{
+			{0, sizeof(FloatPosition), VK_VERTEX_INPUT_RATE_VERTEX},
+			{1, sizeof(FloatAttributes), VK_VERTEX_INPUT_RATE_VERTEX}
+		}};
+
+		static constexpr std::array<VkVertexInputAttributeDescription, 2> attributes{{
+			{0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(FloatPosition, position)},
+			{1, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(FloatAttributes, color)}
+		}};
+	};
+
+	template <>
+	struct VertexLayout<QuantizedStreams> {
+		static constexpr HexVertexFormat format = HexVertexFormat::Quantized;
+
+		static constexpr std::array<VkVertexInputBindingDescription, 2> bindings{{
+			{0, sizeof(QuantizedPosition), VK_VERTEX_INPUT_RATE_VERTEX},
+			{1, sizeof(QuantizedAttributes), VK_VERTEX_INPUT_RATE_VERTEX}
+		}};
+
+		// Normalized formats are expanded to floats by the input assembler, shaders don't change
+		static constexpr std::array<VkVertexInputAttributeDescription, 2> attributes{{
+			{0, 0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(QuantizedPosition, position)},
+			{1, 1, VK_FORMAT_R8G8B8A8_UNORM, offsetof(QuantizedAttributes, color)}
+		}};
+	};
+
+	template <>
+	struct VertexLayout<FloatPosition> {
+		static constexpr HexVertexFormat format = HexVertexFormat::Float;
+
+		static constexpr std::array<VkVertexInputBindingDescription, 1> bindings{{
+			{0, sizeof(FloatPosition), VK_VERTEX_INPUT_RATE_VERTEX}
+		}};
+
+		static constexpr std::array<VkVertexInputAttributeDescription, 1> attributes{{
+			{0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(FloatPosition, position)}
+		}};
+	};
+
+	template <>
+	struct VertexLayout<QuantizedPosition> {
+		static constexpr HexVertexFormat format = HexVertexFormat::Quantized;
+
+		static constexpr std::array<VkVertexInputBindingDescription, 1> bindings{{
+			{0, sizeof(QuantizedPosition), VK_VERTEX_INPUT_RATE_VERTEX}
+		}};
+
+		static constexpr std::array<VkVertexInputAttributeDescription, 1> attributes{{
+			{0, 0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(QuantizedPosition, position)}
+		}};
+	};
+}
@@ -0,0 +1,433 @@
+#include "HexVolumeLoader.h"
+#include "HexParallel.h"
+#include "HexParsing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+namespace hex {
+
+	namespace {
+
+		// VTK cell types with hexahedron corners
+		const int64_t vtkVoxel = 11;
+		const int64_t vtkHexahedron = 12;
+		const int64_t vtkQuadraticHexahedron = 25;
+		const int64_t vtkTriquadraticHexahedron = 29;
+
+		// Voxel corners are ordered like a grid (x fastest), hexahedra go around each quad
+		const uint32_t voxelToHexahedron[HexVolumeMesh::CELL_CORNERS] = {0, 1, 3, 2, 4, 5, 7, 6};
+
+		inline bool isBlank(char c) { return isSpace(c) || c == '\n'; }
+
+		const char *skipBlanks(const char *p, const char *end) {
+			while (p < end && isBlank(*p)) p++;
+			return p;
+		}
+
+		// Next whitespace separated word, '#' comments run to the end of the line.
+		// Returns an empty word at the end of the file.
+		std::string readWord(const char *&p, const char *end) {
+			while (true) {
+				p = skipBlanks(p, end);
+				if (p < end && *p == '#') {
+					p = nextLine(p, end);
+					continue;
+				}
+				break;
+			}
+			const char *wordEnd = skipToken(p, end);
+			std::string word{p, wordEnd};
+			p = wordEnd;
+			return word;
+		}
+
+		std::string upperCase(std::string word) {
+			std::transform(word.begin(), word.end(), word.begin(), [](unsigned char c) { return std::toupper(c); });
+			return word;
+		}
+
+		// METADATA blocks (array information, component names) end with an empty line
+		const char *skipMetadata(const char *p, const char *end) {
+			p = nextLine(p, end);
+			while (p < end) {
+				const char *q = skipSpaces(p, end);
+				p = nextLine(q, end);
+				if (q >= end || *q == '\n' || *q == '\r') break;
+			}
+			return p;
+		}
+
+		// Upper case keyword, METADATA blocks between sections and arrays are skipped
+		std::string readVtkKeyword(const char *&p, const char *end) {
+			while (true) {
+				std::string keyword = upperCase(readWord(p, end));
+				if (keyword != "METADATA") return keyword;
+				p = skipMetadata(p, end);
+			}
+		}
+
+		size_t readCount(const char *&p, const char *end, const std::string &filepath) {
+			std::string word = readWord(p, end);
+			int64_t value;
+			const char *last = word.data() + word.size();
+			if (parseInt(word.data(), last, value) != last || value < 0) {
+				throw std::runtime_error("invalid count '" + word + "' in: " + filepath);
+			}
+			return static_cast<size_t>(value);
+		}
+
+		// Number arrays run until the next line starting with a keyword
+		const char *numbersEnd(const char *p, const char *end) {
+			while (p < end) {
+				const char *q = skipSpaces(p, end);
+				if (q < end && (std::isalpha(static_cast<unsigned char>(*q)) || *q == '#')) return p;
+				p = nextLine(q, end);
+			}
+			return end;
+		}
+
+		inline const char *parseValue(const char *p, const char *end, double &out) { return parseDouble(p, end, out); }
+		inline const char *parseValue(const char *p, const char *end, int64_t &out) { return parseInt(p, end, out); }
+
+		// Parse exactly count ascii numbers from p, in parallel, returns the position after them
+		template <typename T>
+		const char *readAsciiValues(const char *p, const char *end, size_t count, std::vector<T> &values, const std::string &filepath) {
+			const char *valuesEnd = numbersEnd(p, end);
+			auto ranges = splitLines(p, valuesEnd, chunkCountForSize(valuesEnd - p));
+			std::vector<std::vector<T>> chunks(ranges.size());
+
+			parallelTasks(ranges.size(), [&](size_t i) {
+				const char *q = ranges[i].first;
+				const char *last = ranges[i].second;
+				std::vector<T> &chunk = chunks[i];
+				chunk.reserve((last - q) / 4);
+				while ((q = skipBlanks(q, last)) < last) {
+					T value;
+					q = parseValue(q, last, value);
+					if (!q) throw std::runtime_error("invalid number in: " + filepath);
+					chunk.push_back(value);
+				}
+			});
+
+			size_t total = 0;
+			for (auto &chunk : chunks) total += chunk.size();
+			if (total != count) {
+				throw std::runtime_error("expected " + std::to_string(count) + " values, found " + std::to_string(total) + " in: " + filepath);
+			}
+
+			values.resize(count);
+			std::vector<size_t> chunkBase(chunks.size() + 1, 0);
+			for (size_t i = 0; i < chunks.size(); i++) chunkBase[i + 1] = chunkBase[i] + chunks[i].size();
+			parallelTasks(chunks.size(), [&](size_t i) {
+				std::copy(chunks[i].begin(), chunks[i].end(), values.begin() + chunkBase[i]);
+				chunks[i] = std::vector<T>{};
+			});
+
+			return valuesEnd;
+		}
+
+		// Big endian binary array of the given VTK data type
+		template <typename T>
+		const char *readBinaryValues(const char *p, const char *end, size_t count, const std::string &type, std::vector<T> &values, const std::string &filepath) {
+			uint16_t one = 1;
+			bool swapBytes = *reinterpret_cast<uint8_t*>(&one) == 1;
+
+			// float, double, or an integer of the given size
+			bool isFloat = type == "float";
+			bool isDouble = type == "double";
+			size_t size;
+			if (isFloat || type == "int" || type == "vtktypeint32" || type == "unsigned_int" || type == "vtktypeuint32") size = 4;
+			else if (isDouble || type == "long" || type == "vtktypeint64" || type == "unsigned_long" || type == "vtktypeuint64") size = 8;
+			else throw std::runtime_error("unsupported VTK data type '" + type + "' in: " + filepath);
+
+			checkRange(p + count * size, end, filepath);
+			values.resize(count);
+			parallelFor(count, 1 << 16, [&](size_t begin, size_t last) {
+				for (size_t i = begin; i < last; i++) {
+					const char *value = p + i * size;
+					if (isFloat) values[i] = static_cast<T>(readBinary<float>(value, swapBytes));
+					else if (isDouble) values[i] = static_cast<T>(readBinary<double>(value, swapBytes));
+					else if (size == 4) values[i] = static_cast<T>(readBinary<int32_t>(value, swapBytes));
+					else values[i] = static_cast<T>(readBinary<int64_t>(value, swapBytes));
+				}
+			});
+
+			// Binary blocks end with a new line
+			return nextLine(p + count * size, end);
+		}
+
+		template <typename T>
+		const char *readValues(const char *p, const char *end, bool binary, size_t count, const std::string &type, std::vector<T> &values, const std::string &filepath) {
+			if (binary) return readBinaryValues(nextLine(p, end), end, count, type, values, filepath);
+			return readAsciiValues(p, end, count, values, filepath);
+		}
+
+		void logSkippedCells(size_t skipped, const std::string &filepath) {
+			if (skipped > 0) {
+				std::cerr << "Skipped " << skipped << " cells that are not hexahedra in: " << filepath << std::endl;
+			}
+		}
+
+		std::string lowerExtension(const std::string &filepath) {
+			std::string extension;
+			auto dot = filepath.find_last_of('.');
+			if (dot != std::string::npos) {
+				extension = filepath.substr(dot + 1);
+				std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+			}
+			return extension;
+		}
+	}
+
+	bool HexVolumeLoader::isVolumeFile(const std::string &filepath) {
+		std::string extension = lowerExtension(filepath);
+		return extension == "mesh" || extension == "vtk";
+	}
+
+	HexVolumeMesh HexVolumeLoader::load(const HexMappedFile &file) {
+		const std::string &filepath = file.path();
+		std::string extension = lowerExtension(filepath);
+
+		if (extension == "mesh") return loadMedit(file);
+		if (extension == "vtk") return loadVtk(file);
+		throw std::runtime_error("unsupported volume mesh file format: " + filepath);
+	}
+
+	HexVolumeMesh HexVolumeLoader::loadMedit(const HexMappedFile &file) {
+		const char *p = file.data();
+		const char *end = p + file.size();
+		const std::string &filepath = file.path();
+
+		HexVolumeMesh mesh{};
+		std::vector<double> vertexValues;
+		std::vector<int64_t> hexahedronValues;
+		size_t vertexCount = 0;
+		size_t hexahedronCount = 0;
+		size_t skipped = 0;
+		bool hasVersion = false;
+
+		while (true) {
+			std::string keyword = readWord(p, end);
+			if (keyword.empty() || keyword == "End") break;
+
+			if (keyword == "MeshVersionFormatted") {
+				readCount(p, end, filepath);
+				hasVersion = true;
+			} else if (keyword == "Dimension") {
+				if (readCount(p, end, filepath) != 3) {
+					throw std::runtime_error("MEDIT mesh is not 3D: " + filepath);
+				}
+			} else {
+				// Every other section is a record count followed by one record per line
+				size_t count = readCount(p, end, filepath);
+				p = nextLine(p, end);
+				if (keyword == "Vertices") {
+					vertexCount = count;
+					p = readAsciiValues(p, end, count * 4, vertexValues, filepath);
+				} else if (keyword == "Hexahedra") {
+					hexahedronCount = count;
+					p = readAsciiValues(p, end, count * 9, hexahedronValues, filepath);
+				} else {
+					if (keyword == "Tetrahedra" || keyword == "Prisms" || keyword == "Pyramids") skipped += count;
+					p = numbersEnd(p, end);
+				}
+			}
+		}
+
+		if (!hasVersion) {
+			throw std::runtime_error("not an ascii MEDIT mesh: " + filepath);
+		}
+		if (vertexCount > std::numeric_limits<uint32_t>::max()) {
+			throw std::runtime_error("too many points for 32 bit indices in: " + filepath);
+		}
+
+		// Records are x y z ref and 8 one based indices then ref
+		mesh.points.resize(vertexCount);
+		parallelFor(vertexCount, 1 << 14, [&](size_t begin, size_t last) {
+			for (size_t i = begin; i < last; i++) {
+				const double *record = vertexValues.data() + i * 4;
+				mesh.points[i] = glm::vec3{static_cast<float>(record[0]), static_cast<float>(record[1]), static_cast<float>(record[2])};
+			}
+		});
+
+		// Indices are checked before they're narrowed to 32 bits, wrapped ones could look valid
+		std::atomic<bool> invalidIndex{false};
+		int64_t maxIndex = static_cast<int64_t>(vertexCount);
+		mesh.cells.resize(hexahedronCount * HexVolumeMesh::CELL_CORNERS);
+		mesh.cellLabels.resize(hexahedronCount);
+		parallelFor(hexahedronCount, 1 << 14, [&](size_t begin, size_t last) {
+			for (size_t i = begin; i < last; i++) {
+				const int64_t *record = hexahedronValues.data() + i * 9;
+				for (uint32_t c = 0; c < HexVolumeMesh::CELL_CORNERS; c++) {
+					if (record[c] < 1 || record[c] > maxIndex) {
+						invalidIndex = true;
+						return;
+					}
+					mesh.cells[i * HexVolumeMesh::CELL_CORNERS + c] = static_cast<uint32_t>(record[c] - 1);
+				}
+				mesh.cellLabels[i] = static_cast<int32_t>(record[8]);
+			}
+		});
+		if (invalidIndex) {
+			throw std::runtime_error("point index out of range in: " + filepath);
+		}
+
+		logSkippedCells(skipped, filepath);
+		return mesh;
+	}
+
+	HexVolumeMesh HexVolumeLoader::loadVtk(const HexMappedFile &file) {
+		const char *p = file.data();
+		const char *end = p + file.size();
+		const std::string &filepath = file.path();
+
+		// Header: identifier line, title line, then the data format
+		const char *line = nextLine(p, end);
+		std::string identifier{p, line};
+		if (identifier.compare(0, 5, "# vtk") != 0) {
+			throw std::runtime_error("not a VTK legacy file: " + filepath);
+		}
+		p = nextLine(line, end);
+		std::string format = upperCase(readWord(p, end));
+		if (format != "ASCII" && format != "BINARY") {
+			throw std::runtime_error("unknown VTK format '" + format + "' in: " + filepath);
+		}
+		bool binary = format == "BINARY";
+
+		std::vector<double> coordinates;
+		// Legacy layout: count then indices for each cell, 5.1: offsets and connectivity
+		std::vector<int64_t> cellValues;
+		std::vector<int64_t> offsets;
+		std::vector<int64_t> types;
+		size_t pointCount = 0;
+		size_t cellCount = 0;
+		bool hasOffsets = false;
+
+		while (true) {
+			std::string keyword = readVtkKeyword(p, end);
+			if (keyword.empty()) break;
+
+			if (keyword == "DATASET") {
+				std::string dataset = upperCase(readWord(p, end));
+				if (dataset != "UNSTRUCTURED_GRID") {
+					throw std::runtime_error("VTK dataset is not an unstructured grid: " + filepath);
+				}
+			} else if (keyword == "POINTS") {
+				pointCount = readCount(p, end, filepath);
+				std::string type = readWord(p, end);
+				p = readValues(p, end, binary, pointCount * 3, type, coordinates, filepath);
+			} else if (keyword == "CELLS") {
+				size_t first = readCount(p, end, filepath);
+				size_t second = readCount(p, end, filepath);
+				const char *q = p;
+				if (readVtkKeyword(q, end) == "OFFSETS") {
+					// 5.1: OFFSETS type, cell count + 1 values, then CONNECTIVITY type
+					if (first == 0) {
+						throw std::runtime_error("invalid VTK OFFSETS in: " + filepath);
+					}
+					hasOffsets = true;
+					cellCount = first - 1;
+					std::string type = readWord(q, end);
+					p = readValues(q, end, binary, first, type, offsets, filepath);
+					if (readVtkKeyword(p, end) != "CONNECTIVITY") {
+						throw std::runtime_error("missing VTK CONNECTIVITY in: " + filepath);
+					}
+					type = readWord(p, end);
+					p = readValues(p, end, binary, second, type, cellValues, filepath);
+				} else {
+					cellCount = first;
+					p = readValues(p, end, binary, second, "int", cellValues, filepath);
+				}
+			} else if (keyword == "CELL_TYPES") {
+				size_t count = readCount(p, end, filepath);
+				p = readValues(p, end, binary, count, "int", types, filepath);
+			} else if (keyword == "CELL_DATA" || keyword == "POINT_DATA" || keyword == "FIELD") {
+				// Attributes come after the geometry, not loaded
+				break;
+			} else {
+				throw std::runtime_error("unknown VTK keyword '" + keyword + "' in: " + filepath);
+			}
+		}
+
+		if (types.size() != cellCount) {
+			throw std::runtime_error("VTK cell types don't match the cells in: " + filepath);
+		}
+		if (pointCount > std::numeric_limits<uint32_t>::max()) {
+			throw std::runtime_error("too many points for 32 bit indices in: " + filepath);
+		}
+
+		HexVolumeMesh mesh{};
+		mesh.points.resize(pointCount);
+		parallelFor(pointCount, 1 << 14, [&](size_t begin, size_t last) {
+			for (size_t i = begin; i < last; i++) {
+				const double *xyz = coordinates.data() + i * 3;
+				mesh.points[i] = glm::vec3{static_cast<float>(xyz[0]), static_cast<float>(xyz[1]), static_cast<float>(xyz[2])};
+			}
+		});
+
+		// Where the indices of each cell start, legacy cells are found walking the counts
+		if (!hasOffsets) {
+			offsets.resize(cellCount + 1);
+			size_t position = 0;
+			for (size_t i = 0; i < cellCount; i++) {
+				if (position >= cellValues.size() || cellValues[position] < 0) {
+					throw std::runtime_error("invalid VTK cell in: " + filepath);
+				}
+				offsets[i] = static_cast<int64_t>(position + 1);
+				position += cellValues[position] + 1;
+			}
+			offsets[cellCount] = static_cast<int64_t>(position + 1);
+			if (position != cellValues.size()) {
+				throw std::runtime_error("invalid VTK cells in: " + filepath);
+			}
+		}
+
+		// Cells kept in file order, output slots come from a prefix sum over hexahedra
+		std::vector<uint32_t> firstHexahedron(cellCount + 1, 0);
+		for (size_t i = 0; i < cellCount; i++) {
+			int64_t type = types[i];
+			bool kept = type == vtkVoxel || type == vtkHexahedron || type == vtkQuadraticHexahedron || type == vtkTriquadraticHexahedron;
+			firstHexahedron[i + 1] = firstHexahedron[i] + (kept ? 1 : 0);
+		}
+		size_t hexahedronCount = firstHexahedron[cellCount];
+
+		// Indices are checked before they're narrowed to 32 bits, wrapped ones could look valid
+		std::atomic<bool> invalidCell{false};
+		int64_t maxIndex = static_cast<int64_t>(pointCount);
+		mesh.cells.resize(hexahedronCount * HexVolumeMesh::CELL_CORNERS);
+		parallelFor(cellCount, 1 << 14, [&](size_t begin, size_t last) {
+			for (size_t i = begin; i < last; i++) {
+				if (firstHexahedron[i + 1] == firstHexahedron[i]) continue;
+				// Legacy offsets point after the count, 5.1 offsets at the first index
+				int64_t first = offsets[i];
+				int64_t next = hasOffsets ? offsets[i + 1] : offsets[i + 1] - 1;
+				if (first < 0 || next - first < HexVolumeMesh::CELL_CORNERS || static_cast<size_t>(next) > cellValues.size()) {
+					invalidCell = true;
+					return;
+				}
+
+				uint32_t *corners = mesh.cells.data() + static_cast<size_t>(firstHexahedron[i]) * HexVolumeMesh::CELL_CORNERS;
+				bool voxel = types[i] == vtkVoxel;
+				for (uint32_t c = 0; c < HexVolumeMesh::CELL_CORNERS; c++) {
+					int64_t index = cellValues[first + (voxel ? voxelToHexahedron[c] : c)];
+					if (index < 0 || index >= maxIndex) {
+						invalidCell = true;
+						return;
+					}
+					corners[c] = static_cast<uint32_t>(index);
+				}
+			}
+		});
+		if (invalidCell) {
+			throw std::runtime_error("invalid VTK hexahedron or point index out of range in: " + filepath);
+		}
+
+		logSkippedCells(cellCount - hexahedronCount, filepath);
+		return mesh;
+	}
+}
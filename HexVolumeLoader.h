@@ -0,0 +1,26 @@
+#pragma once
+
+#include "HexMappedFile.h"
+#include "HexVolumeMesh.h"
+
+#include <string>
+
+namespace hex {
+
+	// Loads hexahedral volume meshes from MEDIT (.mesh, ascii) and legacy VTK unstructured
+	// grid (.vtk, ascii / binary, 4.x and 5.1 cell layouts) files. Number arrays are split
+	// in line aligned chunks and parsed on all cores like the surface loaders.
+	// Cells other than hexahedra are skipped, voxels are reordered to hexahedra and
+	// higher order hexahedra keep their 8 corners.
+	class HexVolumeLoader {
+		public:
+		// From the file extension, volume files load their boundary as a HexModel
+		static bool isVolumeFile(const std::string &filepath);
+
+		// Pick the parser from the file extension (.mesh / .vtk)
+		static HexVolumeMesh load(const HexMappedFile &file);
+
+		static HexVolumeMesh loadMedit(const HexMappedFile &file);
+		static HexVolumeMesh loadVtk(const HexMappedFile &file);
+	};
+}
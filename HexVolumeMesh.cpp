@@ -0,0 +1,155 @@
+#include "HexVolumeMesh.h"
+#include "HexParallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <memory>
+
+namespace hex {
+
+	namespace {
+		const uint32_t unassigned = ~0u;
+
+		// Color given to boundary vertices, volume files don't carry one
+		const glm::vec3 boundaryColor{.9f, .9f, .9f};
+	}
+
+	bool HexVolumeMesh::isInverted(uint32_t cell) const {
+		const uint32_t *corners = cells.data() + static_cast<size_t>(cell) * CELL_CORNERS;
+		const glm::vec3 &origin = points[corners[0]];
+		glm::vec3 u = points[corners[1]] - origin;
+		glm::vec3 v = points[corners[3]] - origin;
+		glm::vec3 w = points[corners[4]] - origin;
+		return glm::dot(glm::cross(u, v), w) < 0.f;
+	}
+
+	std::array<uint32_t, 4> HexVolumeMesh::faceCorners(uint32_t cell, uint32_t face) const {
+		const uint32_t *corners = cells.data() + static_cast<size_t>(cell) * CELL_CORNERS;
+		const auto &local = FACE_CORNERS[face];
+		std::array<uint32_t, 4> result{corners[local[0]], corners[local[1]], corners[local[2]], corners[local[3]]};
+		if (isInverted(cell)) std::swap(result[1], result[3]);
+		return result;
+	}
+
+	std::vector<uint32_t> HexVolumeMesh::computeFaceNeighbors() const {
+		assert(cells.size() % CELL_CORNERS == 0 && "Cells must have 8 corners");
+
+		size_t faceCount = static_cast<size_t>(cellCount()) * CELL_FACES;
+		size_t pointCount = points.size();
+
+		// Face f of cell c is face c * CELL_FACES + f. Matching ignores the orientation.
+		auto faceKey = [&](size_t face) {
+			const uint32_t *corners = cells.data() + face / CELL_FACES * CELL_CORNERS;
+			const auto &local = FACE_CORNERS[face % CELL_FACES];
+			std::array<uint32_t, 4> key{corners[local[0]], corners[local[1]], corners[local[2]], corners[local[3]]};
+			std::sort(key.begin(), key.end());
+			return key;
+		};
+
+		// Count the faces of each bucket, then scatter face ids into buckets
+		std::unique_ptr<std::atomic<uint32_t>[]> cursors{new std::atomic<uint32_t>[pointCount]};
+		parallelFor(pointCount, 1 << 16, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) cursors[i].store(0, std::memory_order_relaxed);
+		});
+		parallelFor(faceCount, 1 << 14, [&](size_t begin, size_t end) {
+			for (size_t face = begin; face < end; face++) {
+				cursors[faceKey(face)[0]].fetch_add(1, std::memory_order_relaxed);
+			}
+		});
+
+		std::vector<size_t> bucketBegin(pointCount + 1, 0);
+		for (size_t i = 0; i < pointCount; i++) {
+			bucketBegin[i + 1] = bucketBegin[i] + cursors[i].load(std::memory_order_relaxed);
+			cursors[i].store(0, std::memory_order_relaxed);
+		}
+
+		std::vector<uint32_t> bucketFaces(faceCount);
+		parallelFor(faceCount, 1 << 14, [&](size_t begin, size_t end) {
+			for (size_t face = begin; face < end; face++) {
+				uint32_t bucket = faceKey(face)[0];
+				uint32_t slot = cursors[bucket].fetch_add(1, std::memory_order_relaxed);
+				bucketFaces[bucketBegin[bucket] + slot] = static_cast<uint32_t>(face);
+			}
+		});
+		cursors.reset();
+
+		// Buckets are tiny (faces around one point), compare every pair
+		std::vector<uint32_t> neighbors(faceCount, NO_NEIGHBOR);
+		parallelFor(pointCount, 1 << 12, [&](size_t begin, size_t end) {
+			std::vector<std::array<uint32_t, 4>> keys;
+			for (size_t bucket = begin; bucket < end; bucket++) {
+				size_t first = bucketBegin[bucket];
+				size_t last = bucketBegin[bucket + 1];
+
+				keys.clear();
+				for (size_t i = first; i < last; i++) keys.push_back(faceKey(bucketFaces[i]));
+
+				for (size_t i = 0; i < keys.size(); i++) {
+					for (size_t j = 0; j < keys.size(); j++) {
+						if (j != i && keys[j] == keys[i]) {
+							neighbors[bucketFaces[first + i]] = bucketFaces[first + j] / CELL_FACES;
+							break;
+						}
+					}
+				}
+			}
+		});
+
+		return neighbors;
+	}
+
+	HexVolumeMesh::Boundary HexVolumeMesh::extractBoundary() const {
+		return extractBoundary(computeFaceNeighbors());
+	}
+
+	HexVolumeMesh::Boundary HexVolumeMesh::extractBoundary(const std::vector<uint32_t> &faceNeighbors) const {
+		assert(faceNeighbors.size() == static_cast<size_t>(cellCount()) * CELL_FACES && "One neighbor per cell face");
+
+		Boundary boundary{};
+		size_t boundaryCount = std::count(faceNeighbors.begin(), faceNeighbors.end(), NO_NEIGHBOR);
+		boundary.quads.reserve(boundaryCount * 4);
+		boundary.faceCells.reserve(boundaryCount);
+
+		for (size_t face = 0; face < faceNeighbors.size(); face++) {
+			if (faceNeighbors[face] != NO_NEIGHBOR) continue;
+			uint32_t cell = static_cast<uint32_t>(face / CELL_FACES);
+			auto corners = faceCorners(cell, static_cast<uint32_t>(face % CELL_FACES));
+			boundary.quads.insert(boundary.quads.end(), corners.begin(), corners.end());
+			boundary.faceCells.push_back(cell);
+		}
+
+		return boundary;
+	}
+
+	HexModel::Builder HexVolumeMesh::buildBoundaryModel(const Boundary &boundary) const {
+		HexModel::Builder builder{};
+
+		// Keep the points used by the boundary, in first use order
+		std::vector<uint32_t> remap(points.size(), unassigned);
+		builder.indices.reserve(boundary.faceCells.size() * 6);
+		builder.triangleCells.reserve(boundary.faceCells.size() * 2);
+
+		auto vertexOf = [&](uint32_t point) {
+			if (remap[point] == unassigned) {
+				remap[point] = static_cast<uint32_t>(builder.vertices.size());
+				builder.vertices.push_back({points[point], boundaryColor});
+			}
+			return remap[point];
+		};
+
+		for (size_t face = 0; face < boundary.faceCells.size(); face++) {
+			const uint32_t *quad = boundary.quads.data() + face * 4;
+			uint32_t a = vertexOf(quad[0]);
+			uint32_t b = vertexOf(quad[1]);
+			uint32_t c = vertexOf(quad[2]);
+			uint32_t d = vertexOf(quad[3]);
+
+			builder.indices.insert(builder.indices.end(), {a, b, c, c, d, a});
+			builder.triangleCells.push_back(boundary.faceCells[face]);
+			builder.triangleCells.push_back(boundary.faceCells[face]);
+		}
+
+		return builder;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "HexModel.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace hex {
+
+	// Hexahedral volume mesh. Corners follow the VTK_HEXAHEDRON order: 0-3 one quad, 4-7 the
+	// opposite quad, corner i + 4 linked to corner i. Cells may come with either orientation,
+	// faces are flipped for cells with a negative volume.
+	class HexVolumeMesh {
+		public:
+		static constexpr uint32_t CELL_CORNERS = 8;
+		static constexpr uint32_t CELL_FACES = 6;
+		// Neighbor of a face on the boundary
+		static constexpr uint32_t NO_NEIGHBOR = ~0u;
+
+		// Corners of each cell face, counter clockwise seen from outside a positive cell
+		static constexpr std::array<std::array<uint8_t, 4>, CELL_FACES> FACE_CORNERS{{
+			{0, 3, 2, 1},
+			{4, 5, 6, 7},
+			{0, 1, 5, 4},
+			{1, 2, 6, 5},
+			{2, 3, 7, 6},
+			{3, 0, 4, 7}
+		}};
+
+		// Faces of the volume that belong to a single cell
+		struct Boundary {
+			// Point indices of each face, 4 per face, outward facing
+			std::vector<uint32_t> quads;
+			// Source cell of each face
+			std::vector<uint32_t> faceCells;
+		};
+
+		std::vector<glm::vec3> points;
+		// CELL_CORNERS point indices per cell
+		std::vector<uint32_t> cells;
+		// Optional integer label per cell (MEDIT reference), empty when the file has none
+		std::vector<int32_t> cellLabels;
+
+		uint32_t cellCount() const { return static_cast<uint32_t>(cells.size() / CELL_CORNERS); }
+
+		// Cell on the other side of each face (CELL_FACES per cell, in FACE_CORNERS order),
+		// NO_NEIGHBOR on the boundary. Faces are hashed by their smallest point, in parallel,
+		// and matched inside each bucket.
+		std::vector<uint32_t> computeFaceNeighbors() const;
+
+		// Interior faces are shared by two cells and cancel out, faces come out in cell order
+		Boundary extractBoundary() const;
+		Boundary extractBoundary(const std::vector<uint32_t> &faceNeighbors) const;
+
+		// Corners of a face, counter clockwise seen from outside the cell whatever its orientation
+		std::array<uint32_t, 4> faceCorners(uint32_t cell, uint32_t face) const;
+
+		// Boundary as an indexed surface with only the points it uses. Face k becomes
+		// triangles 2k and 2k + 1, split along its first / third corner diagonal, and
+		// builder.triangleCells gives the cell of each triangle.
+		HexModel::Builder buildBoundaryModel(const Boundary &boundary) const;
+
+		// Sign of the cell volume, from the corner 0 frame
+		bool isInverted(uint32_t cell) const;
+	};
+}
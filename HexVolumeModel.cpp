@@ -0,0 +1,104 @@
+#include "HexVolumeModel.h"
+#include "HexParallel.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace hex {
+
+	bool HexCellFilter::operator==(const HexCellFilter &other) const {
+		if (planeCount != other.planeCount) return false;
+		for (uint32_t i = 0; i < planeCount; i++) {
+			if (planes[i] != other.planes[i]) return false;
+		}
+		if (filterValues != other.filterValues || (filterValues && (valueMin != other.valueMin || valueMax != other.valueMax))) return false;
+		if (filterLabels != other.filterLabels || (filterLabels && (labelMin != other.labelMin || labelMax != other.labelMax))) return false;
+		// Only changes the drawn faces when crossing 1, the scale itself is applied when drawing
+		if ((shrink < 1.f) != (other.shrink < 1.f)) return false;
+		return true;
+	}
+
+	HexVolumeModel::HexVolumeModel(HexDevice &device, const HexVolumeMesh &mesh) : hexDevice{device} {
+		pointCount = static_cast<uint32_t>(mesh.points.size());
+		cellCount = mesh.cellCount();
+		labeled = !mesh.cellLabels.empty();
+		assert(cellCount > 0 && "Volume models need cells");
+
+		boundsMin = glm::vec3{std::numeric_limits<float>::max()};
+		boundsMax = glm::vec3{std::numeric_limits<float>::lowest()};
+		for (auto &point : mesh.points) {
+			boundsMin = glm::min(boundsMin, point);
+			boundsMax = glm::max(boundsMax, point);
+		}
+
+		std::vector<uint32_t> faceNeighbors = mesh.computeFaceNeighbors();
+		boundaryFaceCount = static_cast<uint32_t>(std::count(faceNeighbors.begin(), faceNeighbors.end(), HexVolumeMesh::NO_NEIGHBOR));
+
+		// Swapping the two quads of an inverted cell makes it positive, the quads then swap faces
+		std::vector<uint32_t> cells(mesh.cells.size());
+		parallelFor(cellCount, 1 << 14, [&](size_t begin, size_t end) {
+			const uint32_t corners = HexVolumeMesh::CELL_CORNERS;
+			for (size_t cell = begin; cell < end; cell++) {
+				const uint32_t *source = mesh.cells.data() + cell * corners;
+				uint32_t *target = cells.data() + cell * corners;
+				if (!mesh.isInverted(static_cast<uint32_t>(cell))) {
+					std::copy(source, source + corners, target);
+					continue;
+				}
+				std::copy(source + 4, source + 8, target);
+				std::copy(source, source + 4, target + 4);
+				std::swap(faceNeighbors[cell * HexVolumeMesh::CELL_FACES], faceNeighbors[cell * HexVolumeMesh::CELL_FACES + 1]);
+			}
+		});
+
+		static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "Points are uploaded as packed floats");
+		createDeviceBuffer(mesh.points.data(), mesh.points.size() * sizeof(glm::vec3), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, pointBuffer, pointMemory);
+		createDeviceBuffer(cells.data(), cells.size() * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, cellBuffer, cellMemory);
+		createDeviceBuffer(faceNeighbors.data(), faceNeighbors.size() * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, faceNeighborBuffer, faceNeighborMemory);
+
+		const int32_t noLabel = 0;
+		createDeviceBuffer(
+			labeled ? mesh.cellLabels.data() : &noLabel,
+			labeled ? mesh.cellLabels.size() * sizeof(int32_t) : sizeof(int32_t),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			labelBuffer,
+			labelMemory
+		);
+	}
+
+	HexVolumeModel::~HexVolumeModel() {
+		VkBuffer buffers[] = {pointBuffer, cellBuffer, faceNeighborBuffer, labelBuffer};
+		VkDeviceMemory memories[] = {pointMemory, cellMemory, faceNeighborMemory, labelMemory};
+		for (int i = 0; i < 4; i++) {
+			vkDestroyBuffer(hexDevice.device(), buffers[i], nullptr);
+			vkFreeMemory(hexDevice.device(), memories[i], nullptr);
+		}
+	}
+
+	void HexVolumeModel::createDeviceBuffer(const void *data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer, VkDeviceMemory &memory) {
+		hexDevice.createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, memory);
+
+		VkBuffer stagingBuffer;
+		VkDeviceMemory stagingBufferMemory;
+		hexDevice.createBuffer(
+			size,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			stagingBuffer,
+			stagingBufferMemory
+		);
+
+		void *mapped;
+		vkMapMemory(hexDevice.device(), stagingBufferMemory, 0, size, 0, &mapped);
+		memcpy(mapped, data, static_cast<size_t>(size));
+		vkUnmapMemory(hexDevice.device(), stagingBufferMemory);
+
+		hexDevice.copyBuffer(stagingBuffer, buffer, size);
+
+		vkDestroyBuffer(hexDevice.device(), stagingBuffer, nullptr);
+		vkFreeMemory(hexDevice.device(), stagingBufferMemory, nullptr);
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "HexVolumeMesh.h"
+#include "hex_device.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+
+namespace hex {
+
+	// Which cells of a volume are shown. Faces between a shown and a hidden cell become visible.
+	struct HexCellFilter {
+		static constexpr uint32_t MAX_PLANES = 4;
+
+		// Cells whose center is on the negative side of a plane, dot(plane.xyz, center) + plane.w < 0,
+		// are hidden. Model space.
+		std::array<glm::vec4, MAX_PLANES> planes{};
+		uint32_t planeCount = 0;
+
+		// Cells whose cell field value is outside the range are hidden
+		bool filterValues = false;
+		float valueMin = 0.f;
+		float valueMax = 0.f;
+
+		// Cells whose label is outside the range are hidden (meshes with labels only)
+		bool filterLabels = false;
+		int32_t labelMin = 0;
+		int32_t labelMax = 0;
+
+		// Shown cells are drawn scaled by this about their center. Below 1 every face of a
+		// shown cell is drawn, not only the ones against hidden cells.
+		float shrink = 1.f;
+
+		bool operator==(const HexCellFilter &other) const;
+		bool operator!=(const HexCellFilter &other) const { return !(*this == other); }
+	};
+
+	// GPU copy of a hexahedral volume mesh for compute passes: points, cells, the cell across
+	// each face and the cell labels, all in storage buffers. Cells are reoriented on upload so
+	// FACE_CORNERS is outward facing for every cell.
+	class HexVolumeModel {
+		public:
+		HexVolumeModel(HexDevice &device, const HexVolumeMesh &mesh);
+		~HexVolumeModel();
+
+		HexVolumeModel(const HexVolumeModel &) = delete;
+		HexVolumeModel &operator=(const HexVolumeModel &) = delete;
+
+		uint32_t getPointCount() const { return pointCount; }
+		uint32_t getCellCount() const { return cellCount; }
+		uint32_t getBoundaryFaceCount() const { return boundaryFaceCount; }
+		bool hasLabels() const { return labeled; }
+		glm::vec3 getBoundsMin() const { return boundsMin; }
+		glm::vec3 getBoundsMax() const { return boundsMax; }
+
+		// 3 floats per point
+		VkBuffer getPointBuffer() const { return pointBuffer; }
+		// HexVolumeMesh::CELL_CORNERS point indices per cell
+		VkBuffer getCellBuffer() const { return cellBuffer; }
+		// HexVolumeMesh::CELL_FACES neighbor cells per cell, NO_NEIGHBOR on the boundary
+		VkBuffer getFaceNeighborBuffer() const { return faceNeighborBuffer; }
+		// One int per cell, a single 0 without labels
+		VkBuffer getLabelBuffer() const { return labelBuffer; }
+
+		private:
+		void createDeviceBuffer(const void *data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer, VkDeviceMemory &memory);
+
+		HexDevice &hexDevice;
+
+		uint32_t pointCount;
+		uint32_t cellCount;
+		uint32_t boundaryFaceCount = 0;
+		bool labeled;
+		glm::vec3 boundsMin{0.f};
+		glm::vec3 boundsMax{0.f};
+
+		VkBuffer pointBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory pointMemory = VK_NULL_HANDLE;
+		VkBuffer cellBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory cellMemory = VK_NULL_HANDLE;
+		VkBuffer faceNeighborBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory faceNeighborMemory = VK_NULL_HANDLE;
+		VkBuffer labelBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory labelMemory = VK_NULL_HANDLE;
+	};
+}
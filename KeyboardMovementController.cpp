@@ -44,4 +44,66 @@ namespace hex {
 			gameObject.transform.translation += moveSpeed * dt * glm::normalize(moveDir);
 	}
 
+	void KeyboardMovementController::moveClipPlane(GLFWwindow *window, float dt, HexGameObject &gameObject) {
+		if (!gameObject.volume) return;
+
+		float direction = 0.f;
+		if (glfwGetKey(window, keys.clipForward) == GLFW_PRESS) direction += 1.f;
+		if (glfwGetKey(window, keys.clipBackward) == GLFW_PRESS) direction -= 1.f;
+		if (direction == 0.f) return;
+
+		float zMin = gameObject.volume->getBoundsMin().z;
+		float zMax = gameObject.volume->getBoundsMax().z;
+
+		// Keeps z >= depth, starts with every cell shown
+		HexCellFilter &filter = gameObject.cellFilter;
+		if (filter.planeCount == 0) {
+			filter.planeCount = 1;
+			filter.planes[0] = glm::vec4{0.f, 0.f, 1.f, -zMin};
+		}
+
+		float depth = glm::clamp(-filter.planes[0].w + direction * clipSpeed * dt * (zMax - zMin), zMin, zMax);
+		filter.planes[0].w = -depth;
+	}
+
+	void KeyboardMovementController::shrinkCells(GLFWwindow *window, float dt, HexGameObject &gameObject) {
+		if (!gameObject.volume) return;
+
+		float direction = 0.f;
+		if (glfwGetKey(window, keys.growCells) == GLFW_PRESS) direction += 1.f;
+		if (glfwGetKey(window, keys.shrinkCells) == GLFW_PRESS) direction -= 1.f;
+		if (direction == 0.f) return;
+
+		HexCellFilter &filter = gameObject.cellFilter;
+		filter.shrink = glm::clamp(filter.shrink + direction * shrinkSpeed * dt, minShrink, 1.f);
+	}
+
+	bool KeyboardMovementController::nextQualityMetricPressed(GLFWwindow *window) {
+		bool down = glfwGetKey(window, keys.nextQualityMetric) == GLFW_PRESS;
+		bool pressed = down && !qualityMetricKeyDown;
+		qualityMetricKeyDown = down;
+		return pressed;
+	}
+
+	bool KeyboardMovementController::toggleWireframePressed(GLFWwindow *window) {
+		bool down = glfwGetKey(window, keys.toggleWireframe) == GLFW_PRESS;
+		bool pressed = down && !wireframeKeyDown;
+		wireframeKeyDown = down;
+		return pressed;
+	}
+
+	bool KeyboardMovementController::togglePlaybackPressed(GLFWwindow *window) {
+		bool down = glfwGetKey(window, keys.togglePlayback) == GLFW_PRESS;
+		bool pressed = down && !playbackKeyDown;
+		playbackKeyDown = down;
+		return pressed;
+	}
+
+	bool KeyboardMovementController::toggleDepthPrepassPressed(GLFWwindow *window) {
+		bool down = glfwGetKey(window, keys.toggleDepthPrepass) == GLFW_PRESS;
+		bool pressed = down && !depthPrepassKeyDown;
+		depthPrepassKeyDown = down;
+		return pressed;
+	}
+
 }
\ No newline at end of file
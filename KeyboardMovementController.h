@@ -29,14 +29,42 @@ namespace hex {
 			int lookRight = GLFW_KEY_RIGHT;
 			int lookUp = GLFW_KEY_UP;
 			int lookDown = GLFW_KEY_DOWN;
+			int clipForward = GLFW_KEY_PAGE_UP;
+			int clipBackward = GLFW_KEY_PAGE_DOWN;
+			int nextQualityMetric = GLFW_KEY_M;
+			int shrinkCells = GLFW_KEY_COMMA;
+			int growCells = GLFW_KEY_PERIOD;
+			int toggleWireframe = GLFW_KEY_F;
+			int togglePlayback = GLFW_KEY_SPACE;
+			int toggleDepthPrepass = GLFW_KEY_P;
 		};
 
 
 		void moveInPlaneXZ(GLFWwindow *window, float dt, HexGameObject &gameObject);
+		// Slides the first clip plane of a volume along the model z axis, cells behind it are hidden
+		void moveClipPlane(GLFWwindow *window, float dt, HexGameObject &gameObject);
+		// Scales the cells of a volume about their center, 1 shows the solid volume
+		void shrinkCells(GLFWwindow *window, float dt, HexGameObject &gameObject);
+		// True once per press of the key
+		bool nextQualityMetricPressed(GLFWwindow *window);
+		bool toggleWireframePressed(GLFWwindow *window);
+		bool togglePlaybackPressed(GLFWwindow *window);
+		bool toggleDepthPrepassPressed(GLFWwindow *window);
 
 		KeyMappings keys{};
 		float moveSpeed{3.f};
 		float lookSpeed{1.5f};
+		// Model depths per second
+		float clipSpeed{.25f};
+		// Cell scale per second
+		float shrinkSpeed{.5f};
+		float minShrink{.1f};
+
+		private:
+		bool qualityMetricKeyDown{false};
+		bool wireframeKeyDown{false};
+		bool playbackKeyDown{false};
+		bool depthPrepassKeyDown{false};
 
 	};
 }
\ No newline at end of file
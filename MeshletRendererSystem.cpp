@@ -0,0 +1,862 @@
+#include "MeshletRendererSystem.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace hex {
+
+	// Layout of shaders/meshlet_cull.comp
+	struct MeshletCullPushConstantData {
+		glm::mat4 clip{1.f};
+		glm::vec3 eye;
+		uint32_t meshletCount;
+		uint32_t firstIndex;
+		int32_t vertexOffset;
+		uint32_t flags;
+	};
+
+	// Layout of shaders/meshlet_occlusion.comp
+	struct MeshletOcclusionPushConstantData {
+		glm::mat4 clip{1.f};
+		glm::vec3 eye;
+		uint32_t meshletCount;
+		glm::vec3 boundsMin;
+		uint32_t flags;
+		glm::vec3 boundsMax;
+		uint32_t levelCount;
+		uint32_t depthSize[2];
+		uint32_t firstIndex;
+		int32_t vertexOffset;
+	};
+
+	static_assert(sizeof(MeshletOcclusionPushConstantData) == 128, "Push constants must fit the guaranteed 128 bytes");
+
+	// Layout of shaders/meshlet.task and meshlet.mesh, starts like the simple shaders push constants
+	struct MeshletDrawPushConstantData {
+		glm::mat4 transform{1.f};
+		glm::vec3 color;
+		uint32_t meshletCount;
+		glm::vec3 vertexScale;
+		// Position stream word offset in the low 16 bits, attribute stream in the high ones
+		uint32_t vertexWordOffset;
+		glm::vec3 vertexOrigin;
+		uint32_t vertexFormat;
+		glm::vec3 eye;
+		uint32_t coneCulling;
+	};
+
+	static_assert(sizeof(MeshletDrawPushConstantData) == 128, "Push constants must fit the guaranteed 128 bytes");
+
+	namespace {
+		const uint32_t cullWorkgroupSize = 64;
+		// MESHLETS_PER_TASK in shaders/meshlet_common.glsl
+		const uint32_t meshletsPerTask = 32;
+		// CULL_* flags in shaders/meshlet_common.glsl
+		const uint32_t cullCones = 1;
+		const uint32_t cullOcclusion = 2;
+		const uint32_t cullCompact = 4;
+
+		// Cone angles only survive uniform scaling
+		bool uniformScale(const glm::vec3 &scale) {
+			glm::vec3 absolute = glm::abs(scale);
+			float largest = glm::max(absolute.x, glm::max(absolute.y, absolute.z));
+			float smallest = glm::min(absolute.x, glm::min(absolute.y, absolute.z));
+			return smallest > 0.f && largest - smallest <= largest * 1e-3f;
+		}
+	}
+
+	MeshletRendererSystem::MeshletRendererSystem(HexDevice &device, const RenderTargetInfo &renderTarget, HexGeometryArena &geometryArena, HexPipelineManager &pipelineManager)
+		: hexDevice{device}, geometryArena{geometryArena}, pipelineManager{pipelineManager}, meshShaders{device.meshShaderSupported()},
+		drawCount{!meshShaders && device.drawIndirectCountSupported() && device.enabledFeatures().multiDrawIndirect} {
+		createDescriptorSetLayout();
+		createPipelineLayouts();
+		try {
+			createPipelines(renderTarget);
+		} catch (...) {
+			vkDestroyPipelineLayout(hexDevice.device(), drawPipelineLayout, nullptr);
+			if (cullPipelineLayout != VK_NULL_HANDLE) vkDestroyPipelineLayout(hexDevice.device(), cullPipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(hexDevice.device(), descriptorSetLayout, nullptr);
+			throw;
+		}
+
+		if (meshShaders) {
+			cmdDrawMeshTasks = reinterpret_cast<PFN_vkCmdDrawMeshTasksEXT>(vkGetDeviceProcAddr(hexDevice.device(), "vkCmdDrawMeshTasksEXT"));
+			if (cmdDrawMeshTasks == nullptr) {
+				throw std::runtime_error("Failed to load vkCmdDrawMeshTasksEXT");
+			}
+		}
+	}
+
+	MeshletRendererSystem::~MeshletRendererSystem() {
+		if (occlusionFrameCount > 0) {
+			double perFrame = 1.0 / static_cast<double>(occlusionFrameCount);
+			std::cout << "Occlusion culling per frame: " << occludedObjectTotal * perFrame << " objects, "
+				<< occludedMeshletTotal * perFrame << " meshlets occluded" << std::endl;
+		}
+		destroyOcclusionResources();
+		for (auto &entry : modelResources) {
+			destroyResources(entry.second);
+		}
+		// Pipelines before their layouts
+		cullPipeline.reset();
+		meshPipeline.reset();
+		for (auto &pass : vertexPipelines) {
+			for (auto &pipeline : pass) pipeline.reset();
+		}
+		if (cullPipelineLayout != VK_NULL_HANDLE) vkDestroyPipelineLayout(hexDevice.device(), cullPipelineLayout, nullptr);
+		vkDestroyPipelineLayout(hexDevice.device(), drawPipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(hexDevice.device(), descriptorSetLayout, nullptr);
+	}
+
+	void MeshletRendererSystem::createDescriptorSetLayout() {
+		// Indirect path: meshlets, draw commands, visibility, draw count. Mesh path: meshlets, meshlet vertices,
+		// meshlet triangles, vertex pool positions and attributes.
+		uint32_t bindingCount = meshShaders ? 5 : 4;
+		VkShaderStageFlags stages = meshShaders ? VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT : VK_SHADER_STAGE_COMPUTE_BIT;
+
+		std::array<VkDescriptorSetLayoutBinding, 5> bindings{};
+		for (uint32_t i = 0; i < bindingCount; i++) {
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = stages;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = bindingCount;
+		layoutInfo.pBindings = bindings.data();
+
+		if (vkCreateDescriptorSetLayout(hexDevice.device(), &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create descriptor set layout");
+		}
+	}
+
+	void MeshletRendererSystem::createPipelineLayouts() {
+		VkPushConstantRange drawRange{};
+		drawRange.stageFlags = meshShaders
+			? VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT | VK_SHADER_STAGE_FRAGMENT_BIT
+			: VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		drawRange.offset = 0;
+		drawRange.size = sizeof(MeshletDrawPushConstantData);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		// Vertex pipelines of the indirect path read no descriptors
+		pipelineLayoutInfo.setLayoutCount = meshShaders ? 1 : 0;
+		pipelineLayoutInfo.pSetLayouts = meshShaders ? &descriptorSetLayout : nullptr;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &drawRange;
+
+		if (vkCreatePipelineLayout(hexDevice.device(), &pipelineLayoutInfo, nullptr, &drawPipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create pipeline layout");
+		}
+
+		if (meshShaders)
+			return;
+
+		VkPushConstantRange cullRange{};
+		cullRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		cullRange.offset = 0;
+		cullRange.size = sizeof(MeshletCullPushConstantData);
+
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+		pipelineLayoutInfo.pPushConstantRanges = &cullRange;
+
+		if (vkCreatePipelineLayout(hexDevice.device(), &pipelineLayoutInfo, nullptr, &cullPipelineLayout) != VK_SUCCESS) {
+			vkDestroyPipelineLayout(hexDevice.device(), drawPipelineLayout, nullptr);
+			throw std::runtime_error("Failed to create pipeline layout");
+		}
+	}
+
+	void MeshletRendererSystem::createPipelines(const RenderTargetInfo &renderTarget) {
+		if (meshShaders) {
+			PipelineConfigInfo pipelineConfig{};
+			HexPipeline::defaultPipelineConfigInfo(pipelineConfig);
+			HexPipeline::setRenderTarget(pipelineConfig, renderTarget);
+			pipelineConfig.pipelineLayout = drawPipelineLayout;
+
+			meshPipeline = std::make_unique<HexPipeline>(
+				hexDevice,
+				std::vector<ShaderStageInfo>{
+					{VK_SHADER_STAGE_TASK_BIT_EXT, "shaders/meshlet.task.spv"},
+					{VK_SHADER_STAGE_MESH_BIT_EXT, "shaders/meshlet.mesh.spv"},
+					{VK_SHADER_STAGE_FRAGMENT_BIT, "shaders/simple_shader.frag.spv"}
+				},
+				pipelineConfig,
+				std::vector<SpecializationConstant>{},
+				pipelineManager.getPipelineCache(),
+				&pipelineManager.getShaderLibrary()
+			);
+			return;
+		}
+
+		cullPipeline = std::make_unique<HexPipeline>(hexDevice, "shaders/meshlet_cull.comp.spv", cullPipelineLayout, pipelineManager.getPipelineCache(), &pipelineManager.getShaderLibrary());
+		const uint32_t floatFormat = static_cast<uint32_t>(HexVertexFormat::Float);
+		const uint32_t quantizedFormat = static_cast<uint32_t>(HexVertexFormat::Quantized);
+		for (PassKind pass : {COLOR_PASS, COLOR_AFTER_PREPASS}) {
+			vertexPipelines[pass][floatFormat] = createVertexPipeline<FloatStreams>(renderTarget, pass);
+			vertexPipelines[pass][quantizedFormat] = createVertexPipeline<QuantizedStreams>(renderTarget, pass);
+		}
+
+		// Optional, without it the objects take the simple path during the prepass
+		try {
+			vertexPipelines[DEPTH_PREPASS][floatFormat] = createVertexPipeline<FloatPosition>(renderTarget, DEPTH_PREPASS);
+			vertexPipelines[DEPTH_PREPASS][quantizedFormat] = createVertexPipeline<QuantizedPosition>(renderTarget, DEPTH_PREPASS);
+		} catch (const std::exception &e) {
+			vertexPipelines[DEPTH_PREPASS][floatFormat].reset();
+			vertexPipelines[DEPTH_PREPASS][quantizedFormat].reset();
+			std::cerr << "Meshlet depth prepass disabled: " << e.what() << std::endl;
+		}
+	}
+
+	template <typename VertexT>
+	std::unique_ptr<HexPipeline> MeshletRendererSystem::createVertexPipeline(const RenderTargetInfo &renderTarget, PassKind pass) {
+		PipelineConfigInfo pipelineConfig{};
+		HexPipeline::defaultPipelineConfigInfo(pipelineConfig);
+		HexPipeline::setVertexLayout<VertexT>(pipelineConfig);
+		if (pass == COLOR_AFTER_PREPASS) {
+			pipelineConfig.depthStencilInfo.depthCompareOp = VK_COMPARE_OP_EQUAL;
+			pipelineConfig.depthStencilInfo.depthWriteEnable = VK_FALSE;
+		}
+		if (pass == DEPTH_PREPASS) {
+			// Same render target as the color pass, nothing written to the color attachment
+			pipelineConfig.colorBlendAttachment.colorWriteMask = 0;
+		}
+		HexPipeline::setRenderTarget(pipelineConfig, renderTarget);
+		pipelineConfig.pipelineLayout = drawPipelineLayout;
+
+		std::vector<ShaderStageInfo> stages{
+			{VK_SHADER_STAGE_VERTEX_BIT, "shaders/simple_shader.vert.spv"},
+			{VK_SHADER_STAGE_FRAGMENT_BIT, "shaders/simple_shader.frag.spv"}
+		};
+		if (pass == DEPTH_PREPASS) {
+			stages = {{VK_SHADER_STAGE_VERTEX_BIT, "shaders/depth_prepass.vert.spv"}};
+		}
+
+		return std::make_unique<HexPipeline>(
+			hexDevice,
+			stages,
+			pipelineConfig,
+			std::vector<SpecializationConstant>{},
+			pipelineManager.getPipelineCache(),
+			&pipelineManager.getShaderLibrary()
+		);
+	}
+
+	HexPipeline &MeshletRendererSystem::pipelineFor(PassKind pass, HexVertexFormat format) {
+		return *vertexPipelines[pass][static_cast<uint32_t>(format)];
+	}
+
+	bool MeshletRendererSystem::drawsGameObject(const HexGameObject &gameObject) const {
+		// Cell fields index triangles with gl_PrimitiveID, which restarts at every meshlet draw
+		if (!gameObject.model || !gameObject.model->hasMeshlets() || gameObject.lod != 0 || gameObject.cellField)
+			return false;
+		// Back facing clusters and triangles are culled, open surfaces go through the simple renderer
+		if (gameObject.model->isDoubleSided())
+			return false;
+
+		if (meshShaders) {
+			// The whole vertex range of each stream must fit in one storage buffer descriptor
+			for (uint32_t stream : {HexGeometryArena::POSITION_STREAM, HexGeometryArena::ATTRIBUTE_STREAM}) {
+				VkDeviceSize offset;
+				VkDeviceSize range;
+				uint32_t wordOffset;
+				vertexRange(*gameObject.model, stream, offset, range, wordOffset);
+				if (range > hexDevice.properties.limits.maxStorageBufferRange) return false;
+			}
+		}
+		return true;
+	}
+
+	void MeshletRendererSystem::vertexRange(const HexModel &model, uint32_t stream, VkDeviceSize &offset, VkDeviceSize &range, uint32_t &wordOffset) const {
+		VkDeviceSize stride = geometryArena.getVertexStride(model.getVertexFormat(), stream);
+		VkDeviceSize begin = geometryArena.getOffset(model.getVertexAllocation()) * stride;
+		VkDeviceSize alignment = hexDevice.properties.limits.minStorageBufferOffsetAlignment;
+
+		offset = begin / alignment * alignment;
+		range = begin - offset + geometryArena.getCount(model.getVertexAllocation()) * stride;
+		wordOffset = static_cast<uint32_t>((begin - offset) / sizeof(uint32_t));
+	}
+
+	uint32_t MeshletRendererSystem::vertexWordOffsets(const HexModel &model) const {
+		VkDeviceSize offset;
+		VkDeviceSize range;
+		uint32_t positionWordOffset;
+		uint32_t attributeWordOffset;
+		vertexRange(model, HexGeometryArena::POSITION_STREAM, offset, range, positionWordOffset);
+		vertexRange(model, HexGeometryArena::ATTRIBUTE_STREAM, offset, range, attributeWordOffset);
+		return positionWordOffset | attributeWordOffset << 16;
+	}
+
+	void MeshletRendererSystem::createDeviceBuffer(const void *data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer, VkDeviceMemory &memory) {
+		hexDevice.createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, memory);
+		if (data == nullptr)
+			return;
+
+		VkBuffer stagingBuffer;
+		VkDeviceMemory stagingBufferMemory;
+		hexDevice.createBuffer(
+			size,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			stagingBuffer,
+			stagingBufferMemory
+		);
+
+		void *mapped;
+		vkMapMemory(hexDevice.device(), stagingBufferMemory, 0, size, 0, &mapped);
+		memcpy(mapped, data, static_cast<size_t>(size));
+		vkUnmapMemory(hexDevice.device(), stagingBufferMemory);
+
+		hexDevice.copyBuffer(stagingBuffer, buffer, size);
+
+		vkDestroyBuffer(hexDevice.device(), stagingBuffer, nullptr);
+		vkFreeMemory(hexDevice.device(), stagingBufferMemory, nullptr);
+	}
+
+	MeshletRendererSystem::ModelResources &MeshletRendererSystem::resourcesFor(const HexModel &model) {
+		auto it = modelResources.find(&model);
+		if (it != modelResources.end()) {
+			// Arena buffers replaced or compacted since the descriptors were written
+			if (it->second.arenaGeneration != geometryArena.getGeneration()) {
+				updateDescriptorSet(model, it->second);
+			}
+			return it->second;
+		}
+
+		const auto &meshlets = model.getMeshlets();
+		ModelResources &resources = modelResources[&model];
+
+		createDeviceBuffer(
+			meshlets.meshlets.data(),
+			meshlets.meshlets.size() * sizeof(HexMeshlet),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			resources.meshletBuffer,
+			resources.meshletMemory
+		);
+
+		if (meshShaders) {
+			createDeviceBuffer(
+				meshlets.vertices.data(),
+				meshlets.vertices.size() * sizeof(uint32_t),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				resources.vertexBuffer,
+				resources.vertexMemory
+			);
+			createDeviceBuffer(
+				meshlets.triangles.data(),
+				meshlets.triangles.size() * sizeof(uint32_t),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				resources.triangleBuffer,
+				resources.triangleMemory
+			);
+		} else {
+			// Written by the culling pass every frame
+			createDeviceBuffer(
+				nullptr,
+				meshlets.meshlets.size() * sizeof(VkDrawIndexedIndirectCommand),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				resources.drawBuffer,
+				resources.drawMemory
+			);
+			// Nothing visible yet, the second phase of the first frame draws what is
+			std::vector<uint32_t> visibility(meshlets.meshlets.size(), 0);
+			createDeviceBuffer(
+				visibility.data(),
+				visibility.size() * sizeof(uint32_t),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				resources.visibilityBuffer,
+				resources.visibilityMemory
+			);
+			// Bound even when not compacted, cleared before each phase otherwise
+			createDeviceBuffer(
+				nullptr,
+				sizeof(uint32_t),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				resources.countBuffer,
+				resources.countMemory
+			);
+			resources.compacted = drawCount && meshlets.meshlets.size() <= hexDevice.properties.limits.maxDrawIndirectCount;
+		}
+
+		uint32_t bindingCount = meshShaders ? 5 : 4;
+		VkDescriptorPoolSize poolSize{};
+		poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		poolSize.descriptorCount = bindingCount;
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = 1;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &poolSize;
+
+		if (vkCreateDescriptorPool(hexDevice.device(), &poolInfo, nullptr, &resources.descriptorPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create descriptor pool");
+		}
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = resources.descriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &descriptorSetLayout;
+
+		if (vkAllocateDescriptorSets(hexDevice.device(), &allocInfo, &resources.descriptorSet) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate descriptor set");
+		}
+
+		updateDescriptorSet(model, resources);
+		return resources;
+	}
+
+	// Only called when no submitted frame uses the set: on creation, or on the first frame
+	// after the arena waited for the device to grow or compact its buffers
+	void MeshletRendererSystem::updateDescriptorSet(const HexModel &model, ModelResources &resources) {
+		std::array<VkDescriptorBufferInfo, 5> bufferInfos{};
+		bufferInfos[0] = {resources.meshletBuffer, 0, VK_WHOLE_SIZE};
+		if (meshShaders) {
+			bufferInfos[1] = {resources.vertexBuffer, 0, VK_WHOLE_SIZE};
+			bufferInfos[2] = {resources.triangleBuffer, 0, VK_WHOLE_SIZE};
+
+			for (uint32_t stream : {HexGeometryArena::POSITION_STREAM, HexGeometryArena::ATTRIBUTE_STREAM}) {
+				VkDeviceSize offset;
+				VkDeviceSize range;
+				uint32_t wordOffset;
+				vertexRange(model, stream, offset, range, wordOffset);
+				bufferInfos[3 + stream] = {geometryArena.getVertexBuffer(model.getVertexFormat(), stream), offset, range};
+			}
+		} else {
+			bufferInfos[1] = {resources.drawBuffer, 0, VK_WHOLE_SIZE};
+			bufferInfos[2] = {resources.visibilityBuffer, 0, VK_WHOLE_SIZE};
+			bufferInfos[3] = {resources.countBuffer, 0, VK_WHOLE_SIZE};
+		}
+
+		uint32_t bindingCount = meshShaders ? 5 : 4;
+		std::array<VkWriteDescriptorSet, 5> writes{};
+		for (uint32_t i = 0; i < bindingCount; i++) {
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = resources.descriptorSet;
+			writes[i].dstBinding = i;
+			writes[i].descriptorCount = 1;
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+		vkUpdateDescriptorSets(hexDevice.device(), bindingCount, writes.data(), 0, nullptr);
+
+		resources.arenaGeneration = geometryArena.getGeneration();
+	}
+
+	void MeshletRendererSystem::destroyResources(ModelResources &resources) {
+		VkBuffer buffers[] = {resources.meshletBuffer, resources.drawBuffer, resources.countBuffer, resources.visibilityBuffer, resources.vertexBuffer, resources.triangleBuffer};
+		VkDeviceMemory memories[] = {resources.meshletMemory, resources.drawMemory, resources.countMemory, resources.visibilityMemory, resources.vertexMemory, resources.triangleMemory};
+		for (int i = 0; i < 6; i++) {
+			if (buffers[i] == VK_NULL_HANDLE) continue;
+			vkDestroyBuffer(hexDevice.device(), buffers[i], nullptr);
+			vkFreeMemory(hexDevice.device(), memories[i], nullptr);
+		}
+		if (resources.descriptorPool != VK_NULL_HANDLE) {
+			vkDestroyDescriptorPool(hexDevice.device(), resources.descriptorPool, nullptr);
+		}
+	}
+
+	void MeshletRendererSystem::beginCullingPhase(VkCommandBuffer commandBuffer) {
+		// Draws may still read the commands and counts, earlier phases wrote the visibility
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		if (clearedCounts.empty())
+			return;
+		for (VkBuffer countBuffer : clearedCounts) {
+			vkCmdFillBuffer(commandBuffer, countBuffer, 0, sizeof(uint32_t), 0);
+		}
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	void MeshletRendererSystem::cullGameObjects(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera) {
+		// The task shader culls on the mesh shader path
+		if (meshShaders)
+			return;
+
+		// Resources are created on first use, before the phase is recorded
+		bool culled = false;
+		clearedCounts.clear();
+		for (auto &gameObject : gameObjects) {
+			if (!drawsGameObject(gameObject)) continue;
+			ModelResources &resources = resourcesFor(*gameObject.model);
+			if (resources.compacted) clearedCounts.push_back(resources.countBuffer);
+			culled = true;
+		}
+		if (!culled)
+			return;
+
+		beginCullingPhase(commandBuffer);
+		cullPipeline->bind(commandBuffer);
+
+		auto projectionView = camera.getProjection() * camera.getViewMatrix();
+
+		for (auto &gameObject : gameObjects) {
+			if (!drawsGameObject(gameObject)) continue;
+
+			const HexModel &model = *gameObject.model;
+			ModelResources &resources = modelResources.at(&model);
+			glm::mat4 modelMatrix = gameObject.transform.mat4();
+
+			MeshletCullPushConstantData push{};
+			// Planes and eye in model space, where the meshlet bounds are
+			push.clip = projectionView * modelMatrix;
+			push.eye = glm::vec3{glm::inverse(modelMatrix) * glm::vec4{camera.getPosition(), 1.f}};
+			push.meshletCount = static_cast<uint32_t>(model.getMeshlets().meshlets.size());
+			push.firstIndex = geometryArena.getOffset(model.getIndexAllocation()) + model.getLod(0).firstIndex;
+			push.vertexOffset = static_cast<int32_t>(geometryArena.getOffset(model.getVertexAllocation()));
+			if (uniformScale(gameObject.transform.scale)) push.flags |= cullCones;
+			if (usesOcclusionCulling()) push.flags |= cullOcclusion;
+			if (resources.compacted) push.flags |= cullCompact;
+
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &resources.descriptorSet, 0, nullptr);
+			vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(MeshletCullPushConstantData), &push);
+			vkCmdDispatch(commandBuffer, (push.meshletCount + cullWorkgroupSize - 1) / cullWorkgroupSize, 1, 1);
+		}
+
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	void MeshletRendererSystem::setOcclusionCulling(bool enabled, uint32_t framesInFlight) {
+		if (enabled == usesOcclusionCulling())
+			return;
+		if (!enabled) {
+			destroyOcclusionResources();
+			return;
+		}
+		// The task shader culls on its own, without a second phase
+		if (meshShaders) {
+			throw std::runtime_error("Occlusion culling needs the indirect path, mesh shaders are used");
+		}
+		try {
+			createOcclusionResources(framesInFlight);
+		} catch (...) {
+			destroyOcclusionResources();
+			throw;
+		}
+	}
+
+	void MeshletRendererSystem::createOcclusionResources(uint32_t framesInFlight) {
+		// Depth pyramid, debug counters
+		std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+		bindings[0].binding = 0;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[0].descriptorCount = 1;
+		bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[1].binding = 1;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[1].descriptorCount = 1;
+		bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		if (vkCreateDescriptorSetLayout(hexDevice.device(), &layoutInfo, nullptr, &occlusionSetLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create descriptor set layout");
+		}
+
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(MeshletOcclusionPushConstantData);
+
+		// Model meshlets and draws like the first phase, then the frame's set
+		VkDescriptorSetLayout setLayouts[] = {descriptorSetLayout, occlusionSetLayout};
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 2;
+		pipelineLayoutInfo.pSetLayouts = setLayouts;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(hexDevice.device(), &pipelineLayoutInfo, nullptr, &occlusionPipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create pipeline layout");
+		}
+
+		occlusionPipeline = std::make_unique<HexPipeline>(hexDevice, "shaders/meshlet_occlusion.comp.spv", occlusionPipelineLayout, pipelineManager.getPipelineCache(), &pipelineManager.getShaderLibrary());
+
+		VkDescriptorPoolSize poolSizes[] = {
+			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, framesInFlight},
+			{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, framesInFlight}
+		};
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = framesInFlight;
+		poolInfo.poolSizeCount = 2;
+		poolInfo.pPoolSizes = poolSizes;
+
+		if (vkCreateDescriptorPool(hexDevice.device(), &poolInfo, nullptr, &occlusionDescriptorPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create descriptor pool");
+		}
+
+		occlusionFrames.resize(framesInFlight);
+		for (OcclusionFrame &frame : occlusionFrames) {
+			hexDevice.createBuffer(
+				2 * sizeof(uint32_t),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				frame.counterBuffer,
+				frame.counterMemory
+			);
+			void *mapped;
+			vkMapMemory(hexDevice.device(), frame.counterMemory, 0, VK_WHOLE_SIZE, 0, &mapped);
+			frame.counters = static_cast<uint32_t*>(mapped);
+			frame.counters[0] = 0;
+			frame.counters[1] = 0;
+
+			VkDescriptorSetAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			allocInfo.descriptorPool = occlusionDescriptorPool;
+			allocInfo.descriptorSetCount = 1;
+			allocInfo.pSetLayouts = &occlusionSetLayout;
+
+			if (vkAllocateDescriptorSets(hexDevice.device(), &allocInfo, &frame.descriptorSet) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to allocate descriptor set");
+			}
+
+			// The pyramid is written on first use, once it exists
+			VkDescriptorBufferInfo counterInfo{frame.counterBuffer, 0, VK_WHOLE_SIZE};
+			VkWriteDescriptorSet write{};
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = frame.descriptorSet;
+			write.dstBinding = 1;
+			write.descriptorCount = 1;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			write.pBufferInfo = &counterInfo;
+			vkUpdateDescriptorSets(hexDevice.device(), 1, &write, 0, nullptr);
+		}
+	}
+
+	void MeshletRendererSystem::destroyOcclusionResources() {
+		for (OcclusionFrame &frame : occlusionFrames) {
+			if (frame.counterBuffer == VK_NULL_HANDLE) continue;
+			vkUnmapMemory(hexDevice.device(), frame.counterMemory);
+			vkDestroyBuffer(hexDevice.device(), frame.counterBuffer, nullptr);
+			vkFreeMemory(hexDevice.device(), frame.counterMemory, nullptr);
+		}
+		occlusionFrames.clear();
+		if (occlusionDescriptorPool != VK_NULL_HANDLE) vkDestroyDescriptorPool(hexDevice.device(), occlusionDescriptorPool, nullptr);
+		occlusionDescriptorPool = VK_NULL_HANDLE;
+		// Pipeline before its layout
+		occlusionPipeline.reset();
+		if (occlusionPipelineLayout != VK_NULL_HANDLE) vkDestroyPipelineLayout(hexDevice.device(), occlusionPipelineLayout, nullptr);
+		occlusionPipelineLayout = VK_NULL_HANDLE;
+		if (occlusionSetLayout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(hexDevice.device(), occlusionSetLayout, nullptr);
+		occlusionSetLayout = VK_NULL_HANDLE;
+		occludedObjects = 0;
+		occludedMeshlets = 0;
+	}
+
+	// The frame's fence was waited for, its counters are final
+	void MeshletRendererSystem::readOcclusionCounters(OcclusionFrame &frame) {
+		if (frame.pending) {
+			occludedObjects = frame.counters[0];
+			occludedMeshlets = frame.counters[1];
+			occludedObjectTotal += occludedObjects;
+			occludedMeshletTotal += occludedMeshlets;
+			occlusionFrameCount++;
+		}
+		// Host writes are visible to the next submission
+		frame.counters[0] = 0;
+		frame.counters[1] = 0;
+		frame.pending = false;
+	}
+
+	void MeshletRendererSystem::cullOccludedGameObjects(VkCommandBuffer commandBuffer, uint32_t frameIndex, const HexDepthPyramid &depthPyramid, std::vector<HexGameObject> &gameObjects, const HexCamera &camera) {
+		if (!usesOcclusionCulling())
+			return;
+
+		OcclusionFrame &frame = occlusionFrames[frameIndex];
+		readOcclusionCounters(frame);
+
+		if (frame.pyramidGeneration != depthPyramid.getGeneration()) {
+			VkDescriptorImageInfo pyramidInfo = depthPyramid.descriptorInfo();
+			VkWriteDescriptorSet write{};
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = frame.descriptorSet;
+			write.dstBinding = 0;
+			write.descriptorCount = 1;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			write.pImageInfo = &pyramidInfo;
+			vkUpdateDescriptorSets(hexDevice.device(), 1, &write, 0, nullptr);
+			frame.pyramidGeneration = depthPyramid.getGeneration();
+		}
+
+		// Only models the first phase culled have draw commands
+		bool culled = false;
+		clearedCounts.clear();
+		for (auto &gameObject : gameObjects) {
+			if (!drawsGameObject(gameObject)) continue;
+			auto it = modelResources.find(gameObject.model.get());
+			if (it == modelResources.end()) continue;
+			if (it->second.compacted) clearedCounts.push_back(it->second.countBuffer);
+			culled = true;
+		}
+
+		frame.pending = true;
+		if (!culled)
+			return;
+
+		// The scene pass drew the commands of the first phase, the second replaces them
+		beginCullingPhase(commandBuffer);
+		occlusionPipeline->bind(commandBuffer);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, occlusionPipelineLayout, 1, 1, &frame.descriptorSet, 0, nullptr);
+
+		auto projectionView = camera.getProjection() * camera.getViewMatrix();
+
+		for (auto &gameObject : gameObjects) {
+			if (!drawsGameObject(gameObject)) continue;
+
+			const HexModel &model = *gameObject.model;
+			auto it = modelResources.find(&model);
+			if (it == modelResources.end()) continue;
+			ModelResources &resources = it->second;
+
+			glm::mat4 modelMatrix = gameObject.transform.mat4();
+
+			MeshletOcclusionPushConstantData push{};
+			// Bounds in model space like the meshlets
+			push.clip = projectionView * modelMatrix;
+			push.eye = glm::vec3{glm::inverse(modelMatrix) * glm::vec4{camera.getPosition(), 1.f}};
+			push.meshletCount = static_cast<uint32_t>(model.getMeshlets().meshlets.size());
+			push.boundsMin = model.getBoundsMin();
+			if (uniformScale(gameObject.transform.scale)) push.flags |= cullCones;
+			if (resources.compacted) push.flags |= cullCompact;
+			push.boundsMax = model.getBoundsMax();
+			push.levelCount = depthPyramid.getLevelCount();
+			push.depthSize[0] = depthPyramid.getDepthExtent().width;
+			push.depthSize[1] = depthPyramid.getDepthExtent().height;
+			push.firstIndex = geometryArena.getOffset(model.getIndexAllocation()) + model.getLod(0).firstIndex;
+			push.vertexOffset = static_cast<int32_t>(geometryArena.getOffset(model.getVertexAllocation()));
+
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, occlusionPipelineLayout, 0, 1, &resources.descriptorSet, 0, nullptr);
+			vkCmdPushConstants(commandBuffer, occlusionPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(MeshletOcclusionPushConstantData), &push);
+			vkCmdDispatch(commandBuffer, (push.meshletCount + cullWorkgroupSize - 1) / cullWorkgroupSize, 1, 1);
+		}
+
+		// Commands for the second draw, counters for the host once the frame's fence signals
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	void MeshletRendererSystem::renderDepthPrepass(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera) {
+		if (!hasDepthPrepass())
+			return;
+		recordIndirectDraws(commandBuffer, gameObjects, camera, DEPTH_PREPASS);
+		prepassed = true;
+	}
+
+	void MeshletRendererSystem::renderGameObjects(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera) {
+		if (!meshShaders) {
+			recordIndirectDraws(commandBuffer, gameObjects, camera, prepassed ? COLOR_AFTER_PREPASS : COLOR_PASS);
+			prepassed = false;
+			return;
+		}
+
+		meshPipeline->bind(commandBuffer);
+		auto projectionView = camera.getProjection() * camera.getViewMatrix();
+		const VkShaderStageFlags pushStages = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		for (auto &gameObject : gameObjects) {
+			if (!drawsGameObject(gameObject)) continue;
+
+			const HexModel &model = *gameObject.model;
+			uint32_t meshletCount = static_cast<uint32_t>(model.getMeshlets().meshlets.size());
+			glm::mat4 modelMatrix = gameObject.transform.mat4();
+
+			// The mesh shader dequantizes, so the transform stays in model space for the task shader culling
+			const glm::mat4 &vertexTransform = model.getVertexTransform();
+			MeshletDrawPushConstantData push{};
+			push.color = gameObject.color;
+			push.meshletCount = meshletCount;
+			push.vertexWordOffset = vertexWordOffsets(model);
+			push.transform = projectionView * modelMatrix;
+			push.vertexScale = glm::vec3{vertexTransform[0][0], vertexTransform[1][1], vertexTransform[2][2]};
+			push.vertexOrigin = glm::vec3{vertexTransform[3]};
+			push.vertexFormat = static_cast<uint32_t>(model.getVertexFormat());
+			push.eye = glm::vec3{glm::inverse(modelMatrix) * glm::vec4{camera.getPosition(), 1.f}};
+			push.coneCulling = uniformScale(gameObject.transform.scale) ? 1 : 0;
+
+			ModelResources &resources = resourcesFor(model);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawPipelineLayout, 0, 1, &resources.descriptorSet, 0, nullptr);
+			vkCmdPushConstants(commandBuffer, drawPipelineLayout, pushStages, 0, sizeof(MeshletDrawPushConstantData), &push);
+			cmdDrawMeshTasks(commandBuffer, (meshletCount + meshletsPerTask - 1) / meshletsPerTask, 1, 1);
+		}
+	}
+
+	void MeshletRendererSystem::recordIndirectDraws(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera, PassKind pass) {
+		HexPipeline *boundPipeline = nullptr;
+		auto projectionView = camera.getProjection() * camera.getViewMatrix();
+		const VkShaderStageFlags pushStages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		for (auto &gameObject : gameObjects) {
+			if (!drawsGameObject(gameObject)) continue;
+
+			// Draw commands only exist once cullGameObjects ran for the model
+			const HexModel &model = *gameObject.model;
+			auto it = modelResources.find(&model);
+			if (it == modelResources.end()) continue;
+			ModelResources &resources = it->second;
+
+			// Same vertex offsets in both streams, the prepass draws the same commands from the positions alone
+			HexPipeline &pipeline = pipelineFor(pass, model.getVertexFormat());
+			if (&pipeline != boundPipeline) {
+				pipeline.bind(commandBuffer);
+				if (pass == DEPTH_PREPASS) geometryArena.bindPositions(commandBuffer, model.getVertexFormat());
+				else geometryArena.bind(commandBuffer, model.getVertexFormat());
+				boundPipeline = &pipeline;
+			}
+
+			uint32_t meshletCount = static_cast<uint32_t>(model.getMeshlets().meshlets.size());
+			MeshletDrawPushConstantData push{};
+			push.color = gameObject.color;
+			push.meshletCount = meshletCount;
+			push.transform = projectionView * gameObject.transform.mat4() * model.getVertexTransform();
+			vkCmdPushConstants(commandBuffer, drawPipelineLayout, pushStages, 0, sizeof(MeshletDrawPushConstantData), &push);
+
+			const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+			if (resources.compacted) {
+				// Only the visible meshlets have commands, the culling phase counted them
+				vkCmdDrawIndexedIndirectCount(commandBuffer, resources.drawBuffer, 0, resources.countBuffer, 0, meshletCount, stride);
+			} else if (hexDevice.enabledFeatures().multiDrawIndirect) {
+				// Hidden meshlets have no instance, the command processor skips them
+				uint32_t maxDrawCount = hexDevice.properties.limits.maxDrawIndirectCount;
+				for (uint32_t first = 0; first < meshletCount; first += maxDrawCount) {
+					uint32_t count = glm::min(maxDrawCount, meshletCount - first);
+					vkCmdDrawIndexedIndirect(commandBuffer, resources.drawBuffer, static_cast<VkDeviceSize>(first) * stride, count, stride);
+				}
+			} else {
+				for (uint32_t meshlet = 0; meshlet < meshletCount; meshlet++) {
+					vkCmdDrawIndexedIndirect(commandBuffer, resources.drawBuffer, static_cast<VkDeviceSize>(meshlet) * stride, 1, stride);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include "HexCamera.h"
+#include "HexDepthPyramid.h"
+#include "HexGeometryArena.h"
+#include "HexPipeline.h"
+#include "HexPipelineManager.h"
+#include "hex_device.h"
+#include "HexGameObject.h"
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace hex {
+
+	// Draws the full resolution level of models with meshlets, culling each meshlet against
+	// the frustum and its normal cone:
+	//  - with VK_EXT_mesh_shader a task shader culls and launches mesh workgroups
+	//  - otherwise a compute pass writes the indexed indirect draws of the visible meshlets before the
+	//    render pass, compacted and drawn with a count when the device supports it.
+	//    With occlusion culling it only draws the meshlets visible last frame, a second compute pass
+	//    after the scene pass tests every meshlet and object against a depth pyramid of its depth
+	//    buffer, the meshlets found visible then are drawn in a second render pass.
+	//    Its draws have a depth only variant for the depth prepass.
+	// Models must outlive the system, their GPU meshlet data is created on first draw.
+	class MeshletRendererSystem {
+		public:
+
+		MeshletRendererSystem(HexDevice &device, const RenderTargetInfo &renderTarget, HexGeometryArena &geometryArena, HexPipelineManager &pipelineManager);
+		~MeshletRendererSystem();
+
+		MeshletRendererSystem(const MeshletRendererSystem&) = delete;
+		MeshletRendererSystem &operator=(const MeshletRendererSystem &) = delete;
+
+		bool usesMeshShaders() const { return meshShaders; }
+		// Indirect path: only the visible meshlets have commands, vkCmdDrawIndexedIndirectCount draws them
+		bool usesDrawCount() const { return drawCount; }
+
+		// Indirect path only, throws on the mesh shader path. Once enabled every frame must run
+		// cullOccludedGameObjects and draw again after it. No frame may be in flight when disabling.
+		void setOcclusionCulling(bool enabled, uint32_t framesInFlight);
+		bool usesOcclusionCulling() const { return occlusionPipeline != nullptr; }
+		// Counted by the last frame read back (a few frames old), 0 without occlusion culling
+		uint32_t getOccludedObjects() const { return occludedObjects; }
+		uint32_t getOccludedMeshlets() const { return occludedMeshlets; }
+
+		// Objects drawn by this system, other renderers skip them
+		bool drawsGameObject(const HexGameObject &gameObject) const;
+
+		// Record outside of the render pass, before renderGameObjects
+		void cullGameObjects(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera);
+		void renderGameObjects(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera);
+		// Indirect path: depths of the meshlets the next renderGameObjects draws, from the position stream.
+		// That call then only shades the visible fragments, a later one (disoccluded meshlets) draws as usual.
+		void renderDepthPrepass(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera);
+		// False on the mesh shader path or without the prepass shader, the objects then need another renderer during the prepass
+		bool hasDepthPrepass() const { return vertexPipelines[DEPTH_PREPASS][0] != nullptr; }
+		// Second phase of occlusion culling, outside of a render pass after the scene pass, once depthPyramid
+		// was built from its depth buffer. renderGameObjects in a pass loading the scene attachments then
+		// draws the meshlets the first phase missed.
+		void cullOccludedGameObjects(VkCommandBuffer commandBuffer, uint32_t frameIndex, const HexDepthPyramid &depthPyramid, std::vector<HexGameObject> &gameObjects, const HexCamera &camera);
+
+		private:
+		// Passes of the indirect path vertex pipelines, like SimpleRendererSystem's
+		enum PassKind {
+			COLOR_PASS,
+			// Depths already written by the prepass, tested equal without writes
+			COLOR_AFTER_PREPASS,
+			DEPTH_PREPASS,
+			PASS_KIND_COUNT
+		};
+
+		struct ModelResources {
+			VkBuffer meshletBuffer = VK_NULL_HANDLE;
+			VkDeviceMemory meshletMemory = VK_NULL_HANDLE;
+			// Indirect path: one VkDrawIndexedIndirectCommand per meshlet, or the visible ones first when compacted
+			VkBuffer drawBuffer = VK_NULL_HANDLE;
+			VkDeviceMemory drawMemory = VK_NULL_HANDLE;
+			// Indirect path: commands appended by the culling phases, one uint
+			VkBuffer countBuffer = VK_NULL_HANDLE;
+			VkDeviceMemory countMemory = VK_NULL_HANDLE;
+			bool compacted = false;
+			// Indirect path: meshlets visible in the last frame, then those the first phase drew, one uint each
+			VkBuffer visibilityBuffer = VK_NULL_HANDLE;
+			VkDeviceMemory visibilityMemory = VK_NULL_HANDLE;
+			// Mesh shader path: meshlet vertex and triangle lists
+			VkBuffer vertexBuffer = VK_NULL_HANDLE;
+			VkDeviceMemory vertexMemory = VK_NULL_HANDLE;
+			VkBuffer triangleBuffer = VK_NULL_HANDLE;
+			VkDeviceMemory triangleMemory = VK_NULL_HANDLE;
+
+			VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+			// Arena generation the descriptor set was written for
+			uint64_t arenaGeneration = ~0ull;
+		};
+
+		// Occlusion debug counters of a frame in flight, host visible
+		struct OcclusionFrame {
+			VkBuffer counterBuffer = VK_NULL_HANDLE;
+			VkDeviceMemory counterMemory = VK_NULL_HANDLE;
+			uint32_t *counters = nullptr;
+			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+			// Pyramid generation the descriptor set was written for
+			uint64_t pyramidGeneration = ~0ull;
+			bool pending = false;
+		};
+
+		void createDescriptorSetLayout();
+		void createOcclusionResources(uint32_t framesInFlight);
+		void destroyOcclusionResources();
+		void readOcclusionCounters(OcclusionFrame &frame);
+		// Orders a culling phase after the draws and phases before it, then clears the counts in clearedCounts
+		void beginCullingPhase(VkCommandBuffer commandBuffer);
+		void createPipelineLayouts();
+		void createPipelines(const RenderTargetInfo &renderTarget);
+		template <typename VertexT>
+		std::unique_ptr<HexPipeline> createVertexPipeline(const RenderTargetInfo &renderTarget, PassKind pass);
+		void recordIndirectDraws(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera, PassKind pass);
+
+		ModelResources &resourcesFor(const HexModel &model);
+		void updateDescriptorSet(const HexModel &model, ModelResources &resources);
+		void createDeviceBuffer(const void *data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer, VkDeviceMemory &memory);
+		void destroyResources(ModelResources &resources);
+
+		// Range of a vertex pool stream a mesh shader reads for the model, aligned for a storage buffer descriptor
+		void vertexRange(const HexModel &model, uint32_t stream, VkDeviceSize &offset, VkDeviceSize &range, uint32_t &wordOffset) const;
+		// Word offsets of both streams in their descriptor ranges, 16 bits each (below minStorageBufferOffsetAlignment / 4)
+		uint32_t vertexWordOffsets(const HexModel &model) const;
+
+		HexPipeline &pipelineFor(PassKind pass, HexVertexFormat format);
+
+		HexDevice &hexDevice;
+		HexGeometryArena &geometryArena;
+		HexPipelineManager &pipelineManager;
+		bool meshShaders;
+		// Draw counts above 1 need multiDrawIndirect too
+		bool drawCount;
+
+		VkDescriptorSetLayout descriptorSetLayout;
+		// Compute culling (indirect path only)
+		VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+		std::unique_ptr<HexPipeline> cullPipeline;
+		// Count buffers of the compacted models culled by the phase being recorded
+		std::vector<VkBuffer> clearedCounts;
+		// Drawing: mesh pipeline, or vertex pipelines indexed by pass kind and vertex format
+		VkPipelineLayout drawPipelineLayout;
+		std::unique_ptr<HexPipeline> meshPipeline;
+		std::unique_ptr<HexPipeline> vertexPipelines[PASS_KIND_COUNT][VERTEX_FORMAT_COUNT];
+		// Set by renderDepthPrepass, cleared by the renderGameObjects shading its depths
+		bool prepassed = false;
+
+		PFN_vkCmdDrawMeshTasksEXT cmdDrawMeshTasks = nullptr;
+
+		// Occlusion culling, second phase
+		VkDescriptorSetLayout occlusionSetLayout = VK_NULL_HANDLE;
+		VkPipelineLayout occlusionPipelineLayout = VK_NULL_HANDLE;
+		std::unique_ptr<HexPipeline> occlusionPipeline;
+		VkDescriptorPool occlusionDescriptorPool = VK_NULL_HANDLE;
+		std::vector<OcclusionFrame> occlusionFrames;
+		uint32_t occludedObjects = 0;
+		uint32_t occludedMeshlets = 0;
+		// Totals over the frames read back, logged on destruction
+		uint64_t occlusionFrameCount = 0;
+		uint64_t occludedObjectTotal = 0;
+		uint64_t occludedMeshletTotal = 0;
+
+		std::unordered_map<const HexModel*, ModelResources> modelResources;
+	};
+}
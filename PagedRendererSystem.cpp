@@ -0,0 +1,106 @@
+#include "PagedRendererSystem.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <stdexcept>
+#include <cassert>
+
+namespace hex {
+
+	struct PagedPushConstantData {
+		glm::mat4 transform{1.f};
+		alignas(16) glm::vec3 color;
+	};
+
+	PagedRendererSystem::PagedRendererSystem(HexDevice &device, const RenderTargetInfo &renderTarget, HexPipelineManager &pipelineManager)
+		: hexDevice{device}, pipelineManager{pipelineManager}, dynamicState{device, "Paged renderer"} {
+		createPipelineLayout();
+		try {
+			requestPipeline(renderTarget);
+		} catch (...) {
+			vkDestroyPipelineLayout(hexDevice.device(), pipelineLayout, nullptr);
+			throw;
+		}
+	}
+
+	PagedRendererSystem::~PagedRendererSystem() {
+		// Pipeline before its layout
+		pipelineManager.release(pipeline);
+		vkDestroyPipelineLayout(hexDevice.device(), pipelineLayout, nullptr);
+	}
+
+	void PagedRendererSystem::createPipelineLayout() {
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(PagedPushConstantData);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 0;
+		pipelineLayoutInfo.pSetLayouts = nullptr;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(hexDevice.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create pipeline layout");
+		}
+	}
+
+	// Pages are stored with full precision vertices, the simple shaders draw them as is
+	void PagedRendererSystem::requestPipeline(const RenderTargetInfo &renderTarget) {
+		assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
+
+		PipelineConfigInfo pipelineConfig{};
+		HexPipeline::defaultPipelineConfigInfo(pipelineConfig);
+		HexPipeline::setVertexLayout<FloatVertex>(pipelineConfig);
+		// Pages are written straight from the loader, their winding isn't oriented
+		pipelineConfig.rasterizationInfo.cullMode = VK_CULL_MODE_NONE;
+		HexPipeline::enableDynamicRenderState(pipelineConfig, hexDevice);
+		HexPipeline::setRenderTarget(pipelineConfig, renderTarget);
+		pipelineConfig.pipelineLayout = pipelineLayout;
+		renderState = RenderState::fromConfig(pipelineConfig);
+
+		pipeline = pipelineManager.request({
+			{VK_SHADER_STAGE_VERTEX_BIT, "shaders/simple_shader.vert.spv"},
+			{VK_SHADER_STAGE_FRAGMENT_BIT, "shaders/simple_shader.frag.spv"}
+		}, pipelineConfig);
+	}
+
+	void PagedRendererSystem::updateGameObjects(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera, float viewportHeight) {
+		for (auto &gameObject : gameObjects) {
+			if (!drawsGameObject(gameObject)) continue;
+			gameObject.pagedModel->update(commandBuffer, gameObject.transform.mat4(), camera, viewportHeight);
+		}
+	}
+
+	void PagedRendererSystem::renderGameObjects(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera) {
+		// Still compiling, uploads go on in updateGameObjects
+		HexPipeline *hexPipeline = pipelineManager.get(pipeline);
+		if (hexPipeline == nullptr) return;
+
+		dynamicState.begin(commandBuffer);
+		auto projectionView = camera.getProjection() * camera.getViewMatrix();
+
+		for (auto &gameObject : gameObjects) {
+			if (!drawsGameObject(gameObject)) continue;
+
+			dynamicState.bindPipeline(*hexPipeline, renderState);
+
+			PagedPushConstantData push{};
+			push.color = gameObject.color;
+			push.transform = projectionView * gameObject.transform.mat4();
+			vkCmdPushConstants(
+				commandBuffer,
+				pipelineLayout,
+				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+				0,
+				sizeof(PagedPushConstantData), &push
+			);
+
+			gameObject.pagedModel->draw(commandBuffer);
+		}
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "HexCamera.h"
+#include "HexDynamicState.h"
+#include "HexPipeline.h"
+#include "HexPipelineManager.h"
+#include "hex_device.h"
+#include "HexGameObject.h"
+
+#include <memory>
+#include <vector>
+
+namespace hex {
+
+	// Draws the objects with a paged model, the resident pages and the proxies of the others
+	class PagedRendererSystem {
+		public:
+
+		PagedRendererSystem(HexDevice &device, const RenderTargetInfo &renderTarget, HexPipelineManager &pipelineManager);
+		~PagedRendererSystem();
+
+		PagedRendererSystem(const PagedRendererSystem&) = delete;
+		PagedRendererSystem &operator=(const PagedRendererSystem &) = delete;
+
+		static bool drawsGameObject(const HexGameObject &gameObject) { return gameObject.pagedModel != nullptr; }
+
+		// Record page uploads and pick what to draw, outside of the render pass
+		void updateGameObjects(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera, float viewportHeight);
+		void renderGameObjects(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera);
+
+		private:
+
+		void createPipelineLayout();
+		void requestPipeline(const RenderTargetInfo &renderTarget);
+
+		HexDevice &hexDevice;
+		HexPipelineManager &pipelineManager;
+
+		HexPipelineManager::Handle pipeline = HexPipelineManager::NO_PIPELINE;
+		VkPipelineLayout pipelineLayout;
+		RenderState renderState;
+		HexDynamicState dynamicState;
+	};
+}
@@ -0,0 +1,199 @@
+#include "SeriesRendererSystem.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cassert>
+#include <stdexcept>
+
+namespace hex {
+
+	namespace {
+		// Positions and scalars come from two streams of one buffer
+		constexpr std::array<VkVertexInputBindingDescription, 2> seriesBindings{{
+			{0, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX},
+			{1, sizeof(float), VK_VERTEX_INPUT_RATE_VERTEX}
+		}};
+
+		constexpr std::array<VkVertexInputAttributeDescription, 2> seriesAttributes{{
+			{0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0},
+			{1, 1, VK_FORMAT_R32_SFLOAT, 0}
+		}};
+	}
+
+	// Layout of shaders/series.vert and series.frag
+	struct SeriesPushConstantData {
+		glm::mat4 transform{1.f};
+		float rangeMin;
+		// 1 / (max - min), 0 for a constant field
+		float rangeScale;
+	};
+
+	// constant_id of USE_SCALARS in shaders/series.frag
+	constexpr uint32_t USE_SCALARS_CONSTANT = 0;
+
+	SeriesRendererSystem::SeriesRendererSystem(HexDevice &device, const RenderTargetInfo &renderTarget, HexPipelineManager &pipelineManager)
+		: hexDevice{device}, pipelineManager{pipelineManager}, colormap{device}, dynamicState{device, "Series renderer"} {
+		try {
+			createDescriptorSet();
+			createPipelineLayout();
+			requestPipelines(renderTarget);
+		} catch (...) {
+			pipelineManager.release(scalarPipeline);
+			pipelineManager.release(shadedPipeline);
+			if (pipelineLayout != VK_NULL_HANDLE) vkDestroyPipelineLayout(hexDevice.device(), pipelineLayout, nullptr);
+			if (descriptorPool != VK_NULL_HANDLE) vkDestroyDescriptorPool(hexDevice.device(), descriptorPool, nullptr);
+			if (descriptorSetLayout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(hexDevice.device(), descriptorSetLayout, nullptr);
+			throw;
+		}
+	}
+
+	SeriesRendererSystem::~SeriesRendererSystem() {
+		// Pipelines before their layout
+		pipelineManager.release(scalarPipeline);
+		pipelineManager.release(shadedPipeline);
+		vkDestroyPipelineLayout(hexDevice.device(), pipelineLayout, nullptr);
+		vkDestroyDescriptorPool(hexDevice.device(), descriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(hexDevice.device(), descriptorSetLayout, nullptr);
+	}
+
+	// The colormap is the only descriptor, shared by every series
+	void SeriesRendererSystem::createDescriptorSet() {
+		VkDescriptorSetLayoutBinding binding{};
+		binding.binding = 0;
+		binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		binding.descriptorCount = 1;
+		binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = 1;
+		layoutInfo.pBindings = &binding;
+
+		if (vkCreateDescriptorSetLayout(hexDevice.device(), &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+			descriptorSetLayout = VK_NULL_HANDLE;
+			throw std::runtime_error("Failed to create descriptor set layout");
+		}
+
+		VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1};
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = 1;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &poolSize;
+
+		if (vkCreateDescriptorPool(hexDevice.device(), &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+			descriptorPool = VK_NULL_HANDLE;
+			throw std::runtime_error("Failed to create descriptor pool");
+		}
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = descriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &descriptorSetLayout;
+
+		if (vkAllocateDescriptorSets(hexDevice.device(), &allocInfo, &descriptorSet) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate descriptor set");
+		}
+
+		VkDescriptorImageInfo colormapInfo = colormap.descriptorInfo();
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = descriptorSet;
+		write.dstBinding = 0;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.pImageInfo = &colormapInfo;
+		vkUpdateDescriptorSets(hexDevice.device(), 1, &write, 0, nullptr);
+	}
+
+	void SeriesRendererSystem::createPipelineLayout() {
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(SeriesPushConstantData);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(hexDevice.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+			pipelineLayout = VK_NULL_HANDLE;
+			throw std::runtime_error("Failed to create pipeline layout");
+		}
+	}
+
+	void SeriesRendererSystem::requestPipelines(const RenderTargetInfo &renderTarget) {
+		assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
+
+		PipelineConfigInfo pipelineConfig{};
+		HexPipeline::defaultPipelineConfigInfo(pipelineConfig);
+		pipelineConfig.bindingDescriptions = seriesBindings.data();
+		pipelineConfig.bindingDescriptionCount = static_cast<uint32_t>(seriesBindings.size());
+		pipelineConfig.attributeDescriptions = seriesAttributes.data();
+		pipelineConfig.attributeDescriptionCount = static_cast<uint32_t>(seriesAttributes.size());
+		// Frames are decoded as recorded, nothing orients their winding
+		pipelineConfig.rasterizationInfo.cullMode = VK_CULL_MODE_NONE;
+		HexPipeline::enableDynamicRenderState(pipelineConfig, hexDevice);
+		HexPipeline::setRenderTarget(pipelineConfig, renderTarget);
+		pipelineConfig.pipelineLayout = pipelineLayout;
+		renderState = RenderState::fromConfig(pipelineConfig);
+
+		std::vector<ShaderStageInfo> stages{
+			{VK_SHADER_STAGE_VERTEX_BIT, "shaders/series.vert.spv"},
+			{VK_SHADER_STAGE_FRAGMENT_BIT, "shaders/series.frag.spv"}
+		};
+		// Requested first, it's compiled first
+		shadedPipeline = pipelineManager.request(stages, pipelineConfig, {{USE_SCALARS_CONSTANT, VK_FALSE}});
+		scalarPipeline = pipelineManager.request(stages, pipelineConfig, {{USE_SCALARS_CONSTANT, VK_TRUE}}, shadedPipeline);
+	}
+
+	void SeriesRendererSystem::updateGameObjects(VkCommandBuffer commandBuffer, int frameIndex, float dt, std::vector<HexGameObject> &gameObjects) {
+		for (auto &gameObject : gameObjects) {
+			if (!drawsGameObject(gameObject)) continue;
+			gameObject.series->update(commandBuffer, frameIndex, dt);
+		}
+	}
+
+	void SeriesRendererSystem::renderGameObjects(VkCommandBuffer commandBuffer, int frameIndex, std::vector<HexGameObject> &gameObjects, const HexCamera &camera) {
+		dynamicState.begin(commandBuffer);
+		auto projectionView = camera.getProjection() * camera.getViewMatrix();
+
+		for (auto &gameObject : gameObjects) {
+			if (!drawsGameObject(gameObject)) continue;
+
+			HexSeriesModel &series = *gameObject.series;
+			// Nothing decoded yet
+			if (!series.hasFrame()) continue;
+
+			// Shaded until the scalar permutation is compiled, nothing while neither is
+			HexPipeline *pipeline = pipelineManager.get(series.hasScalars() ? scalarPipeline : shadedPipeline);
+			if (pipeline == nullptr) continue;
+			if (dynamicState.bindPipeline(*pipeline, renderState)) {
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+			}
+
+			SeriesPushConstantData push{};
+			push.transform = projectionView * gameObject.transform.mat4();
+			push.rangeMin = series.getScalarMin();
+			float range = series.getScalarMax() - series.getScalarMin();
+			push.rangeScale = range > 0.f ? 1.f / range : 0.f;
+			vkCmdPushConstants(
+				commandBuffer,
+				pipelineLayout,
+				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+				0,
+				sizeof(SeriesPushConstantData), &push
+			);
+
+			series.bind(commandBuffer, frameIndex);
+			series.draw(commandBuffer);
+		}
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "HexCamera.h"
+#include "HexColormap.h"
+#include "HexDynamicState.h"
+#include "HexPipeline.h"
+#include "HexPipelineManager.h"
+#include "hex_device.h"
+#include "HexGameObject.h"
+
+#include <memory>
+#include <vector>
+
+namespace hex {
+
+	// Draws the objects playing a time series, from the vertex streams of the current frame.
+	// Scalars go through a colormap over the range of the whole series.
+	class SeriesRendererSystem {
+		public:
+
+		SeriesRendererSystem(HexDevice &device, const RenderTargetInfo &renderTarget, HexPipelineManager &pipelineManager);
+		~SeriesRendererSystem();
+
+		SeriesRendererSystem(const SeriesRendererSystem&) = delete;
+		SeriesRendererSystem &operator=(const SeriesRendererSystem &) = delete;
+
+		static bool drawsGameObject(const HexGameObject &gameObject) { return gameObject.series != nullptr; }
+
+		// Advance playback and record the stream copies, outside of the render pass
+		void updateGameObjects(VkCommandBuffer commandBuffer, int frameIndex, float dt, std::vector<HexGameObject> &gameObjects);
+		void renderGameObjects(VkCommandBuffer commandBuffer, int frameIndex, std::vector<HexGameObject> &gameObjects, const HexCamera &camera);
+
+		private:
+
+		void createDescriptorSet();
+		void createPipelineLayout();
+		void requestPipelines(const RenderTargetInfo &renderTarget);
+
+		HexDevice &hexDevice;
+		HexPipelineManager &pipelineManager;
+		HexColormap colormap;
+
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		// Constant color permutation, the fallback of the scalar one
+		HexPipelineManager::Handle shadedPipeline = HexPipelineManager::NO_PIPELINE;
+		HexPipelineManager::Handle scalarPipeline = HexPipelineManager::NO_PIPELINE;
+		RenderState renderState;
+		HexDynamicState dynamicState;
+	};
+}
@@ -1,4 +1,7 @@
 #include "SimpleRendererSystem.h"
+#include "CellFieldRendererSystem.h"
+#include "CellFilterSystem.h"
+#include "MeshletRendererSystem.h"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -6,6 +9,7 @@
 #include <glm/gtc/constants.hpp>
 
 #include <array>
+#include <iostream>
 #include <stdexcept>
 #include <cassert>
 
@@ -14,14 +18,23 @@ namespace hex {
 	struct SimplePushConstantData {
 		glm::mat4 transform{1.f}; // identity matrix (initialize diagonal by 1)
 		alignas(16) glm::vec3 color;
+		// Only read by simple_shader_barycentric.frag, 0 without wireframe
+		float wireWidth = 0.f;
 	};
 
-	SimpleRendererSystem::SimpleRendererSystem(HexDevice &device, VkRenderPass renderPass) : hexDevice{device} {
+	SimpleRendererSystem::SimpleRendererSystem(HexDevice &device, const RenderTargetInfo &renderTarget, HexGeometryArena &geometryArena, HexPipelineManager &pipelineManager)
+		: hexDevice{device}, geometryArena{geometryArena}, pipelineManager{pipelineManager}, dynamicState{device, "Simple renderer"} {
 		createPipelineLayout();
-		createPipeline(renderPass);
+		createPipelines(renderTarget);
 	}
 
 	SimpleRendererSystem::~SimpleRendererSystem() {
+		// Pipelines before their layout
+		for (auto &pass : pipelines) {
+			for (auto &format : pass) {
+				for (HexPipelineManager::Handle pipeline : format) pipelineManager.release(pipeline);
+			}
+		}
 		vkDestroyPipelineLayout(hexDevice.device(), pipelineLayout, nullptr);
 	}
 
@@ -45,45 +58,265 @@ namespace hex {
 		}
 	}
 
-	void SimpleRendererSystem::createPipeline(VkRenderPass renderPass) {
+	void SimpleRendererSystem::createPipelines(const RenderTargetInfo &renderTarget) {
+		const uint32_t floatFormat = static_cast<uint32_t>(HexVertexFormat::Float);
+		const uint32_t quantizedFormat = static_cast<uint32_t>(HexVertexFormat::Quantized);
+		const VkCullModeFlags cullModes[2] = {VK_CULL_MODE_BACK_BIT, VK_CULL_MODE_NONE};
+		hardwareBarycentrics = hexDevice.fragmentShaderBarycentricSupported();
+
+		// With dynamic cull mode the double sided requests get the culled pipelines,
+		// with dynamic depth state the color requests after the prepass get the color ones
+		for (uint32_t doubleSided = 0; doubleSided < 2; doubleSided++) {
+			for (PassKind pass : {COLOR_PASS, COLOR_AFTER_PREPASS}) {
+				pipelines[pass][floatFormat][doubleSided] = requestPipeline<FloatStreams>(renderTarget, pass, cullModes[doubleSided]);
+				pipelines[pass][quantizedFormat][doubleSided] = requestPipeline<QuantizedStreams>(renderTarget, pass, cullModes[doubleSided]);
+			}
+			pipelines[DEPTH_PREPASS][floatFormat][doubleSided] = HexPipelineManager::NO_PIPELINE;
+			pipelines[DEPTH_PREPASS][quantizedFormat][doubleSided] = HexPipelineManager::NO_PIPELINE;
+		}
+
+		// Optional, the color passes draw without it
+		try {
+			for (uint32_t doubleSided = 0; doubleSided < 2; doubleSided++) {
+				pipelines[DEPTH_PREPASS][floatFormat][doubleSided] = requestPipeline<FloatPosition>(renderTarget, DEPTH_PREPASS, cullModes[doubleSided]);
+				pipelines[DEPTH_PREPASS][quantizedFormat][doubleSided] = requestPipeline<QuantizedPosition>(renderTarget, DEPTH_PREPASS, cullModes[doubleSided]);
+			}
+			depthPrepassAvailable = true;
+		} catch (const std::exception &e) {
+			std::cerr << "Depth prepass disabled: " << e.what() << std::endl;
+		}
+	}
+
+	template <typename VertexT>
+	HexPipelineManager::Handle SimpleRendererSystem::requestPipeline(const RenderTargetInfo &renderTarget, PassKind pass, VkCullModeFlags cullMode) {
 		assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
 
 		PipelineConfigInfo pipelineConfig{};
 		HexPipeline::defaultPipelineConfigInfo(pipelineConfig);
-		pipelineConfig.renderPass = renderPass;
+		HexPipeline::setVertexLayout<VertexT>(pipelineConfig);
+		pipelineConfig.rasterizationInfo.cullMode = cullMode;
+		if (pass == COLOR_AFTER_PREPASS) {
+			pipelineConfig.depthStencilInfo.depthCompareOp = VK_COMPARE_OP_EQUAL;
+			pipelineConfig.depthStencilInfo.depthWriteEnable = VK_FALSE;
+		}
+		if (pass == DEPTH_PREPASS) {
+			// Same render target as the color pass, nothing written to the color attachment
+			pipelineConfig.colorBlendAttachment.colorWriteMask = 0;
+		}
+		HexPipeline::enableDynamicRenderState(pipelineConfig, hexDevice);
+		HexPipeline::setRenderTarget(pipelineConfig, renderTarget);
 		pipelineConfig.pipelineLayout = pipelineLayout;
+		renderStates[pass] = RenderState::fromConfig(pipelineConfig);
+
+		if (pass == DEPTH_PREPASS) {
+			return pipelineManager.request({
+				{VK_SHADER_STAGE_VERTEX_BIT, "shaders/depth_prepass.vert.spv"}
+			}, pipelineConfig);
+		}
+		return pipelineManager.request({
+			{VK_SHADER_STAGE_VERTEX_BIT, "shaders/simple_shader.vert.spv"},
+			{VK_SHADER_STAGE_FRAGMENT_BIT, hardwareBarycentrics ? "shaders/simple_shader_barycentric.frag.spv" : "shaders/simple_shader.frag.spv"}
+		}, pipelineConfig);
+	}
+
+	HexPipeline *SimpleRendererSystem::pipelineFor(PassKind pass, HexVertexFormat format, bool doubleSided) {
+		return pipelineManager.get(pipelines[pass][static_cast<uint32_t>(format)][doubleSided ? 1 : 0]);
+	}
+
+	bool SimpleRendererSystem::drawsGameObject(const HexGameObject &gameObject, const MeshletRendererSystem *meshletRenderer) const {
+		if (!gameObject.model) return false;
+		if (meshletRenderer != nullptr && meshletRenderer->drawsGameObject(gameObject)) return false;
+		if (CellFieldRendererSystem::drawsGameObject(gameObject)) return false;
+		if (CellFilterSystem::drawsGameObject(gameObject)) return false;
+		return true;
+	}
 
-		hexPipeline = std::make_unique<HexPipeline>(
-			hexDevice,
-			"shaders/simple_shader.vert.spv",
-			"shaders/simple_shader.frag.spv",
-			pipelineConfig
+	void SimpleRendererSystem::pushConstants(VkCommandBuffer commandBuffer, HexGameObject &gameObject, const glm::mat4 &projectionView) {
+		SimplePushConstantData push{};
+		push.color = gameObject.color;
+		push.wireWidth = wireframe ? WIREFRAME_WIDTH : 0.f;
+		// Vertex transform expands quantized positions back to model space
+		push.transform = projectionView * gameObject.transform.mat4() * gameObject.model->getVertexTransform();
+
+		vkCmdPushConstants(
+			commandBuffer, 
+			pipelineLayout, 
+			VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 
+			0, 
+			sizeof(SimplePushConstantData), &push
 		);
 	}
 
-	void SimpleRendererSystem::renderGameObjectObjects(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera) {
-		hexPipeline->bind(commandBuffer);
+	bool SimpleRendererSystem::culledGameObject(size_t index) const {
+		return objectOcclusion != nullptr && index < occlusionObjects.size() && occlusionObjects[index].indexCount != 0;
+	}
 
-		auto projectionView = camera.getProjection() * camera.getViewMatrix();
+	void SimpleRendererSystem::drawGameObject(VkCommandBuffer commandBuffer, size_t index, HexGameObject &gameObject) {
+		if (culledGameObject(index)) {
+			// Same draw as HexModel::draw, with the instance count of the culling phase
+			const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+			vkCmdDrawIndexedIndirect(commandBuffer, objectOcclusion->getDrawBuffer(), index * stride, 1, stride);
+		} else {
+			gameObject.model->draw(commandBuffer, gameObject.lod);
+		}
+	}
+
+	// Pick the coarsest level whose error, projected at the distance of the object bounds, stays under the threshold
+	uint32_t SimpleRendererSystem::selectLod(HexGameObject &gameObject, const HexCamera &camera, float pixelsPerUnit) const {
+		const HexModel &model = *gameObject.model;
+		if (model.getLodCount() <= 1) return 0;
+
+		glm::vec3 center = (model.getBoundsMin() + model.getBoundsMax()) * .5f;
+		float radius = glm::length(model.getBoundsMax() - model.getBoundsMin()) * .5f;
+		auto &scale = gameObject.transform.scale;
+		float maxScale = glm::max(glm::abs(scale.x), glm::max(glm::abs(scale.y), glm::abs(scale.z)));
+
+		glm::vec3 worldCenter{gameObject.transform.mat4() * glm::vec4{center, 1.f}};
+		float distance = glm::length(worldCenter - camera.getPosition()) - radius * maxScale;
+		// Camera inside the bounds, always full resolution
+		if (distance <= 0.f) return 0;
+
+		float errorToPixels = maxScale * pixelsPerUnit / distance;
+
+		uint32_t current = glm::min(gameObject.lod, model.getLodCount() - 1);
+		uint32_t refined = 0;
+		uint32_t coarsened = 0;
+		for (uint32_t lod = 0; lod < model.getLodCount(); lod++) {
+			float pixels = model.getLod(lod).error * errorToPixels;
+			if (pixels <= LOD_ERROR_PIXELS) refined = lod;
+			if (pixels <= LOD_ERROR_PIXELS * (1.f - LOD_HYSTERESIS)) coarsened = lod;
+		}
+
+		// Refine as soon as the current level is too coarse, coarsen only past the hysteresis band
+		if (model.getLod(current).error * errorToPixels > LOD_ERROR_PIXELS) return refined;
+		return glm::max(current, coarsened);
+	}
+
+	void SimpleRendererSystem::updateLods(std::vector<HexGameObject> &gameObjects, const HexCamera &camera, float viewportHeight) const {
+		// Pixels covered by one world unit at distance 1, projection[1][1] is 1 / tan(fovy / 2)
+		float pixelsPerUnit = camera.getProjection()[1][1] * viewportHeight * .5f;
 
 		for (auto &gameObject : gameObjects) {
+			if (!gameObject.model) continue;
+			gameObject.lod = selectLod(gameObject, camera, pixelsPerUnit);
+		}
+	}
+
+	void SimpleRendererSystem::renderGameObjectObjects(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera, const MeshletRendererSystem *meshletRenderer) {
+		// Only rebind the pipeline and the arena buffers when the vertex format changes
+		dynamicState.begin(commandBuffer);
+
+		auto projectionView = camera.getProjection() * camera.getViewMatrix();
+
+		for (size_t i = 0; i < gameObjects.size(); i++) {
+			auto &gameObject = gameObjects[i];
 			// gameObject.transform.rotation.y = glm::mod(gameObject.transform.rotation.y + 0.001f, glm::two_pi<float>());
 			// gameObject.transform.rotation.z = glm::mod(gameObject.transform.rotation.z + 0.002f, glm::two_pi<float>());
 
-			SimplePushConstantData push{};
-			push.color = gameObject.color;
-			push.transform = projectionView * gameObject.transform.mat4();
+			if (!drawsGameObject(gameObject, meshletRenderer)) continue;
+
+			PassKind pass = depthPrepass && i < prepassed.size() && prepassed[i] ? COLOR_AFTER_PREPASS : COLOR_PASS;
+			RenderState &renderState = renderStates[pass];
+			HexPipeline *pipeline = pipelineFor(pass, gameObject.model->getVertexFormat(), gameObject.model->isDoubleSided());
+			if (pipeline == nullptr) continue;
+			renderState.cullMode = gameObject.model->getCullMode();
+			if (dynamicState.bindPipeline(*pipeline, renderState)) {
+				geometryArena.bind(commandBuffer, gameObject.model->getVertexFormat());
+			}
+
+			pushConstants(commandBuffer, gameObject, projectionView);
+			drawGameObject(commandBuffer, i, gameObject);
+		}
+	}
+
+	void SimpleRendererSystem::renderDepthPrepass(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera, const MeshletRendererSystem *meshletRenderer) {
+		dynamicState.begin(commandBuffer);
+		RenderState &renderState = renderStates[DEPTH_PREPASS];
+
+		auto projectionView = camera.getProjection() * camera.getViewMatrix();
+
+		prepassed.assign(gameObjects.size(), false);
+		for (size_t i = 0; i < gameObjects.size(); i++) {
+			auto &gameObject = gameObjects[i];
+			if (!drawsGameObject(gameObject, meshletRenderer)) continue;
+
+			HexPipeline *pipeline = pipelineFor(DEPTH_PREPASS, gameObject.model->getVertexFormat(), gameObject.model->isDoubleSided());
+			if (pipeline == nullptr) continue;
+			prepassed[i] = true;
+			renderState.cullMode = gameObject.model->getCullMode();
+			if (dynamicState.bindPipeline(*pipeline, renderState)) {
+				geometryArena.bindPositions(commandBuffer, gameObject.model->getVertexFormat());
+			}
+
+			pushConstants(commandBuffer, gameObject, projectionView);
+			drawGameObject(commandBuffer, i, gameObject);
+		}
+	}
+
+	void SimpleRendererSystem::setOcclusionCulling(bool enabled, uint32_t framesInFlight) {
+		if (enabled == usesOcclusionCulling())
+			return;
+		occlusionObjects.clear();
+		if (!enabled) {
+			objectOcclusion.reset();
+			return;
+		}
+		objectOcclusion = std::make_unique<HexObjectOcclusion>(hexDevice, framesInFlight, pipelineManager);
+	}
+
+	void SimpleRendererSystem::cullGameObjects(VkCommandBuffer commandBuffer, uint32_t frameIndex, std::vector<HexGameObject> &gameObjects, const HexCamera &camera, const MeshletRendererSystem *meshletRenderer) {
+		if (!objectOcclusion)
+			return;
+
+		auto projectionView = camera.getProjection() * camera.getViewMatrix();
+
+		occlusionObjects.assign(gameObjects.size(), {});
+		for (size_t i = 0; i < gameObjects.size(); i++) {
+			auto &gameObject = gameObjects[i];
+			if (!drawsGameObject(gameObject, meshletRenderer) || !gameObject.model->isIndexed()) continue;
+
+			const HexModel &model = *gameObject.model;
+			VkDrawIndexedIndirectCommand command = model.indirectCommand(gameObject.lod);
+			HexObjectOcclusion::Object &object = occlusionObjects[i];
+			// Bounds of the model space positions, before any vertex transform
+			object.clip = projectionView * gameObject.transform.mat4();
+			object.boundsMin = model.getBoundsMin();
+			object.boundsMax = model.getBoundsMax();
+			object.indexCount = command.indexCount;
+			object.firstIndex = command.firstIndex;
+			object.vertexOffset = command.vertexOffset;
+		}
+		objectOcclusion->cull(commandBuffer, frameIndex, occlusionObjects);
+	}
+
+	void SimpleRendererSystem::cullOccludedGameObjects(VkCommandBuffer commandBuffer, uint32_t frameIndex, const HexDepthPyramid &depthPyramid) {
+		if (!objectOcclusion)
+			return;
+		objectOcclusion->cullOccluded(commandBuffer, frameIndex, depthPyramid);
+	}
+
+	void SimpleRendererSystem::renderDisoccludedGameObjects(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera) {
+		if (!objectOcclusion)
+			return;
+		dynamicState.begin(commandBuffer);
+		RenderState &renderState = renderStates[COLOR_PASS];
+
+		auto projectionView = camera.getProjection() * camera.getViewMatrix();
+
+		for (size_t i = 0; i < gameObjects.size(); i++) {
+			if (!culledGameObject(i)) continue;
+			auto &gameObject = gameObjects[i];
 
-			vkCmdPushConstants(
-				commandBuffer, 
-				pipelineLayout, 
-				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 
-				0, 
-				sizeof(SimplePushConstantData), &push
-			);
+			// No prepass depths for these, the plain color pass
+			HexPipeline *pipeline = pipelineFor(COLOR_PASS, gameObject.model->getVertexFormat(), gameObject.model->isDoubleSided());
+			if (pipeline == nullptr) continue;
+			renderState.cullMode = gameObject.model->getCullMode();
+			if (dynamicState.bindPipeline(*pipeline, renderState)) {
+				geometryArena.bind(commandBuffer, gameObject.model->getVertexFormat());
+			}
 
-			gameObject.model->bind(commandBuffer);
-			gameObject.model->draw(commandBuffer);
+			pushConstants(commandBuffer, gameObject, projectionView);
+			drawGameObject(commandBuffer, i, gameObject);
 		}
 	}
 
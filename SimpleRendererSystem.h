@@ -1,7 +1,12 @@
 #pragma once
 
 #include "HexCamera.h"
+#include "HexDepthPyramid.h"
+#include "HexDynamicState.h"
+#include "HexGeometryArena.h"
+#include "HexObjectOcclusion.h"
 #include "HexPipeline.h"
+#include "HexPipelineManager.h"
 #include "hex_device.h"
 #include "HexGameObject.h"
 
@@ -9,26 +14,102 @@
 #include <vector>
 
 namespace hex {
+	class MeshletRendererSystem;
+
 	class SimpleRendererSystem {
 		public:
 
-		SimpleRendererSystem(HexDevice &device, VkRenderPass renderPass);
+		SimpleRendererSystem(HexDevice &device, const RenderTargetInfo &renderTarget, HexGeometryArena &geometryArena, HexPipelineManager &pipelineManager);
 		~SimpleRendererSystem();
 
 		SimpleRendererSystem(const SimpleRendererSystem&) = delete;
 		SimpleRendererSystem &operator=(const SimpleRendererSystem &) = delete;
 
-		void renderGameObjectObjects(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera);
+		// Largest projected geometric error tolerated when picking a level of detail, in pixels
+		static constexpr float LOD_ERROR_PIXELS = 1.f;
+		// A coarser level is only taken once its error is this fraction below the threshold, avoids flickering
+		static constexpr float LOD_HYSTERESIS = .25f;
+		// Edge lines of the wireframe overlay, in pixels
+		static constexpr float WIREFRAME_WIDTH = 1.f;
+
+		// Pick the level of detail of every object, before any renderer records the frame
+		void updateLods(std::vector<HexGameObject> &gameObjects, const HexCamera &camera, float viewportHeight) const;
+		// Objects drawn by meshletRenderer, with a cell field or without a model are skipped,
+		// objects whose pipeline is still compiling too
+		void renderGameObjectObjects(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera, const MeshletRendererSystem *meshletRenderer = nullptr);
+		// Depths of the same objects from their position streams, no fragment shader. Recorded before
+		// renderGameObjectObjects in the same pass, which then only shades the visible fragments.
+		void renderDepthPrepass(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera, const MeshletRendererSystem *meshletRenderer = nullptr);
+
+		// Stays off without the prepass shader
+		void setDepthPrepass(bool enabled) { depthPrepass = enabled && depthPrepassAvailable; }
+		bool usesDepthPrepass() const { return depthPrepass; }
+		bool hasDepthPrepass() const { return depthPrepassAvailable; }
+
+		// Triangle edges drawn over the color passes in the same draws. Stays off without
+		// VK_KHR_fragment_shader_barycentric, shared vertices leave no barycentrics to interpolate.
+		void setWireframe(bool enabled) { wireframe = enabled && hardwareBarycentrics; }
+		bool getWireframe() const { return wireframe; }
+		bool hasWireframe() const { return hardwareBarycentrics; }
+
+		// Two phase occlusion culling of the indexed objects (HexObjectOcclusion), their draws then read
+		// its commands. Once enabled every frame runs cullGameObjects before the scene pass,
+		// cullOccludedGameObjects after it and renderDisoccludedGameObjects in a pass loading the scene
+		// attachments. No frame may be in flight when disabling.
+		void setOcclusionCulling(bool enabled, uint32_t framesInFlight);
+		bool usesOcclusionCulling() const { return objectOcclusion != nullptr; }
+		// Outside of a render pass after updateLods, with the meshletRenderer the frame's draws get
+		void cullGameObjects(VkCommandBuffer commandBuffer, uint32_t frameIndex, std::vector<HexGameObject> &gameObjects, const HexCamera &camera, const MeshletRendererSystem *meshletRenderer = nullptr);
+		// Outside of a render pass after the scene pass, once depthPyramid was built from its depth buffer
+		void cullOccludedGameObjects(VkCommandBuffer commandBuffer, uint32_t frameIndex, const HexDepthPyramid &depthPyramid);
+		// The culled objects the first phase missed, the others were drawn by the scene pass
+		void renderDisoccludedGameObjects(VkCommandBuffer commandBuffer, std::vector<HexGameObject> &gameObjects, const HexCamera &camera);
 
 		private:
 
+		enum PassKind {
+			COLOR_PASS,
+			// Depths already written by the prepass, tested equal without writes
+			COLOR_AFTER_PREPASS,
+			DEPTH_PREPASS,
+			PASS_KIND_COUNT
+		};
+
 		void createPipelineLayout();
-		void createPipeline(VkRenderPass renderPass);
+		void createPipelines(const RenderTargetInfo &renderTarget);
+		template <typename VertexT>
+		HexPipelineManager::Handle requestPipeline(const RenderTargetInfo &renderTarget, PassKind pass, VkCullModeFlags cullMode);
+
+		HexPipeline *pipelineFor(PassKind pass, HexVertexFormat format, bool doubleSided);
+		bool drawsGameObject(const HexGameObject &gameObject, const MeshletRendererSystem *meshletRenderer) const;
+		void pushConstants(VkCommandBuffer commandBuffer, HexGameObject &gameObject, const glm::mat4 &projectionView);
+		// From the occlusion commands when the last cullGameObjects culled the object
+		bool culledGameObject(size_t index) const;
+		void drawGameObject(VkCommandBuffer commandBuffer, size_t index, HexGameObject &gameObject);
+		uint32_t selectLod(HexGameObject &gameObject, const HexCamera &camera, float pixelsPerUnit) const;
 
 		HexDevice &hexDevice;
+		HexGeometryArena &geometryArena;
+		HexPipelineManager &pipelineManager;
 
-		std::unique_ptr<HexPipeline> hexPipeline;
+		// Indexed by pass kind, vertex format and double sided (open models, HexModel::isDoubleSided).
+		// With dynamic depth state the color pass kinds share their pipelines.
+		HexPipelineManager::Handle pipelines[PASS_KIND_COUNT][VERTEX_FORMAT_COUNT][2];
 		VkPipelineLayout pipelineLayout;
+		RenderState renderStates[PASS_KIND_COUNT];
+		bool depthPrepass = false;
+		bool depthPrepassAvailable = false;
+		bool wireframe = false;
+		// The color passes use simple_shader_barycentric.frag
+		bool hardwareBarycentrics = false;
+		// Objects whose depths the prepass wrote this frame, indexed like gameObjects.
+		// The others (prepass pipeline still compiling) keep the plain color pass.
+		std::vector<bool> prepassed;
+		HexDynamicState dynamicState;
+		std::unique_ptr<HexObjectOcclusion> objectOcclusion;
+		// Slots of the last cullGameObjects, indexed like gameObjects. Objects drawn directly
+		// (not indexed, or not drawn by this system) have no indices.
+		std::vector<HexObjectOcclusion::Object> occlusionObjects;
 
 	};
 }
\ No newline at end of file
@@ -73,8 +73,8 @@ bool VulkanInstance::isDeviceSuitable(VkPhysicalDevice device) {
 	vkGetPhysicalDeviceProperties(device, &deviceProperties);
 	vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
 
-	bool res = deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
-           deviceFeatures.geometryShader;
+	// Any device, pickPhysicalDevice prefers discrete GPUs
+	bool res = deviceFeatures.geometryShader;
 	
 	std::cout << 
 		"Physical device found: " << 
@@ -99,10 +99,14 @@ VulkanPhysicalDevice VulkanInstance::pickPhysicalDevice() {
 	vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
 
 	for (const auto& device : devices) {
-		if (isDeviceSuitable(device)) {
+		if (!isDeviceSuitable(device)) continue;
+		VkPhysicalDeviceProperties deviceProperties;
+		vkGetPhysicalDeviceProperties(device, &deviceProperties);
+		if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
 			physicalDevice = device;
 			break;
 		}
+		if (physicalDevice == VK_NULL_HANDLE) physicalDevice = device;
 	}
 
 	if (physicalDevice == VK_NULL_HANDLE) {
@@ -1,2 +1,21 @@
 /usr/bin/glslc shaders/simple_shader.vert -o shaders/simple_shader.vert.spv
-/usr/bin/glslc shaders/simple_shader.frag -o shaders/simple_shader.frag.spv
\ No newline at end of file
+/usr/bin/glslc shaders/simple_shader.frag -o shaders/simple_shader.frag.spv
+/usr/bin/glslc shaders/meshlet_cull.comp -o shaders/meshlet_cull.comp.spv
+/usr/bin/glslc --target-env=vulkan1.2 shaders/meshlet.task -o shaders/meshlet.task.spv
+/usr/bin/glslc --target-env=vulkan1.2 shaders/meshlet.mesh -o shaders/meshlet.mesh.spv
+/usr/bin/glslc shaders/cell_field.vert -o shaders/cell_field.vert.spv
+/usr/bin/glslc shaders/cell_field.frag -o shaders/cell_field.frag.spv
+/usr/bin/glslc shaders/cell_filter.comp -o shaders/cell_filter.comp.spv
+/usr/bin/glslc shaders/face_count.comp -o shaders/face_count.comp.spv
+/usr/bin/glslc shaders/group_scan.comp -o shaders/group_scan.comp.spv
+/usr/bin/glslc shaders/face_compact.comp -o shaders/face_compact.comp.spv
+/usr/bin/glslc shaders/cell_quality.comp -o shaders/cell_quality.comp.spv
+/usr/bin/glslc shaders/cell_histogram.comp -o shaders/cell_histogram.comp.spv
+/usr/bin/glslc shaders/cell_faces.vert -o shaders/cell_faces.vert.spv
+/usr/bin/glslc shaders/cell_faces.frag -o shaders/cell_faces.frag.spv
+/usr/bin/glslc shaders/cell_faces_barycentric.frag -o shaders/cell_faces_barycentric.frag.spv
+/usr/bin/glslc shaders/series.vert -o shaders/series.vert.spv
+/usr/bin/glslc shaders/series.frag -o shaders/series.frag.spv
+/usr/bin/glslc shaders/depth_prepass.vert -o shaders/depth_prepass.vert.spv
+/usr/bin/glslc shaders/meshlet_occlusion.comp -o shaders/meshlet_occlusion.comp.spv
+/usr/bin/glslc shaders/depth_pyramid.comp -o shaders/depth_pyramid.comp.spv
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "hex_device.h"
 
 // std headers
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <set>
@@ -47,7 +48,7 @@ void DestroyDebugUtilsMessengerEXT(
 }
 
 // class member functions
-HexDevice::HexDevice(HexWindow &window) : window{window} {
+HexDevice::HexDevice(HexWindow &window) : window{&window} {
   createInstance();
   setupDebugMessenger();
   createSurface();
@@ -56,6 +57,15 @@ HexDevice::HexDevice(HexWindow &window) : window{window} {
   createCommandPool();
 }
 
+HexDevice::HexDevice() : window{nullptr} {
+  deviceExtensions.clear();
+  createInstance();
+  setupDebugMessenger();
+  pickPhysicalDevice();
+  createLogicalDevice();
+  createCommandPool();
+}
+
 HexDevice::~HexDevice() {
   vkDestroyCommandPool(device_, commandPool, nullptr);
   vkDestroyDevice(device_, nullptr);
@@ -64,7 +74,7 @@ HexDevice::~HexDevice() {
     DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
   }
 
-  vkDestroySurfaceKHR(instance, surface_, nullptr);
+  if (surface_ != VK_NULL_HANDLE) vkDestroySurfaceKHR(instance, surface_, nullptr);
   vkDestroyInstance(instance, nullptr);
 }
 
@@ -73,13 +83,23 @@ void HexDevice::createInstance() {
     throw std::runtime_error("validation layers requested, but not available!");
   }
 
+  // Highest version the loader offers, 1.0 loaders don't have vkEnumerateInstanceVersion
+  uint32_t instanceVersion = VK_API_VERSION_1_0;
+  auto enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(
+      nullptr,
+      "vkEnumerateInstanceVersion");
+  if (enumerateInstanceVersion != nullptr) {
+    enumerateInstanceVersion(&instanceVersion);
+  }
+  apiVersion_ = std::min(instanceVersion, static_cast<uint32_t>(VK_API_VERSION_1_3));
+
   VkApplicationInfo appInfo = {};
   appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
   appInfo.pApplicationName = "LittleVulkanEngine App";
   appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
   appInfo.pEngineName = "No Engine";
   appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-  appInfo.apiVersion = VK_API_VERSION_1_0;
+  appInfo.apiVersion = apiVersion_;
 
   VkInstanceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -118,11 +138,17 @@ void HexDevice::pickPhysicalDevice() {
   std::vector<VkPhysicalDevice> devices(deviceCount);
   vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
 
+  // A discrete GPU when there is one, otherwise any suitable device (integrated GPUs,
+  // software rasterizers like lavapipe)
   for (const auto &device : devices) {
-    if (isDeviceSuitable(device)) {
+    if (!isDeviceSuitable(device)) continue;
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(device, &deviceProperties);
+    if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
       physicalDevice = device;
       break;
     }
+    if (physicalDevice == VK_NULL_HANDLE) physicalDevice = device;
   }
 
   if (physicalDevice == VK_NULL_HANDLE) {
@@ -131,6 +157,7 @@ void HexDevice::pickPhysicalDevice() {
 
   vkGetPhysicalDeviceProperties(physicalDevice, &properties);
   std::cout << "physical device: " << properties.deviceName << std::endl;
+  apiVersion_ = std::min(apiVersion_, properties.apiVersion);
 }
 
 void HexDevice::createLogicalDevice() {
@@ -149,10 +176,123 @@ void HexDevice::createLogicalDevice() {
     queueCreateInfos.push_back(queueCreateInfo);
   }
 
+  VkPhysicalDeviceFeatures supportedFeatures;
+  vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
   VkPhysicalDeviceFeatures deviceFeatures = {};
   deviceFeatures.samplerAnisotropy = VK_TRUE;
   // deviceFeatures.fillModeNonSolid = VK_TRUE;
   // deviceFeatures.wideLines = VK_TRUE;
+  // One indirect call for all the meshlets of a model, otherwise one call per meshlet
+  deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+  // gl_PrimitiveID in fragment shaders (cell fields look up their cell per triangle)
+  deviceFeatures.geometryShader = supportedFeatures.geometryShader;
+  enabledFeatures_ = deviceFeatures;
+
+  std::vector<const char *> extensions = deviceExtensions;
+  for (const char *extension : selectOptionalExtensions()) {
+    extensions.push_back(extension);
+    enabledExtensions.push_back(extension);
+  }
+
+  // Features of the optional extensions, chained in createInfo.pNext
+  VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures = {};
+  meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+  VkPhysicalDeviceFragmentShaderBarycentricFeaturesKHR barycentricFeatures = {};
+  barycentricFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADER_BARYCENTRIC_FEATURES_KHR;
+  VkPhysicalDeviceMaintenance5FeaturesKHR maintenance5Features = {};
+  maintenance5Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_5_FEATURES_KHR;
+  VkPhysicalDeviceShaderModuleIdentifierFeaturesEXT shaderModuleIdentifierFeatures = {};
+  shaderModuleIdentifierFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_MODULE_IDENTIFIER_FEATURES_EXT;
+  VkPhysicalDeviceExtendedDynamicStateFeaturesEXT extendedDynamicStateFeatures = {};
+  extendedDynamicStateFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+  VkPhysicalDeviceExtendedDynamicState2FeaturesEXT extendedDynamicState2Features = {};
+  extendedDynamicState2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_2_FEATURES_EXT;
+  VkPhysicalDeviceExtendedDynamicState3FeaturesEXT extendedDynamicState3Features = {};
+  extendedDynamicState3Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+  VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+  vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  VkPhysicalDeviceVulkan13Features vulkan13Features = {};
+  vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+  void *featureChain = nullptr;
+  if (isExtensionEnabled(VK_EXT_MESH_SHADER_EXTENSION_NAME)) {
+    meshShaderFeatures.taskShader = VK_TRUE;
+    meshShaderFeatures.meshShader = VK_TRUE;
+    meshShaderFeatures.pNext = featureChain;
+    featureChain = &meshShaderFeatures;
+    meshShaderSupported_ = true;
+  }
+  if (isExtensionEnabled(VK_KHR_FRAGMENT_SHADER_BARYCENTRIC_EXTENSION_NAME)) {
+    barycentricFeatures.fragmentShaderBarycentric = VK_TRUE;
+    barycentricFeatures.pNext = featureChain;
+    featureChain = &barycentricFeatures;
+    fragmentShaderBarycentricSupported_ = true;
+  }
+  if (isExtensionEnabled(VK_KHR_MAINTENANCE_5_EXTENSION_NAME)) {
+    maintenance5Features.maintenance5 = VK_TRUE;
+    maintenance5Features.pNext = featureChain;
+    featureChain = &maintenance5Features;
+    maintenance5Supported_ = true;
+  }
+  if (isExtensionEnabled(VK_EXT_SHADER_MODULE_IDENTIFIER_EXTENSION_NAME)) {
+    shaderModuleIdentifierFeatures.shaderModuleIdentifier = VK_TRUE;
+    shaderModuleIdentifierFeatures.pNext = featureChain;
+    featureChain = &shaderModuleIdentifierFeatures;
+    // Identifier only pipelines must be allowed to fail with VK_PIPELINE_COMPILE_REQUIRED
+    vulkan13Features.pipelineCreationCacheControl = VK_TRUE;
+    shaderModuleIdentifierSupported_ = true;
+  }
+  if (isExtensionEnabled(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME)) {
+    extendedDynamicStateFeatures.extendedDynamicState = VK_TRUE;
+    extendedDynamicStateFeatures.pNext = featureChain;
+    featureChain = &extendedDynamicStateFeatures;
+    extendedDynamicStateSupported_ = true;
+  }
+  if (isExtensionEnabled(VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME)) {
+    extendedDynamicState2Features.extendedDynamicState2 = VK_TRUE;
+    extendedDynamicState2Features.pNext = featureChain;
+    featureChain = &extendedDynamicState2Features;
+    extendedDynamicState2Supported_ = true;
+  }
+  if (isExtensionEnabled(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME)) {
+    // Only the polygon mode is used
+    extendedDynamicState3Features.extendedDynamicState3PolygonMode = VK_TRUE;
+    extendedDynamicState3Features.pNext = featureChain;
+    featureChain = &extendedDynamicState3Features;
+    extendedDynamicState3PolygonModeSupported_ = true;
+  }
+  if (apiVersion_ >= VK_API_VERSION_1_2) {
+    // Core features, no extension to select
+    VkPhysicalDeviceVulkan12Features supported12Features = {};
+    supported12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 features = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &supported12Features;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+    if (supported12Features.drawIndirectCount) {
+      vulkan12Features.drawIndirectCount = VK_TRUE;
+      drawIndirectCountSupported_ = true;
+    }
+
+    vulkan12Features.pNext = featureChain;
+    featureChain = &vulkan12Features;
+  }
+  if (apiVersion_ >= VK_API_VERSION_1_3) {
+    // Core features, no extension to select
+    VkPhysicalDeviceVulkan13Features supported13Features = {};
+    supported13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    VkPhysicalDeviceFeatures2 features = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &supported13Features;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+    if (supported13Features.dynamicRendering) {
+      vulkan13Features.dynamicRendering = VK_TRUE;
+      dynamicRenderingSupported_ = true;
+    }
+
+    vulkan13Features.pNext = featureChain;
+    featureChain = &vulkan13Features;
+  }
 
   VkDeviceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -161,8 +301,9 @@ void HexDevice::createLogicalDevice() {
   createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
   createInfo.pEnabledFeatures = &deviceFeatures;
-  createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-  createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+  createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+  createInfo.ppEnabledExtensionNames = extensions.data();
+  createInfo.pNext = featureChain;
 
   // might not really be necessary anymore because device specific validation layers
   // have been deprecated
@@ -195,15 +336,16 @@ void HexDevice::createCommandPool() {
   }
 }
 
-void HexDevice::createSurface() { window.createWindowSurface(instance, &surface_); }
+void HexDevice::createSurface() { window->createWindowSurface(instance, &surface_); }
 
 bool HexDevice::isDeviceSuitable(VkPhysicalDevice device) {
   QueueFamilyIndices indices = findQueueFamilies(device);
 
   bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-  bool swapChainAdequate = false;
-  if (extensionsSupported) {
+  // Nothing is presented without a window
+  bool swapChainAdequate = window == nullptr;
+  if (extensionsSupported && window != nullptr) {
     SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
     swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
   }
@@ -211,13 +353,9 @@ bool HexDevice::isDeviceSuitable(VkPhysicalDevice device) {
   VkPhysicalDeviceFeatures supportedFeatures;
   vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
-  VkPhysicalDeviceProperties deviceProperties;
-  vkGetPhysicalDeviceProperties(device, &deviceProperties);
-
-  // return indices.isComplete() && extensionsSupported && swapChainAdequate &&
-  //        supportedFeatures.samplerAnisotropy;
+  // Geometry shaders are optional, the systems needing them are disabled without (see enabledFeatures)
   return indices.isComplete() && extensionsSupported && swapChainAdequate &&
-         supportedFeatures.samplerAnisotropy && supportedFeatures.geometryShader && deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU /* Needed a true GPU not NVIDIA integrated :) */;
+         supportedFeatures.samplerAnisotropy;
 }
 
 void HexDevice::populateDebugMessengerCreateInfo(
@@ -268,11 +406,13 @@ bool HexDevice::checkValidationLayerSupport() {
 }
 
 std::vector<const char *> HexDevice::getRequiredExtensions() {
-  uint32_t glfwExtensionCount = 0;
-  const char **glfwExtensions;
-  glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-  std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  std::vector<const char *> extensions;
+  if (window != nullptr) {
+    uint32_t glfwExtensionCount = 0;
+    const char **glfwExtensions;
+    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  }
 
   if (enableValidationLayers) {
     extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -324,6 +464,131 @@ bool HexDevice::checkDeviceExtensionSupport(VkPhysicalDevice device) {
   return requiredExtensions.empty();
 }
 
+std::vector<const char *> HexDevice::selectOptionalExtensions() {
+  uint32_t extensionCount;
+  vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+
+  std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(
+      physicalDevice,
+      nullptr,
+      &extensionCount,
+      availableExtensions.data());
+
+  std::set<std::string> available;
+  for (const auto &extension : availableExtensions) {
+    available.insert(extension.extensionName);
+  }
+
+  std::vector<const char *> selected;
+  for (const char *extension : optionalDeviceExtensions) {
+    if (available.count(extension) == 0) continue;
+
+    if (strcmp(extension, VK_EXT_MESH_SHADER_EXTENSION_NAME) == 0) {
+      // Mesh shaders are SPIR-V 1.4, core since 1.2
+      if (apiVersion_ < VK_API_VERSION_1_2) continue;
+
+      VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures = {};
+      meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+      VkPhysicalDeviceFeatures2 features = {};
+      features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+      features.pNext = &meshShaderFeatures;
+      vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+      if (!meshShaderFeatures.taskShader || !meshShaderFeatures.meshShader) continue;
+    }
+
+    if (strcmp(extension, VK_KHR_FRAGMENT_SHADER_BARYCENTRIC_EXTENSION_NAME) == 0) {
+      // Feature query through vkGetPhysicalDeviceFeatures2, core since 1.1
+      if (apiVersion_ < VK_API_VERSION_1_1) continue;
+
+      VkPhysicalDeviceFragmentShaderBarycentricFeaturesKHR barycentricFeatures = {};
+      barycentricFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADER_BARYCENTRIC_FEATURES_KHR;
+      VkPhysicalDeviceFeatures2 features = {};
+      features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+      features.pNext = &barycentricFeatures;
+      vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+      if (!barycentricFeatures.fragmentShaderBarycentric) continue;
+    }
+
+    if (strcmp(extension, VK_KHR_MAINTENANCE_5_EXTENSION_NAME) == 0) {
+      // Needs dynamic rendering, core since 1.3
+      if (apiVersion_ < VK_API_VERSION_1_3) continue;
+
+      VkPhysicalDeviceMaintenance5FeaturesKHR maintenance5Features = {};
+      maintenance5Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_5_FEATURES_KHR;
+      VkPhysicalDeviceFeatures2 features = {};
+      features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+      features.pNext = &maintenance5Features;
+      vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+      if (!maintenance5Features.maintenance5) continue;
+    }
+
+    if (strcmp(extension, VK_EXT_SHADER_MODULE_IDENTIFIER_EXTENSION_NAME) == 0) {
+      // Needs pipeline creation cache control, core since 1.3
+      if (apiVersion_ < VK_API_VERSION_1_3) continue;
+
+      VkPhysicalDeviceShaderModuleIdentifierFeaturesEXT identifierFeatures = {};
+      identifierFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_MODULE_IDENTIFIER_FEATURES_EXT;
+      VkPhysicalDeviceVulkan13Features vulkan13Features = {};
+      vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+      identifierFeatures.pNext = &vulkan13Features;
+      VkPhysicalDeviceFeatures2 features = {};
+      features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+      features.pNext = &identifierFeatures;
+      vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+      if (!identifierFeatures.shaderModuleIdentifier || !vulkan13Features.pipelineCreationCacheControl) continue;
+    }
+
+    if (strcmp(extension, VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME) == 0) {
+      // Feature query through vkGetPhysicalDeviceFeatures2, core since 1.1
+      if (apiVersion_ < VK_API_VERSION_1_1) continue;
+
+      VkPhysicalDeviceExtendedDynamicStateFeaturesEXT dynamicStateFeatures = {};
+      dynamicStateFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+      VkPhysicalDeviceFeatures2 features = {};
+      features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+      features.pNext = &dynamicStateFeatures;
+      vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+      if (!dynamicStateFeatures.extendedDynamicState) continue;
+    }
+
+    if (strcmp(extension, VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME) == 0) {
+      if (apiVersion_ < VK_API_VERSION_1_1) continue;
+
+      VkPhysicalDeviceExtendedDynamicState2FeaturesEXT dynamicState2Features = {};
+      dynamicState2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_2_FEATURES_EXT;
+      VkPhysicalDeviceFeatures2 features = {};
+      features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+      features.pNext = &dynamicState2Features;
+      vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+      if (!dynamicState2Features.extendedDynamicState2) continue;
+    }
+
+    if (strcmp(extension, VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME) == 0) {
+      if (apiVersion_ < VK_API_VERSION_1_1) continue;
+
+      VkPhysicalDeviceExtendedDynamicState3FeaturesEXT dynamicState3Features = {};
+      dynamicState3Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+      VkPhysicalDeviceFeatures2 features = {};
+      features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+      features.pNext = &dynamicState3Features;
+      vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+      if (!dynamicState3Features.extendedDynamicState3PolygonMode) continue;
+    }
+
+    std::cout << "optional extension: " << extension << std::endl;
+    selected.push_back(extension);
+  }
+  return selected;
+}
+
+bool HexDevice::isExtensionEnabled(const char *extensionName) const {
+  for (const auto &extension : enabledExtensions) {
+    if (extension == extensionName) return true;
+  }
+  return false;
+}
+
 QueueFamilyIndices HexDevice::findQueueFamilies(VkPhysicalDevice device) {
   QueueFamilyIndices indices;
 
@@ -339,8 +604,13 @@ QueueFamilyIndices HexDevice::findQueueFamilies(VkPhysicalDevice device) {
       indices.graphicsFamily = i;
       indices.graphicsFamilyHasValue = true;
     }
+    // Without a surface the graphics queue stands in for the present queue
     VkBool32 presentSupport = false;
-    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+    if (surface_ != VK_NULL_HANDLE) {
+      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+    } else {
+      presentSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+    }
     if (queueFamily.queueCount > 0 && presentSupport) {
       indices.presentFamily = i;
       indices.presentFamilyHasValue = true;
@@ -410,6 +680,18 @@ uint32_t HexDevice::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags pr
   throw std::runtime_error("failed to find suitable memory type!");
 }
 
+bool HexDevice::hasMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+  VkPhysicalDeviceMemoryProperties memProperties;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+  for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+    if ((typeFilter & (1 << i)) &&
+        (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+      return true;
+    }
+  }
+  return false;
+}
+
 void HexDevice::createBuffer(
     VkDeviceSize size,
     VkBufferUsageFlags usage,
@@ -474,11 +756,20 @@ void HexDevice::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
 }
 
 void HexDevice::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+  copyBuffer(srcBuffer, dstBuffer, size, 0, 0);
+}
+
+void HexDevice::copyBuffer(
+    VkBuffer srcBuffer,
+    VkBuffer dstBuffer,
+    VkDeviceSize size,
+    VkDeviceSize srcOffset,
+    VkDeviceSize dstOffset) {
   VkCommandBuffer commandBuffer = beginSingleTimeCommands();
 
   VkBufferCopy copyRegion{};
-  copyRegion.srcOffset = 0;  // Optional
-  copyRegion.dstOffset = 0;  // Optional
+  copyRegion.srcOffset = srcOffset;
+  copyRegion.dstOffset = dstOffset;
   copyRegion.size = size;
   vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
@@ -516,7 +807,8 @@ void HexDevice::createImageWithInfo(
     const VkImageCreateInfo &imageInfo,
     VkMemoryPropertyFlags properties,
     VkImage &image,
-    VkDeviceMemory &imageMemory) {
+    VkDeviceMemory &imageMemory,
+    VkMemoryPropertyFlags preferredProperties) {
   if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS) {
     throw std::runtime_error("failed to create image!");
   }
@@ -527,7 +819,12 @@ void HexDevice::createImageWithInfo(
   VkMemoryAllocateInfo allocInfo{};
   allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
   allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+  VkMemoryPropertyFlags preferred = properties | preferredProperties;
+  if (preferredProperties != 0 && hasMemoryType(memRequirements.memoryTypeBits, preferred)) {
+    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, preferred);
+  } else {
+    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+  }
 
   if (vkAllocateMemory(device_, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
     throw std::runtime_error("failed to allocate image memory!");
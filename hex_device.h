@@ -33,6 +33,8 @@ class HexDevice {
 #endif
 
   HexDevice(HexWindow &window);
+  // Without a window, e.g. for tests: no surface, no swap chains
+  HexDevice();
   ~HexDevice();
 
   // Not copyable or movable
@@ -49,6 +51,7 @@ class HexDevice {
 
   SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(physicalDevice); }
   uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+  bool hasMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
   QueueFamilyIndices findPhysicalQueueFamilies() { return findQueueFamilies(physicalDevice); }
   VkFormat findSupportedFormat(
       const std::vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
@@ -63,17 +66,48 @@ class HexDevice {
   VkCommandBuffer beginSingleTimeCommands();
   void endSingleTimeCommands(VkCommandBuffer commandBuffer);
   void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+  void copyBuffer(
+      VkBuffer srcBuffer,
+      VkBuffer dstBuffer,
+      VkDeviceSize size,
+      VkDeviceSize srcOffset,
+      VkDeviceSize dstOffset);
   void copyBufferToImage(
       VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount);
 
+  // Memory with the preferred properties too when the image can use it
   void createImageWithInfo(
       const VkImageCreateInfo &imageInfo,
       VkMemoryPropertyFlags properties,
       VkImage &image,
-      VkDeviceMemory &imageMemory);
+      VkDeviceMemory &imageMemory,
+      VkMemoryPropertyFlags preferredProperties = 0);
 
   VkPhysicalDeviceProperties properties;
 
+  // Vulkan version used by both the instance and the device
+  uint32_t apiVersion() const { return apiVersion_; }
+  // Core features enabled on the logical device
+  const VkPhysicalDeviceFeatures &enabledFeatures() const { return enabledFeatures_; }
+  // Optional extensions are enabled when the device supports them
+  bool isExtensionEnabled(const char *extensionName) const;
+  bool meshShaderSupported() const { return meshShaderSupported_; }
+  bool fragmentShaderBarycentricSupported() const { return fragmentShaderBarycentricSupported_; }
+  // Pipeline stages can take SPIR-V without a VkShaderModule
+  bool maintenance5Supported() const { return maintenance5Supported_; }
+  // Pipelines can be created from the pipeline cache with shader module identifiers only
+  bool shaderModuleIdentifierSupported() const { return shaderModuleIdentifierSupported_; }
+  // Cull mode, front face, topology and depth state set on the command buffer
+  bool extendedDynamicStateSupported() const { return extendedDynamicStateSupported_; }
+  // Depth bias and primitive restart enables too
+  bool extendedDynamicState2Supported() const { return extendedDynamicState2Supported_; }
+  // Polygon mode too
+  bool extendedDynamicState3PolygonModeSupported() const { return extendedDynamicState3PolygonModeSupported_; }
+  // Rendering begins on image views, no render pass or framebuffer (core 1.3)
+  bool dynamicRenderingSupported() const { return dynamicRenderingSupported_; }
+  // Indirect draws can read their draw count from a buffer (core 1.2)
+  bool drawIndirectCountSupported() const { return drawIndirectCountSupported_; }
+
  private:
   void createInstance();
   void setupDebugMessenger();
@@ -91,20 +125,44 @@ class HexDevice {
   void hasGflwRequiredInstanceExtensions();
   bool checkDeviceExtensionSupport(VkPhysicalDevice device);
   SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
+  std::vector<const char *> selectOptionalExtensions();
 
   VkInstance instance;
   VkDebugUtilsMessengerEXT debugMessenger;
   VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-  HexWindow &window;
+  // Null without a window
+  HexWindow *window;
   VkCommandPool commandPool;
 
   VkDevice device_;
-  VkSurfaceKHR surface_;
+  VkSurfaceKHR surface_ = VK_NULL_HANDLE;
   VkQueue graphicsQueue_;
   VkQueue presentQueue_;
 
+  uint32_t apiVersion_ = VK_API_VERSION_1_0;
+  VkPhysicalDeviceFeatures enabledFeatures_{};
+  std::vector<std::string> enabledExtensions;
+  bool meshShaderSupported_ = false;
+  bool fragmentShaderBarycentricSupported_ = false;
+  bool maintenance5Supported_ = false;
+  bool shaderModuleIdentifierSupported_ = false;
+  bool extendedDynamicStateSupported_ = false;
+  bool extendedDynamicState2Supported_ = false;
+  bool extendedDynamicState3PolygonModeSupported_ = false;
+  bool dynamicRenderingSupported_ = false;
+  bool drawIndirectCountSupported_ = false;
+
   const std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
-  const std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+  // Cleared without a window
+  std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+  const std::vector<const char *> optionalDeviceExtensions = {
+      VK_EXT_MESH_SHADER_EXTENSION_NAME,
+      VK_KHR_FRAGMENT_SHADER_BARYCENTRIC_EXTENSION_NAME,
+      VK_KHR_MAINTENANCE_5_EXTENSION_NAME,
+      VK_EXT_SHADER_MODULE_IDENTIFIER_EXTENSION_NAME,
+      VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME,
+      VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME,
+      VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME};
 };
 
 }  // namespace lve
\ No newline at end of file
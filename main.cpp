@@ -3,10 +3,14 @@
 #include <iostream>
 #include <stdexcept>
 #include <cstdlib>
+#include <string>
+#include <vector>
 
-int main() {
+int main(int argc, char **argv) {
 
-    hex::HexApp app{};
+    std::vector<std::string> modelFiles(argv + 1, argv + argc);
+
+    hex::HexApp app{modelFiles};
     try {
         app.run();
     } catch (const std::exception &e) {
@@ -0,0 +1,13 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "cell_faces_common.glsl"
+
+// cell_field.frag with the cell coming from the vertex shader instead of gl_PrimitiveID.
+// Barycentrics are interpolated from the vertex shader, see cell_faces_barycentric.frag.
+
+layout (location = 1) noperspective in vec3 barycentric;
+
+void main() {
+	shadeCellFace(barycentric);
+}
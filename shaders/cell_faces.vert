@@ -0,0 +1,58 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "hex_cell.glsl"
+
+// Vertex pulling, no vertex input: every 6 vertices are the two triangles of one face of
+// the face list, positions are fetched from the volume points through the cell corners
+
+layout (location = 0) flat out uint outCell;
+// Only read by cell_faces.frag, devices with fragment shader barycentrics skip it
+layout (location = 1) noperspective out vec3 outBarycentric;
+
+// HexVolumeModel buffers
+layout (std430, set = 0, binding = 0) readonly buffer Points {
+	float points[];
+};
+
+layout (std430, set = 0, binding = 1) readonly buffer Cells {
+	uint cells[];
+};
+
+// cell * 6 + face, compacted by the cell filter passes
+layout (std430, set = 0, binding = 2) readonly buffer Faces {
+	uint faces[];
+};
+
+layout (push_constant) uniform Push {
+	mat4 transform;
+	float rangeMin;
+	float rangeScale;
+	float shrink;
+	float wireWidth;
+} push;
+
+vec3 point(uint index) {
+	return vec3(points[index * 3u], points[index * 3u + 1u], points[index * 3u + 2u]);
+}
+
+void main() {
+	uint face = faces[gl_VertexIndex / 6];
+	uint cell = face / 6u;
+	uint first = cell * 8u;
+	uint corner = FACE_CORNERS[(face % 6u) * 4u + TRIANGLE_CORNERS[gl_VertexIndex % 6]];
+
+	vec3 position = point(cells[first + corner]);
+	if (push.shrink < 1.0) {
+		vec3 center = vec3(0.0);
+		for (uint i = 0u; i < 8u; i++) {
+			center += point(cells[first + i]);
+		}
+		position = mix(center * 0.125, position, push.shrink);
+	}
+
+	outCell = cell;
+	outBarycentric = vec3(0.0);
+	outBarycentric[gl_VertexIndex % 3] = 1.0;
+	gl_Position = push.transform * vec4(position, 1.0);
+}
@@ -0,0 +1,11 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_fragment_shader_barycentric : require
+
+#include "cell_faces_common.glsl"
+
+// cell_faces.frag with the barycentrics of VK_KHR_fragment_shader_barycentric
+
+void main() {
+	shadeCellFace(gl_BaryCoordNoPerspEXT);
+}
@@ -0,0 +1,43 @@
+// Shared by the cell face fragment shaders, which only differ in where barycentrics come from
+
+layout (location = 0) flat in uint cell;
+
+layout (location = 0) out vec4 outColor;
+
+layout (std430, set = 0, binding = 3) readonly buffer CellValues {
+	float cellValues[];
+};
+
+layout (set = 0, binding = 4) uniform sampler1D colormap;
+
+layout (push_constant) uniform Push {
+	mat4 transform;
+	float rangeMin;
+	float rangeScale;
+	float shrink;
+	// Edge line width in pixels, 0 without wireframe
+	float wireWidth;
+} push;
+
+// HexColormap::SIZE
+const float COLORMAP_SIZE = 256.0;
+
+const vec3 WIRE_COLOR = vec3(0.05);
+
+// Both triangles of a face have the quad diagonal opposite their second vertex
+// (see TRIANGLE_CORNERS), so barycentric y is never an edge
+void shadeCellFace(vec3 barycentric) {
+	float t = clamp((cellValues[cell] - push.rangeMin) * push.rangeScale, 0.0, 1.0);
+	// Sample texel centers so the range ends get the end colors
+	t = (t * (COLORMAP_SIZE - 1.0) + 0.5) / COLORMAP_SIZE;
+	vec3 color = texture(colormap, t).rgb;
+
+	if (push.wireWidth > 0.0) {
+		// Distance to the edges in pixels from the screen space derivatives, constant width
+		vec2 pixels = barycentric.xz / max(fwidth(barycentric.xz), vec2(1e-6));
+		float edge = min(pixels.x, pixels.y);
+		color = mix(WIRE_COLOR, color, smoothstep(push.wireWidth - 0.5, push.wireWidth + 0.5, edge));
+	}
+
+	outColor = vec4(color, 1.0);
+}
@@ -0,0 +1,31 @@
+#version 450
+
+layout (location = 0) out vec4 outColor;
+
+// Source cell of each triangle, in index buffer order
+layout (std430, set = 0, binding = 0) readonly buffer TriangleCells {
+	uint triangleCells[];
+};
+
+layout (std430, set = 0, binding = 1) readonly buffer CellValues {
+	float cellValues[];
+};
+
+layout (set = 0, binding = 2) uniform sampler1D colormap;
+
+layout (push_constant) uniform Push {
+	mat4 transform;
+	float rangeMin;
+	float rangeScale;
+} push;
+
+// HexColormap::SIZE
+const float COLORMAP_SIZE = 256.0;
+
+void main() {
+	float value = cellValues[triangleCells[gl_PrimitiveID]];
+	float t = clamp((value - push.rangeMin) * push.rangeScale, 0.0, 1.0);
+	// Sample texel centers so the range ends get the end colors
+	t = (t * (COLORMAP_SIZE - 1.0) + 0.5) / COLORMAP_SIZE;
+	outColor = vec4(texture(colormap, t).rgb, 1.0);
+}
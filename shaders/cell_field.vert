@@ -0,0 +1,13 @@
+#version 450
+
+layout (location = 0) in vec3 position;
+
+layout (push_constant) uniform Push {
+	mat4 transform;
+	float rangeMin;
+	float rangeScale;
+} push;
+
+void main() {
+	gl_Position = push.transform * vec4(position, 1.0);
+}
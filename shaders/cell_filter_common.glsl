@@ -0,0 +1,102 @@
+// Shared by the cell filter passes: cell visibility, exposed face counts, scan and compaction
+
+#include "hex_cell.glsl"
+
+#define CELL_GROUP_SIZE 256
+
+// HexVolumeModel buffers
+layout (std430, set = 0, binding = 0) readonly buffer Points {
+	float points[];
+};
+
+layout (std430, set = 0, binding = 1) readonly buffer Cells {
+	uint cells[];
+};
+
+layout (std430, set = 0, binding = 2) readonly buffer FaceNeighbors {
+	uint faceNeighbors[];
+};
+
+layout (std430, set = 0, binding = 3) readonly buffer Labels {
+	int labels[];
+};
+
+layout (std430, set = 0, binding = 4) readonly buffer CellValues {
+	float cellValues[];
+};
+
+// 1 for shown cells
+layout (std430, set = 0, binding = 5) buffer Visible {
+	uint visible[];
+};
+
+// Exposed faces of each cell workgroup, then the first face slot of each workgroup
+layout (std430, set = 0, binding = 6) buffer Groups {
+	uint groups[];
+};
+
+// VkDrawIndirectCommand
+struct DrawCommand {
+	uint vertexCount;
+	uint instanceCount;
+	uint firstVertex;
+	uint firstInstance;
+};
+
+layout (std430, set = 0, binding = 7) writeonly buffer Draw {
+	DrawCommand draw;
+};
+
+// Exposed faces, cell * 6 + face, expanded to triangles by cell_faces.vert
+layout (std430, set = 0, binding = 8) writeonly buffer Faces {
+	uint faces[];
+};
+
+// Exposed face count, one slot per frame in flight, read by the CPU
+layout (std430, set = 0, binding = 9) writeonly buffer Readback {
+	uint readback[];
+};
+
+layout (push_constant) uniform Push {
+	vec4 planes[4];
+	uint planeCount;
+	uint filterValues;
+	float valueMin;
+	float valueMax;
+	uint filterLabels;
+	int labelMin;
+	int labelMax;
+	uint cellCount;
+	uint groupCount;
+	uint groupsX;
+	uint faceCapacity;
+	uint readbackSlot;
+	uint allFaces;
+} push;
+
+const uint NO_NEIGHBOR = 0xffffffffu;
+
+// Cell workgroups are dispatched on two dimensions past 65535 groups
+uint cellGroup() {
+	return gl_WorkGroupID.y * push.groupsX + gl_WorkGroupID.x;
+}
+
+// Faces of a shown cell against a hidden cell or the outside, one bit per face.
+// Every face of shrunk cells.
+uint exposedFaces(uint cell) {
+	if (visible[cell] == 0u) {
+		return 0u;
+	}
+	if (push.allFaces != 0u) {
+		return 0x3fu;
+	}
+
+	uint faces = 0u;
+	for (uint face = 0u; face < 6u; face++) {
+		uint neighbor = faceNeighbors[cell * 6u + face];
+		if (neighbor == NO_NEIGHBOR || visible[neighbor] == 0u) {
+			faces |= 1u << face;
+		}
+	}
+	return faces;
+}
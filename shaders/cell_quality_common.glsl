@@ -0,0 +1,52 @@
+// Shared by the cell quality passes
+
+#define QUALITY_GROUP_SIZE 256
+// CellQualitySystem::MAX_BIN_COUNT
+#define MAX_BIN_COUNT 256
+
+// HexVolumeModel buffers, cells have a positive orientation
+layout (std430, set = 0, binding = 0) readonly buffer Points {
+	float points[];
+};
+
+layout (std430, set = 0, binding = 1) readonly buffer Cells {
+	uint cells[];
+};
+
+// HexCellField values
+layout (std430, set = 0, binding = 2) buffer CellValues {
+	float cellValues[];
+};
+
+// HexQuality::DEGENERATE, cells without a defined metric are only counted
+const float DEGENERATE_VALUE = 3.402823466e+38;
+
+// Host visible. Min and max as order preserving keys, the degenerate count, then the histogram.
+layout (std430, set = 0, binding = 3) buffer Stats {
+	uint minKey;
+	uint maxKey;
+	uint degenerateCount;
+	uint bins[MAX_BIN_COUNT];
+};
+
+layout (push_constant) uniform Push {
+	uint metric;
+	uint cellCount;
+	uint groupsX;
+	uint binCount;
+} push;
+
+// Workgroups are dispatched on two dimensions past 65535 groups
+uint cellIndex() {
+	return (gl_WorkGroupID.y * push.groupsX + gl_WorkGroupID.x) * QUALITY_GROUP_SIZE + gl_LocalInvocationID.x;
+}
+
+// Floats compare like these unsigned keys
+uint orderedKey(float value) {
+	uint bits = floatBitsToUint(value);
+	return (bits & 0x80000000u) != 0u ? ~bits : bits | 0x80000000u;
+}
+
+float orderedValue(uint key) {
+	return uintBitsToFloat((key & 0x80000000u) != 0u ? key & 0x7fffffffu : ~key);
+}
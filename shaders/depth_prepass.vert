@@ -0,0 +1,16 @@
+#version 450
+
+// Depth prepass, only the position stream of the arena is bound (HexGeometryArena::bindPositions).
+// Transformed like simple_shader.vert, both invariant so the main pass depths equal these.
+layout (location = 0) in vec3 position;
+
+invariant gl_Position;
+
+layout (push_constant) uniform Push {
+	mat4 transform;
+	vec3 color;
+} push;
+
+void main() {
+	gl_Position = push.transform * vec4(position, 1.0);
+}
@@ -0,0 +1,15 @@
+// Hexahedron corner tables shared by the volume shaders
+
+// HexVolumeMesh::FACE_CORNERS, cells are uploaded with a positive orientation
+const uint FACE_CORNERS[24] = uint[24](
+	0u, 3u, 2u, 1u,
+	4u, 5u, 6u, 7u,
+	0u, 1u, 5u, 4u,
+	1u, 2u, 6u, 5u,
+	2u, 3u, 7u, 6u,
+	3u, 0u, 4u, 7u
+);
+
+// Face corners of the two triangles of a face, split like HexVolumeMesh::buildBoundaryModel:
+// (a, b, c) and (c, d, a)
+const uint TRIANGLE_CORNERS[6] = uint[6](0u, 1u, 2u, 2u, 3u, 0u);
@@ -0,0 +1,79 @@
+// Shared by the meshlet culling shaders
+
+// Same layout as HexMeshlet
+struct Meshlet {
+	vec4 sphere; // center, radius
+	vec4 cone; // axis, cutoff
+	uint vertexOffset;
+	uint vertexCount;
+	uint triangleOffset;
+	uint triangleCount;
+};
+
+// VkDrawIndexedIndirectCommand, written per meshlet on the indirect path
+struct DrawCommand {
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+
+// Flags of the culling passes (MeshletRendererSystem.cpp)
+// Normal cones, only valid under uniform scaling
+#define CULL_CONES 1u
+// First phase of occlusion culling, only the meshlets visible last frame are drawn
+#define CULL_OCCLUSION 2u
+// Visible meshlets append their command and the count, drawn with vkCmdDrawIndexedIndirectCount.
+// Otherwise every meshlet has its command, hidden ones without an instance.
+#define CULL_COMPACT 4u
+
+DrawCommand meshletDraw(Meshlet meshlet, uint firstIndex, int vertexOffset) {
+	DrawCommand draw;
+	draw.indexCount = meshlet.triangleCount * 3u;
+	draw.instanceCount = 1u;
+	draw.firstIndex = firstIndex + meshlet.triangleOffset * 3u;
+	draw.vertexOffset = vertexOffset;
+	draw.firstInstance = 0u;
+	return draw;
+}
+
+#define MESHLETS_PER_TASK 32
+
+// Meshlets a task workgroup hands to its mesh workgroups
+struct MeshletTask {
+	uint meshletIndices[MESHLETS_PER_TASK];
+};
+
+// clip maps model space to clip space, so the extracted planes are in model space
+bool sphereInFrustum(mat4 clip, vec4 sphere) {
+	mat4 rows = transpose(clip);
+	// left, right, top, bottom, near (depth 0 to 1), far
+	vec4 planes[6] = vec4[6](
+		rows[3] + rows[0],
+		rows[3] - rows[0],
+		rows[3] + rows[1],
+		rows[3] - rows[1],
+		rows[2],
+		rows[3] - rows[2]
+	);
+	for (int i = 0; i < 6; i++) {
+		if (dot(planes[i].xyz, sphere.xyz) + planes[i].w < -sphere.w * length(planes[i].xyz)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Every triangle of the meshlet faces away from eye (model space)
+bool coneBackFacing(vec4 sphere, vec4 cone, vec3 eye) {
+	vec3 toCenter = sphere.xyz - eye;
+	return dot(toCenter, cone.xyz) >= cone.w * length(toCenter) + sphere.w;
+}
+
+bool meshletVisible(Meshlet meshlet, mat4 clip, vec3 eye, bool coneCulling) {
+	if (coneCulling && coneBackFacing(meshlet.sphere, meshlet.cone, eye)) {
+		return false;
+	}
+	return sphereInFrustum(clip, meshlet.sphere);
+}
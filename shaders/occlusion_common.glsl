@@ -0,0 +1,51 @@
+// Shared by the occlusion culling shaders, tests against the farthest depth mip chain of the
+// scene (HexDepthPyramid)
+
+// Same layout as HexObjectOcclusion::Object
+struct OcclusionObject {
+	mat4 clip;
+	vec3 boundsMin;
+	uint indexCount;
+	vec3 boundsMax;
+	uint firstIndex;
+	int vertexOffset;
+};
+
+// Model space box entirely behind the pyramid, clip maps model space to clip space and
+// depthSize is the size of the depth buffer the pyramid was built from. Boxes crossing the near
+// plane or off screen never are.
+bool boxOccluded(sampler2D depthPyramid, mat4 clip, vec3 boxMin, vec3 boxMax, uvec2 depthSize, uint levelCount) {
+	vec2 uvMin = vec2(1.0);
+	vec2 uvMax = vec2(0.0);
+	float nearest = 1.0;
+	for (int i = 0; i < 8; i++) {
+		vec3 corner = mix(boxMin, boxMax, vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1));
+		vec4 position = clip * vec4(corner, 1.0);
+		if (position.w <= 0.0) {
+			return false;
+		}
+		vec3 ndc = position.xyz / position.w;
+		uvMin = min(uvMin, ndc.xy * 0.5 + 0.5);
+		uvMax = max(uvMax, ndc.xy * 0.5 + 0.5);
+		nearest = min(nearest, ndc.z);
+	}
+	if (nearest < 0.0 || any(lessThan(uvMax, vec2(0.0))) || any(greaterThan(uvMin, vec2(1.0)))) {
+		return false;
+	}
+
+	// Depth buffer pixels under the box, then the level where they span at most 2 texels
+	vec2 lastPixel = vec2(depthSize - 1u);
+	uvec2 pixelMin = uvec2(clamp(uvMin * vec2(depthSize), vec2(0.0), lastPixel));
+	uvec2 pixelMax = uvec2(clamp(uvMax * vec2(depthSize), vec2(0.0), lastPixel));
+	uint span = max(pixelMax.x - pixelMin.x, pixelMax.y - pixelMin.y);
+	int level = min(span > 0u ? findMSB(span) : 0, int(levelCount) - 1);
+
+	ivec2 lastTexel = textureSize(depthPyramid, level) - 1;
+	ivec2 texelMin = min(ivec2(pixelMin >> uint(level + 1)), lastTexel);
+	ivec2 texelMax = min(ivec2(pixelMax >> uint(level + 1)), lastTexel);
+	float farthest = max(
+		max(texelFetch(depthPyramid, texelMin, level).r, texelFetch(depthPyramid, ivec2(texelMax.x, texelMin.y), level).r),
+		max(texelFetch(depthPyramid, ivec2(texelMin.x, texelMax.y), level).r, texelFetch(depthPyramid, texelMax, level).r)
+	);
+	return nearest > farthest;
+}
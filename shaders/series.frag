@@ -0,0 +1,37 @@
+#version 450
+
+layout (location = 0) in vec3 fragPosition;
+layout (location = 1) in float fragScalar;
+
+layout (location = 0) out vec4 outColor;
+
+layout (set = 0, binding = 0) uniform sampler1D colormap;
+
+layout (push_constant) uniform Push {
+	mat4 transform;
+	float rangeMin;
+	float rangeScale;
+} push;
+
+// Off shades with a constant color
+layout (constant_id = 0) const bool USE_SCALARS = true;
+
+// HexColormap::SIZE
+const float COLORMAP_SIZE = 256.0;
+const vec3 LIGHT_DIRECTION = normalize(vec3(1.0, -3.0, -1.0));
+const float AMBIENT = 0.3;
+
+void main() {
+	vec3 color = vec3(0.8);
+	if (USE_SCALARS) {
+		float t = clamp((fragScalar - push.rangeMin) * push.rangeScale, 0.0, 1.0);
+		// Sample texel centers so the range ends get the end colors
+		t = (t * (COLORMAP_SIZE - 1.0) + 0.5) / COLORMAP_SIZE;
+		color = texture(colormap, t).rgb;
+	}
+
+	// Streams carry no normals, the face normal comes from the position derivatives
+	vec3 normal = normalize(cross(dFdx(fragPosition), dFdy(fragPosition)));
+	float diffuse = abs(dot(normal, LIGHT_DIRECTION));
+	outColor = vec4(color * (AMBIENT + (1.0 - AMBIENT) * diffuse), 1.0);
+}
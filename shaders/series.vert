@@ -0,0 +1,21 @@
+#version 450
+
+layout (location = 0) in vec3 position;
+// Vertex scalar, 0 when the series has none
+layout (location = 1) in float scalar;
+
+layout (location = 0) out vec3 fragPosition;
+layout (location = 1) out float fragScalar;
+
+layout (push_constant) uniform Push {
+	mat4 transform;
+	float rangeMin;
+	// 1 / (max - min), 0 for a constant field
+	float rangeScale;
+} push;
+
+void main() {
+	gl_Position = push.transform * vec4(position, 1.0);
+	fragPosition = position;
+	fragScalar = scalar;
+}
@@ -5,6 +5,9 @@ layout (location = 1) in vec3 color;
 
 layout (location = 0) out vec3 fragColor;
 
+// Depths must match the depth prepass exactly (depth_prepass.vert)
+invariant gl_Position;
+
 layout (push_constant) uniform Push {
 	mat4 transform;
 	vec3 color;
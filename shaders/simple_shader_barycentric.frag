@@ -0,0 +1,32 @@
+#version 450
+#extension GL_EXT_fragment_shader_barycentric : require
+
+// simple_shader.frag with the triangle edges drawn over the shading, from the barycentrics of
+// VK_KHR_fragment_shader_barycentric. Surface meshes keep no quads, every edge is drawn.
+
+layout (location = 0) out vec4 outColor;
+layout (location = 0) in vec3 fragColor;
+
+layout (push_constant) uniform Push {
+	mat4 transform;
+	vec3 color;
+	// Edge line width in pixels, 0 without wireframe
+	float wireWidth;
+} push;
+
+// Same as the cell faces (cell_faces_common.glsl)
+const vec3 WIRE_COLOR = vec3(0.05);
+
+void main() {
+	vec3 color = fragColor;
+
+	if (push.wireWidth > 0.0) {
+		// Distance to the edges in pixels from the screen space derivatives, constant width
+		vec3 barycentric = gl_BaryCoordNoPerspEXT;
+		vec3 pixels = barycentric / max(fwidth(barycentric), vec3(1e-6));
+		float edge = min(pixels.x, min(pixels.y, pixels.z));
+		color = mix(WIRE_COLOR, color, smoothstep(push.wireWidth - 0.5, push.wireWidth + 0.5, edge));
+	}
+
+	outColor = vec4(color, 1.0);
+}
@@ -0,0 +1,118 @@
+// OBJ and PLY index handling: relative OBJ indices, and indices or counts that don't fit their
+// range being rejected instead of wrapping into it. CPU only, the files are written to the
+// temporary directory.
+
+#include "HexMeshLoader.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace hex;
+
+namespace {
+
+	int failures = 0;
+
+	void check(bool condition, const char *what) {
+		if (condition) return;
+		std::cerr << "FAILED: " << what << std::endl;
+		failures++;
+	}
+
+	std::string writeFile(const std::string &name, const std::string &contents) {
+		std::string path = (std::filesystem::temp_directory_path() / ("HexMeshLoaderTest_" + name)).string();
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file << contents;
+		return path;
+	}
+
+	bool loads(const std::string &name, const std::string &contents, HexModel::Builder &builder) {
+		std::string path = writeFile(name, contents);
+		bool loaded = true;
+		try {
+			builder = HexMeshLoader::loadFile(path);
+		} catch (const std::exception &e) {
+			std::cout << "Rejected " << name << ": " << e.what() << std::endl;
+			loaded = false;
+		}
+		std::remove(path.c_str());
+		return loaded;
+	}
+
+	bool loads(const std::string &name, const std::string &contents) {
+		HexModel::Builder builder;
+		return loads(name, contents, builder);
+	}
+
+	const std::string square = "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n";
+
+	void testObj() {
+		HexModel::Builder builder;
+		check(loads("relative.obj", square + "f -4 -3 -2 -1\n", builder), "relative indices load");
+		check(builder.indices == std::vector<uint32_t>({0, 1, 2, 0, 2, 3}), "relative indices count back from the last vertex");
+
+		check(loads("mixed.obj", square + "f 1 -3 -2\nv 2 2 0\nf -1 -2 3\n", builder), "relative and absolute indices mix");
+		check(builder.indices == std::vector<uint32_t>({0, 1, 2, 4, 3, 2}), "relative indices count from the vertices read so far");
+
+		check(!loads("relative_before_first.obj", square + "f -5 -1 -2\n"), "relative indices before the first vertex are rejected");
+		check(!loads("relative_overflow.obj", square + "f -99999999999999999999999 -1 -2\n"), "relative indices too long for 64 bits are rejected");
+		check(!loads("absolute_past_end.obj", square + "f 1 2 5\n"), "absolute indices past the last vertex are rejected");
+		// 2^32 + 1 would wrap to the first vertex if narrowed before the check
+		check(!loads("absolute_wrap.obj", square + "f 4294967297 2 3\n"), "absolute indices past 32 bits are rejected");
+		check(!loads("absolute_overflow.obj", square + "f 99999999999999999999999 2 3\n"), "absolute indices too long for 64 bits are rejected");
+	}
+
+	std::string plyHeader(const std::string &format, const std::string &vertexCount, const std::string &faceCount) {
+		return "ply\nformat " + format + " 1.0\nelement vertex " + vertexCount + "\nproperty float x\nproperty float y\nproperty float z\n"
+			"element face " + faceCount + "\nproperty list uchar int vertex_indices\nend_header\n";
+	}
+
+	void testPly() {
+		const std::string points = "0 0 0\n1 0 0\n1 1 0\n";
+
+		HexModel::Builder builder;
+		check(loads("valid.ply", plyHeader("ascii", "3", "1") + points + "3 0 1 2\n", builder), "ascii PLY loads");
+		check(builder.indices == std::vector<uint32_t>({0, 1, 2}), "ascii PLY indices are kept");
+
+		check(!loads("negative.ply", plyHeader("ascii", "3", "1") + points + "3 0 -1 2\n"), "negative PLY indices are rejected");
+		check(!loads("wrap.ply", plyHeader("ascii", "3", "1") + points + "3 0 4294967296 2\n"), "PLY indices past 32 bits are rejected");
+		check(!loads("bad_count.ply", plyHeader("ascii", "3x", "1") + points + "3 0 1 2\n"), "invalid element counts are rejected");
+
+		std::string binary = plyHeader("binary_little_endian", "3", "1");
+		float coordinates[9] = {0, 0, 0, 1, 0, 0, 1, 1, 0};
+		binary.append(reinterpret_cast<const char*>(coordinates), sizeof(coordinates));
+		binary += '\3';
+		int32_t indices[3] = {0, 1, 2};
+		binary.append(reinterpret_cast<const char*>(indices), sizeof(indices));
+		check(loads("valid_binary.ply", binary, builder), "binary PLY loads");
+		check(builder.indices == std::vector<uint32_t>({0, 1, 2}), "binary PLY indices are kept");
+
+		// Counts whose size in bytes overflows must not pass the bounds checks
+		std::string body = binary.substr(plyHeader("binary_little_endian", "3", "1").size());
+		check(!loads("huge_vertex_count.ply", plyHeader("binary_little_endian", "1537228672809129302", "1") + body),
+			"binary vertex counts past the end of the file are rejected");
+		// 13 byte faces, the count times 13 wraps to 10 bytes
+		check(!loads("huge_face_count.ply", plyHeader("binary_little_endian", "3", "1418980313362273202") + body),
+			"binary face counts past the end of the file are rejected");
+	}
+}
+
+int main() {
+	try {
+		testObj();
+		testPly();
+	} catch (const std::exception &e) {
+		std::cerr << "FAILED: " << e.what() << std::endl;
+		failures++;
+	}
+
+	if (failures != 0) return 1;
+	std::cout << "Mesh loader tests passed" << std::endl;
+	return 0;
+}
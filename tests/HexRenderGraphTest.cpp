@@ -0,0 +1,127 @@
+// Render graph compilation on a device without a window: pass culling, barriers between passes,
+// transient aliasing and recreating the transients on a new extent. Any Vulkan device with dynamic
+// rendering will do (lavapipe too), skipped without one.
+
+#include "HexRenderGraph.h"
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <memory>
+
+using namespace hex;
+
+namespace {
+
+	// ctest's SKIP_RETURN_CODE
+	constexpr int SKIPPED = 77;
+
+	int failures = 0;
+
+	void check(bool condition, const char *what) {
+		if (condition) return;
+		std::cerr << "FAILED: " << what << std::endl;
+		failures++;
+	}
+
+	const HexRenderGraph::Barrier *findBarrier(const HexRenderGraph::Barriers &barriers, HexRenderGraph::ResourceId resource) {
+		auto it = std::find_if(barriers.barriers.begin(), barriers.barriers.end(),
+			[&](const HexRenderGraph::Barrier &barrier) { return barrier.resource == resource; });
+		return it != barriers.barriers.end() ? &*it : nullptr;
+	}
+
+	void testGraph(HexDevice &device) {
+		using Access = HexRenderGraph::Access;
+		const VkFormat hdrFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+		HexRenderGraph graph{device, 2};
+		graph.setExtent({320, 240});
+		auto swapChain = graph.importImage("swap chain", VK_FORMAT_B8G8R8A8_UNORM,
+			{VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0},
+			{VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0});
+		auto albedo = graph.createImage("albedo", hdrFormat);
+		auto lit = graph.createImage("lit", hdrFormat);
+		auto blurred = graph.createImage("blurred", hdrFormat);
+		auto debug = graph.createImage("debug", hdrFormat);
+
+		// albedo lives in gbuffer and lighting, blurred in blur and tonemap: they share memory.
+		// lit lives from lighting to tonemap and overlaps both.
+		graph.addPass("upload", nullptr).sideEffect();
+		graph.addPass("gbuffer", nullptr).colorAttachment(albedo, VK_ATTACHMENT_LOAD_OP_CLEAR);
+		graph.addPass("lighting", nullptr)
+			.read(albedo, Access::FragmentSampled)
+			.colorAttachment(lit, VK_ATTACHMENT_LOAD_OP_CLEAR);
+		// Nothing reads it
+		graph.addPass("debug", nullptr).colorAttachment(debug, VK_ATTACHMENT_LOAD_OP_CLEAR);
+		graph.addPass("blur", nullptr)
+			.read(lit, Access::FragmentSampled)
+			.colorAttachment(blurred, VK_ATTACHMENT_LOAD_OP_CLEAR);
+		graph.addPass("tonemap", nullptr)
+			.read(lit, Access::FragmentSampled)
+			.read(blurred, Access::FragmentSampled)
+			.colorAttachment(swapChain, VK_ATTACHMENT_LOAD_OP_DONT_CARE);
+		graph.compile();
+
+		check(!graph.isCulled("upload"), "side effect passes are kept");
+		check(graph.isCulled("debug"), "passes nothing reads are culled");
+		check(!graph.isCulled("gbuffer") && !graph.isCulled("lighting") && !graph.isCulled("blur") && !graph.isCulled("tonemap"),
+			"passes the swap chain depends on are kept");
+		check(graph.getImage(debug, 0) == VK_NULL_HANDLE, "images of culled passes aren't created");
+
+		auto checkBarriers = [&]() {
+			const HexRenderGraph::Barriers &lighting = graph.getBarriers("lighting");
+			const HexRenderGraph::Barrier *sampled = findBarrier(lighting, albedo);
+			check(sampled != nullptr, "sampling an attachment waits for it");
+			if (sampled != nullptr) {
+				check(sampled->oldLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL && sampled->newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					"sampled attachments are transitioned to shader reads");
+				check(sampled->srcAccess == VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT && sampled->dstAccess == VK_ACCESS_SHADER_READ_BIT,
+					"attachment writes are made visible to shader reads");
+			}
+			check((lighting.srcStages & VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT) != 0 && (lighting.dstStages & VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT) != 0,
+				"color output is waited for at fragment shading");
+			check(lighting.barriers.size() == 2, "one barrier per resource and pass");
+
+			// lit is already visible to fragment shader reads since blur
+			check(findBarrier(graph.getBarriers("tonemap"), lit) == nullptr, "reads after reads don't wait again");
+
+			const HexRenderGraph::Barriers &blur = graph.getBarriers("blur");
+			const HexRenderGraph::Barrier *alias = findBarrier(blur, blurred);
+			check(alias != nullptr && alias->oldLayout == VK_IMAGE_LAYOUT_UNDEFINED, "aliases start undefined");
+			check((blur.srcStages & VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT) != 0, "aliases wait for the last reads of the image before them");
+
+			check(graph.sharesMemory(albedo, blurred), "images with disjoint lifetimes share memory");
+			check(!graph.sharesMemory(albedo, lit) && !graph.sharesMemory(lit, blurred), "images with overlapping lifetimes don't");
+		};
+		checkBarriers();
+
+		graph.setExtent({640, 480});
+		check(graph.getImage(albedo, 0) != VK_NULL_HANDLE, "a new extent recreates the transients");
+		checkBarriers();
+	}
+}
+
+int main() {
+	std::unique_ptr<HexDevice> device;
+	try {
+		device = std::make_unique<HexDevice>();
+	} catch (const std::exception &e) {
+		std::cerr << "Skipped, no device: " << e.what() << std::endl;
+		return SKIPPED;
+	}
+	if (!device->dynamicRenderingSupported()) {
+		std::cerr << "Skipped, the device has no dynamic rendering" << std::endl;
+		return SKIPPED;
+	}
+
+	try {
+		testGraph(*device);
+	} catch (const std::exception &e) {
+		std::cerr << "FAILED: " << e.what() << std::endl;
+		failures++;
+	}
+
+	if (failures != 0) return 1;
+	std::cout << "Render graph tests passed" << std::endl;
+	return 0;
+}